@@ -65,7 +65,8 @@ public:
 
     void authenticate(const std::string& user_name)
     {
-        detail::agent_state::scoped_lock lock = m_agent->aquire_lock();
+        detail::agent_state::scoped_lock lock =
+            m_agent->aquire_lock("agent_userauth");
 
         detail::libssh2::agent::userauth(m_agent->agent_ptr(),
                                          m_agent->session_ptr(),
@@ -125,7 +126,8 @@ private:
             BOOST_THROW_EXCEPTION(std::logic_error(
                 "Can't increment past the end of a collection"));
 
-        detail::agent_state::scoped_lock lock = m_agent->aquire_lock();
+        detail::agent_state::scoped_lock lock =
+            m_agent->aquire_lock("agent_get_identity");
 
         bool no_more_identities =
             detail::libssh2::agent::get_identity(m_agent->agent_ptr(),
@@ -180,7 +182,8 @@ public:
         // If we called this when creating the iterator it would wipe out all
         // other iterators.
 
-        detail::agent_state::scoped_lock lock = m_agent->aquire_lock();
+        detail::agent_state::scoped_lock lock =
+            m_agent->aquire_lock("agent_list_identities");
 
         ::ssh::detail::libssh2::agent::list_identities(m_agent->agent_ptr(),
                                                        m_agent->session_ptr());
@@ -51,7 +51,7 @@ namespace detail
 
 inline LIBSSH2_AGENT* do_agent_init(session_state& session)
 {
-    detail::session_state::scoped_lock lock = session.aquire_lock();
+    detail::session_state::scoped_lock lock = session.aquire_lock("agent_init");
 
     return detail::libssh2::agent::init(session.session_ptr());
 }
@@ -83,7 +83,8 @@ public:
     agent_state(session_state& session)
         : m_session(session), m_agent(do_agent_init(session_ref()))
     {
-        detail::session_state::scoped_lock lock = session_ref().aquire_lock();
+        detail::session_state::scoped_lock lock =
+            session_ref().aquire_lock("agent_connect");
 
         try
         {
@@ -100,15 +101,16 @@ public:
 
     ~agent_state() throw()
     {
-        session_state::scoped_lock lock = session_ref().aquire_lock();
+        session_state::scoped_lock lock =
+            session_ref().aquire_lock("agent_disconnect");
 
         ::libssh2_agent_disconnect(m_agent);
         ::libssh2_agent_free(m_agent);
     }
 
-    scoped_lock aquire_lock()
+    scoped_lock aquire_lock(const char* operation)
     {
-        return session_ref().aquire_lock();
+        return session_ref().aquire_lock(operation);
     }
 
     LIBSSH2_SESSION* session_ptr()
@@ -0,0 +1,470 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * RAII lifetime management of libssh2 channels running a remote command or
+ * subsystem.
+ */
+
+#ifndef SSH_DETAIL_EXEC_CHANNEL_STATE_HPP
+#define SSH_DETAIL_EXEC_CHANNEL_STATE_HPP
+
+#include <ssh/detail/libssh2/channel.hpp>
+#include <ssh/detail/session_state.hpp>
+#include <ssh/ssh_error.hpp> // SSH_DETAIL_THROW_API_ERROR_CODE
+#include <ssh/trace.hpp>     // traced_call
+
+#include <boost/chrono/duration.hpp>      // seconds
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/noncopyable.hpp>
+#include <boost/optional/optional.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/thread.hpp> // this_thread::yield, interruption_point
+
+#include <cstddef> // size_t
+#include <string>
+
+#include <libssh2.h> // LIBSSH2_CHANNEL, libssh2_session_*
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * Puts a session into non-blocking mode for the lifetime of this object.
+ *
+ * Must only be created while holding the session lock, and destroyed before
+ * releasing it, so that no other thread ever sees the session non-blocking.
+ */
+class non_blocking_session : private boost::noncopyable
+{
+public:
+    explicit non_blocking_session(LIBSSH2_SESSION* session)
+        : m_session(session),
+          m_was_blocking(::libssh2_session_get_blocking(session) != 0)
+    {
+        ::libssh2_session_set_blocking(m_session, 0);
+    }
+
+    ~non_blocking_session() throw()
+    {
+        ::libssh2_session_set_blocking(m_session, m_was_blocking ? 1 : 0);
+    }
+
+private:
+    LIBSSH2_SESSION* m_session;
+    bool m_was_blocking;
+};
+
+/**
+ * Increasing waits between attempts at an operation that would have blocked.
+ *
+ * The first retry only yields the processor, so data already on its way is
+ * picked up quickly.  Later ones wait for the session's socket to have data
+ * to read, which is what a blocked channel operation is waiting for, but
+ * only for so long, because another thread using the session may read that
+ * data first.  That limit doubles up to a few milliseconds and, once the
+ * operation has been waiting over a second, on up to a quarter of a second.
+ * A command that is idle for a long time, such as a remote watch, then costs
+ * almost nothing yet still sees new output as soon as it arrives.
+ */
+class retry_backoff
+{
+public:
+    retry_backoff()
+        : m_started(boost::chrono::steady_clock::now()), m_next_wait_ms(0)
+    {
+    }
+
+    void wait(session_state& session)
+    {
+        if (m_next_wait_ms == 0)
+        {
+            boost::this_thread::yield();
+            m_next_wait_ms = 1;
+        }
+        else
+        {
+            session.wait_for_input(m_next_wait_ms);
+
+            // Waiting on the socket isn't an interruption point, as sleeping
+            // is, and a remote watch is stopped by interrupting its thread
+            boost::this_thread::interruption_point();
+
+            int maximum_wait_ms =
+                (boost::chrono::steady_clock::now() - m_started <
+                 boost::chrono::seconds(1))
+                    ? MAXIMUM_WAIT_MS
+                    : MAXIMUM_IDLE_WAIT_MS;
+            if (m_next_wait_ms < maximum_wait_ms)
+                m_next_wait_ms *= 2;
+        }
+    }
+
+private:
+    static const int MAXIMUM_WAIT_MS = 8;
+    static const int MAXIMUM_IDLE_WAIT_MS = 256;
+
+    boost::chrono::steady_clock::time_point m_started;
+    int m_next_wait_ms;
+};
+
+/**
+ * Whether an operation that returned `LIBSSH2_ERROR_EAGAIN` must be repeated
+ * before the session lock is released.
+ *
+ * If the socket would have blocked while sending, libssh2 has a transport
+ * packet partly sent and requires the same call to be repeated until it has
+ * gone.  Any other use of the session in the meantime, by another thread
+ * taking the lock, would fail or corrupt the stream.  In that case this
+ * waits, still holding the lock, until the socket can take more and returns
+ * `true`.  Otherwise nothing was left half done, so the caller may release
+ * the lock and back off.
+ */
+inline bool must_repeat_under_lock(session_state& session)
+{
+    if ((::libssh2_session_block_directions(session.session_ptr()) &
+         LIBSSH2_SESSION_BLOCK_OUTBOUND) == 0)
+    {
+        return false;
+    }
+
+    session.wait_for_socket(10);
+    return true;
+}
+
+/**
+ * Open a session channel and start a program on it.
+ *
+ * @param request  "exec" to run `message` as a command, or "subsystem" to
+ *                 start the subsystem it names.
+ */
+inline LIBSSH2_CHANNEL* do_exec(session_state& session,
+                                const std::string& request,
+                                const std::string& message)
+{
+    session_state::scoped_lock lock = session.aquire_lock("channel_exec");
+
+    static const char CHANNEL_TYPE[] = "session";
+
+    LIBSSH2_CHANNEL* channel = libssh2::channel::open(
+        session.session_ptr(), CHANNEL_TYPE, sizeof(CHANNEL_TYPE) - 1,
+        LIBSSH2_CHANNEL_WINDOW_DEFAULT, LIBSSH2_CHANNEL_PACKET_DEFAULT, NULL,
+        0);
+
+    try
+    {
+        libssh2::channel::process_startup(
+            session.session_ptr(), channel, request.data(),
+            static_cast<unsigned int>(request.size()), message.data(),
+            static_cast<unsigned int>(message.size()));
+    }
+    catch (...)
+    {
+        ::libssh2_channel_free(channel);
+        throw;
+    }
+
+    return channel;
+}
+
+/**
+ * RAII object managing a channel running a remote command.
+ *
+ * The channel shares its session with any SFTP channels and other commands
+ * running over it, so it must not hold the session lock while waiting for
+ * the command.  Every operation therefore takes the lock only for one
+ * non-blocking attempt, releasing it and backing off before trying again if
+ * the attempt would have blocked.  Other threads can use the session while
+ * a command is waiting for input or producing output slowly.  The exception
+ * is an attempt that blocked part way through sending a packet, which is
+ * repeated without releasing the lock (see `must_repeat_under_lock`).
+ */
+class exec_channel_state : private boost::noncopyable
+{
+    //
+    // Intentionally not movable to prevent the public classes that own
+    // this object moving it when they are themselves moved.  This object
+    // is referenced by other classes that don't own it so the owning classes
+    // need to leave it where it is when they move so as not to invalidate
+    // the other references.  Making this non-copyable, non-movable enforces
+    // that.
+    //
+public:
+    typedef session_state::scoped_lock scoped_lock;
+
+    /**
+     * Starts the command on a new channel that closes itself in a
+     * thread-safe manner when it goes out of scope.
+     */
+    exec_channel_state(session_state& session, const std::string& command)
+        : m_session(session),
+          m_channel(do_exec(session_ref(), "exec", command)),
+          m_input_closed(false)
+    {
+    }
+
+    /**
+     * Starts a program on a new channel using the given channel request.
+     *
+     * Used to start subsystems, such as "sftp", which are named rather than
+     * run by the shell.
+     */
+    exec_channel_state(session_state& session, const std::string& request,
+                       const std::string& message)
+        : m_session(session),
+          m_channel(do_exec(session_ref(), request, message)),
+          m_input_closed(false)
+    {
+    }
+
+    ~exec_channel_state() throw()
+    {
+        scoped_lock lock = session_ref().aquire_lock("channel_free");
+
+        ::libssh2_channel_free(m_channel);
+    }
+
+    /**
+     * Read from the command's standard output or standard error.
+     *
+     * Waits until some data is available and returns however much that is,
+     * up to `buffer_size`.  Returns 0 once the stream has ended.
+     *
+     * The whole wait is traced as one call, rather than each attempt.
+     */
+    std::size_t read(int stream_id, char* buffer, std::size_t buffer_size)
+    {
+        boost::system::error_code ec;
+        std::string e_msg;
+        traced_call trace("libssh2_channel_read_ex", ec);
+
+        retry_backoff backoff;
+        for (;;)
+        {
+            {
+                scoped_lock lock = session_ref().aquire_lock("channel_read");
+                non_blocking_session non_blocking(session_ptr());
+
+                ssize_t rc;
+                do
+                {
+                    rc = libssh2::channel::read(session_ptr(), m_channel,
+                                                stream_id, buffer, buffer_size,
+                                                ec, e_msg);
+                } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                         must_repeat_under_lock(session_ref()));
+
+                if (ec)
+                {
+                    SSH_DETAIL_THROW_API_ERROR_CODE(ec, e_msg,
+                                                    "libssh2_channel_read_ex");
+                }
+
+                if (rc != LIBSSH2_ERROR_EAGAIN)
+                {
+                    trace.transferred(rc);
+                    return static_cast<std::size_t>(rc);
+                }
+            }
+
+            backoff.wait(session_ref());
+        }
+    }
+
+    /**
+     * Write to the command's standard input.
+     *
+     * Waits until the channel accepts some of the data and returns how much
+     * that was.
+     *
+     * The whole wait is traced as one call, rather than each attempt.
+     */
+    std::size_t write(const char* data, std::size_t data_size)
+    {
+        boost::system::error_code ec;
+        std::string e_msg;
+        traced_call trace("libssh2_channel_write_ex", ec);
+
+        retry_backoff backoff;
+        for (;;)
+        {
+            {
+                scoped_lock lock = session_ref().aquire_lock("channel_write");
+                non_blocking_session non_blocking(session_ptr());
+
+                ssize_t rc;
+                do
+                {
+                    rc = libssh2::channel::write(session_ptr(), m_channel, 0,
+                                                 data, data_size, ec, e_msg);
+                } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                         must_repeat_under_lock(session_ref()));
+
+                if (ec)
+                {
+                    SSH_DETAIL_THROW_API_ERROR_CODE(ec, e_msg,
+                                                    "libssh2_channel_write_ex");
+                }
+
+                if (rc != LIBSSH2_ERROR_EAGAIN)
+                {
+                    trace.transferred(rc);
+                    return static_cast<std::size_t>(rc);
+                }
+            }
+
+            backoff.wait(session_ref());
+        }
+    }
+
+    /**
+     * Tell the command there is no more input.
+     *
+     * Does nothing if the input is already closed.
+     */
+    void close_input()
+    {
+        if (!m_input_closed)
+        {
+            repeat_until_done(&libssh2::channel::send_eof, "channel_send_eof");
+            m_input_closed = true;
+        }
+    }
+
+    /**
+     * Wait for the command to finish and return its exit status.
+     *
+     * Closes the command's input and discards any output not yet read.
+     * Once the command has finished, the status is remembered and later
+     * calls return it at once.
+     */
+    int exit_status()
+    {
+        if (!m_exit_status)
+        {
+            close_input();
+            discard_output();
+            repeat_until_done(&libssh2::channel::close, "channel_close");
+            repeat_until_done(&libssh2::channel::wait_closed,
+                              "channel_wait_closed");
+
+            scoped_lock lock =
+                session_ref().aquire_lock("channel_exit_status");
+            m_exit_status = ::libssh2_channel_get_exit_status(m_channel);
+        }
+
+        return *m_exit_status;
+    }
+
+private:
+    typedef int (*channel_operation)(LIBSSH2_SESSION*, LIBSSH2_CHANNEL*);
+
+    void repeat_until_done(channel_operation operation, const char* name)
+    {
+        retry_backoff backoff;
+        for (;;)
+        {
+            {
+                scoped_lock lock = session_ref().aquire_lock(name);
+                non_blocking_session non_blocking(session_ptr());
+
+                int rc;
+                do
+                {
+                    rc = operation(session_ptr(), m_channel);
+                } while (rc == LIBSSH2_ERROR_EAGAIN &&
+                         must_repeat_under_lock(session_ref()));
+
+                if (rc != LIBSSH2_ERROR_EAGAIN)
+                    return;
+            }
+
+            backoff.wait(session_ref());
+        }
+    }
+
+    /**
+     * Read and throw away output until the command closes both its output
+     * streams.
+     *
+     * Leaving unread output queued would fill the channel window and stop
+     * the command before it could exit.
+     */
+    void discard_output()
+    {
+        char buffer[4096];
+
+        retry_backoff backoff;
+        for (;;)
+        {
+            {
+                scoped_lock lock = session_ref().aquire_lock("channel_read");
+                non_blocking_session non_blocking(session_ptr());
+
+                ssize_t output;
+                do
+                {
+                    output = libssh2::channel::read(
+                        session_ptr(), m_channel, 0, buffer, sizeof(buffer));
+                } while (output == LIBSSH2_ERROR_EAGAIN &&
+                         must_repeat_under_lock(session_ref()));
+
+                ssize_t error;
+                do
+                {
+                    error = libssh2::channel::read(
+                        session_ptr(), m_channel, SSH_EXTENDED_DATA_STDERR,
+                        buffer, sizeof(buffer));
+                } while (error == LIBSSH2_ERROR_EAGAIN &&
+                         must_repeat_under_lock(session_ref()));
+
+                if (output > 0 || error > 0)
+                {
+                    backoff = retry_backoff();
+                    continue;
+                }
+
+                // Only reports the end once no data remains queued
+                if (::libssh2_channel_eof(m_channel) == 1)
+                    return;
+            }
+
+            backoff.wait(session_ref());
+        }
+    }
+
+    LIBSSH2_SESSION* session_ptr()
+    {
+        return session_ref().session_ptr();
+    }
+
+    session_state& session_ref()
+    {
+        return m_session;
+    }
+
+    session_state& m_session;
+    LIBSSH2_CHANNEL* m_channel;
+    bool m_input_closed;
+    boost::optional<int> m_exit_status;
+};
+}
+} // namespace ssh::detail
+
+#endif
@@ -40,8 +40,10 @@
 #include <ssh/detail/libssh2/sftp.hpp> // open
 #include <ssh/detail/sftp_channel_state.hpp>
 
+#include <boost/cstdint.hpp> // uint64_t
 #include <boost/noncopyable.hpp>
 
+#include <deque>
 #include <string>
 
 #include <libssh2_sftp.h> // LIBSSH2_SFTP_HANDLE
@@ -57,16 +59,36 @@ inline LIBSSH2_SFTP_HANDLE* do_open(sftp_channel_state& sftp,
                                     unsigned long flags, long mode,
                                     int open_type)
 {
-    session_state::scoped_lock lock = sftp.aquire_lock();
+    session_state::scoped_lock lock = sftp.aquire_lock("sftp_open");
 
     return libssh2::sftp::open(sftp.session_ptr(), sftp.sftp_ptr(), filename,
                                filename_len, flags, mode, open_type);
 }
 
+inline std::string do_native_open(sftp_channel_state& sftp,
+                                  const std::string& path,
+                                  unsigned long flags, long mode,
+                                  int open_type)
+{
+    if (open_type == LIBSSH2_SFTP_OPENDIR)
+    {
+        return sftp.native()->open_directory(path);
+    }
+    else
+    {
+        return sftp.native()->open(path, flags, mode);
+    }
+}
+
 /**
  * RAII object managing SFTP file handle state that must be maintained together.
  *
  * Manages the graceful opening/closing of file handles.
+ *
+ * When the channel is run by the native engine, the handle is the server's
+ * own handle string.  libssh2 would keep the file position and a directory
+ * listing's unread entries itself, so for the native engine this object
+ * keeps them instead.
  */
 class file_handle_state : private boost::noncopyable
 {
@@ -85,26 +107,52 @@ public:
     /**
      * Creates a new file handle that closes itself in a thread-safe manner
      * when it goes out of scope.
+     *
+     * `filename` is only borrowed until the file is open.
      */
-    file_handle_state(sftp_channel_state& sftp, const char* filename,
-                      unsigned int filename_len, unsigned long flags, long mode,
-                      int open_type)
-        : m_sftp(sftp),
-          m_handle(do_open(sftp_ref(), filename, filename_len, flags, mode,
-                           open_type))
+    file_handle_state(sftp_channel_state& sftp, const std::string& filename,
+                      unsigned long flags, long mode, int open_type)
+        : m_sftp(sftp), m_handle(NULL), m_native_offset(0)
     {
+        if (sftp_ref().native())
+        {
+            m_native_handle =
+                do_native_open(sftp_ref(), filename, flags, mode, open_type);
+        }
+        else
+        {
+            m_handle = do_open(sftp_ref(), filename.data(),
+                               static_cast<unsigned int>(filename.size()),
+                               flags, mode, open_type);
+        }
     }
 
     ~file_handle_state() throw()
     {
-        sftp_channel_state::scoped_lock lock = sftp_ref().aquire_lock();
-
-        ::libssh2_sftp_close_handle(m_handle);
+        if (native())
+        {
+            try
+            {
+                native()->close(m_native_handle);
+            }
+            catch (const std::exception&)
+            {
+                // Like libssh2_sftp_close_handle, a failure to close is
+                // ignored; the server frees the handle when the channel ends
+            }
+        }
+        else
+        {
+            sftp_channel_state::scoped_lock lock =
+                sftp_ref().aquire_lock("sftp_close_handle");
+
+            ::libssh2_sftp_close_handle(m_handle);
+        }
     }
 
-    scoped_lock aquire_lock()
+    scoped_lock aquire_lock(const char* operation)
     {
-        return sftp_ref().aquire_lock();
+        return sftp_ref().aquire_lock(operation);
     }
 
     LIBSSH2_SESSION* session_ptr()
@@ -112,6 +160,11 @@ public:
         return sftp_ref().session_ptr();
     }
 
+    session_traffic& traffic()
+    {
+        return sftp_ref().traffic();
+    }
+
     LIBSSH2_SFTP* sftp_ptr()
     {
         return sftp_ref().sftp_ptr();
@@ -122,6 +175,37 @@ public:
         return m_handle;
     }
 
+    /**
+     * The native engine running the channel, or NULL if libssh2 runs it.
+     */
+    native_sftp_state* native()
+    {
+        return sftp_ref().native();
+    }
+
+    const std::string& native_handle() const
+    {
+        return m_native_handle;
+    }
+
+    boost::uint64_t native_offset() const
+    {
+        return m_native_offset;
+    }
+
+    void set_native_offset(boost::uint64_t offset)
+    {
+        m_native_offset = offset;
+    }
+
+    /**
+     * Directory entries the native engine has read but not yet returned.
+     */
+    std::deque<native_sftp_entry>& native_listing()
+    {
+        return m_native_listing;
+    }
+
 private:
     sftp_channel_state& sftp_ref()
     {
@@ -130,6 +214,13 @@ private:
 
     sftp_channel_state& m_sftp;
     LIBSSH2_SFTP_HANDLE* m_handle;
+
+    /// @name Used only with the native engine.
+    // @{
+    std::string m_native_handle;
+    boost::uint64_t m_native_offset;
+    std::deque<native_sftp_entry> m_native_listing;
+    // @}
 };
 }
 } // namespace ssh::detail
@@ -0,0 +1,221 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Reader of the listing printed by GNU `find` with `FIND_LISTING_FORMAT`.
+ *
+ * Every field ends with a NUL, the one byte that can't appear in a file
+ * name, so names holding newlines or any other byte are read back exactly.
+ */
+
+#ifndef SSH_DETAIL_FIND_LISTING_HPP
+#define SSH_DETAIL_FIND_LISTING_HPP
+
+#include <boost/cstdint.hpp>         // uint64_t
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <istream>
+#include <stdexcept> // runtime_error
+#include <string>
+
+#include <libssh2_sftp.h>
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * `find -printf` format of one entry: the path relative to the starting
+ * point, the type letter, the permission bits in octal, the size, the owner
+ * and group IDs and the access and modification times.
+ */
+const char FIND_LISTING_FORMAT[] =
+    "%P\\0%y\\0%m\\0%s\\0%U\\0%G\\0%A@\\0%T@\\0";
+
+/// @cond INTERNAL
+namespace find_listing
+{
+
+inline void malformed(const std::string& field)
+{
+    BOOST_THROW_EXCEPTION(
+        std::runtime_error("Malformed find listing field: " + field));
+}
+
+/**
+ * Whole part of a decimal field, such as a size or a time with a fractional
+ * part.
+ *
+ * Times before 1970 can't be held in SFTP attributes so are read as zero.
+ */
+inline boost::uint64_t read_decimal(const std::string& field)
+{
+    std::string::size_type i = 0;
+    bool negative = false;
+    if (!field.empty() && field[0] == '-')
+    {
+        negative = true;
+        ++i;
+    }
+
+    if (i == field.size() || field[i] < '0' || field[i] > '9')
+        malformed(field);
+
+    boost::uint64_t value = 0;
+    for (; i < field.size() && field[i] != '.'; ++i)
+    {
+        if (field[i] < '0' || field[i] > '9')
+            malformed(field);
+        value = value * 10 + (field[i] - '0');
+    }
+
+    return negative ? 0 : value;
+}
+
+inline unsigned long read_octal(const std::string& field)
+{
+    if (field.empty())
+        malformed(field);
+
+    unsigned long value = 0;
+    for (std::string::size_type i = 0; i < field.size(); ++i)
+    {
+        if (field[i] < '0' || field[i] > '7')
+            malformed(field);
+        value = value * 8 + (field[i] - '0');
+    }
+
+    return value;
+}
+
+/**
+ * SFTP file-type bits for a `find -printf %y` type letter.
+ */
+inline unsigned long type_bits(const std::string& field)
+{
+    if (field.size() != 1)
+        malformed(field);
+
+    switch (field[0])
+    {
+    case 'f':
+        return LIBSSH2_SFTP_S_IFREG;
+    case 'd':
+        return LIBSSH2_SFTP_S_IFDIR;
+    case 'l':
+        return LIBSSH2_SFTP_S_IFLNK;
+    case 'b':
+        return LIBSSH2_SFTP_S_IFBLK;
+    case 'c':
+        return LIBSSH2_SFTP_S_IFCHR;
+    case 'p':
+        return LIBSSH2_SFTP_S_IFIFO;
+    case 's':
+        return LIBSSH2_SFTP_S_IFSOCK;
+    default:
+        // Doors and the like have no SFTP equivalent
+        return 0;
+    }
+}
+}
+/// @endcond
+
+/**
+ * Incremental reader of a `find` listing.
+ *
+ * Entries are read one at a time as the listing arrives, so listings of
+ * millions of entries never need to be held in memory.
+ */
+class find_listing_reader
+{
+public:
+    explicit find_listing_reader(std::istream& stream) : m_stream(stream)
+    {
+    }
+
+    /**
+     * Read the next entry.
+     *
+     * @param[out] name        Path of the entry relative to the starting
+     *                         point.
+     * @param[out] attributes  The entry's attributes, as SFTP would report
+     *                         them.
+     *
+     * @returns false at the end of the listing.
+     */
+    bool next_entry(std::string& name, LIBSSH2_SFTP_ATTRIBUTES& attributes)
+    {
+        if (!std::getline(m_stream, name, '\0'))
+        {
+            if (m_stream.bad())
+                truncated();
+            return false;
+        }
+        else if (m_stream.eof())
+        {
+            truncated();
+        }
+
+        attributes = LIBSSH2_SFTP_ATTRIBUTES();
+        attributes.flags = LIBSSH2_SFTP_ATTR_SIZE | LIBSSH2_SFTP_ATTR_UIDGID |
+                           LIBSSH2_SFTP_ATTR_PERMISSIONS |
+                           LIBSSH2_SFTP_ATTR_ACMODTIME;
+
+        unsigned long type = find_listing::type_bits(next_field());
+        attributes.permissions =
+            type | (find_listing::read_octal(next_field()) & 07777);
+        attributes.filesize = next_decimal();
+        attributes.uid = static_cast<unsigned long>(next_decimal());
+        attributes.gid = static_cast<unsigned long>(next_decimal());
+        attributes.atime = static_cast<unsigned long>(next_decimal());
+        attributes.mtime = static_cast<unsigned long>(next_decimal());
+
+        return true;
+    }
+
+private:
+    const std::string& next_field()
+    {
+        // Every field ends with a NUL, so reaching the end of the stream
+        // means the field is incomplete
+        if (!std::getline(m_stream, m_field, '\0') || m_stream.eof())
+            truncated();
+        return m_field;
+    }
+
+    boost::uint64_t next_decimal()
+    {
+        return find_listing::read_decimal(next_field());
+    }
+
+    void truncated()
+    {
+        BOOST_THROW_EXCEPTION(
+            std::runtime_error("find listing ended part way through entry"));
+    }
+
+    std::istream& m_stream;
+
+    // Reused so reading an entry doesn't allocate once the longest field
+    // has been seen
+    std::string m_field;
+};
+}
+} // namespace ssh::detail
+
+#endif
@@ -0,0 +1,994 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Incremental hashes of file contents.
+ *
+ * Implemented here rather than taken from a crypto library because the
+ * library doesn't otherwise depend on one; libssh2 may be built against any
+ * of several.
+ */
+
+#ifndef SSH_DETAIL_HASH_HPP
+#define SSH_DETAIL_HASH_HPP
+
+#include <ssh/hash_algorithm.hpp>
+
+#include <boost/cstdint.hpp> // uint32_t, uint64_t
+#include <boost/noncopyable.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // min
+#include <cstddef>   // size_t
+#include <cstring>   // memcpy
+#include <memory>    // auto_ptr
+#include <stdexcept> // invalid_argument
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SSH_DETAIL_HASH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h> // _umul128
+#endif
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * A hash computed incrementally over data passed to it in pieces.
+ */
+class hash_function : private boost::noncopyable
+{
+public:
+    virtual ~hash_function()
+    {
+    }
+
+    virtual void update(const char* data, std::size_t size) = 0;
+
+    /**
+     * Digest of everything passed to `update`.
+     *
+     * No more data may be passed afterwards.
+     */
+    virtual std::vector<unsigned char> finish() = 0;
+};
+
+/**
+ * Common structure of hashes, like MD5 and SHA-256, that process 64-byte
+ * blocks and pad the message with its length in bits.
+ */
+template <typename Derived>
+class block_hash : public hash_function
+{
+public:
+    void update(const char* data, std::size_t size)
+    {
+        m_length += size;
+
+        if (m_buffered > 0)
+        {
+            std::size_t count = (std::min)(size, BLOCK_SIZE - m_buffered);
+            std::memcpy(m_buffer + m_buffered, data, count);
+            m_buffered += count;
+            data += count;
+            size -= count;
+
+            if (m_buffered < BLOCK_SIZE)
+                return;
+
+            derived().process_block(m_buffer);
+            m_buffered = 0;
+        }
+
+        for (; size >= BLOCK_SIZE; data += BLOCK_SIZE, size -= BLOCK_SIZE)
+        {
+            derived().process_block(
+                reinterpret_cast<const unsigned char*>(data));
+        }
+
+        std::memcpy(m_buffer, data, size);
+        m_buffered = size;
+    }
+
+protected:
+    static const std::size_t BLOCK_SIZE = 64;
+
+    block_hash() : m_length(0), m_buffered(0)
+    {
+    }
+
+    /**
+     * Add the padding and length, processing the final blocks.
+     */
+    void pad(bool big_endian_length)
+    {
+        boost::uint64_t bit_length = m_length * 8;
+
+        static const char padding[BLOCK_SIZE] = {'\x80'};
+        std::size_t padding_size = (m_buffered < 56) ? 56 - m_buffered
+                                                      : 120 - m_buffered;
+        update(padding, padding_size);
+
+        char length[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            int shift = (big_endian_length) ? 56 - 8 * i : 8 * i;
+            length[i] = static_cast<char>((bit_length >> shift) & 0xff);
+        }
+        update(length, sizeof(length));
+    }
+
+    static boost::uint32_t rotate_left(boost::uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    static boost::uint32_t rotate_right(boost::uint32_t x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+private:
+    Derived& derived()
+    {
+        return static_cast<Derived&>(*this);
+    }
+
+    boost::uint64_t m_length;
+    unsigned char m_buffer[BLOCK_SIZE];
+    std::size_t m_buffered;
+};
+
+class sha256_hash : public block_hash<sha256_hash>
+{
+public:
+    sha256_hash()
+    {
+        static const boost::uint32_t initial[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+            0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        std::memcpy(m_state, initial, sizeof(m_state));
+    }
+
+    std::vector<unsigned char> finish()
+    {
+        pad(true);
+
+        std::vector<unsigned char> digest(32);
+        for (int i = 0; i < 8; ++i)
+        {
+            digest[4 * i] = static_cast<unsigned char>(m_state[i] >> 24);
+            digest[4 * i + 1] = static_cast<unsigned char>(m_state[i] >> 16);
+            digest[4 * i + 2] = static_cast<unsigned char>(m_state[i] >> 8);
+            digest[4 * i + 3] = static_cast<unsigned char>(m_state[i]);
+        }
+        return digest;
+    }
+
+private:
+    friend class block_hash<sha256_hash>;
+
+    void process_block(const unsigned char* block)
+    {
+        static const boost::uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+            0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01,
+            0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7,
+            0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+            0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152,
+            0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+            0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+            0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08,
+            0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+            0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+            0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+        boost::uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (boost::uint32_t(block[4 * i]) << 24) |
+                   (boost::uint32_t(block[4 * i + 1]) << 16) |
+                   (boost::uint32_t(block[4 * i + 2]) << 8) |
+                   boost::uint32_t(block[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            boost::uint32_t s0 = rotate_right(w[i - 15], 7) ^
+                                 rotate_right(w[i - 15], 18) ^
+                                 (w[i - 15] >> 3);
+            boost::uint32_t s1 = rotate_right(w[i - 2], 17) ^
+                                 rotate_right(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        boost::uint32_t a = m_state[0], b = m_state[1], c = m_state[2],
+                        d = m_state[3], e = m_state[4], f = m_state[5],
+                        g = m_state[6], h = m_state[7];
+
+        for (int i = 0; i < 64; ++i)
+        {
+            boost::uint32_t s1 =
+                rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+            boost::uint32_t choice = (e & f) ^ (~e & g);
+            boost::uint32_t t1 = h + s1 + choice + k[i] + w[i];
+            boost::uint32_t s0 =
+                rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+            boost::uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            boost::uint32_t t2 = s0 + majority;
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+        m_state[4] += e;
+        m_state[5] += f;
+        m_state[6] += g;
+        m_state[7] += h;
+    }
+
+    boost::uint32_t m_state[8];
+};
+
+class md5_hash : public block_hash<md5_hash>
+{
+public:
+    md5_hash()
+    {
+        m_state[0] = 0x67452301;
+        m_state[1] = 0xefcdab89;
+        m_state[2] = 0x98badcfe;
+        m_state[3] = 0x10325476;
+    }
+
+    std::vector<unsigned char> finish()
+    {
+        pad(false);
+
+        std::vector<unsigned char> digest(16);
+        for (int i = 0; i < 4; ++i)
+        {
+            digest[4 * i] = static_cast<unsigned char>(m_state[i]);
+            digest[4 * i + 1] = static_cast<unsigned char>(m_state[i] >> 8);
+            digest[4 * i + 2] = static_cast<unsigned char>(m_state[i] >> 16);
+            digest[4 * i + 3] = static_cast<unsigned char>(m_state[i] >> 24);
+        }
+        return digest;
+    }
+
+private:
+    friend class block_hash<md5_hash>;
+
+    void process_block(const unsigned char* block)
+    {
+        static const boost::uint32_t k[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf,
+            0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af,
+            0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e,
+            0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+            0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6,
+            0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+            0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122,
+            0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039,
+            0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97,
+            0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
+            0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+            0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+        static const int shifts[64] = {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+        boost::uint32_t m[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            m[i] = boost::uint32_t(block[4 * i]) |
+                   (boost::uint32_t(block[4 * i + 1]) << 8) |
+                   (boost::uint32_t(block[4 * i + 2]) << 16) |
+                   (boost::uint32_t(block[4 * i + 3]) << 24);
+        }
+
+        boost::uint32_t a = m_state[0], b = m_state[1], c = m_state[2],
+                        d = m_state[3];
+
+        for (int i = 0; i < 64; ++i)
+        {
+            boost::uint32_t f;
+            int g;
+            if (i < 16)
+            {
+                f = (b & c) | (~b & d);
+                g = i;
+            }
+            else if (i < 32)
+            {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            }
+            else if (i < 48)
+            {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            }
+            else
+            {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+
+            boost::uint32_t next_d = c;
+            c = b;
+            b = b + rotate_left(a + f + k[i] + m[g], shifts[i]);
+            a = d;
+            d = next_d;
+        }
+
+        m_state[0] += a;
+        m_state[1] += b;
+        m_state[2] += c;
+        m_state[3] += d;
+    }
+
+    boost::uint32_t m_state[4];
+};
+
+/**
+ * XXH64, processing 32-byte stripes over four lanes.
+ */
+class xxh64_hash : public hash_function
+{
+public:
+    xxh64_hash() : m_length(0), m_buffered(0)
+    {
+        m_lanes[0] = PRIME1 + PRIME2;
+        m_lanes[1] = PRIME2;
+        m_lanes[2] = 0;
+        m_lanes[3] = 0 - PRIME1;
+    }
+
+    void update(const char* data, std::size_t size)
+    {
+        const unsigned char* bytes =
+            reinterpret_cast<const unsigned char*>(data);
+        m_length += size;
+
+        if (m_buffered > 0)
+        {
+            std::size_t count = (std::min)(size, STRIPE_SIZE - m_buffered);
+            std::memcpy(m_buffer + m_buffered, bytes, count);
+            m_buffered += count;
+            bytes += count;
+            size -= count;
+
+            if (m_buffered < STRIPE_SIZE)
+                return;
+
+            process_stripe(m_buffer);
+            m_buffered = 0;
+        }
+
+        for (; size >= STRIPE_SIZE; bytes += STRIPE_SIZE, size -= STRIPE_SIZE)
+        {
+            process_stripe(bytes);
+        }
+
+        std::memcpy(m_buffer, bytes, size);
+        m_buffered = size;
+    }
+
+    std::vector<unsigned char> finish()
+    {
+        boost::uint64_t h;
+        if (m_length >= STRIPE_SIZE)
+        {
+            h = rotate_left(m_lanes[0], 1) + rotate_left(m_lanes[1], 7) +
+                rotate_left(m_lanes[2], 12) + rotate_left(m_lanes[3], 18);
+            for (int i = 0; i < 4; ++i)
+            {
+                h ^= round(0, m_lanes[i]);
+                h = h * PRIME1 + PRIME4;
+            }
+        }
+        else
+        {
+            h = PRIME5;
+        }
+
+        h += m_length;
+
+        const unsigned char* tail = m_buffer;
+        std::size_t remaining = m_buffered;
+        for (; remaining >= 8; tail += 8, remaining -= 8)
+        {
+            h ^= round(0, read_little_endian(tail, 8));
+            h = rotate_left(h, 27) * PRIME1 + PRIME4;
+        }
+        if (remaining >= 4)
+        {
+            h ^= read_little_endian(tail, 4) * PRIME1;
+            h = rotate_left(h, 23) * PRIME2 + PRIME3;
+            tail += 4;
+            remaining -= 4;
+        }
+        for (; remaining > 0; ++tail, --remaining)
+        {
+            h ^= *tail * PRIME5;
+            h = rotate_left(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+
+        // Big-endian, as `xxh64sum` prints it
+        std::vector<unsigned char> digest(8);
+        for (int i = 0; i < 8; ++i)
+        {
+            digest[i] = static_cast<unsigned char>(h >> (56 - 8 * i));
+        }
+        return digest;
+    }
+
+private:
+    static const std::size_t STRIPE_SIZE = 32;
+
+    static const boost::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+    static const boost::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+    static const boost::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+    static const boost::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+    static const boost::uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+    static boost::uint64_t rotate_left(boost::uint64_t x, int n)
+    {
+        return (x << n) | (x >> (64 - n));
+    }
+
+    static boost::uint64_t read_little_endian(const unsigned char* bytes,
+                                              int size)
+    {
+        boost::uint64_t value = 0;
+        for (int i = size - 1; i >= 0; --i)
+        {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+
+    static boost::uint64_t round(boost::uint64_t lane, boost::uint64_t input)
+    {
+        lane += input * PRIME2;
+        return rotate_left(lane, 31) * PRIME1;
+    }
+
+    void process_stripe(const unsigned char* stripe)
+    {
+        // The lanes are independent, so the compiler can interleave them
+        m_lanes[0] = round(m_lanes[0], read_little_endian(stripe, 8));
+        m_lanes[1] = round(m_lanes[1], read_little_endian(stripe + 8, 8));
+        m_lanes[2] = round(m_lanes[2], read_little_endian(stripe + 16, 8));
+        m_lanes[3] = round(m_lanes[3], read_little_endian(stripe + 24, 8));
+    }
+
+    boost::uint64_t m_lanes[4];
+    boost::uint64_t m_length;
+    unsigned char m_buffer[STRIPE_SIZE];
+    std::size_t m_buffered;
+};
+
+/**
+ * XXH3 (the 64-bit variant), with the default secret and no seed.
+ *
+ * Input longer than 240 bytes is mixed into eight lanes, 64 bytes at a time.
+ * Where the processor has SSE2 the lanes are updated two at a time, as the
+ * reference implementation does, which makes this several times faster than
+ * `xxh64_hash`.
+ */
+class xxh3_hash : public hash_function
+{
+public:
+    xxh3_hash() : m_length(0), m_buffered(0), m_block_stripes(0)
+    {
+        m_lanes[0] = PRIME32_3;
+        m_lanes[1] = PRIME64_1;
+        m_lanes[2] = PRIME64_2;
+        m_lanes[3] = PRIME64_3;
+        m_lanes[4] = PRIME64_4;
+        m_lanes[5] = PRIME32_2;
+        m_lanes[6] = PRIME64_5;
+        m_lanes[7] = PRIME32_1;
+    }
+
+    void update(const char* data, std::size_t size)
+    {
+        const unsigned char* bytes =
+            reinterpret_cast<const unsigned char*>(data);
+        m_length += size;
+
+        if (size <= BUFFER_SIZE - m_buffered)
+        {
+            std::memcpy(m_buffer + m_buffered, bytes, size);
+            m_buffered += size;
+            return;
+        }
+
+        if (m_buffered > 0)
+        {
+            std::size_t count = BUFFER_SIZE - m_buffered;
+            std::memcpy(m_buffer + m_buffered, bytes, count);
+            bytes += count;
+            size -= count;
+
+            consume(m_buffer, BUFFER_SIZE / STRIPE_SIZE);
+            m_buffered = 0;
+        }
+
+        // Some input is always held back because the final stripe is mixed
+        // differently.  If it is shorter than a stripe, the end of the
+        // buffer keeps the stripe before it.
+        if (size > BUFFER_SIZE)
+        {
+            std::size_t stripes = (size - 1) / STRIPE_SIZE;
+            consume(bytes, stripes);
+            bytes += stripes * STRIPE_SIZE;
+            size -= stripes * STRIPE_SIZE;
+
+            std::memcpy(m_buffer + BUFFER_SIZE - STRIPE_SIZE,
+                        bytes - STRIPE_SIZE, STRIPE_SIZE);
+        }
+
+        std::memcpy(m_buffer, bytes, size);
+        m_buffered = size;
+    }
+
+    std::vector<unsigned char> finish()
+    {
+        boost::uint64_t h = (m_length > MIDSIZE_MAX) ? finish_long()
+                                                     : finish_short();
+
+        // Big-endian, as `xxh3sum` prints it
+        std::vector<unsigned char> digest(8);
+        for (int i = 0; i < 8; ++i)
+        {
+            digest[i] = static_cast<unsigned char>(h >> (56 - 8 * i));
+        }
+        return digest;
+    }
+
+private:
+    static const std::size_t STRIPE_SIZE = 64;
+    static const std::size_t BUFFER_SIZE = 256;
+    static const std::size_t MIDSIZE_MAX = 240;
+
+    static const std::size_t SECRET_SIZE = 192;
+
+    /**
+     * How far into the secret each stripe of a block starts from the last.
+     */
+    static const std::size_t SECRET_STEP = 8;
+
+    static const std::size_t BLOCK_STRIPES =
+        (SECRET_SIZE - STRIPE_SIZE) / SECRET_STEP;
+
+    static const boost::uint64_t PRIME32_1 = 0x9E3779B1U;
+    static const boost::uint64_t PRIME32_2 = 0x85EBCA77U;
+    static const boost::uint64_t PRIME32_3 = 0xC2B2AE3DU;
+    static const boost::uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    static const boost::uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    static const boost::uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    static const boost::uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    static const boost::uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+    static const boost::uint64_t PRIME_MX1 = 0x165667919E3779F9ULL;
+    static const boost::uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ULL;
+
+    static const unsigned char* secret()
+    {
+        static const unsigned char value[SECRET_SIZE] = {
+            0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81,
+            0x2c, 0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90,
+            0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb,
+            0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d,
+            0xcc, 0xff, 0x72, 0x21, 0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24,
+            0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28,
+            0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b,
+            0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e,
+            0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8, 0xa8, 0xfa, 0x76,
+            0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b,
+            0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8,
+            0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+            0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63,
+            0xeb, 0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16,
+            0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d,
+            0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+            0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb,
+            0xca, 0xbb, 0x4b, 0x40, 0x7e};
+        return value;
+    }
+
+    static boost::uint64_t rotate_left(boost::uint64_t x, int n)
+    {
+        return (x << n) | (x >> (64 - n));
+    }
+
+    /**
+     * Little-endian value, spelt out rather than looped so that compilers
+     * recognise it as a single load.
+     */
+    static boost::uint64_t read32(const unsigned char* bytes)
+    {
+        return boost::uint64_t(bytes[0]) | (boost::uint64_t(bytes[1]) << 8) |
+               (boost::uint64_t(bytes[2]) << 16) |
+               (boost::uint64_t(bytes[3]) << 24);
+    }
+
+    static boost::uint64_t read64(const unsigned char* bytes)
+    {
+        return read32(bytes) | (read32(bytes + 4) << 32);
+    }
+
+    /**
+     * Full 128-bit product, with its halves XORed together.
+     */
+    static boost::uint64_t multiply_fold(boost::uint64_t lhs,
+                                         boost::uint64_t rhs)
+    {
+#if defined(__SIZEOF_INT128__)
+        unsigned __int128 product = static_cast<unsigned __int128>(lhs) * rhs;
+        return static_cast<boost::uint64_t>(product) ^
+               static_cast<boost::uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+        unsigned __int64 high;
+        unsigned __int64 low = _umul128(lhs, rhs, &high);
+        return low ^ high;
+#else
+        boost::uint64_t lo_lo = (lhs & 0xFFFFFFFF) * (rhs & 0xFFFFFFFF);
+        boost::uint64_t hi_lo = (lhs >> 32) * (rhs & 0xFFFFFFFF);
+        boost::uint64_t lo_hi = (lhs & 0xFFFFFFFF) * (rhs >> 32);
+        boost::uint64_t hi_hi = (lhs >> 32) * (rhs >> 32);
+
+        boost::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+        boost::uint64_t high = (hi_lo >> 32) + (cross >> 32) + hi_hi;
+        boost::uint64_t low = (cross << 32) | (lo_lo & 0xFFFFFFFF);
+        return low ^ high;
+#endif
+    }
+
+    static boost::uint64_t avalanche(boost::uint64_t h)
+    {
+        h ^= h >> 37;
+        h *= PRIME_MX1;
+        h ^= h >> 32;
+        return h;
+    }
+
+    /**
+     * XXH64's avalanche, for inputs of no more than three bytes.
+     */
+    static boost::uint64_t xxh64_avalanche(boost::uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static boost::uint64_t mix16(const unsigned char* input,
+                                 const unsigned char* key)
+    {
+        return multiply_fold(read64(input) ^ read64(key),
+                             read64(input + 8) ^ read64(key + 8));
+    }
+
+    /**
+     * Hash of input short enough to be held in the buffer whole.
+     */
+    boost::uint64_t finish_short() const
+    {
+        const unsigned char* input = m_buffer;
+        const unsigned char* key = secret();
+        std::size_t length = static_cast<std::size_t>(m_length);
+
+        if (length == 0)
+        {
+            return xxh64_avalanche(read64(key + 56) ^ read64(key + 64));
+        }
+        else if (length <= 3)
+        {
+            boost::uint64_t combined =
+                (boost::uint64_t(input[0]) << 16) |
+                (boost::uint64_t(input[length >> 1]) << 24) |
+                boost::uint64_t(input[length - 1]) | (length << 8);
+            return xxh64_avalanche(combined ^
+                                   (read32(key) ^ read32(key + 4)));
+        }
+        else if (length <= 8)
+        {
+            boost::uint64_t combined =
+                read32(input + length - 4) + (read32(input) << 32);
+            boost::uint64_t h =
+                combined ^ (read64(key + 8) ^ read64(key + 16));
+            h ^= rotate_left(h, 49) ^ rotate_left(h, 24);
+            h *= PRIME_MX2;
+            h ^= (h >> 35) + length;
+            h *= PRIME_MX2;
+            return h ^ (h >> 28);
+        }
+        else if (length <= 16)
+        {
+            boost::uint64_t low =
+                read64(input) ^ (read64(key + 24) ^ read64(key + 32));
+            boost::uint64_t high = read64(input + length - 8) ^
+                                   (read64(key + 40) ^ read64(key + 48));
+
+            boost::uint64_t swapped_low = 0;
+            for (int i = 0; i < 8; ++i)
+            {
+                swapped_low = (swapped_low << 8) | ((low >> (8 * i)) & 0xff);
+            }
+
+            return avalanche(length + swapped_low + high +
+                             multiply_fold(low, high));
+        }
+        else if (length <= 128)
+        {
+            // Pairs of 16-byte chunks working in from both ends
+            boost::uint64_t h = length * PRIME64_1;
+            for (std::size_t i = 0; i <= (length - 1) / 32; ++i)
+            {
+                h += mix16(input + 16 * i, key + 32 * i);
+                h += mix16(input + length - 16 * (i + 1), key + 32 * i + 16);
+            }
+            return avalanche(h);
+        }
+        else
+        {
+            boost::uint64_t h = length * PRIME64_1;
+            for (std::size_t i = 0; i < 8; ++i)
+            {
+                h += mix16(input + 16 * i, key + 16 * i);
+            }
+            h = avalanche(h);
+
+            // The rest, and the final 16 bytes, with keys offset from the
+            // first eight
+            boost::uint64_t end = mix16(input + length - 16, key + 119);
+            for (std::size_t i = 8; i < length / 16; ++i)
+            {
+                end += mix16(input + 16 * i, key + 16 * (i - 8) + 3);
+            }
+            return avalanche(h + end);
+        }
+    }
+
+    boost::uint64_t finish_long()
+    {
+        const unsigned char* last;
+        unsigned char joined[STRIPE_SIZE];
+        if (m_buffered >= STRIPE_SIZE)
+        {
+            consume(m_buffer, (m_buffered - 1) / STRIPE_SIZE);
+            last = m_buffer + m_buffered - STRIPE_SIZE;
+        }
+        else
+        {
+            std::size_t catch_up = STRIPE_SIZE - m_buffered;
+            std::memcpy(joined, m_buffer + BUFFER_SIZE - catch_up, catch_up);
+            std::memcpy(joined + catch_up, m_buffer, m_buffered);
+            last = joined;
+        }
+        // The odd offsets into the secret give the last stripe, and the
+        // merging of the lanes, keys different from any the stripes had
+        accumulate(m_lanes, last, secret() + SECRET_SIZE - STRIPE_SIZE - 7,
+                   1);
+
+        const unsigned char* key = secret() + 11;
+        boost::uint64_t h = m_length * PRIME64_1;
+        for (int i = 0; i < 4; ++i)
+        {
+            h += multiply_fold(
+                m_lanes[2 * i] ^ read64(key + 16 * i),
+                m_lanes[2 * i + 1] ^ read64(key + 16 * i + 8));
+        }
+        return avalanche(h);
+    }
+
+    /**
+     * Mix whole stripes into the lanes, scrambling them at the end of each
+     * block.
+     */
+    void consume(const unsigned char* input, std::size_t stripes)
+    {
+        while (stripes > 0)
+        {
+            std::size_t count =
+                (std::min)(stripes, BLOCK_STRIPES - m_block_stripes);
+            accumulate(m_lanes, input,
+                       secret() + m_block_stripes * SECRET_STEP, count);
+            input += count * STRIPE_SIZE;
+            stripes -= count;
+
+            m_block_stripes += count;
+            if (m_block_stripes == BLOCK_STRIPES)
+            {
+                scramble(m_lanes, secret() + SECRET_SIZE - STRIPE_SIZE);
+                m_block_stripes = 0;
+            }
+        }
+    }
+
+    /**
+     * Mix consecutive stripes into the lanes, the key for each starting
+     * `SECRET_STEP` bytes further into the secret.
+     */
+    static void accumulate(boost::uint64_t* lanes, const unsigned char* input,
+                           const unsigned char* key, std::size_t stripes)
+    {
+#if defined(SSH_DETAIL_HASH_SSE2)
+        __m128i* pairs = reinterpret_cast<__m128i*>(lanes);
+        __m128i pair[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            pair[i] = _mm_loadu_si128(pairs + i);
+        }
+
+        for (; stripes > 0;
+             --stripes, input += STRIPE_SIZE, key += SECRET_STEP)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                __m128i data = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(input) + i);
+                __m128i keyed = _mm_xor_si128(
+                    data, _mm_loadu_si128(
+                              reinterpret_cast<const __m128i*>(key) + i));
+
+                // Low half of each lane times its high half
+                __m128i product = _mm_mul_epu32(
+                    keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+
+                // Each lane also gets the data of its neighbour
+                __m128i swapped =
+                    _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+
+                pair[i] =
+                    _mm_add_epi64(pair[i], _mm_add_epi64(product, swapped));
+            }
+        }
+
+        for (int i = 0; i < 4; ++i)
+        {
+            _mm_storeu_si128(pairs + i, pair[i]);
+        }
+#else
+        for (; stripes > 0;
+             --stripes, input += STRIPE_SIZE, key += SECRET_STEP)
+        {
+            for (int i = 0; i < 8; ++i)
+            {
+                boost::uint64_t data = read64(input + 8 * i);
+                boost::uint64_t keyed = data ^ read64(key + 8 * i);
+
+                lanes[i ^ 1] += data;
+                lanes[i] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+            }
+        }
+#endif
+    }
+
+    static void scramble(boost::uint64_t* lanes, const unsigned char* key)
+    {
+#if defined(SSH_DETAIL_HASH_SSE2)
+        __m128i* pairs = reinterpret_cast<__m128i*>(lanes);
+        const __m128i prime = _mm_set1_epi32(static_cast<int>(PRIME32_1));
+        for (int i = 0; i < 4; ++i)
+        {
+            __m128i pair = _mm_loadu_si128(pairs + i);
+            pair = _mm_xor_si128(pair, _mm_srli_epi64(pair, 47));
+            pair = _mm_xor_si128(
+                pair,
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(key) + i));
+
+            // SSE2 only multiplies 32-bit halves, so multiply each half and
+            // recombine
+            __m128i low = _mm_mul_epu32(pair, prime);
+            __m128i high = _mm_mul_epu32(
+                _mm_shuffle_epi32(pair, _MM_SHUFFLE(0, 3, 0, 1)), prime);
+            _mm_storeu_si128(pairs + i,
+                             _mm_add_epi64(low, _mm_slli_epi64(high, 32)));
+        }
+#else
+        for (int i = 0; i < 8; ++i)
+        {
+            boost::uint64_t lane = lanes[i];
+            lane ^= lane >> 47;
+            lane ^= read64(key + 8 * i);
+            lanes[i] = lane * PRIME32_1;
+        }
+#endif
+    }
+
+    boost::uint64_t m_lanes[8];
+    boost::uint64_t m_length;
+    unsigned char m_buffer[BUFFER_SIZE];
+    std::size_t m_buffered;
+    std::size_t m_block_stripes;
+};
+
+inline std::auto_ptr<hash_function>
+make_hash_function(BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    switch (algorithm)
+    {
+    case hash_algorithm::sha256:
+        return std::auto_ptr<hash_function>(new sha256_hash());
+    case hash_algorithm::md5:
+        return std::auto_ptr<hash_function>(new md5_hash());
+    case hash_algorithm::xxh64:
+        return std::auto_ptr<hash_function>(new xxh64_hash());
+    case hash_algorithm::xxh3:
+        return std::auto_ptr<hash_function>(new xxh3_hash());
+    default:
+        BOOST_THROW_EXCEPTION(
+            std::invalid_argument("Unrecognised hash algorithm"));
+    }
+}
+
+/**
+ * Digest as lowercase hexadecimal, as `sha256sum` and friends print it.
+ */
+inline std::string hex_digest(const std::vector<unsigned char>& digest)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    std::string hex;
+    hex.reserve(digest.size() * 2);
+    for (std::vector<unsigned char>::const_iterator it = digest.begin();
+         it != digest.end(); ++it)
+    {
+        hex += digits[*it >> 4];
+        hex += digits[*it & 0xf];
+    }
+    return hex;
+}
+}
+} // namespace ssh::detail
+
+#endif
@@ -38,6 +38,7 @@
 #define SSH_DETAIL_LIBSSH2_AGENT_HPP
 
 #include <ssh/ssh_error.hpp> // last_error_code, SSH_DETAIL_THROW_API_ERROR_CODE
+#include <ssh/trace.hpp>     // traced_call
 
 #include <boost/exception/info.hpp>  // errinfo_api_function
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
@@ -65,6 +66,12 @@ inline LIBSSH2_AGENT*
 init(LIBSSH2_SESSION* session, boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    // Tracing reports a failure if `ec` is set when the call ends, so an
+    // error from an earlier call mustn't be left in it
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_agent_init", ec);
+
     LIBSSH2_AGENT* agent = ::libssh2_agent_init(session);
 
     if (!agent)
@@ -101,6 +108,10 @@ connect(LIBSSH2_AGENT* agent, LIBSSH2_SESSION* session,
         boost::system::error_code& ec,
         boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_agent_connect", ec);
+
     int rc = ::libssh2_agent_connect(agent);
     if (rc < 0)
     {
@@ -136,6 +147,10 @@ inline int get_identity(
     boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_agent_get_identity", ec);
+
     int rc = ::libssh2_agent_get_identity(agent, out, previous);
     if (rc < 0)
     {
@@ -176,6 +191,10 @@ inline void list_identities(
     boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_agent_list_identities", ec);
+
     int rc = ::libssh2_agent_list_identities(agent);
 
     if (rc < 0)
@@ -209,6 +228,10 @@ userauth(LIBSSH2_AGENT* agent, LIBSSH2_SESSION* session, const char* user_name,
          libssh2_agent_publickey* identity, boost::system::error_code& ec,
          boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_agent_userauth", ec);
+
     int rc = ::libssh2_agent_userauth(agent, user_name, identity);
     if (rc < 0)
     {
@@ -38,6 +38,7 @@
 #define SSH_DETAIL_LIBSSH2_KNOWNHOST_HPP
 
 #include <ssh/ssh_error.hpp> // last_error_code, SSH_DETAIL_THROW_API_ERROR_CODE
+#include <ssh/trace.hpp>     // traced_call
 
 #include <boost/exception/info.hpp>  // errinfo_api_function
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
@@ -63,6 +64,12 @@ inline LIBSSH2_KNOWNHOSTS*
 init(LIBSSH2_SESSION* session, boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    // Tracing reports a failure if `ec` is set when the call ends, so an
+    // error from an earlier call mustn't be left in it
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_init", ec);
+
     LIBSSH2_KNOWNHOSTS* hosts = ::libssh2_knownhost_init(session);
 
     if (!hosts)
@@ -99,6 +106,10 @@ readline(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts, const char* line,
          size_t line_length, int type, boost::system::error_code& ec,
          boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_readline", ec);
+
     int rc = ::libssh2_knownhost_readline(hosts, line, line_length, type);
 
     if (rc < 0)
@@ -134,6 +145,10 @@ writeline(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts,
           size_t* written_length_out, int type, boost::system::error_code& ec,
           boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_writeline", ec);
+
     int rc = ::libssh2_knownhost_writeline(hosts, host, buffer, buffer_length,
                                            written_length_out, type);
 
@@ -175,6 +190,10 @@ get(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts,
     boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_get", ec);
+
     int rc = ::libssh2_knownhost_get(hosts, store, current_position);
 
     if (rc < 0)
@@ -215,6 +234,10 @@ add(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts, const char* host,
     libssh2_knownhost** store, boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_add", ec);
+
     int rc = ::libssh2_knownhost_add(hosts, host, salt, key, key_length,
                                      typemask, store);
 
@@ -251,6 +274,10 @@ del(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts,
     libssh2_knownhost* entry, boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_del", ec);
+
     int rc = ::libssh2_knownhost_del(hosts, entry);
 
     if (rc < 0)
@@ -285,6 +312,10 @@ check(LIBSSH2_SESSION* session, LIBSSH2_KNOWNHOSTS* hosts, const char* host,
       libssh2_knownhost** knownhost, boost::system::error_code& ec,
       boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_knownhost_check", ec);
+
     int rc = ::libssh2_knownhost_check(hosts, host, key, key_length, typemask,
                                        knownhost);
 
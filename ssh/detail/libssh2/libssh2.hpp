@@ -79,6 +79,11 @@ namespace detail
  *   the wrappers and only one thread may call these wrapper functions
  *   (or an libssh2 function) with the same session at any time.
  *
+ * - Each error-fetching wrapper reports its call to any installed tracer
+ *   (see ssh/trace.hpp) and SFTP wrappers also report to the metrics
+ *   registry (see ssh/metrics.hpp).  The exception-throwing variants call
+ *   the error-fetching ones so every call is reported exactly once.
+ *
  * Any function not able to adhere to these restrictions is not
  * eligible for inclusion in this namespace.
  *
@@ -38,6 +38,7 @@
 #define SSH_DETAIL_LIBSSH2_SESSION_HPP
 
 #include <ssh/ssh_error.hpp> // last_error_code, SSH_DETAIL_THROW_API_ERROR_CODE
+#include <ssh/trace.hpp>     // traced_call
 
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
 
@@ -78,6 +79,12 @@ inline void
 startup(LIBSSH2_SESSION* session, int socket, boost::system::error_code& ec,
         boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    // Tracing reports a failure if `ec` is set when the call ends, so an
+    // error from an earlier call mustn't be left in it
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_session_startup", ec);
+
     int rc = ::libssh2_session_startup(session, socket);
 
     if (rc != 0)
@@ -110,6 +117,10 @@ inline void disconnect(
     boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_session_disconnect", ec);
+
     int rc = ::libssh2_session_disconnect(session, description);
 
     if (rc != 0)
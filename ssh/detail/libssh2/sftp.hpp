@@ -37,8 +37,10 @@
 #ifndef SSH_DETAIL_LIBSSH2_SFTP_HPP
 #define SSH_DETAIL_LIBSSH2_SFTP_HPP
 
+#include <ssh/metrics.hpp>    // metered_sftp_call
 #include <ssh/sftp_error.hpp> // last_sftp_error_code
 #include <ssh/ssh_error.hpp>  // last_error_code
+#include <ssh/trace.hpp>      // traced_call
 
 #include <boost/optional/optional.hpp>
 #include <boost/system/error_code.hpp>
@@ -50,6 +52,11 @@
 #include <libssh2.h>      // LIBSSH2_SESSION, LIBSSH2_SFTP
 #include <libssh2_sftp.h> // libssh2_sftp_*
 
+// libssh2 1.11.1 added posix-rename@openssh.com requests
+#if LIBSSH2_VERSION_NUM >= 0x010b01
+#define SSH_DETAIL_LIBSSH2_POSIX_RENAME
+#endif
+
 // See ssh/detail/libssh2/libssh2.hpp for rules governing functions in this
 // namespace
 
@@ -69,6 +76,14 @@ inline LIBSSH2_SFTP*
 init(LIBSSH2_SESSION* session, boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    // Tracing and metrics report a failure if `ec` is set when the call
+    // ends, so an error from an earlier call mustn't be left in it
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_init", ec);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::init, ec);
+
     LIBSSH2_SFTP* sftp = ::libssh2_sftp_init(session);
     if (!sftp)
     {
@@ -101,6 +116,13 @@ open(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* filename,
      boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_open_ex", ec, filename,
+                                     filename_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::open, ec);
+
     LIBSSH2_SFTP_HANDLE* handle = ::libssh2_sftp_open_ex(
         sftp, filename, filename_len, flags, mode, open_type);
     if (!handle)
@@ -149,6 +171,18 @@ inline int symlink_ex(
     int resolve_action, boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_symlink_ex", ec, path,
+                                     path_len);
+    ::ssh::detail::metered_sftp_call call(
+        (resolve_action == LIBSSH2_SFTP_READLINK)
+            ? ::ssh::detail::sftp_operation::readlink
+            : (resolve_action == LIBSSH2_SFTP_REALPATH)
+                  ? ::ssh::detail::sftp_operation::realpath
+                  : ::ssh::detail::sftp_operation::symlink,
+        ec);
+
     // Slightly odd treatment of the return value because the success value
     // is 0 for `LIBSSH2_SFTP_SYMLINK` but >= 0 for `LIBSSH2_SFTP_READLINK` or
     // `LIBSSH2_SFTP_REALPATH`.
@@ -245,6 +279,13 @@ stat(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* path,
      boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_stat_ex", ec, path,
+                                     path_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::stat, ec);
+
     int rc =
         ::libssh2_sftp_stat_ex(sftp, path, path_len, stat_type, attributes);
     if (rc < 0)
@@ -282,6 +323,12 @@ fstat(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, LIBSSH2_SFTP_HANDLE* handle,
       boost::system::error_code& ec,
       boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_fstat_ex", ec);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::fstat, ec);
+
     int rc = ::libssh2_sftp_fstat_ex(handle, attributes, fstat_type);
     if (rc != 0)
     {
@@ -316,6 +363,13 @@ unlink_ex(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* path,
           unsigned int path_len, boost::system::error_code& ec,
           boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_unlink_ex", ec, path,
+                                     path_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::unlink, ec);
+
     int rc = ::libssh2_sftp_unlink_ex(sftp, path, path_len);
     if (rc < 0)
     {
@@ -350,6 +404,13 @@ mkdir_ex(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* path,
          unsigned int path_len, long mode, boost::system::error_code& ec,
          boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_mkdir_ex", ec, path,
+                                     path_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::mkdir, ec);
+
     int rc = ::libssh2_sftp_mkdir_ex(sftp, path, path_len, mode);
     if (rc < 0)
     {
@@ -384,6 +445,13 @@ rmdir_ex(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* path,
          unsigned int path_len, boost::system::error_code& ec,
          boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_rmdir_ex", ec, path,
+                                     path_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::rmdir, ec);
+
     int rc = ::libssh2_sftp_rmdir_ex(sftp, path, path_len);
     if (rc < 0)
     {
@@ -419,6 +487,13 @@ rename(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* source,
        unsigned int destination_len, long flags, boost::system::error_code& ec,
        boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_rename_ex", ec, source,
+                                     source_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::rename, ec);
+
     int rc = ::libssh2_sftp_rename_ex(sftp, source, source_len, destination,
                                       destination_len, flags);
     if (rc)
@@ -449,6 +524,38 @@ inline void rename(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp,
     }
 }
 
+#ifdef SSH_DETAIL_LIBSSH2_POSIX_RENAME
+
+/**
+ * Error-fetching wrapper around libssh2_sftp_posix_rename_ex.
+ *
+ * Servers without the posix-rename@openssh.com extension fail with
+ * `LIBSSH2_FX_OP_UNSUPPORTED`.
+ */
+inline void posix_rename(
+    LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp, const char* source,
+    unsigned int source_len, const char* destination,
+    unsigned int destination_len, boost::system::error_code& ec,
+    boost::optional<std::string&> e_msg = boost::optional<std::string&>())
+{
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_posix_rename_ex", ec,
+                                     source, source_len);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::extended, ec);
+
+    int rc = ::libssh2_sftp_posix_rename_ex(sftp, source, source_len,
+                                            destination, destination_len);
+    if (rc)
+    {
+        ec =
+            ssh::filesystem::detail::last_sftp_error_code(session, sftp, e_msg);
+    }
+}
+
+#endif
+
 /**
  * Error-fetching wrapper around libssh2_sftp_read.
  */
@@ -458,7 +565,15 @@ read(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp,
      boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_read", ec);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::read, ec);
+
     ssize_t count = ::libssh2_sftp_read(file_handle, buffer, buffer_len);
+    call.transferred(count);
+    trace.transferred(count);
     if (count < 0)
     {
         ec = ::ssh::filesystem::detail::last_sftp_error_code(session, sftp,
@@ -498,7 +613,15 @@ write(LIBSSH2_SESSION* session, LIBSSH2_SFTP* sftp,
       boost::system::error_code& ec,
       boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_write", ec);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::write, ec);
+
     ssize_t count = ::libssh2_sftp_write(file_handle, data, data_len);
+    call.transferred(count);
+    trace.transferred(count);
     if (count < 0)
     {
         ec = ::ssh::filesystem::detail::last_sftp_error_code(session, sftp,
@@ -538,6 +661,12 @@ inline int readdir_ex(
     LIBSSH2_SFTP_ATTRIBUTES* attrs, boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_sftp_readdir_ex", ec);
+    ::ssh::detail::metered_sftp_call call(
+        ::ssh::detail::sftp_operation::readdir, ec);
+
     int rc = ::libssh2_sftp_readdir_ex(handle, buffer, buffer_len, longentry,
                                        longentry_len, attrs);
 
@@ -38,12 +38,15 @@
 #define SSH_DETAIL_LIBSSH2_USERAUTH_HPP
 
 #include <ssh/ssh_error.hpp> // last_error_code, SSH_DETAIL_THROW_API_ERROR_CODE
+#include <ssh/trace.hpp>     // traced_call
 
 #include <boost/exception/info.hpp> // errinfo_api_function
 #include <boost/optional/optional.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
 
+#include <cstring> // strlen
+
 #include <libssh2.h> // LIBSSH2_SESSION, libssh2_userauth_*
 
 // See ssh/detail/libssh2/libssh2.hpp for rules governing functions in this
@@ -69,6 +72,12 @@ list(LIBSSH2_SESSION* session, const char* username, unsigned int username_len,
      boost::system::error_code& ec,
      boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    // Tracing reports a failure if `ec` is set when the call ends, so an
+    // error from an earlier call mustn't be left in it
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_userauth_list", ec);
+
     const char* method_list =
         ::libssh2_userauth_list(session, username, username_len);
 
@@ -112,6 +121,10 @@ password(LIBSSH2_SESSION* session, const char* username, size_t username_len,
          boost::system::error_code& ec,
          boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_userauth_password_ex", ec);
+
     int rc = ::libssh2_userauth_password_ex(session, username, username_len,
                                             password, password_len,
                                             passwd_change_cb);
@@ -152,6 +165,11 @@ inline void keyboard_interactive_ex(
     boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_userauth_keyboard_interactive_ex",
+                                     ec);
+
     int rc = ::libssh2_userauth_keyboard_interactive_ex(
         session, username, username_len, response_callback);
 
@@ -190,6 +208,12 @@ inline void public_key_from_file(
     const char* passphrase, boost::system::error_code& ec,
     boost::optional<std::string&> e_msg = boost::optional<std::string&>())
 {
+    ec.clear();
+
+    ::ssh::detail::traced_call trace("libssh2_userauth_publickey_fromfile_ex",
+                                     ec, private_key_path,
+                                     std::strlen(private_key_path));
+
     int rc = libssh2_userauth_publickey_fromfile_ex(
         session, username, username_len, public_key_path, private_key_path,
         passphrase);
@@ -0,0 +1,1219 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * SFTP client speaking the protocol itself over a session channel.
+ */
+
+#ifndef SSH_DETAIL_NATIVE_SFTP_STATE_HPP
+#define SSH_DETAIL_NATIVE_SFTP_STATE_HPP
+
+#include <ssh/detail/exec_channel_state.hpp>
+#include <ssh/detail/sftp_packet.hpp>
+#include <ssh/detail/session_state.hpp>
+#include <ssh/metrics.hpp>     // metered_sftp_call, sftp_operation
+#include <ssh/sftp_engine.hpp> // sftp_limits
+#include <ssh/sftp_error.hpp>  // sftp_error_category
+#include <ssh/ssh_error.hpp>   // SSH_DETAIL_THROW_API_ERROR_CODE_WITH_PATH
+#include <ssh/trace.hpp>       // traced_call
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp> // uint32_t, uint64_t
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/locks.hpp> // lock_guard
+#include <boost/thread/mutex.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // min
+#include <cstddef>   // size_t
+#include <cstring>   // memcpy
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <libssh2_sftp.h> // LIBSSH2_SFTP_ATTRIBUTES, LIBSSH2_SFTP_STATVFS,
+                          // LIBSSH2_FX_*
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * One entry of a directory listing.
+ */
+struct native_sftp_entry
+{
+    std::string filename;
+    std::string long_entry;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+};
+
+/**
+ * File data asked for, or sent, in one READ or WRITE request when the server
+ * doesn't say how much it allows.
+ *
+ * Every server must accept this much.
+ */
+const std::size_t NATIVE_SFTP_CHUNK_SIZE = 32 * 1024;
+
+/**
+ * Largest READ or WRITE request made, however much the server allows.
+ *
+ * Keeps the data in a full pipeline of requests to 16 MiB.  OpenSSH allows
+ * a little less than this.
+ */
+const std::size_t NATIVE_SFTP_MAXIMUM_CHUNK_SIZE = 256 * 1024;
+
+/**
+ * Room left in a WRITE request's packet for everything except its data.
+ */
+const std::size_t NATIVE_SFTP_WRITE_OVERHEAD = 1024;
+
+/**
+ * Most READ or WRITE requests a single call keeps waiting for a reply at
+ * once.
+ */
+const std::size_t NATIVE_SFTP_MAXIMUM_PIPELINE = 64;
+
+/**
+ * Largest reply accepted from the server.
+ *
+ * Anything longer means the channel is out of step with the packets on it.
+ */
+const std::size_t NATIVE_SFTP_MAXIMUM_PACKET_SIZE = 1024 * 1024;
+
+/**
+ * The limits every SFTP server must accept, used until a server reports its
+ * own.
+ */
+inline ::ssh::filesystem::sftp_limits default_sftp_limits()
+{
+    ::ssh::filesystem::sftp_limits limits;
+    limits.max_packet_length = 34000;
+    limits.max_read_length = NATIVE_SFTP_CHUNK_SIZE;
+    limits.max_write_length = NATIVE_SFTP_CHUNK_SIZE;
+    limits.max_open_handles = 0;
+
+    return limits;
+}
+
+/**
+ * SFTP version 3 client on its own channel, running the "sftp" subsystem.
+ *
+ * Unlike libssh2's SFTP layer, requests are tagged with their ID and sent
+ * without waiting for earlier ones to be answered.  Replies are matched to
+ * requests by that ID, whatever order they arrive in.  Bulk reads and writes
+ * therefore keep many requests in flight, and so do requests from different
+ * threads using the engine at once.
+ *
+ * Whichever thread is waiting for a reply reads the next packet off the
+ * channel.  A reply to someone else's request is kept for them to collect.
+ * Replies are parsed in the buffer they were read into, so file data is
+ * only copied once, into the caller's buffer.
+ *
+ * If a call fails part way through sending or reading a packet, the channel
+ * is out of step with the packets on it, so the engine is broken and every
+ * later call fails.  A call that fails with requests still in flight has
+ * their replies thrown away when they arrive.
+ *
+ * The server's extensions are discovered when the engine starts and can be
+ * used through methods for the ones this engine knows about.  If the server
+ * reports its limits, READ and WRITE requests are made as large as it
+ * allows.
+ */
+class native_sftp_state : private boost::noncopyable
+{
+    //
+    // Intentionally not movable to prevent the public classes that own
+    // this object moving it when they are themselves moved.  This object
+    // is referenced by other classes that don't own it so the owning classes
+    // need to leave it where it is when they move so as not to invalidate
+    // the other references.  Making this non-copyable, non-movable enforces
+    // that.
+    //
+public:
+    /// Extension name mapped to the data the server sent with it.
+    typedef std::map<std::string, std::string> extension_map;
+
+    explicit native_sftp_state(session_state& session)
+        : m_channel(session, "subsystem", "sftp"),
+          m_next_id(0),
+          m_broken(false),
+          m_limits(default_sftp_limits()),
+          m_read_chunk_size(NATIVE_SFTP_CHUNK_SIZE),
+          m_write_chunk_size(NATIVE_SFTP_CHUNK_SIZE)
+    {
+        negotiate_version();
+
+        if (has_extension("limits@openssh.com"))
+        {
+            query_limits();
+        }
+    }
+
+    /**
+     * Extensions the server announced when the engine started.
+     */
+    const extension_map& extensions() const
+    {
+        return m_extensions;
+    }
+
+    bool has_extension(const std::string& name) const
+    {
+        return m_extensions.find(name) != m_extensions.end();
+    }
+
+    /**
+     * Limits the server reported when the engine started, or the defaults
+     * for fields it didn't report.
+     */
+    const ::ssh::filesystem::sftp_limits& limits() const
+    {
+        return m_limits;
+    }
+
+    /**
+     * File data asked for in each READ request.
+     */
+    std::size_t read_chunk_size() const
+    {
+        return m_read_chunk_size;
+    }
+
+    /**
+     * File data sent in each WRITE request.
+     */
+    std::size_t write_chunk_size() const
+    {
+        return m_write_chunk_size;
+    }
+
+    /**
+     * Open a file.
+     *
+     * @param flags  `LIBSSH2_FXF_*` flags, which are the protocol's own.
+     *
+     * @returns the server's handle for the open file.
+     */
+    std::string open(const std::string& path, unsigned long flags, long mode)
+    {
+        LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+        attributes.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+        attributes.permissions = mode;
+
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::open);
+        request.string(path);
+        request.uint32(static_cast<boost::uint32_t>(flags));
+        request.attributes(attributes);
+
+        std::vector<char> reply;
+        transact(sftp_operation::open, "SSH_FXP_OPEN", request,
+                 sftp_packet_type::handle, path, reply);
+
+        return body(reply).string().str();
+    }
+
+    std::string open_directory(const std::string& path)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::opendir);
+        request.string(path);
+
+        std::vector<char> reply;
+        transact(sftp_operation::open, "SSH_FXP_OPENDIR", request,
+                 sftp_packet_type::handle, path, reply);
+
+        return body(reply).string().str();
+    }
+
+    void close(const std::string& handle)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::close);
+        request.string(handle);
+
+        boost::system::error_code ec;
+        std::string message;
+        std::vector<char> reply = send_and_receive(request);
+        if (!parse_reply(reply, sftp_packet_type::status, ec, message))
+        {
+            SSH_DETAIL_THROW_API_ERROR_CODE(ec, message, "SSH_FXP_CLOSE");
+        }
+    }
+
+    /**
+     * Read from an open file, keeping many requests in flight for large
+     * reads.
+     *
+     * @returns the number of bytes read, which is less than `size` if the
+     *          file ended or the server sent less than asked for.  Returns 0
+     *          only at the end of the file.
+     */
+    std::size_t read(const std::string& handle, boost::uint64_t offset,
+                     char* buffer, std::size_t size)
+    {
+        boost::system::error_code ec;
+        std::string message;
+        metered_sftp_call call(sftp_operation::read, ec);
+        traced_call trace("SSH_FXP_READ", ec);
+
+        std::deque<chunk> pending;
+        std::size_t requested = 0;
+        std::size_t count = 0;
+        bool complete = false;
+
+        try
+        {
+            while (!pending.empty() || (requested < size && !complete))
+            {
+                while (!complete && requested < size &&
+                       pending.size() < NATIVE_SFTP_MAXIMUM_PIPELINE)
+                {
+                    std::size_t length =
+                        (std::min)(size - requested, m_read_chunk_size);
+
+                    sftp_packet_writer request;
+                    chunk next(start_request(request, sftp_packet_type::read),
+                               requested, length);
+                    request.string(handle);
+                    request.uint64(offset + requested);
+                    request.uint32(static_cast<boost::uint32_t>(length));
+                    send(request);
+
+                    pending.push_back(next);
+                    requested += length;
+                }
+
+                chunk current = pending.front();
+                std::vector<char> reply = receive(current.id);
+                pending.pop_front();
+
+                boost::system::error_code chunk_ec;
+                std::string chunk_message;
+                if (parse_reply(reply, sftp_packet_type::data, chunk_ec,
+                                chunk_message))
+                {
+                    sftp_slice data = body(reply).string();
+                    if (data.size > current.length)
+                    {
+                        BOOST_THROW_EXCEPTION(sftp_protocol_error(
+                            "Server sent more data than asked for"));
+                    }
+
+                    // Once one chunk falls short, later chunks no longer
+                    // follow on from what was read, so are collected but not
+                    // used
+                    if (!complete)
+                    {
+                        std::memcpy(buffer + current.offset, data.data,
+                                    data.size);
+                        count += data.size;
+                        complete = data.size < current.length;
+                    }
+                }
+                else
+                {
+                    if (!complete && !ec &&
+                        chunk_ec.value() != static_cast<int>(LIBSSH2_FX_EOF))
+                    {
+                        ec = chunk_ec;
+                        message = chunk_message;
+                    }
+                    complete = true;
+                }
+            }
+        }
+        catch (...)
+        {
+            for (std::size_t i = 0; i < pending.size(); ++i)
+            {
+                abandon(pending[i].id);
+            }
+            throw;
+        }
+
+        call.transferred(count);
+        trace.transferred(count);
+
+        if (ec)
+        {
+            SSH_DETAIL_THROW_API_ERROR_CODE(ec, message, "SSH_FXP_READ");
+        }
+
+        return count;
+    }
+
+    /**
+     * Write to an open file, keeping many requests in flight for large
+     * writes.
+     *
+     * Either all the data is written or an exception is thrown.
+     */
+    void write(const std::string& handle, boost::uint64_t offset,
+               const char* data, std::size_t size)
+    {
+        boost::system::error_code ec;
+        std::string message;
+        metered_sftp_call call(sftp_operation::write, ec);
+        traced_call trace("SSH_FXP_WRITE", ec);
+
+        std::deque<boost::uint32_t> pending;
+        std::size_t sent = 0;
+
+        try
+        {
+            while (!pending.empty() || sent < size)
+            {
+                while (sent < size &&
+                       pending.size() < NATIVE_SFTP_MAXIMUM_PIPELINE)
+                {
+                    std::size_t length =
+                        (std::min)(size - sent, m_write_chunk_size);
+
+                    sftp_packet_writer request;
+                    boost::uint32_t id =
+                        start_request(request, sftp_packet_type::write);
+                    request.string(handle);
+                    request.uint64(offset + sent);
+                    request.string(data + sent, length);
+                    send(request);
+
+                    pending.push_back(id);
+                    sent += length;
+                }
+
+                std::vector<char> reply = receive(pending.front());
+                pending.pop_front();
+
+                boost::system::error_code chunk_ec;
+                std::string chunk_message;
+                if (!parse_reply(reply, sftp_packet_type::status, chunk_ec,
+                                 chunk_message) &&
+                    !ec)
+                {
+                    // Later chunks are already on their way and must still be
+                    // collected, so the first failure is thrown once they are
+                    ec = chunk_ec;
+                    message = chunk_message;
+                }
+            }
+        }
+        catch (...)
+        {
+            for (std::size_t i = 0; i < pending.size(); ++i)
+            {
+                abandon(pending[i]);
+            }
+            throw;
+        }
+
+        if (ec)
+        {
+            SSH_DETAIL_THROW_API_ERROR_CODE(ec, message, "SSH_FXP_WRITE");
+        }
+
+        call.transferred(size);
+        trace.transferred(size);
+    }
+
+    /**
+     * Read the next batch of entries from an open directory.
+     *
+     * @returns false, adding nothing, once the listing has ended.
+     */
+    bool read_directory(const std::string& handle,
+                        std::deque<native_sftp_entry>& entries)
+    {
+        boost::system::error_code ec;
+        std::string message;
+        metered_sftp_call call(sftp_operation::readdir, ec);
+        traced_call trace("SSH_FXP_READDIR", ec);
+
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::readdir);
+        request.string(handle);
+
+        std::vector<char> reply = send_and_receive(request);
+        if (!parse_reply(reply, sftp_packet_type::name, ec, message))
+        {
+            if (ec.value() == static_cast<int>(LIBSSH2_FX_EOF))
+            {
+                ec.clear();
+                return false;
+            }
+            SSH_DETAIL_THROW_API_ERROR_CODE(ec, message, "SSH_FXP_READDIR");
+        }
+
+        sftp_packet_reader reader = body(reply);
+        boost::uint32_t count = reader.uint32();
+        for (boost::uint32_t i = 0; i < count; ++i)
+        {
+            native_sftp_entry entry;
+            entry.filename = reader.string().str();
+            entry.long_entry = reader.string().str();
+            entry.attributes = reader.attributes();
+            entries.push_back(entry);
+        }
+
+        return true;
+    }
+
+    /**
+     * Attributes of a file, or of a link itself if `follow_links` is false.
+     */
+    LIBSSH2_SFTP_ATTRIBUTES stat(const std::string& path, bool follow_links,
+                                 boost::system::error_code& ec,
+                                 std::string& message)
+    {
+        ec.clear();
+
+        sftp_packet_writer request;
+        start_request(request, (follow_links) ? sftp_packet_type::stat
+                                              : sftp_packet_type::lstat);
+        request.string(path);
+
+        metered_sftp_call call(sftp_operation::stat, ec);
+        traced_call trace("SSH_FXP_STAT", ec, path.data(), path.size());
+
+        std::vector<char> reply = send_and_receive(request);
+        if (!parse_reply(reply, sftp_packet_type::attrs, ec, message))
+        {
+            return LIBSSH2_SFTP_ATTRIBUTES();
+        }
+
+        return body(reply).attributes();
+    }
+
+    LIBSSH2_SFTP_ATTRIBUTES stat(const std::string& path, bool follow_links)
+    {
+        boost::system::error_code ec;
+        std::string message;
+
+        LIBSSH2_SFTP_ATTRIBUTES attributes =
+            stat(path, follow_links, ec, message);
+        if (ec)
+        {
+            SSH_DETAIL_THROW_API_ERROR_CODE_WITH_PATH(
+                ec, message, "SSH_FXP_STAT", path.data(), path.size());
+        }
+
+        return attributes;
+    }
+
+    LIBSSH2_SFTP_ATTRIBUTES fstat(const std::string& handle)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::fstat);
+        request.string(handle);
+
+        std::vector<char> reply;
+        transact(sftp_operation::fstat, "SSH_FXP_FSTAT", request,
+                 sftp_packet_type::attrs, std::string(), reply);
+
+        return body(reply).attributes();
+    }
+
+    /**
+     * Change the attributes named by `attributes.flags`.
+     */
+    void setstat(const std::string& path,
+                 const LIBSSH2_SFTP_ATTRIBUTES& attributes)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::setstat);
+        request.string(path);
+        request.attributes(attributes);
+
+        std::vector<char> reply;
+        transact(sftp_operation::stat, "SSH_FXP_SETSTAT", request,
+                 sftp_packet_type::status, path, reply);
+    }
+
+    void make_directory(const std::string& path, long mode)
+    {
+        LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+        attributes.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+        attributes.permissions = mode;
+
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::mkdir);
+        request.string(path);
+        request.attributes(attributes);
+
+        std::vector<char> reply;
+        transact(sftp_operation::mkdir, "SSH_FXP_MKDIR", request,
+                 sftp_packet_type::status, path, reply);
+    }
+
+    void remove_directory(const std::string& path)
+    {
+        path_request(sftp_operation::rmdir, "SSH_FXP_RMDIR",
+                     sftp_packet_type::rmdir, path);
+    }
+
+    void remove_file(const std::string& path)
+    {
+        path_request(sftp_operation::unlink, "SSH_FXP_REMOVE",
+                     sftp_packet_type::remove, path);
+    }
+
+    /**
+     * Rename as version 3 of the protocol defines it, which fails if
+     * `destination` exists.
+     */
+    void rename(const std::string& source, const std::string& destination)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::rename);
+        request.string(source);
+        request.string(destination);
+
+        std::vector<char> reply;
+        transact(sftp_operation::rename, "SSH_FXP_RENAME", request,
+                 sftp_packet_type::status, source, reply);
+    }
+
+    /**
+     * Create a symbolic link.
+     *
+     * The paths are sent in the same order libssh2 sends them, so links
+     * come out the same whichever engine made them.
+     */
+    void symlink(const std::string& link, const std::string& target)
+    {
+        sftp_packet_writer request;
+        start_request(request, sftp_packet_type::symlink);
+        request.string(link);
+        request.string(target);
+
+        std::vector<char> reply;
+        transact(sftp_operation::symlink, "SSH_FXP_SYMLINK", request,
+                 sftp_packet_type::status, link, reply);
+    }
+
+    std::string readlink(const std::string& path)
+    {
+        return resolve(sftp_operation::readlink, "SSH_FXP_READLINK",
+                       sftp_packet_type::readlink, path);
+    }
+
+    std::string realpath(const std::string& path)
+    {
+        return resolve(sftp_operation::realpath, "SSH_FXP_REALPATH",
+                       sftp_packet_type::realpath, path);
+    }
+
+    /**
+     * Rename with POSIX semantics, atomically replacing any existing
+     * `destination`.
+     *
+     * Needs the server's "posix-rename@openssh.com" extension.
+     */
+    void posix_rename(const std::string& source,
+                      const std::string& destination)
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "posix-rename@openssh.com");
+        request.string(source);
+        request.string(destination);
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "posix-rename@openssh.com",
+                 request, sftp_packet_type::status, source, reply);
+    }
+
+    /**
+     * Flush an open file to the server's disk.
+     *
+     * Needs the server's "fsync@openssh.com" extension.
+     */
+    void fsync(const std::string& handle)
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "fsync@openssh.com");
+        request.string(handle);
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "fsync@openssh.com", request,
+                 sftp_packet_type::status, std::string(), reply);
+    }
+
+    /**
+     * Statistics of the filesystem holding `path`.
+     *
+     * Needs the server's "statvfs@openssh.com" extension.
+     */
+    LIBSSH2_SFTP_STATVFS statvfs(const std::string& path)
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "statvfs@openssh.com");
+        request.string(path);
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "statvfs@openssh.com", request,
+                 sftp_packet_type::extended_reply, path, reply);
+
+        sftp_packet_reader reader = body(reply);
+
+        LIBSSH2_SFTP_STATVFS statistics = LIBSSH2_SFTP_STATVFS();
+        statistics.f_bsize = reader.uint64();
+        statistics.f_frsize = reader.uint64();
+        statistics.f_blocks = reader.uint64();
+        statistics.f_bfree = reader.uint64();
+        statistics.f_bavail = reader.uint64();
+        statistics.f_files = reader.uint64();
+        statistics.f_ffree = reader.uint64();
+        statistics.f_favail = reader.uint64();
+        statistics.f_fsid = reader.uint64();
+        statistics.f_flag = reader.uint64();
+        statistics.f_namemax = reader.uint64();
+
+        return statistics;
+    }
+
+    /**
+     * Copy data between open files on the server, without it crossing the
+     * connection.
+     *
+     * A `length` of 0 copies to the end of the source file.  Needs the
+     * server's "copy-data" extension.
+     */
+    void copy_data(const std::string& source_handle,
+                   boost::uint64_t source_offset, boost::uint64_t length,
+                   const std::string& destination_handle,
+                   boost::uint64_t destination_offset)
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "copy-data");
+        request.string(source_handle);
+        request.uint64(source_offset);
+        request.uint64(length);
+        request.string(destination_handle);
+        request.uint64(destination_offset);
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "copy-data", request,
+                 sftp_packet_type::status, std::string(), reply);
+    }
+
+    /**
+     * Hash of a whole file's contents, computed by the server.
+     *
+     * Needs the server's "check-file" extension.
+     *
+     * @param algorithms  Comma-separated names of hashes the server may use,
+     *                    such as "sha256" or "md5", most preferred first.
+     * @param[out] algorithm  The one it used.
+     */
+    std::vector<unsigned char> check_file(const std::string& path,
+                                          const std::string& algorithms,
+                                          std::string& algorithm)
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "check-file-name");
+        request.string(path);
+        request.string(algorithms);
+        request.uint64(0); // From the start
+        request.uint64(0); // To the end
+        request.uint32(0); // In one block
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "check-file-name", request,
+                 sftp_packet_type::extended_reply, path, reply);
+
+        sftp_packet_reader reader = body(reply);
+        reader.string(); // "check-file"
+        algorithm = reader.string().str();
+
+        // The hash is the rest of the reply, not a string
+        const unsigned char* hash =
+            reinterpret_cast<const unsigned char*>(&reply[0]) +
+            (reply.size() - reader.remaining());
+        return std::vector<unsigned char>(hash, hash + reader.remaining());
+    }
+
+private:
+    /**
+     * A READ request waiting for its reply.
+     */
+    struct chunk
+    {
+        chunk(boost::uint32_t id, std::size_t offset, std::size_t length)
+            : id(id), offset(offset), length(length)
+        {
+        }
+
+        boost::uint32_t id;
+
+        /// Where the data goes in the caller's buffer.
+        std::size_t offset;
+
+        std::size_t length;
+    };
+
+    /// Bytes before the fields of a reply: its type and request ID.
+    static const std::size_t REPLY_HEADER_SIZE = 5;
+
+    void negotiate_version()
+    {
+        sftp_packet_writer init;
+        init.start(sftp_packet_type::init);
+        init.uint32(SFTP_PROTOCOL_VERSION);
+        send(init);
+
+        std::vector<char> packet;
+        read_packet(packet);
+
+        sftp_packet_reader reader(&packet[0], packet.size());
+        if (reader.byte() != sftp_packet_type::version)
+        {
+            BOOST_THROW_EXCEPTION(sftp_protocol_error(
+                "Server didn't start with SSH_FXP_VERSION"));
+        }
+
+        if (reader.uint32() < SFTP_PROTOCOL_VERSION)
+        {
+            BOOST_THROW_EXCEPTION(sftp_protocol_error(
+                "Server doesn't support SFTP version 3"));
+        }
+
+        while (!reader.at_end())
+        {
+            std::string name = reader.string().str();
+            m_extensions[name] = reader.string().str();
+        }
+    }
+
+    /**
+     * Ask the server for its limits and size READ and WRITE requests to
+     * them.
+     *
+     * A limit the server sends as 0 isn't enforced, so the default stays.
+     */
+    void query_limits()
+    {
+        sftp_packet_writer request;
+        start_extended_request(request, "limits@openssh.com");
+
+        std::vector<char> reply;
+        transact(sftp_operation::extended, "limits@openssh.com", request,
+                 sftp_packet_type::extended_reply, std::string(), reply);
+
+        sftp_packet_reader reader = body(reply);
+        boost::uint64_t packet_length = reader.uint64();
+        boost::uint64_t read_length = reader.uint64();
+        boost::uint64_t write_length = reader.uint64();
+        boost::uint64_t open_handles = reader.uint64();
+
+        if (packet_length != 0)
+        {
+            m_limits.max_packet_length = packet_length;
+        }
+
+        if (read_length != 0)
+        {
+            m_limits.max_read_length = read_length;
+        }
+
+        if (write_length != 0)
+        {
+            m_limits.max_write_length = write_length;
+        }
+
+        m_limits.max_open_handles = open_handles;
+
+        m_read_chunk_size = chunk_size(m_limits.max_read_length);
+
+        // The data has to fit in a packet with the rest of the request
+        boost::uint64_t write_room = m_limits.max_write_length;
+        if (m_limits.max_packet_length > NATIVE_SFTP_WRITE_OVERHEAD)
+        {
+            write_room =
+                (std::min)(write_room, m_limits.max_packet_length -
+                                           NATIVE_SFTP_WRITE_OVERHEAD);
+        }
+        m_write_chunk_size = chunk_size(write_room);
+    }
+
+    static std::size_t chunk_size(boost::uint64_t limit)
+    {
+        return static_cast<std::size_t>((std::min)(
+            limit,
+            static_cast<boost::uint64_t>(NATIVE_SFTP_MAXIMUM_CHUNK_SIZE)));
+    }
+
+    /**
+     * Begin a request, giving it the next ID.
+     *
+     * @returns the ID.
+     */
+    boost::uint32_t start_request(sftp_packet_writer& request,
+                                  sftp_packet_type::type type)
+    {
+        boost::uint32_t id = m_next_id.fetch_add(1);
+
+        request.start(type);
+        request.uint32(id);
+
+        return id;
+    }
+
+    boost::uint32_t start_extended_request(sftp_packet_writer& request,
+                                           const char* extension)
+    {
+        boost::uint32_t id =
+            start_request(request, sftp_packet_type::extended);
+        request.string(std::string(extension));
+
+        return id;
+    }
+
+    /**
+     * Send a request whose reply is a status or one path, throwing any error.
+     */
+    void path_request(sftp_operation::type operation, const char* name,
+                      sftp_packet_type::type type, const std::string& path)
+    {
+        sftp_packet_writer request;
+        start_request(request, type);
+        request.string(path);
+
+        std::vector<char> reply;
+        transact(operation, name, request, sftp_packet_type::status, path,
+                 reply);
+    }
+
+    std::string resolve(sftp_operation::type operation, const char* name,
+                        sftp_packet_type::type type, const std::string& path)
+    {
+        sftp_packet_writer request;
+        start_request(request, type);
+        request.string(path);
+
+        std::vector<char> reply;
+        transact(operation, name, request, sftp_packet_type::name, path,
+                 reply);
+
+        sftp_packet_reader reader = body(reply);
+        if (reader.uint32() < 1)
+        {
+            BOOST_THROW_EXCEPTION(
+                sftp_protocol_error("Server resolved path to no name"));
+        }
+
+        return reader.string().str();
+    }
+
+    /**
+     * Send a request and wait for the reply it expects, throwing the error
+     * the server sends instead, if any.
+     */
+    void transact(sftp_operation::type operation, const char* name,
+                  sftp_packet_writer& request, sftp_packet_type::type expected,
+                  const std::string& path, std::vector<char>& reply)
+    {
+        boost::system::error_code ec;
+        std::string message;
+        metered_sftp_call call(operation, ec);
+        traced_call trace(name, ec, path.data(), path.size());
+
+        send_and_receive(request).swap(reply);
+        if (!parse_reply(reply, expected, ec, message))
+        {
+            SSH_DETAIL_THROW_API_ERROR_CODE_WITH_PATH(ec, message, name,
+                                                      path.data(), path.size());
+        }
+    }
+
+    std::vector<char> send_and_receive(sftp_packet_writer& request)
+    {
+        boost::uint32_t id =
+            sftp_packet_reader::load_uint32(request.data() +
+                                            sftp_packet_writer::LENGTH_SIZE +
+                                            1);
+        send(request);
+        return receive(id);
+    }
+
+    /**
+     * Check a reply is the expected one, rather than an error status.
+     *
+     * The reply is checked where it lies, so callers go on to read the
+     * fields of an expected reply from the same buffer.
+     *
+     * @param[out] ec  The error if it isn't the expected reply.
+     */
+    static bool parse_reply(const std::vector<char>& reply,
+                            sftp_packet_type::type expected,
+                            boost::system::error_code& ec,
+                            std::string& message)
+    {
+        sftp_packet_reader reader(&reply[0], reply.size());
+        boost::uint8_t type = reader.byte();
+        reader.uint32(); // ID
+
+        if (type == sftp_packet_type::status)
+        {
+            boost::uint32_t code = reader.uint32();
+
+            // Servers from before version 3 may not send a message
+            if (!reader.at_end())
+            {
+                message = reader.string().str();
+            }
+
+            if (code != LIBSSH2_FX_OK)
+            {
+                ec = boost::system::error_code(
+                    static_cast<int>(code),
+                    ::ssh::filesystem::sftp_error_category());
+                return false;
+            }
+            else if (expected != sftp_packet_type::status)
+            {
+                BOOST_THROW_EXCEPTION(
+                    sftp_protocol_error("Server reported success without "
+                                        "sending the result"));
+            }
+        }
+        else if (type != expected)
+        {
+            BOOST_THROW_EXCEPTION(
+                sftp_protocol_error("Server sent the wrong kind of reply"));
+        }
+
+        return true;
+    }
+
+    /**
+     * Reader positioned at the first field of a reply.
+     */
+    static sftp_packet_reader body(const std::vector<char>& reply)
+    {
+        return sftp_packet_reader(&reply[REPLY_HEADER_SIZE],
+                                  reply.size() - REPLY_HEADER_SIZE);
+    }
+
+    void send(sftp_packet_writer& request)
+    {
+        const char* data = request.data();
+        std::size_t size = request.size();
+
+        // Packets from different threads must not interleave
+        boost::lock_guard<boost::mutex> lock(m_send_mutex);
+
+        check_not_broken();
+
+        std::size_t sent = 0;
+        try
+        {
+            while (sent < size)
+            {
+                sent += m_channel.write(data + sent, size - sent);
+            }
+        }
+        catch (...)
+        {
+            // The server would take the next packet as the rest of this one
+            if (sent > 0)
+            {
+                m_broken = true;
+            }
+            throw;
+        }
+    }
+
+    /**
+     * Wait for the reply to a request.
+     *
+     * Replies to other requests that arrive first are kept for the threads
+     * that sent them.  If waiting fails, the reply is thrown away when it
+     * arrives.
+     */
+    std::vector<char> receive(boost::uint32_t id)
+    {
+        boost::lock_guard<boost::mutex> lock(m_receive_mutex);
+
+        try
+        {
+            return receive_locked(id);
+        }
+        catch (...)
+        {
+            abandon_locked(id);
+            throw;
+        }
+    }
+
+    std::vector<char> receive_locked(boost::uint32_t id)
+    {
+        for (;;)
+        {
+            std::vector<char> packet;
+
+            // Another thread may have broken the engine while this one
+            // waited for the lock
+            check_not_broken();
+
+            // Another thread may have read it while this one waited for
+            // the lock
+            std::map<boost::uint32_t, std::vector<char> >::iterator kept =
+                m_replies.find(id);
+            if (kept != m_replies.end())
+            {
+                packet.swap(kept->second);
+                m_replies.erase(kept);
+                return packet;
+            }
+
+            read_packet(packet);
+            if (packet.size() < REPLY_HEADER_SIZE)
+            {
+                // Whoever is waiting for it can never be told
+                m_broken = true;
+                BOOST_THROW_EXCEPTION(
+                    sftp_protocol_error("SFTP reply too short"));
+            }
+
+            boost::uint32_t reply_id =
+                sftp_packet_reader::load_uint32(&packet[1]);
+            if (reply_id == id)
+            {
+                return packet;
+            }
+
+            std::set<boost::uint32_t>::iterator abandoned =
+                m_abandoned.find(reply_id);
+            if (abandoned != m_abandoned.end())
+            {
+                m_abandoned.erase(abandoned);
+            }
+            else
+            {
+                m_replies[reply_id].swap(packet);
+            }
+        }
+    }
+
+    /**
+     * Throw away the reply to a request no one will collect, whether it has
+     * arrived or is still to come.
+     */
+    void abandon(boost::uint32_t id)
+    {
+        boost::lock_guard<boost::mutex> lock(m_receive_mutex);
+        abandon_locked(id);
+    }
+
+    void abandon_locked(boost::uint32_t id)
+    {
+        if (m_replies.erase(id) == 0)
+        {
+            m_abandoned.insert(id);
+        }
+    }
+
+    void check_not_broken() const
+    {
+        if (m_broken)
+        {
+            BOOST_THROW_EXCEPTION(sftp_protocol_error(
+                "SFTP channel out of step after an earlier failure"));
+        }
+    }
+
+    void read_packet(std::vector<char>& packet)
+    {
+        char length_bytes[sftp_packet_writer::LENGTH_SIZE];
+        std::size_t length_count = 0;
+
+        try
+        {
+            read_exactly(length_bytes, sizeof(length_bytes), length_count);
+
+            boost::uint32_t length =
+                sftp_packet_reader::load_uint32(length_bytes);
+            if (length < 1 || length > NATIVE_SFTP_MAXIMUM_PACKET_SIZE)
+            {
+                BOOST_THROW_EXCEPTION(
+                    sftp_protocol_error("SFTP packet length out of range"));
+            }
+
+            packet.resize(length);
+            std::size_t count = 0;
+            read_exactly(&packet[0], length, count);
+        }
+        catch (...)
+        {
+            // The rest of the packet would be taken as the start of the next
+            if (length_count > 0)
+            {
+                m_broken = true;
+            }
+            throw;
+        }
+    }
+
+    /**
+     * Read until `count` reaches `size`, keeping `count` up to date in case
+     * reading fails part way.
+     */
+    void read_exactly(char* buffer, std::size_t size, std::size_t& count)
+    {
+        while (count < size)
+        {
+            std::size_t rc = m_channel.read(0, buffer + count, size - count);
+            if (rc == 0)
+            {
+                BOOST_THROW_EXCEPTION(
+                    sftp_protocol_error("SFTP channel closed by server"));
+            }
+
+            count += rc;
+        }
+    }
+
+    exec_channel_state m_channel;
+    boost::atomic<boost::uint32_t> m_next_id;
+
+    /// Set once the channel is out of step with the packets on it.
+    boost::atomic<bool> m_broken;
+
+    extension_map m_extensions;
+    ::ssh::filesystem::sftp_limits m_limits;
+    std::size_t m_read_chunk_size;
+    std::size_t m_write_chunk_size;
+
+    boost::mutex m_send_mutex;
+
+    /// Held while reading from the channel and while using `m_replies`.
+    boost::mutex m_receive_mutex;
+    std::map<boost::uint32_t, std::vector<char> > m_replies;
+
+    /// Requests whose replies are to be thrown away when they arrive.
+    std::set<boost::uint32_t> m_abandoned;
+};
+}
+} // namespace ssh::detail
+
+#endif
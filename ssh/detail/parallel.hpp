@@ -0,0 +1,116 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_DETAIL_PARALLEL_HPP
+#define SSH_DETAIL_PARALLEL_HPP
+
+#include <boost/bind/bind.hpp>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp> // thread_group
+
+#include <algorithm> // min, max
+#include <cstddef>   // size_t
+
+namespace ssh
+{
+namespace detail
+{
+
+/// @cond INTERNAL
+/**
+ * Hands out task numbers to worker threads until they run out or a task
+ * fails.
+ */
+class parallel_task_queue : private boost::noncopyable
+{
+public:
+    parallel_task_queue(std::size_t count,
+                        const boost::function<void(std::size_t)>& task)
+        : m_next(0), m_count(count), m_task(task)
+    {
+    }
+
+    void work()
+    {
+        while (true)
+        {
+            std::size_t task_number;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                if (m_error || m_next == m_count)
+                    return;
+                task_number = m_next++;
+            }
+
+            try
+            {
+                m_task(task_number);
+            }
+            catch (...)
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                if (!m_error)
+                    m_error = boost::current_exception();
+                return;
+            }
+        }
+    }
+
+    void rethrow_any_error()
+    {
+        if (m_error)
+            boost::rethrow_exception(m_error);
+    }
+
+private:
+    boost::mutex m_mutex;
+    std::size_t m_next;
+    std::size_t m_count;
+    boost::function<void(std::size_t)> m_task;
+    boost::exception_ptr m_error;
+};
+/// @endcond
+
+/**
+ * Run tasks `0` to `count - 1` over at most `parallelism` threads.
+ *
+ * The first failure stops the threads starting further tasks and is
+ * rethrown once they have all finished.
+ */
+inline void run_in_parallel(std::size_t count, unsigned int parallelism,
+                            const boost::function<void(std::size_t)>& task)
+{
+    parallel_task_queue queue(count, task);
+
+    std::size_t workers =
+        (std::min)(static_cast<std::size_t>((std::max)(parallelism, 1U)),
+                   count);
+
+    boost::thread_group threads;
+    for (std::size_t i = 0; i < workers; ++i)
+    {
+        threads.create_thread(boost::bind(&parallel_task_queue::work, &queue));
+    }
+    threads.join_all();
+
+    queue.rethrow_any_error();
+}
+}
+} // namespace ssh::detail
+
+#endif
@@ -0,0 +1,264 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_DETAIL_SESSION_LOCK_HPP
+#define SSH_DETAIL_SESSION_LOCK_HPP
+
+#include <ssh/lock_statistics.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/move/move.hpp> // BOOST_RV_REF, BOOST_MOVABLE_BUT_NOT_COPYABLE
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp> // lock_guard
+#include <boost/thread/mutex.hpp>
+
+#include <cstring> // strcmp
+#include <vector>
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * Accumulates lock statistics for one session.
+ *
+ * Recording is off by default.  While off, the locks taken through the
+ * session do nothing beyond checking a single relaxed atomic flag, so leaving
+ * the recorder in place costs nothing measurable.
+ */
+class lock_statistics_recorder : private boost::noncopyable
+{
+public:
+    typedef duration_histogram::duration duration;
+
+    lock_statistics_recorder() : m_enabled(false)
+    {
+    }
+
+    bool enabled() const
+    {
+        return m_enabled.load(boost::memory_order_relaxed);
+    }
+
+    void enable(bool enabled)
+    {
+        m_enabled.store(enabled, boost::memory_order_relaxed);
+    }
+
+    /**
+     * @param operation  Name of the operation that held the lock.  Must
+     *                   outlive the recorder; in practice it is a literal.
+     */
+    void record(const char* operation, duration wait, duration hold,
+                bool contended)
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+
+        lock_operation_statistics& statistics = find_or_add(operation);
+
+        ++statistics.acquisitions;
+        if (contended)
+        {
+            ++statistics.contended_acquisitions;
+        }
+        statistics.wait.record(wait);
+        statistics.hold.record(hold);
+    }
+
+    lock_statistics snapshot() const
+    {
+        lock_statistics::operation_map operations;
+
+        boost::lock_guard<boost::mutex> guard(m_guard);
+
+        for (std::vector<entry>::const_iterator it = m_entries.begin();
+             it != m_entries.end(); ++it)
+        {
+            operations[it->operation].merge(it->statistics);
+        }
+
+        return lock_statistics(operations);
+    }
+
+    void reset()
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+        m_entries.clear();
+    }
+
+private:
+    struct entry
+    {
+        explicit entry(const char* operation) : operation(operation)
+        {
+        }
+
+        const char* operation;
+        lock_operation_statistics statistics;
+    };
+
+    lock_operation_statistics& find_or_add(const char* operation)
+    {
+        // There are only a few dozen operations, each named by a literal, so
+        // a linear scan comparing pointers first beats hashing the name.
+        for (std::vector<entry>::iterator it = m_entries.begin();
+             it != m_entries.end(); ++it)
+        {
+            if (it->operation == operation ||
+                std::strcmp(it->operation, operation) == 0)
+            {
+                return it->statistics;
+            }
+        }
+
+        m_entries.push_back(entry(operation));
+        return m_entries.back().statistics;
+    }
+
+    mutable boost::mutex m_guard;
+    std::vector<entry> m_entries;
+    boost::atomic<bool> m_enabled;
+};
+
+/**
+ * Exclusive ownership of a session's mutex that reports its usage to a
+ * lock_statistics_recorder.
+ *
+ * Behaves like `boost::mutex::scoped_lock` for the purposes of the session.
+ * When the recorder is enabled at the moment the lock is requested, the lock
+ * measures how long it waited to acquire the mutex and how long it held it,
+ * and reports both to the recorder once the mutex has been released so the
+ * reporting itself never extends the critical section.
+ */
+class session_lock
+{
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(session_lock)
+
+    typedef boost::chrono::steady_clock clock;
+
+public:
+    session_lock(boost::mutex& mutex, lock_statistics_recorder& recorder,
+                 const char* operation)
+        : m_mutex(&mutex),
+          m_recorder(NULL),
+          m_operation(operation),
+          m_contended(false),
+          m_wait(0)
+    {
+        if (recorder.enabled())
+        {
+            m_recorder = &recorder;
+
+            clock::time_point wait_start = clock::now();
+            if (!mutex.try_lock())
+            {
+                m_contended = true;
+                mutex.lock();
+            }
+            m_acquired = clock::now();
+            m_wait = m_acquired - wait_start;
+        }
+        else
+        {
+            mutex.lock();
+        }
+    }
+
+    session_lock(BOOST_RV_REF(session_lock) other)
+        : m_mutex(other.m_mutex),
+          m_recorder(other.m_recorder),
+          m_operation(other.m_operation),
+          m_contended(other.m_contended),
+          m_wait(other.m_wait),
+          m_acquired(other.m_acquired)
+    {
+        other.m_mutex = NULL;
+    }
+
+    session_lock& operator=(BOOST_RV_REF(session_lock) other)
+    {
+        if (this != &other)
+        {
+            release();
+
+            m_mutex = other.m_mutex;
+            m_recorder = other.m_recorder;
+            m_operation = other.m_operation;
+            m_contended = other.m_contended;
+            m_wait = other.m_wait;
+            m_acquired = other.m_acquired;
+
+            other.m_mutex = NULL;
+        }
+
+        return *this;
+    }
+
+    ~session_lock()
+    {
+        release();
+    }
+
+    bool owns_lock() const
+    {
+        return m_mutex != NULL;
+    }
+
+private:
+    void release()
+    {
+        if (m_mutex == NULL)
+        {
+            return;
+        }
+
+        if (m_recorder)
+        {
+            lock_statistics_recorder::duration hold =
+                clock::now() - m_acquired;
+
+            m_mutex->unlock();
+            m_mutex = NULL;
+
+            try
+            {
+                m_recorder->record(m_operation, m_wait, hold, m_contended);
+            }
+            catch (...)
+            {
+                // Losing a sample is better than failing the operation that
+                // produced it
+            }
+        }
+        else
+        {
+            m_mutex->unlock();
+            m_mutex = NULL;
+        }
+    }
+
+    boost::mutex* m_mutex;
+    lock_statistics_recorder* m_recorder;
+    const char* m_operation;
+    bool m_contended;
+    lock_statistics_recorder::duration m_wait;
+    clock::time_point m_acquired;
+};
+}
+} // namespace ssh::detail
+
+#endif
@@ -38,17 +38,27 @@
 #define SSH_DETAIL_SESSION_STATE_HPP
 
 #include <ssh/detail/libssh2/session.hpp> // init
+#include <ssh/detail/session_lock.hpp>
+#include <ssh/metrics.hpp> // session_traffic
 
+#include <boost/chrono/duration.hpp> // milliseconds
 #include <boost/noncopyable.hpp>
 #include <boost/optional/optional.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp> // this_thread::sleep_for
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
 
 #include <string>
 
-#include <libssh2.h> // LIBSSH2_SESSION
+#include <libssh2.h> // LIBSSH2_SESSION, libssh2_session_block_directions
+
+#ifdef _WIN32
+#include <winsock2.h> // select, fd_set, timeval
+#else
+#include <sys/select.h> // select, fd_set, timeval
+#endif
 
 namespace ssh
 {
@@ -78,12 +88,13 @@ class session_state : private boost::noncopyable
     //
 
 public:
-    typedef boost::mutex::scoped_lock scoped_lock;
+    typedef session_lock scoped_lock;
 
     /**
      * Creates a session that is not (and never will be) connected to a host.
      */
-    session_state() : m_session(::ssh::detail::libssh2::session::init())
+    session_state()
+        : m_session(::ssh::detail::libssh2::session::init()), m_socket(-1)
     {
     }
 
@@ -91,7 +102,7 @@ public:
      * Creates a session connected to a host over the given socket.
      */
     session_state(int socket, const std::string& disconnection_message)
-        : m_session(libssh2::session::init())
+        : m_session(libssh2::session::init()), m_socket(socket)
     {
         // Session is 'alive' from this point onwards.  All paths must
         // eventually free it.
@@ -131,9 +142,26 @@ public:
         ::libssh2_session_free(m_session);
     }
 
-    scoped_lock aquire_lock()
+    /**
+     * Take exclusive use of the session.
+     *
+     * @param operation  Name under which the time spent waiting for, and
+     *                   holding, the lock is recorded when lock statistics
+     *                   are enabled.
+     */
+    scoped_lock aquire_lock(const char* operation)
+    {
+        return scoped_lock(m_mutex, m_lock_statistics, operation);
+    }
+
+    lock_statistics_recorder& lock_statistics()
+    {
+        return m_lock_statistics;
+    }
+
+    session_traffic& traffic()
     {
-        return scoped_lock(m_mutex);
+        return m_traffic;
     }
 
     LIBSSH2_SESSION* session_ptr()
@@ -141,12 +169,80 @@ public:
         return m_session;
     }
 
+    /**
+     * Wait, for at most `timeout_ms`, until the socket is ready in whichever
+     * direction the last non-blocking operation would have blocked.
+     *
+     * Must be called while holding the session lock.
+     */
+    void wait_for_socket(long timeout_ms)
+    {
+        int directions = ::libssh2_session_block_directions(m_session);
+        if (m_socket < 0 || directions == 0)
+        {
+            return;
+        }
+
+        fd_set read_set;
+        fd_set write_set;
+        FD_ZERO(&read_set);
+        FD_ZERO(&write_set);
+        if (directions & LIBSSH2_SESSION_BLOCK_INBOUND)
+        {
+            FD_SET(m_socket, &read_set);
+        }
+        if (directions & LIBSSH2_SESSION_BLOCK_OUTBOUND)
+        {
+            FD_SET(m_socket, &write_set);
+        }
+
+        timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+        // Errors and timeouts both just mean the caller tries again
+        ::select(m_socket + 1, &read_set, &write_set, NULL, &timeout);
+    }
+
+    /**
+     * Wait, for at most `timeout_ms`, until the socket has data to read.
+     *
+     * Unlike `wait_for_socket`, doesn't ask libssh2 anything, so may be
+     * called without holding the session lock.
+     */
+    void wait_for_input(long timeout_ms)
+    {
+        if (m_socket < 0)
+        {
+            boost::this_thread::sleep_for(
+                boost::chrono::milliseconds(timeout_ms));
+            return;
+        }
+
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(m_socket, &read_set);
+
+        timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+        ::select(m_socket + 1, &read_set, NULL, NULL, &timeout);
+    }
+
 private:
     mutable boost::mutex m_mutex;
     ///< Coordinates multiple-threads using of non-thread-safe LIBSSH2_SESSION.
 
+    lock_statistics_recorder m_lock_statistics;
+
+    session_traffic m_traffic;
+
     LIBSSH2_SESSION* m_session;
 
+    /// -1 if the session was never connected.
+    int m_socket;
+
     // Overloading this to hold both the message and flag whether disconnection
     // is necessary.
     boost::optional<std::string> m_disconnection_message;
@@ -38,9 +38,13 @@
 #define SSH_DETAIL_SFTP_CHANNEL_STATE_HPP
 
 #include <ssh/detail/libssh2/sftp.hpp> // init
+#include <ssh/detail/native_sftp_state.hpp>
 #include <ssh/detail/session_state.hpp>
+#include <ssh/sftp_engine.hpp>
 
+#include <boost/atomic.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
 
 #include <libssh2_sftp.h> // LIBSSH2_SFTP
 
@@ -51,7 +55,7 @@ namespace detail
 
 inline LIBSSH2_SFTP* do_sftp_init(session_state& session)
 {
-    session_state::scoped_lock lock = session.aquire_lock();
+    session_state::scoped_lock lock = session.aquire_lock("sftp_init");
 
     return libssh2::sftp::init(session.session_ptr());
 }
@@ -61,6 +65,10 @@ inline LIBSSH2_SFTP* do_sftp_init(session_state& session)
  *
  * Manages the graceful startup/shutdown the SFTP channel and does so in
  * a thread-safe manner.
+ *
+ * The channel is run either by libssh2 or by the native engine.  Only one
+ * of `sftp_ptr` and `native` is non-NULL, and users of the channel must
+ * send each operation to whichever that is.
  */
 class sftp_channel_state : private boost::noncopyable
 {
@@ -79,21 +87,36 @@ public:
      * Creates SFTP channel that closes itself in a thread-safe manner
      * when it goes out of scope.
      */
-    sftp_channel_state(session_state& session)
-        : m_session(session), m_sftp(do_sftp_init(session_ref()))
+    sftp_channel_state(session_state& session,
+                       BOOST_SCOPED_ENUM(::ssh::filesystem::sftp_engine)
+                           engine = ::ssh::filesystem::sftp_engine::libssh2)
+        : m_session(session), m_sftp(NULL), m_posix_rename_refused(false)
     {
+        if (engine == ::ssh::filesystem::sftp_engine::native)
+        {
+            m_native.reset(new native_sftp_state(session_ref()));
+        }
+        else
+        {
+            m_sftp = do_sftp_init(session_ref());
+        }
     }
 
     ~sftp_channel_state() throw()
     {
-        session_state::scoped_lock lock = session_ref().aquire_lock();
-
-        ::libssh2_sftp_shutdown(m_sftp);
+        // The native engine's channel closes itself
+        if (m_sftp)
+        {
+            session_state::scoped_lock lock =
+                session_ref().aquire_lock("sftp_shutdown");
+
+            ::libssh2_sftp_shutdown(m_sftp);
+        }
     }
 
-    scoped_lock aquire_lock()
+    scoped_lock aquire_lock(const char* operation)
     {
-        return session_ref().aquire_lock();
+        return session_ref().aquire_lock(operation);
     }
 
     LIBSSH2_SESSION* session_ptr()
@@ -101,11 +124,38 @@ public:
         return session_ref().session_ptr();
     }
 
+    session_traffic& traffic()
+    {
+        return session_ref().traffic();
+    }
+
     LIBSSH2_SFTP* sftp_ptr()
     {
         return m_sftp;
     }
 
+    /**
+     * The native engine running the channel, or NULL if libssh2 runs it.
+     */
+    native_sftp_state* native()
+    {
+        return m_native.get();
+    }
+
+    /**
+     * Whether the server has turned down a posix-rename@openssh.com request
+     * sent through libssh2, which can't ask which extensions it has.
+     */
+    bool posix_rename_refused() const
+    {
+        return m_posix_rename_refused;
+    }
+
+    void refuse_posix_rename()
+    {
+        m_posix_rename_refused = true;
+    }
+
 private:
     session_state& session_ref()
     {
@@ -114,6 +164,8 @@ private:
 
     session_state& m_session;
     LIBSSH2_SFTP* m_sftp;
+    boost::scoped_ptr<native_sftp_state> m_native;
+    boost::atomic<bool> m_posix_rename_refused;
 };
 }
 } // namespace ssh::detail
@@ -0,0 +1,368 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Building and parsing SFTP version 3 packets
+ * (draft-ietf-secsh-filexfer-02).
+ */
+
+#ifndef SSH_DETAIL_SFTP_PACKET_HPP
+#define SSH_DETAIL_SFTP_PACKET_HPP
+
+#include <boost/cstdint.hpp>         // uint8_t, uint32_t, uint64_t
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cassert>   // assert
+#include <cstddef>   // size_t
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+#include <libssh2_sftp.h> // LIBSSH2_SFTP_ATTRIBUTES, LIBSSH2_SFTP_ATTR_*
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * Packet types from the SFTP version 3 draft.
+ *
+ * libssh2 keeps these to itself, so they are repeated here.
+ */
+namespace sftp_packet_type
+{
+enum type
+{
+    init = 1,
+    version = 2,
+    open = 3,
+    close = 4,
+    read = 5,
+    write = 6,
+    lstat = 7,
+    fstat = 8,
+    setstat = 9,
+    fsetstat = 10,
+    opendir = 11,
+    readdir = 12,
+    remove = 13,
+    mkdir = 14,
+    rmdir = 15,
+    realpath = 16,
+    stat = 17,
+    rename = 18,
+    readlink = 19,
+    symlink = 20,
+    status = 101,
+    handle = 102,
+    data = 103,
+    name = 104,
+    attrs = 105,
+    extended = 200,
+    extended_reply = 201
+};
+}
+
+/**
+ * The protocol version this client speaks.
+ */
+const boost::uint32_t SFTP_PROTOCOL_VERSION = 3;
+
+/**
+ * Thrown when a packet from the server ends early or is otherwise not what
+ * the protocol allows.
+ */
+class sftp_protocol_error : public std::runtime_error
+{
+public:
+    explicit sftp_protocol_error(const std::string& message)
+        : std::runtime_error(message)
+    {
+    }
+};
+
+/**
+ * A run of bytes inside a packet being parsed.
+ *
+ * Strings in a packet are read as slices so that file data and names are
+ * not copied until the caller decides where they go.
+ */
+struct sftp_slice
+{
+    sftp_slice() : data(NULL), size(0)
+    {
+    }
+
+    sftp_slice(const char* data, std::size_t size) : data(data), size(size)
+    {
+    }
+
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * Builds one packet, including the length that prefixes it on the wire.
+ *
+ * The packet is built in a reusable buffer, so sending many requests only
+ * allocates when one is bigger than any before it.
+ */
+class sftp_packet_writer
+{
+public:
+    sftp_packet_writer()
+    {
+    }
+
+    /**
+     * Start a new packet of the given type, discarding any built before.
+     */
+    void start(sftp_packet_type::type type)
+    {
+        m_buffer.resize(LENGTH_SIZE);
+        byte(static_cast<boost::uint8_t>(type));
+    }
+
+    void byte(boost::uint8_t value)
+    {
+        m_buffer.push_back(static_cast<char>(value));
+    }
+
+    void uint32(boost::uint32_t value)
+    {
+        char bytes[4];
+        store_uint32(bytes, value);
+        m_buffer.insert(m_buffer.end(), bytes, bytes + sizeof(bytes));
+    }
+
+    void uint64(boost::uint64_t value)
+    {
+        uint32(static_cast<boost::uint32_t>(value >> 32));
+        uint32(static_cast<boost::uint32_t>(value));
+    }
+
+    void string(const char* data, std::size_t size)
+    {
+        uint32(static_cast<boost::uint32_t>(size));
+        m_buffer.insert(m_buffer.end(), data, data + size);
+    }
+
+    void string(const std::string& value)
+    {
+        string(value.data(), value.size());
+    }
+
+    /**
+     * Attributes in the form used by OPEN, MKDIR and SETSTAT.
+     *
+     * Only the fields named by `attributes.flags` are written.  Extended
+     * attributes are never sent.
+     */
+    void attributes(const LIBSSH2_SFTP_ATTRIBUTES& attributes)
+    {
+        unsigned long flags =
+            attributes.flags &
+            (LIBSSH2_SFTP_ATTR_SIZE | LIBSSH2_SFTP_ATTR_UIDGID |
+             LIBSSH2_SFTP_ATTR_PERMISSIONS | LIBSSH2_SFTP_ATTR_ACMODTIME);
+
+        uint32(static_cast<boost::uint32_t>(flags));
+        if (flags & LIBSSH2_SFTP_ATTR_SIZE)
+        {
+            uint64(attributes.filesize);
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_UIDGID)
+        {
+            uint32(static_cast<boost::uint32_t>(attributes.uid));
+            uint32(static_cast<boost::uint32_t>(attributes.gid));
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_PERMISSIONS)
+        {
+            uint32(static_cast<boost::uint32_t>(attributes.permissions));
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_ACMODTIME)
+        {
+            uint32(static_cast<boost::uint32_t>(attributes.atime));
+            uint32(static_cast<boost::uint32_t>(attributes.mtime));
+        }
+    }
+
+    /**
+     * The finished packet, ready to send.
+     */
+    const char* data()
+    {
+        assert(m_buffer.size() > LENGTH_SIZE);
+        store_uint32(&m_buffer[0],
+                     static_cast<boost::uint32_t>(m_buffer.size() -
+                                                  LENGTH_SIZE));
+        return &m_buffer[0];
+    }
+
+    std::size_t size() const
+    {
+        return m_buffer.size();
+    }
+
+    static void store_uint32(char* bytes, boost::uint32_t value)
+    {
+        bytes[0] = static_cast<char>((value >> 24) & 0xFF);
+        bytes[1] = static_cast<char>((value >> 16) & 0xFF);
+        bytes[2] = static_cast<char>((value >> 8) & 0xFF);
+        bytes[3] = static_cast<char>(value & 0xFF);
+    }
+
+    /// Bytes in the length that prefixes every packet.
+    static const std::size_t LENGTH_SIZE = 4;
+
+private:
+    std::vector<char> m_buffer;
+};
+
+/**
+ * Reads the fields of one packet, in order, without copying it.
+ *
+ * The reader only points into the packet, which must outlive it and any
+ * slices read from it.
+ */
+class sftp_packet_reader
+{
+public:
+    /**
+     * @param data  The packet without the length that prefixed it on the
+     *              wire, starting at the type.
+     */
+    sftp_packet_reader(const char* data, std::size_t size)
+        : m_position(data), m_end(data + size)
+    {
+    }
+
+    boost::uint8_t byte()
+    {
+        require(1);
+        return static_cast<boost::uint8_t>(*m_position++);
+    }
+
+    boost::uint32_t uint32()
+    {
+        require(4);
+        boost::uint32_t value = load_uint32(m_position);
+        m_position += 4;
+        return value;
+    }
+
+    boost::uint64_t uint64()
+    {
+        boost::uint64_t high = uint32();
+        return (high << 32) | uint32();
+    }
+
+    sftp_slice string()
+    {
+        boost::uint32_t size = uint32();
+        require(size);
+        sftp_slice slice(m_position, size);
+        m_position += size;
+        return slice;
+    }
+
+    /**
+     * Attributes in the form returned by STAT, FSTAT and READDIR.
+     *
+     * Extended attributes are skipped.
+     */
+    LIBSSH2_SFTP_ATTRIBUTES attributes()
+    {
+        LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+
+        boost::uint32_t flags = uint32();
+        if (flags & LIBSSH2_SFTP_ATTR_SIZE)
+        {
+            attributes.filesize = uint64();
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_UIDGID)
+        {
+            attributes.uid = uint32();
+            attributes.gid = uint32();
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_PERMISSIONS)
+        {
+            attributes.permissions = uint32();
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_ACMODTIME)
+        {
+            attributes.atime = uint32();
+            attributes.mtime = uint32();
+        }
+        if (flags & LIBSSH2_SFTP_ATTR_EXTENDED)
+        {
+            boost::uint32_t count = uint32();
+            for (boost::uint32_t i = 0; i < count; ++i)
+            {
+                string(); // type
+                string(); // data
+            }
+        }
+
+        // The extended flag is left set, like libssh2 does, but nothing
+        // from the extensions is kept
+        attributes.flags = flags;
+
+        return attributes;
+    }
+
+    bool at_end() const
+    {
+        return m_position == m_end;
+    }
+
+    std::size_t remaining() const
+    {
+        return static_cast<std::size_t>(m_end - m_position);
+    }
+
+    static boost::uint32_t load_uint32(const char* bytes)
+    {
+        const unsigned char* unsigned_bytes =
+            reinterpret_cast<const unsigned char*>(bytes);
+
+        return (static_cast<boost::uint32_t>(unsigned_bytes[0]) << 24) |
+               (static_cast<boost::uint32_t>(unsigned_bytes[1]) << 16) |
+               (static_cast<boost::uint32_t>(unsigned_bytes[2]) << 8) |
+               static_cast<boost::uint32_t>(unsigned_bytes[3]);
+    }
+
+private:
+    void require(std::size_t size) const
+    {
+        if (remaining() < size)
+            BOOST_THROW_EXCEPTION(
+                sftp_protocol_error("SFTP packet ended early"));
+    }
+
+    const char* m_position;
+    const char* m_end;
+};
+}
+} // namespace ssh::detail
+
+#endif
@@ -0,0 +1,567 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Streaming reader and writer of tar archives.
+ *
+ * Archives are written in POSIX ustar format, with pax extended headers for
+ * names and sizes that don't fit in a ustar header, so any modern `tar` can
+ * read them.  The reader also understands the GNU long-name and base-256
+ * size extensions that GNU `tar` writes by default.
+ *
+ * Only regular files and directories are carried.  The reader skips other
+ * kinds of entry.
+ */
+
+#ifndef SSH_DETAIL_TAR_HPP
+#define SSH_DETAIL_TAR_HPP
+
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // find, min
+#include <cstddef>   // size_t
+#include <ctime>     // time_t
+#include <istream>
+#include <ostream>
+#include <stdexcept> // runtime_error
+#include <string>
+
+namespace ssh
+{
+namespace detail
+{
+
+enum tar_entry_type
+{
+    tar_regular_file,
+    tar_directory,
+    tar_other
+};
+
+struct tar_entry
+{
+    tar_entry() : type(tar_regular_file), size(0), mode(0644), mtime(0)
+    {
+    }
+
+    /// Path relative to the archive root, `/`-separated and UTF-8 encoded.
+    std::string name;
+
+    tar_entry_type type;
+    boost::uint64_t size;
+    unsigned int mode;
+    std::time_t mtime;
+};
+
+const std::size_t TAR_BLOCK_SIZE = 512;
+
+/// @cond INTERNAL
+namespace tar
+{
+
+// Offsets and lengths of the ustar header fields
+const std::size_t NAME_OFFSET = 0;
+const std::size_t NAME_LENGTH = 100;
+const std::size_t MODE_OFFSET = 100;
+const std::size_t UID_OFFSET = 108;
+const std::size_t GID_OFFSET = 116;
+const std::size_t ID_LENGTH = 8;
+const std::size_t SIZE_OFFSET = 124;
+const std::size_t SIZE_LENGTH = 12;
+const std::size_t MTIME_OFFSET = 136;
+const std::size_t MTIME_LENGTH = 12;
+const std::size_t CHECKSUM_OFFSET = 148;
+const std::size_t CHECKSUM_LENGTH = 8;
+const std::size_t TYPE_OFFSET = 156;
+const std::size_t MAGIC_OFFSET = 257;
+const std::size_t PREFIX_OFFSET = 345;
+const std::size_t PREFIX_LENGTH = 155;
+
+// Largest size an 11-digit octal field can hold
+const boost::uint64_t MAXIMUM_OCTAL_SIZE = 077777777777ULL;
+
+inline void write_octal(char* field, std::size_t field_length,
+                        boost::uint64_t value)
+{
+    // Digits fill all but the last byte, which stays NUL
+    std::size_t digits = field_length - 1;
+    for (std::size_t i = digits; i > 0; --i)
+    {
+        field[i - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+    field[digits] = '\0';
+}
+
+inline boost::uint64_t read_number(const char* field, std::size_t field_length)
+{
+    // GNU base-256 encoding, used for values too big for octal
+    if (static_cast<unsigned char>(field[0]) & 0x80)
+    {
+        boost::uint64_t value = static_cast<unsigned char>(field[0]) & 0x7f;
+        for (std::size_t i = 1; i < field_length; ++i)
+        {
+            value = (value << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return value;
+    }
+
+    boost::uint64_t value = 0;
+    std::size_t i = 0;
+    while (i < field_length && field[i] == ' ')
+    {
+        ++i;
+    }
+    for (; i < field_length && field[i] >= '0' && field[i] <= '7'; ++i)
+    {
+        value = (value << 3) | static_cast<boost::uint64_t>(field[i] - '0');
+    }
+    return value;
+}
+
+inline unsigned int checksum(const char* header)
+{
+    unsigned int sum = 0;
+    for (std::size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+        if (i >= CHECKSUM_OFFSET && i < CHECKSUM_OFFSET + CHECKSUM_LENGTH)
+            sum += ' ';
+        else
+            sum += static_cast<unsigned char>(header[i]);
+    }
+    return sum;
+}
+
+inline std::string read_string(const char* field, std::size_t field_length)
+{
+    return std::string(field, std::find(field, field + field_length, '\0'));
+}
+
+/**
+ * One pax extended header record: `"<length> <key>=<value>\n"`, where the
+ * length counts the whole record including its own digits.
+ */
+inline std::string pax_record(const std::string& key, const std::string& value)
+{
+    std::size_t body_length = key.size() + value.size() + 3; // ' ', '=', '\n'
+    std::size_t length = body_length + 1;
+    while (boost::lexical_cast<std::string>(length).size() + body_length !=
+           length)
+    {
+        length = boost::lexical_cast<std::string>(length).size() + body_length;
+    }
+
+    return boost::lexical_cast<std::string>(length) + " " + key + "=" + value +
+           "\n";
+}
+
+inline std::size_t padding_after(boost::uint64_t size)
+{
+    return static_cast<std::size_t>((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) %
+                                    TAR_BLOCK_SIZE);
+}
+}
+/// @endcond
+
+/**
+ * Writes a tar archive to a stream an entry at a time.
+ *
+ * For each entry, call `begin_entry`, then `write` exactly the entry's size
+ * in bytes of content (none for a directory), then `end_entry`.  Call
+ * `finish` after the last entry.
+ */
+class tar_writer : private boost::noncopyable
+{
+public:
+    explicit tar_writer(std::ostream& archive)
+        : m_archive(archive), m_remaining(0), m_padding(0)
+    {
+    }
+
+    void begin_entry(const tar_entry& entry)
+    {
+        std::string name = entry.name;
+        if (entry.type == tar_directory &&
+            (name.empty() || name[name.size() - 1] != '/'))
+        {
+            name += '/';
+        }
+
+        boost::uint64_t size = (entry.type == tar_directory) ? 0 : entry.size;
+
+        std::string extended;
+        if (name.size() > tar::NAME_LENGTH)
+        {
+            extended += tar::pax_record("path", name);
+        }
+        if (size > tar::MAXIMUM_OCTAL_SIZE)
+        {
+            extended += tar::pax_record("size",
+                                        boost::lexical_cast<std::string>(size));
+        }
+
+        if (!extended.empty())
+        {
+            write_header("././@PaxHeader", 'x', extended.size(), 0644,
+                         entry.mtime);
+            write_block_padded(extended.data(), extended.size());
+        }
+
+        write_header(name, (entry.type == tar_directory) ? '5' : '0', size,
+                     entry.mode, entry.mtime);
+
+        m_remaining = size;
+        m_padding = tar::padding_after(size);
+    }
+
+    void write(const char* data, std::size_t size)
+    {
+        if (size > m_remaining)
+        {
+            BOOST_THROW_EXCEPTION(
+                std::logic_error("More tar entry content than its size"));
+        }
+
+        m_archive.write(data, size);
+        m_remaining -= size;
+    }
+
+    void end_entry()
+    {
+        if (m_remaining != 0)
+        {
+            BOOST_THROW_EXCEPTION(
+                std::logic_error("Less tar entry content than its size"));
+        }
+
+        write_zeros(m_padding);
+    }
+
+    void finish()
+    {
+        // End of archive is marked by two zero blocks
+        write_zeros(2 * TAR_BLOCK_SIZE);
+        m_archive.flush();
+    }
+
+private:
+    void write_header(const std::string& name, char type, boost::uint64_t size,
+                      unsigned int mode, std::time_t mtime)
+    {
+        char header[TAR_BLOCK_SIZE] = {};
+
+        // Names too long for the field are carried by a pax header, so only
+        // a truncated name, for readers that don't understand pax, goes here
+        name.copy(header + tar::NAME_OFFSET, tar::NAME_LENGTH);
+
+        tar::write_octal(header + tar::MODE_OFFSET, tar::ID_LENGTH,
+                         mode & 07777);
+        tar::write_octal(header + tar::UID_OFFSET, tar::ID_LENGTH, 0);
+        tar::write_octal(header + tar::GID_OFFSET, tar::ID_LENGTH, 0);
+        tar::write_octal(header + tar::SIZE_OFFSET, tar::SIZE_LENGTH,
+                         std::min(size, tar::MAXIMUM_OCTAL_SIZE));
+        tar::write_octal(
+            header + tar::MTIME_OFFSET, tar::MTIME_LENGTH,
+            (mtime > 0) ? static_cast<boost::uint64_t>(mtime) : 0);
+        header[tar::TYPE_OFFSET] = type;
+        std::string("ustar\0" "00", 8).copy(header + tar::MAGIC_OFFSET, 8);
+
+        tar::write_octal(header + tar::CHECKSUM_OFFSET, 7,
+                         tar::checksum(header));
+        header[tar::CHECKSUM_OFFSET + 7] = ' ';
+
+        m_archive.write(header, TAR_BLOCK_SIZE);
+    }
+
+    void write_block_padded(const char* data, std::size_t size)
+    {
+        m_archive.write(data, size);
+        write_zeros(tar::padding_after(size));
+    }
+
+    void write_zeros(std::size_t count)
+    {
+        static const char zeros[TAR_BLOCK_SIZE] = {};
+        while (count > 0)
+        {
+            std::size_t chunk = std::min(count, TAR_BLOCK_SIZE);
+            m_archive.write(zeros, chunk);
+            count -= chunk;
+        }
+    }
+
+    std::ostream& m_archive;
+    boost::uint64_t m_remaining;
+    std::size_t m_padding;
+};
+
+/**
+ * Reads a tar archive from a stream an entry at a time.
+ *
+ * `next_entry` moves to the next file or directory, skipping any content of
+ * the current entry that wasn't read.  `read` then returns the entry's
+ * content.
+ */
+class tar_reader : private boost::noncopyable
+{
+public:
+    explicit tar_reader(std::istream& archive)
+        : m_archive(archive), m_remaining(0), m_padding(0)
+    {
+    }
+
+    /**
+     * Move to the next regular file or directory in the archive.
+     *
+     * @returns `false` at the end of the archive.
+     */
+    bool next_entry(tar_entry& entry)
+    {
+        skip(m_remaining + m_padding);
+        m_remaining = 0;
+        m_padding = 0;
+
+        std::string long_name;
+        boost::uint64_t long_size = 0;
+        bool has_long_size = false;
+
+        for (;;)
+        {
+            char header[TAR_BLOCK_SIZE];
+            if (!read_block(header))
+                return false;
+
+            if (is_zero_block(header))
+                return false;
+
+            if (tar::read_number(header + tar::CHECKSUM_OFFSET,
+                                 tar::CHECKSUM_LENGTH) != tar::checksum(header))
+            {
+                BOOST_THROW_EXCEPTION(
+                    std::runtime_error("Corrupt tar header: bad checksum"));
+            }
+
+            boost::uint64_t size =
+                tar::read_number(header + tar::SIZE_OFFSET, tar::SIZE_LENGTH);
+            char type = header[tar::TYPE_OFFSET];
+
+            if (type == 'x')
+            {
+                parse_pax(read_content(size), long_name, long_size,
+                          has_long_size);
+                continue;
+            }
+            else if (type == 'L')
+            {
+                long_name = read_content(size).c_str();
+                continue;
+            }
+            else if (type == 'g' || type == 'K')
+            {
+                skip(size + tar::padding_after(size));
+                continue;
+            }
+
+            if (has_long_size)
+                size = long_size;
+
+            tar_entry_type entry_type = tar_other;
+            switch (type)
+            {
+            case '0':
+            case '\0':
+            case '7':
+                entry_type = tar_regular_file;
+                break;
+            case '5':
+                entry_type = tar_directory;
+                break;
+            }
+
+            if (entry_type == tar_other)
+            {
+                // Links, devices and so on may still have content to skip
+                skip(size + tar::padding_after(size));
+                long_name.clear();
+                has_long_size = false;
+                continue;
+            }
+
+            if (!long_name.empty())
+            {
+                entry.name = long_name;
+            }
+            else
+            {
+                entry.name = tar::read_string(header + tar::NAME_OFFSET,
+                                              tar::NAME_LENGTH);
+                std::string prefix = tar::read_string(
+                    header + tar::PREFIX_OFFSET, tar::PREFIX_LENGTH);
+                if (!prefix.empty() &&
+                    std::string(header + tar::MAGIC_OFFSET, 5) == "ustar")
+                {
+                    entry.name = prefix + "/" + entry.name;
+                }
+            }
+
+            entry.type = entry_type;
+            entry.size = (entry_type == tar_directory) ? 0 : size;
+            entry.mode = static_cast<unsigned int>(
+                tar::read_number(header + tar::MODE_OFFSET, tar::ID_LENGTH));
+            entry.mtime = static_cast<std::time_t>(tar::read_number(
+                header + tar::MTIME_OFFSET, tar::MTIME_LENGTH));
+
+            m_remaining = entry.size;
+            m_padding = tar::padding_after(entry.size);
+
+            return true;
+        }
+    }
+
+    /**
+     * Read the current entry's content.
+     *
+     * @returns the number of bytes read, which is 0 once all the content
+     *          has been read.
+     */
+    std::size_t read(char* buffer, std::size_t buffer_size)
+    {
+        std::size_t count = static_cast<std::size_t>(
+            std::min<boost::uint64_t>(buffer_size, m_remaining));
+        if (count == 0)
+            return 0;
+
+        m_archive.read(buffer, count);
+        if (static_cast<std::size_t>(m_archive.gcount()) != count)
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Tar archive ended in the middle of a file"));
+        }
+
+        m_remaining -= count;
+        return count;
+    }
+
+private:
+    bool read_block(char* block)
+    {
+        m_archive.read(block, TAR_BLOCK_SIZE);
+        std::streamsize count = m_archive.gcount();
+        if (count == 0)
+            return false; // Archive ended without end-of-archive blocks
+
+        if (count != static_cast<std::streamsize>(TAR_BLOCK_SIZE))
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Tar archive ended in the middle of a block"));
+        }
+
+        return true;
+    }
+
+    static bool is_zero_block(const char* block)
+    {
+        for (std::size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+        {
+            if (block[i] != '\0')
+                return false;
+        }
+        return true;
+    }
+
+    std::string read_content(boost::uint64_t size)
+    {
+        std::string content(static_cast<std::size_t>(size), '\0');
+        if (size > 0)
+        {
+            m_archive.read(&content[0], content.size());
+            if (static_cast<boost::uint64_t>(m_archive.gcount()) != size)
+            {
+                BOOST_THROW_EXCEPTION(
+                    std::runtime_error("Tar archive ended in a header"));
+            }
+        }
+        skip(tar::padding_after(size));
+        return content;
+    }
+
+    static void parse_pax(const std::string& records, std::string& path,
+                          boost::uint64_t& size, bool& has_size)
+    {
+        std::size_t position = 0;
+        while (position < records.size())
+        {
+            std::size_t space = records.find(' ', position);
+            if (space == std::string::npos)
+                break;
+
+            std::size_t length = boost::lexical_cast<std::size_t>(
+                records.substr(position, space - position));
+            if (length == 0 || position + length > records.size())
+                break;
+
+            // Record ends with a newline, which isn't part of the value
+            std::string record =
+                records.substr(space + 1, position + length - space - 2);
+            std::size_t equals = record.find('=');
+            if (equals != std::string::npos)
+            {
+                std::string key = record.substr(0, equals);
+                std::string value = record.substr(equals + 1);
+                if (key == "path")
+                {
+                    path = value;
+                }
+                else if (key == "size")
+                {
+                    size = boost::lexical_cast<boost::uint64_t>(value);
+                    has_size = true;
+                }
+            }
+
+            position += length;
+        }
+    }
+
+    void skip(boost::uint64_t count)
+    {
+        char buffer[TAR_BLOCK_SIZE];
+        while (count > 0)
+        {
+            std::size_t chunk = static_cast<std::size_t>(
+                std::min<boost::uint64_t>(count, TAR_BLOCK_SIZE));
+            m_archive.read(buffer, chunk);
+            if (static_cast<std::size_t>(m_archive.gcount()) != chunk)
+            {
+                BOOST_THROW_EXCEPTION(
+                    std::runtime_error("Tar archive ended unexpectedly"));
+            }
+            count -= chunk;
+        }
+    }
+
+    std::istream& m_archive;
+    boost::uint64_t m_remaining;
+    std::size_t m_padding;
+};
+}
+} // namespace ssh::detail
+
+#endif
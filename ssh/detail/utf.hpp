@@ -0,0 +1,472 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Conversion between UTF-8 and wide strings.
+ *
+ * Equivalent to `boost::locale::conv::utf_to_utf` between `char` and
+ * `wchar_t`, including what each `method_type` does with invalid input, but
+ * faster, particularly for the mostly-ASCII text that filenames usually
+ * are.  Where the processor has SSE2 (every x64 processor) or NEON (every
+ * AArch64 processor) runs of ASCII are converted 16 characters at a time.
+ * Valid characters below U+10000 are converted inline.  Everything else,
+ * including all invalid input, goes through Boost.Locale's own decoder, so
+ * what is rejected, and what `skip` leaves out, is exactly what Boost does.
+ */
+
+#ifndef SSH_DETAIL_UTF_HPP
+#define SSH_DETAIL_UTF_HPP
+
+#include <boost/locale/encoding.hpp> // conversion_error, method_type
+#include <boost/locale/utf.hpp>      // utf_traits
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef> // size_t
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SSH_DETAIL_UTF_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SSH_DETAIL_UTF_NEON
+#include <arm_neon.h>
+#include <cstring> // memcpy
+#endif
+
+namespace ssh
+{
+namespace detail
+{
+
+namespace utf
+{
+
+inline bool is_trail(char c)
+{
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+/**
+ * Characters converted by each block operation.
+ */
+const std::size_t block_size = 16;
+
+#if defined(SSH_DETAIL_UTF_SSE2) || defined(SSH_DETAIL_UTF_NEON)
+#define SSH_DETAIL_UTF_BLOCKS
+
+/**
+ * Block conversions for a `wchar_t` of `WideSize` bytes.
+ *
+ * Each converts `block_size` characters and returns `true` if they are all
+ * ASCII, otherwise converts nothing and returns `false`.
+ */
+template <std::size_t WideSize>
+struct ascii_block;
+
+#if defined(SSH_DETAIL_UTF_SSE2)
+
+template <>
+struct ascii_block<2>
+{
+    static bool widen(const char* in, wchar_t* out)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        if (_mm_movemask_epi8(bytes) != 0)
+        {
+            return false;
+        }
+
+        __m128i zero = _mm_setzero_si128();
+        __m128i* wide = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(wide, _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128(wide + 1, _mm_unpackhi_epi8(bytes, zero));
+        return true;
+    }
+
+    static bool narrow(const wchar_t* in, char* out)
+    {
+        const __m128i* wide = reinterpret_cast<const __m128i*>(in);
+        __m128i low = _mm_loadu_si128(wide);
+        __m128i high = _mm_loadu_si128(wide + 1);
+
+        __m128i non_ascii = _mm_and_si128(_mm_or_si128(low, high),
+                                          _mm_set1_epi16(~0x7F));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(non_ascii, _mm_setzero_si128())) !=
+            0xFFFF)
+        {
+            return false;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                         _mm_packus_epi16(low, high));
+        return true;
+    }
+};
+
+template <>
+struct ascii_block<4>
+{
+    static bool widen(const char* in, wchar_t* out)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+        if (_mm_movemask_epi8(bytes) != 0)
+        {
+            return false;
+        }
+
+        __m128i zero = _mm_setzero_si128();
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+
+        __m128i* wide = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(wide, _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128(wide + 1, _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128(wide + 2, _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128(wide + 3, _mm_unpackhi_epi16(high, zero));
+        return true;
+    }
+
+    static bool narrow(const wchar_t* in, char* out)
+    {
+        const __m128i* wide = reinterpret_cast<const __m128i*>(in);
+        __m128i first = _mm_loadu_si128(wide);
+        __m128i second = _mm_loadu_si128(wide + 1);
+        __m128i third = _mm_loadu_si128(wide + 2);
+        __m128i fourth = _mm_loadu_si128(wide + 3);
+
+        __m128i non_ascii =
+            _mm_and_si128(_mm_or_si128(_mm_or_si128(first, second),
+                                       _mm_or_si128(third, fourth)),
+                          _mm_set1_epi32(~0x7F));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(non_ascii, _mm_setzero_si128())) !=
+            0xFFFF)
+        {
+            return false;
+        }
+
+        // All below 0x80, so neither pack saturates
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out),
+                         _mm_packus_epi16(_mm_packs_epi32(first, second),
+                                          _mm_packs_epi32(third, fourth)));
+        return true;
+    }
+};
+
+#elif defined(SSH_DETAIL_UTF_NEON)
+
+// Loads and stores go through memcpy because wchar_t may not alias the
+// NEON element types
+
+template <>
+struct ascii_block<2>
+{
+    static bool widen(const char* in, wchar_t* out)
+    {
+        uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(in));
+        if (vmaxvq_u8(bytes) >= 0x80)
+        {
+            return false;
+        }
+
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        std::memcpy(out, &low, sizeof(low));
+        std::memcpy(out + 8, &high, sizeof(high));
+        return true;
+    }
+
+    static bool narrow(const wchar_t* in, char* out)
+    {
+        uint16x8_t low;
+        uint16x8_t high;
+        std::memcpy(&low, in, sizeof(low));
+        std::memcpy(&high, in + 8, sizeof(high));
+        if (vmaxvq_u16(vorrq_u16(low, high)) >= 0x80)
+        {
+            return false;
+        }
+
+        vst1q_u8(reinterpret_cast<uint8_t*>(out),
+                 vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        return true;
+    }
+};
+
+template <>
+struct ascii_block<4>
+{
+    static bool widen(const char* in, wchar_t* out)
+    {
+        uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(in));
+        if (vmaxvq_u8(bytes) >= 0x80)
+        {
+            return false;
+        }
+
+        uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+        uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+        uint32x4_t quarters[4] = {
+            vmovl_u16(vget_low_u16(low)), vmovl_u16(vget_high_u16(low)),
+            vmovl_u16(vget_low_u16(high)), vmovl_u16(vget_high_u16(high))};
+        std::memcpy(out, quarters, sizeof(quarters));
+        return true;
+    }
+
+    static bool narrow(const wchar_t* in, char* out)
+    {
+        uint32x4_t quarters[4];
+        std::memcpy(quarters, in, sizeof(quarters));
+        if (vmaxvq_u32(vorrq_u32(vorrq_u32(quarters[0], quarters[1]),
+                                 vorrq_u32(quarters[2], quarters[3]))) >= 0x80)
+        {
+            return false;
+        }
+
+        uint16x8_t low =
+            vcombine_u16(vmovn_u32(quarters[0]), vmovn_u32(quarters[1]));
+        uint16x8_t high =
+            vcombine_u16(vmovn_u32(quarters[2]), vmovn_u32(quarters[3]));
+        vst1q_u8(reinterpret_cast<uint8_t*>(out),
+                 vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        return true;
+    }
+};
+
+#endif
+
+typedef ascii_block<sizeof(wchar_t)> wide_ascii_block;
+
+#endif
+}
+
+/**
+ * Convert UTF-8 to a wide string: UTF-16 where `wchar_t` is 16 bits,
+ * otherwise UTF-32.
+ *
+ * @throws boost::locale::conv::conversion_error if the input is not valid
+ *         UTF-8 and `how` is `stop`.  With `skip`, invalid sequences are left
+ *         out of the result.
+ */
+inline std::wstring
+utf8_to_wide(const char* begin, const char* end,
+             boost::locale::conv::method_type how =
+                 boost::locale::conv::default_method)
+{
+    typedef boost::locale::utf::utf_traits<char> utf8;
+    typedef boost::locale::utf::utf_traits<wchar_t> wide;
+
+    // Never more wide characters than UTF-8 bytes
+    std::wstring result(end - begin, L'\0');
+    if (result.empty())
+    {
+        return result;
+    }
+
+    wchar_t* out = &result[0];
+
+    // After a block that isn't all ASCII, the text probably isn't mostly
+    // ASCII, so stop trying blocks for a while
+    const char* next_block = begin;
+
+    while (begin != end)
+    {
+        if (static_cast<unsigned char>(*begin) < 0x80)
+        {
+#ifdef SSH_DETAIL_UTF_BLOCKS
+            if (begin >= next_block &&
+                static_cast<std::size_t>(end - begin) >= utf::block_size)
+            {
+                if (utf::wide_ascii_block::widen(begin, out))
+                {
+                    begin += utf::block_size;
+                    out += utf::block_size;
+                    continue;
+                }
+
+                next_block = begin + utf::block_size;
+            }
+#endif
+
+            do
+            {
+                *out++ = static_cast<wchar_t>(*begin++);
+            } while (begin != end && static_cast<unsigned char>(*begin) < 0x80);
+
+            continue;
+        }
+
+        // Most non-ASCII filename characters are two or three bytes.  A valid
+        // sequence of either length can be decoded without the general
+        // decoder; anything else, valid or not, is left to it.
+        unsigned char lead = static_cast<unsigned char>(*begin);
+        std::size_t remaining = end - begin;
+        if (lead >= 0xC2 && lead < 0xE0 && remaining >= 2 &&
+            utf::is_trail(begin[1]))
+        {
+            *out++ = static_cast<wchar_t>(((lead & 0x1F) << 6) |
+                                          (begin[1] & 0x3F));
+            begin += 2;
+            continue;
+        }
+        else if (lead >= 0xE0 && lead < 0xF0 && remaining >= 3 &&
+                 utf::is_trail(begin[1]) && utf::is_trail(begin[2]))
+        {
+            unsigned int c = ((lead & 0x0F) << 12) | ((begin[1] & 0x3F) << 6) |
+                             (begin[2] & 0x3F);
+
+            // Not overlong and not a surrogate
+            if (c >= 0x800 && (c < 0xD800 || c > 0xDFFF))
+            {
+                *out++ = static_cast<wchar_t>(c);
+                begin += 3;
+                continue;
+            }
+        }
+
+        boost::locale::utf::code_point c = utf8::decode(begin, end);
+        if (c == boost::locale::utf::illegal ||
+            c == boost::locale::utf::incomplete)
+        {
+            if (how == boost::locale::conv::stop)
+            {
+                BOOST_THROW_EXCEPTION(
+                    boost::locale::conv::conversion_error());
+            }
+        }
+        else
+        {
+            out = wide::encode(c, out);
+        }
+    }
+
+    result.resize(out - result.data());
+    return result;
+}
+
+inline std::wstring
+utf8_to_wide(const std::string& utf8,
+             boost::locale::conv::method_type how =
+                 boost::locale::conv::default_method)
+{
+    return utf8_to_wide(utf8.data(), utf8.data() + utf8.size(), how);
+}
+
+/**
+ * Convert a wide string, UTF-16 or UTF-32 as for `utf8_to_wide`, to UTF-8.
+ *
+ * @throws boost::locale::conv::conversion_error if the input is not valid
+ *         and `how` is `stop`.  With `skip`, invalid characters are left out
+ *         of the result.
+ */
+inline std::string
+wide_to_utf8(const wchar_t* begin, const wchar_t* end,
+             boost::locale::conv::method_type how =
+                 boost::locale::conv::default_method)
+{
+    typedef boost::locale::utf::utf_traits<char> utf8;
+    typedef boost::locale::utf::utf_traits<wchar_t> wide;
+
+    // Big enough for ASCII and grown as needed otherwise.  Writing through a
+    // pointer is much faster than push_back.
+    std::string result(end - begin + utf::block_size, '\0');
+    char* out = &result[0];
+
+    // As in utf8_to_wide
+    const wchar_t* next_block = begin;
+
+    while (begin != end)
+    {
+        // Room for a block or the longest character
+        std::size_t used = out - result.data();
+        if (result.size() - used < utf::block_size)
+        {
+            result.resize(result.size() * 2);
+            out = &result[0] + used;
+        }
+
+        if (static_cast<unsigned long>(*begin) < 0x80)
+        {
+#ifdef SSH_DETAIL_UTF_BLOCKS
+            if (begin >= next_block &&
+                static_cast<std::size_t>(end - begin) >= utf::block_size)
+            {
+                if (utf::wide_ascii_block::narrow(begin, out))
+                {
+                    begin += utf::block_size;
+                    out += utf::block_size;
+                    continue;
+                }
+
+                next_block = begin + utf::block_size;
+            }
+#endif
+
+            *out++ = static_cast<char>(*begin++);
+            continue;
+        }
+
+        // Characters below U+10000 other than surrogates are a single wide
+        // character in UTF-16 and UTF-32 alike
+        unsigned long unit = static_cast<unsigned long>(*begin);
+        if (unit < 0x800)
+        {
+            *out++ = static_cast<char>(0xC0 | (unit >> 6));
+            *out++ = static_cast<char>(0x80 | (unit & 0x3F));
+            ++begin;
+            continue;
+        }
+        else if (unit <= 0xFFFF && (unit < 0xD800 || unit > 0xDFFF))
+        {
+            *out++ = static_cast<char>(0xE0 | (unit >> 12));
+            *out++ = static_cast<char>(0x80 | ((unit >> 6) & 0x3F));
+            *out++ = static_cast<char>(0x80 | (unit & 0x3F));
+            ++begin;
+            continue;
+        }
+
+        boost::locale::utf::code_point c = wide::decode(begin, end);
+        if (c == boost::locale::utf::illegal ||
+            c == boost::locale::utf::incomplete)
+        {
+            if (how == boost::locale::conv::stop)
+            {
+                BOOST_THROW_EXCEPTION(
+                    boost::locale::conv::conversion_error());
+            }
+        }
+        else
+        {
+            out = utf8::encode(c, out);
+        }
+    }
+
+    result.resize(out - result.data());
+    return result;
+}
+
+inline std::string
+wide_to_utf8(const std::wstring& wide,
+             boost::locale::conv::method_type how =
+                 boost::locale::conv::default_method)
+{
+    return wide_to_utf8(wide.data(), wide.data() + wide.size(), how);
+}
+}
+} // namespace ssh::detail
+
+#endif
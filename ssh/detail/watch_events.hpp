@@ -0,0 +1,245 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Reading `inotifywait` events and merging repeated changes to an entry.
+ */
+
+#ifndef SSH_DETAIL_WATCH_EVENTS_HPP
+#define SSH_DETAIL_WATCH_EVENTS_HPP
+
+#include <ssh/filesystem/path.hpp>
+#include <ssh/remote_change.hpp>
+
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM
+#include <boost/optional/optional.hpp>
+
+#include <map>
+#include <string>
+#include <utility> // make_pair
+#include <vector>
+
+namespace ssh
+{
+namespace detail
+{
+
+/**
+ * `inotifywait --format` of one event: the comma-separated event names, a
+ * space, then the entry's name, which is empty for events on the watched
+ * directory itself.
+ *
+ * `inotifywait` ends each event with a newline, so a name holding a newline
+ * is read as two events.  The second is malformed and ignored.
+ */
+const char INOTIFY_EVENT_FORMAT[] = "%e %f";
+
+/**
+ * Events `inotifywait` is asked to report.
+ */
+const char INOTIFY_EVENTS[] = "-e create -e modify -e attrib -e delete "
+                              "-e moved_to -e moved_from -e delete_self "
+                              "-e move_self";
+
+/// @cond INTERNAL
+namespace watch_events
+{
+
+inline bool has_event(const std::string& events, const char* event)
+{
+    std::string::size_type start = 0;
+    while (start <= events.size())
+    {
+        std::string::size_type end = events.find(',', start);
+        if (end == std::string::npos)
+            end = events.size();
+
+        if (events.compare(start, end - start, event) == 0)
+            return true;
+
+        start = end + 1;
+    }
+    return false;
+}
+}
+/// @endcond
+
+/**
+ * Read one line of `inotifywait` output printed with `INOTIFY_EVENT_FORMAT`.
+ *
+ * @returns false for lines that change nothing, such as the `IGNORED` event
+ *          after a watch is removed, and for malformed lines.
+ */
+inline bool parse_inotify_event(const std::string& line,
+                                BOOST_SCOPED_ENUM(remote_change_kind) & kind,
+                                std::string& name)
+{
+    std::string::size_type space = line.find(' ');
+    if (space == std::string::npos)
+        return false;
+
+    std::string events = line.substr(0, space);
+    name = line.substr(space + 1);
+
+    using watch_events::has_event;
+
+    if (has_event(events, "Q_OVERFLOW"))
+    {
+        kind = remote_change_kind::rescan;
+        name.clear();
+    }
+    else if (has_event(events, "DELETE_SELF") ||
+             has_event(events, "MOVE_SELF"))
+    {
+        kind = remote_change_kind::removed;
+        name.clear();
+    }
+    else if (name.empty())
+    {
+        // Other events on the directory itself, such as its attributes
+        // changing, don't change what it holds
+        return false;
+    }
+    else if (has_event(events, "CREATE") || has_event(events, "MOVED_TO"))
+    {
+        kind = remote_change_kind::created;
+    }
+    else if (has_event(events, "DELETE") || has_event(events, "MOVED_FROM"))
+    {
+        kind = remote_change_kind::removed;
+    }
+    else if (has_event(events, "MODIFY") || has_event(events, "ATTRIB"))
+    {
+        kind = remote_change_kind::modified;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Merges the changes to each entry since they were last taken, so a file
+ * written in many pieces is reported once.
+ *
+ * A file created and then modified is reported as created; one created and
+ * then removed isn't reported at all.  Entries are reported in the order
+ * they first changed.
+ */
+class change_coalescer
+{
+public:
+    /**
+     * @param name  Name of the entry in the watched directory, or empty for
+     *              the directory itself.
+     */
+    void add(BOOST_SCOPED_ENUM(remote_change_kind) kind,
+             const std::string& name)
+    {
+        std::map<std::string, pending_kind>::iterator pending =
+            m_pending.find(name);
+        if (pending == m_pending.end())
+        {
+            m_pending.insert(std::make_pair(name, pending_kind(kind)));
+            m_order.push_back(name);
+        }
+        else if (!pending->second)
+        {
+            pending->second = kind;
+        }
+        else
+        {
+            pending->second = combine(*pending->second, kind);
+        }
+    }
+
+    bool empty() const
+    {
+        for (std::map<std::string, pending_kind>::const_iterator it =
+                 m_pending.begin();
+             it != m_pending.end(); ++it)
+        {
+            if (it->second)
+                return false;
+        }
+        return true;
+    }
+
+    /**
+     * The merged changes, with paths in `directory`, leaving none pending.
+     */
+    std::vector<remote_change> take(const ::ssh::filesystem::path& directory)
+    {
+        std::vector<remote_change> changes;
+        for (std::vector<std::string>::const_iterator it = m_order.begin();
+             it != m_order.end(); ++it)
+        {
+            pending_kind kind = m_pending[*it];
+            if (kind)
+            {
+                changes.push_back(remote_change(
+                    *kind, (it->empty()) ? directory : directory / *it));
+            }
+        }
+
+        m_pending.clear();
+        m_order.clear();
+
+        return changes;
+    }
+
+private:
+    /// Empty when changes cancelled each other out.
+    typedef boost::optional<BOOST_SCOPED_ENUM(remote_change_kind)>
+        pending_kind;
+
+    static pending_kind combine(BOOST_SCOPED_ENUM(remote_change_kind) earlier,
+                                BOOST_SCOPED_ENUM(remote_change_kind) later)
+    {
+        if (earlier == remote_change_kind::rescan ||
+            later == remote_change_kind::rescan)
+        {
+            return pending_kind(remote_change_kind::rescan);
+        }
+        else if (earlier == remote_change_kind::created)
+        {
+            if (later == remote_change_kind::removed)
+                return pending_kind();
+            else
+                return pending_kind(remote_change_kind::created);
+        }
+        else if (later == remote_change_kind::removed)
+        {
+            return pending_kind(remote_change_kind::removed);
+        }
+        else
+        {
+            // Replaced or changed in place: either way, still there but
+            // different
+            return pending_kind(remote_change_kind::modified);
+        }
+    }
+
+    std::map<std::string, pending_kind> m_pending;
+    std::vector<std::string> m_order;
+};
+}
+} // namespace ssh::detail
+
+#endif
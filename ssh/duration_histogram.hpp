@@ -0,0 +1,221 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_DURATION_HISTOGRAM_HPP
+#define SSH_DURATION_HISTOGRAM_HPP
+
+#include <boost/chrono/duration.hpp> // nanoseconds
+#include <boost/cstdint.hpp>         // uint64_t
+
+#include <algorithm> // fill, max
+#include <cassert>   // assert
+#include <cstddef>   // size_t
+#include <stdexcept> // out_of_range
+
+namespace ssh
+{
+
+/**
+ * Distribution of durations in power-of-two buckets.
+ *
+ * Bucket 0 counts zero-length durations.  Bucket `i`, for `i > 0`, counts
+ * durations `d` where `2^(i-1) <= d < 2^i` nanoseconds.  The last bucket has
+ * no upper bound and counts everything too long for the others.
+ *
+ * Recording is a handful of integer operations and never allocates, so the
+ * histogram is cheap enough to update on every operation.  It is not
+ * thread-safe; callers must coordinate access themselves.
+ */
+class duration_histogram
+{
+public:
+    typedef boost::chrono::nanoseconds duration;
+
+    static const std::size_t bucket_count = 40;
+
+    duration_histogram() : m_count(0), m_total(0), m_max(0)
+    {
+        std::fill(m_buckets, m_buckets + bucket_count, boost::uint64_t(0));
+    }
+
+    void record(duration d)
+    {
+        duration::rep ticks = (std::max)(d.count(), duration::rep(0));
+
+        ++m_buckets[bucket_index(duration(ticks))];
+        ++m_count;
+        m_total += ticks;
+        m_max = (std::max)(m_max, ticks);
+    }
+
+    /**
+     * Add the contents of another histogram to this one.
+     */
+    void merge(const duration_histogram& other)
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            m_buckets[i] += other.m_buckets[i];
+        }
+
+        m_count += other.m_count;
+        m_total += other.m_total;
+        m_max = (std::max)(m_max, other.m_max);
+    }
+
+    /**
+     * Add durations that were counted into buckets elsewhere.
+     *
+     * For counters that cannot be a histogram themselves, such as the
+     * atomic counters behind the metrics registry.
+     *
+     * @param buckets  Array of `bucket_count` counts, laid out like this
+     *                 histogram's buckets.
+     * @param total    Sum of the durations counted.
+     * @param max      Longest of the durations counted.
+     */
+    void merge(const boost::uint64_t* buckets, duration total, duration max)
+    {
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            m_buckets[i] += buckets[i];
+            m_count += buckets[i];
+        }
+
+        m_total += total.count();
+        m_max = (std::max)(m_max, max.count());
+    }
+
+    /**
+     * Number of durations recorded.
+     */
+    boost::uint64_t count() const
+    {
+        return m_count;
+    }
+
+    /**
+     * Sum of all durations recorded.
+     */
+    duration total() const
+    {
+        return duration(m_total);
+    }
+
+    /**
+     * Longest duration recorded.
+     */
+    duration max() const
+    {
+        return duration(m_max);
+    }
+
+    duration mean() const
+    {
+        return (m_count == 0) ? duration(0)
+                              : duration(m_total /
+                                         static_cast<duration::rep>(m_count));
+    }
+
+    /**
+     * Number of durations recorded in the given bucket.
+     */
+    boost::uint64_t bucket(std::size_t index) const
+    {
+        if (index >= bucket_count)
+        {
+            throw std::out_of_range("No such histogram bucket");
+        }
+
+        return m_buckets[index];
+    }
+
+    /**
+     * Approximate duration below which the given fraction of the recorded
+     * durations lie.
+     *
+     * The result is the upper bound of the bucket containing the requested
+     * rank, capped at the longest recorded duration, so it may overestimate
+     * by up to a factor of two but never underestimates.
+     *
+     * @param fraction  Value between 0 and 1, e.g. 0.99 for the 99th
+     *                  percentile.
+     */
+    duration percentile(double fraction) const
+    {
+        if (m_count == 0)
+        {
+            return duration(0);
+        }
+
+        fraction = (std::min)((std::max)(fraction, 0.0), 1.0);
+
+        boost::uint64_t rank =
+            static_cast<boost::uint64_t>(fraction * (m_count - 1)) + 1;
+        boost::uint64_t seen = 0;
+        for (std::size_t i = 0; i < bucket_count; ++i)
+        {
+            seen += m_buckets[i];
+            if (seen >= rank)
+            {
+                return (std::min)(bucket_upper_bound(i), duration(m_max));
+            }
+        }
+
+        assert(!"rank beyond recorded count");
+        return duration(m_max);
+    }
+
+    /**
+     * Smallest duration that falls beyond the given bucket.
+     *
+     * The unbounded last bucket returns the largest representable duration.
+     */
+    static duration bucket_upper_bound(std::size_t index)
+    {
+        if (index + 1 >= bucket_count)
+        {
+            return (duration::max)();
+        }
+        else
+        {
+            return duration(duration::rep(1) << index);
+        }
+    }
+
+    static std::size_t bucket_index(duration d)
+    {
+        duration::rep ticks = d.count();
+
+        std::size_t index = 0;
+        while (ticks > 0 && index + 1 < bucket_count)
+        {
+            ticks >>= 1;
+            ++index;
+        }
+
+        return index;
+    }
+
+private:
+    boost::uint64_t m_buckets[bucket_count];
+    boost::uint64_t m_count;
+    duration::rep m_total;
+    duration::rep m_max;
+};
+
+} // namespace ssh
+
+#endif
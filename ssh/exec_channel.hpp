@@ -0,0 +1,385 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Running commands on the remote server.
+ */
+
+#ifndef SSH_EXEC_CHANNEL_HPP
+#define SSH_EXEC_CHANNEL_HPP
+
+#include <ssh/detail/exec_channel_state.hpp>
+#include <ssh/detail/session_state.hpp>
+
+#include <boost/iostreams/categories.hpp> // input, output
+#include <boost/iostreams/concepts.hpp>   // device
+#include <boost/iostreams/stream.hpp>
+#include <boost/move/move.hpp> // BOOST_RV_REF, BOOST_MOVABLE_BUT_NOT_COPYABLE
+#include <boost/noncopyable.hpp>
+
+#include <cstddef> // size_t
+#include <ios>     // streamsize
+#include <memory>  // auto_ptr
+#include <string>
+
+#include <libssh2.h> // SSH_EXTENDED_DATA_STDERR
+
+namespace ssh
+{
+
+class session;
+
+class exec_stdin_device;
+class exec_stdout_device;
+class exec_stderr_device;
+
+/**
+ * A command running on the remote server.
+ *
+ * The command's standard input, output and error are reached through
+ * `exec_stdin_stream`, `exec_stdout_stream` and `exec_stderr_stream` (or
+ * their devices) created on the channel.
+ *
+ * The command runs over its own channel of the session, which it shares
+ * with any filesystems and other commands.  Waiting for the command never
+ * holds the session lock, so other threads can use the session while the
+ * command runs.
+ *
+ * The channel window is shared by the command's output and error.  If the
+ * command writes a lot to one while the caller only reads the other, the
+ * command stops when the window fills.  Read both from separate threads, or
+ * redirect one to the other in the command itself, if that could happen.
+ *
+ * Channels are non-copyable.  The channel is closed when the object is
+ * destroyed, which ends the command if it is still running.
+ */
+class exec_channel : private boost::noncopyable
+{
+    BOOST_MOVABLE_BUT_NOT_COPYABLE(exec_channel)
+
+public:
+    /**
+     * Move constructor.
+     */
+    exec_channel(BOOST_RV_REF(exec_channel) other)
+        : m_state(boost::move(other.m_state))
+    {
+    }
+
+    /**
+     * Move-assignment.
+     */
+    exec_channel& operator=(BOOST_RV_REF(exec_channel) other)
+    {
+        m_state = boost::move(other.m_state);
+        return *this;
+    }
+
+    /**
+     * Tell the command there is no more input.
+     *
+     * Closing an `exec_stdin_stream` does the same.  Does nothing if the
+     * input is already closed.
+     */
+    void close_input()
+    {
+        state_ref().close_input();
+    }
+
+    /**
+     * Read whatever output the command has ready, waiting until there is
+     * some.
+     *
+     * `exec_stdout_stream` fills its buffer before handing anything over,
+     * which suits commands that run to completion.  This suits commands,
+     * such as monitors, that report as they go.
+     *
+     * @returns the number of bytes read, or 0 once the output has ended.
+     */
+    std::size_t read_some_output(char* buffer, std::size_t buffer_size)
+    {
+        return state_ref().read(0, buffer, buffer_size);
+    }
+
+    /**
+     * Read whatever the command has written to its standard error, waiting
+     * until there is some.
+     *
+     * @returns the number of bytes read, or 0 once the error has ended.
+     */
+    std::size_t read_some_error(char* buffer, std::size_t buffer_size)
+    {
+        return state_ref().read(SSH_EXTENDED_DATA_STDERR, buffer, buffer_size);
+    }
+
+    /**
+     * Wait for the command to finish and return its exit status.
+     *
+     * Closes the command's input first, as the command may be waiting for
+     * it, and discards any output or error not yet read.
+     */
+    int exit_status()
+    {
+        return state_ref().exit_status();
+    }
+
+    /// @cond INTERNAL
+    class factory_attorney
+    {
+    private:
+        friend class ::ssh::session;
+
+        exec_channel operator()(::ssh::detail::session_state& session,
+                                const std::string& command)
+        {
+            return exec_channel(session, command);
+        }
+    };
+    /// @endcond
+
+private:
+    exec_channel(::ssh::detail::session_state& session,
+                 const std::string& command)
+        : m_state(new ::ssh::detail::exec_channel_state(session, command))
+    {
+    }
+
+    friend class exec_stdin_device;
+    friend class exec_stdout_device;
+    friend class exec_stderr_device;
+
+    ::ssh::detail::exec_channel_state& state_ref()
+    {
+        return *m_state;
+    }
+
+    // Using an auto_ptr (eventually unique_ptr) so that the devices
+    // referencing this state continue to reference a valid object even if
+    // this channel object is moved, as for `sftp_filesystem`.
+    std::auto_ptr<::ssh::detail::exec_channel_state> m_state;
+};
+
+// Only needed for C++03 support with Boost move-emulation because C++11
+// std::swap does this type of swap already
+inline void swap(exec_channel& lhs, exec_channel& rhs)
+{
+    exec_channel tmp(boost::move(lhs));
+    lhs = boost::move(rhs);
+    rhs = boost::move(tmp);
+}
+
+/**
+ * Quote a string so that the remote shell passes it to a command as a single
+ * argument, unchanged.
+ */
+inline std::string shell_quote(const std::string& argument)
+{
+    // Within single quotes nothing is special except the closing quote, so
+    // each embedded quote closes the quoting, adds an escaped quote and
+    // reopens it
+    std::string quoted = "'";
+    for (std::string::const_iterator it = argument.begin();
+         it != argument.end(); ++it)
+    {
+        if (*it == '\'')
+            quoted += "'\\''";
+        else
+            quoted += *it;
+    }
+    quoted += "'";
+
+    return quoted;
+}
+
+namespace detail
+{
+
+const std::streamsize DEFAULT_EXEC_BUFFER_SIZE = 1024 * 32;
+
+struct exec_input_category : boost::iostreams::input,
+                             boost::iostreams::optimally_buffered_tag
+{
+};
+
+struct exec_output_category : boost::iostreams::output,
+                              boost::iostreams::optimally_buffered_tag
+{
+};
+
+inline std::streamsize read_exec_stream(exec_channel_state& channel,
+                                        int stream_id, char* buffer,
+                                        std::streamsize buffer_size)
+{
+    // As for SFTP files, only the end of the stream may cut a read short
+    // (see `ssh::filesystem::detail::read`), so we keep reading until the
+    // buffer is full even though the command may be producing output
+    // slowly.
+
+    std::streamsize count = 0;
+    do
+    {
+        std::size_t rc =
+            channel.read(stream_id, buffer + count,
+                         static_cast<std::size_t>(buffer_size - count));
+        if (rc == 0)
+            break; // EOF
+
+        count += rc;
+    } while (count < buffer_size);
+
+    return (count == 0) ? -1 : count;
+}
+
+/**
+ * Allows setting buffer size on streams over a command's input or output.
+ *
+ * As `sftp_stream`, this passes the buffer size up to the device.
+ */
+template <typename Device>
+class exec_stream : public boost::iostreams::stream<Device>
+{
+public:
+    explicit exec_stream(exec_channel& channel)
+    {
+        this->open(Device(channel));
+    }
+
+    exec_stream(exec_channel& channel, std::streamsize buffer_size)
+    {
+        this->open(Device(channel), buffer_size);
+    }
+};
+}
+
+/**
+ * Device writing to a command's standard input.
+ *
+ * Closing the device tells the command there is no more input.
+ */
+class exec_stdin_device
+    : public boost::iostreams::device<detail::exec_output_category>
+{
+public:
+    explicit exec_stdin_device(exec_channel& channel)
+        : m_channel(&channel.state_ref())
+    {
+    }
+
+    std::streamsize optimal_buffer_size() const
+    {
+        return detail::DEFAULT_EXEC_BUFFER_SIZE;
+    }
+
+    std::streamsize write(const char* data, std::streamsize data_size)
+    {
+        // Must not return a short count; see `ssh::filesystem::detail::write`
+
+        std::streamsize count = 0;
+        while (count < data_size)
+        {
+            count += m_channel->write(
+                data + count, static_cast<std::size_t>(data_size - count));
+        }
+
+        return count;
+    }
+
+    void close()
+    {
+        m_channel->close_input();
+    }
+
+private:
+    ::ssh::detail::exec_channel_state* m_channel;
+};
+
+/**
+ * Stream writing to a command's standard input.
+ *
+ * The `exec_channel` must outlive the stream.
+ */
+typedef detail::exec_stream<exec_stdin_device> exec_stdin_stream;
+
+/**
+ * Device reading a command's standard output.
+ */
+class exec_stdout_device
+    : public boost::iostreams::device<detail::exec_input_category>
+{
+public:
+    explicit exec_stdout_device(exec_channel& channel)
+        : m_channel(&channel.state_ref())
+    {
+    }
+
+    std::streamsize optimal_buffer_size() const
+    {
+        return detail::DEFAULT_EXEC_BUFFER_SIZE;
+    }
+
+    std::streamsize read(char* buffer, std::streamsize buffer_size)
+    {
+        return detail::read_exec_stream(*m_channel, 0, buffer, buffer_size);
+    }
+
+private:
+    ::ssh::detail::exec_channel_state* m_channel;
+};
+
+/**
+ * Stream reading a command's standard output.
+ *
+ * The `exec_channel` must outlive the stream.
+ */
+typedef detail::exec_stream<exec_stdout_device> exec_stdout_stream;
+
+/**
+ * Device reading a command's standard error.
+ */
+class exec_stderr_device
+    : public boost::iostreams::device<detail::exec_input_category>
+{
+public:
+    explicit exec_stderr_device(exec_channel& channel)
+        : m_channel(&channel.state_ref())
+    {
+    }
+
+    std::streamsize optimal_buffer_size() const
+    {
+        return detail::DEFAULT_EXEC_BUFFER_SIZE;
+    }
+
+    std::streamsize read(char* buffer, std::streamsize buffer_size)
+    {
+        return detail::read_exec_stream(*m_channel, SSH_EXTENDED_DATA_STDERR,
+                                        buffer, buffer_size);
+    }
+
+private:
+    ::ssh::detail::exec_channel_state* m_channel;
+};
+
+/**
+ * Stream reading a command's standard error.
+ *
+ * The `exec_channel` must outlive the stream.
+ */
+typedef detail::exec_stream<exec_stderr_device> exec_stderr_stream;
+}
+
+#endif
@@ -20,6 +20,7 @@
 #include <ssh/detail/sftp_channel_state.hpp>
 #include <ssh/detail/libssh2/sftp.hpp>
 #include <ssh/filesystem/path.hpp>
+#include <ssh/sftp_engine.hpp>
 
 #include <boost/cstdint.hpp>                      // uint64_t, uintmax_t
 #include <boost/detail/bitmask.hpp>               // BOOST_BITMASK
@@ -39,8 +40,11 @@
 
 #include <algorithm> // min
 #include <cassert>   // assert
+#include <ctime>     // time_t
+#include <deque>
 #include <exception> // bad_alloc
-#include <stdexcept> // invalid_argument
+#include <map>
+#include <stdexcept> // invalid_argument, logic_error, runtime_error
 #include <string>
 #include <vector>
 
@@ -425,11 +429,9 @@ namespace detail
 inline boost::shared_ptr<::ssh::detail::file_handle_state>
 open_directory(::ssh::detail::sftp_channel_state& channel, const path& path)
 {
-    std::string path_string = path.native();
-
     return boost::make_shared<::ssh::detail::file_handle_state>(
         boost::ref(channel), // http://stackoverflow.com/a/1374266/67013
-        path_string.data(), path_string.size(), 0, 0, LIBSSH2_SFTP_OPENDIR);
+        path.native(), 0, 0, LIBSSH2_SFTP_OPENDIR);
 }
 }
 
@@ -510,6 +512,12 @@ private:
 
     void next_file()
     {
+        if (m_handle->native())
+        {
+            next_native_file();
+            return;
+        }
+
         // yuk! hardcoded buffer sizes. unfortunately, libssh2 doesn't
         // give us a choice so we allocate massive buffers here and then
         // take measures later to reduce the footprint
@@ -523,7 +531,7 @@ private:
             int rc;
             {
                 ::ssh::detail::file_handle_state::scoped_lock lock =
-                    m_handle->aquire_lock();
+                    m_handle->aquire_lock("sftp_readdir");
 
                 rc = ::ssh::detail::libssh2::sftp::readdir_ex(
                     m_handle->session_ptr(), m_handle->sftp_ptr(),
@@ -579,6 +587,38 @@ private:
         }
     }
 
+    void next_native_file()
+    {
+        std::deque<::ssh::detail::native_sftp_entry>& listing =
+            m_handle->native_listing();
+
+        while (true)
+        {
+            if (listing.empty() &&
+                !m_handle->native()->read_directory(m_handle->native_handle(),
+                                                    listing))
+            {
+                m_handle.reset();
+                return;
+            }
+
+            if (listing.empty())
+                continue;
+
+            ::ssh::detail::native_sftp_entry& entry = listing.front();
+            if (entry.filename != "." && entry.filename != "..")
+            {
+                m_file_name.swap(entry.filename);
+                m_long_entry.swap(entry.long_entry);
+                m_attributes = entry.attributes;
+                listing.pop_front();
+                return;
+            }
+
+            listing.pop_front();
+        }
+    }
+
     sftp_file dereference() const
     {
         if (m_handle == NULL)
@@ -643,6 +683,8 @@ BOOST_SCOPED_ENUM_END
 class sftp_input_device;
 class sftp_output_device;
 class sftp_io_device;
+class hashing_input_device;
+class hashing_output_device;
 
 /**
  * Connection to the filesystem on a remote server via an SSH/SFTP connection.
@@ -707,12 +749,17 @@ public:
      */
     file_attributes attributes(const path& file, bool follow_links)
     {
-        std::string file_path = file.native();
+        const std::string& file_path = file.native();
         LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
 
+        if (sftp_ref().native())
+        {
+            attributes = sftp_ref().native()->stat(file_path, follow_links);
+        }
+        else
         {
             ::ssh::detail::sftp_channel_state::scoped_lock lock =
-                sftp_ref().aquire_lock();
+                sftp_ref().aquire_lock("sftp_stat");
 
             ::ssh::detail::libssh2::sftp::stat(
                 sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
@@ -726,7 +773,10 @@ public:
 
     path resolve_link_target(const path& link)
     {
-        std::string link_string = link.native();
+        const std::string& link_string = link.native();
+
+        if (sftp_ref().native())
+            return sftp_ref().native()->readlink(link_string);
 
         return symlink_resolve(link_string.data(), link_string.size(),
                                LIBSSH2_SFTP_READLINK);
@@ -734,12 +784,111 @@ public:
 
     path canonical_path(const path& link)
     {
-        std::string link_string = link.native();
+        const std::string& link_string = link.native();
+
+        if (sftp_ref().native())
+            return sftp_ref().native()->realpath(link_string);
 
         return symlink_resolve(link_string.data(), link_string.size(),
                                LIBSSH2_SFTP_REALPATH);
     }
 
+    /**
+     * The SFTP client this connection uses.
+     */
+    BOOST_SCOPED_ENUM(sftp_engine) engine()
+    {
+        return (sftp_ref().native()) ? sftp_engine::native
+                                     : sftp_engine::libssh2;
+    }
+
+    /**
+     * Protocol extensions the server supports, each mapped to the data the
+     * server announced it with.
+     *
+     * libssh2 doesn't pass on the server's extensions, so this is always
+     * empty unless the connection uses `sftp_engine::native`.
+     */
+    std::map<std::string, std::string> extensions()
+    {
+        if (sftp_ref().native())
+            return sftp_ref().native()->extensions();
+        else
+            return std::map<std::string, std::string>();
+    }
+
+    /**
+     * Whether `rename` can replace an existing destination atomically.
+     *
+     * Only servers with the "posix-rename@openssh.com" extension can.
+     * libssh2 doesn't pass on the server's extensions, so connections using
+     * `sftp_engine::libssh2` assume the server has it until a rename shows
+     * otherwise.  They never can if the libssh2 they use is older than
+     * 1.11.1.
+     */
+    bool can_overwrite_atomically()
+    {
+        if (sftp_ref().native())
+        {
+            return sftp_ref().native()->has_extension(
+                "posix-rename@openssh.com");
+        }
+
+#ifdef SSH_DETAIL_LIBSSH2_POSIX_RENAME
+        return !sftp_ref().posix_rename_refused();
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Limits the server puts on requests, discovered when the connection
+     * opened.
+     *
+     * Only `sftp_engine::native` connections can ask the server, and only
+     * servers with the "limits@openssh.com" extension answer.  Otherwise
+     * these are the limits every server must accept.
+     */
+    sftp_limits limits()
+    {
+        if (sftp_ref().native())
+            return sftp_ref().native()->limits();
+        else
+            return ::ssh::detail::default_sftp_limits();
+    }
+
+    /**
+     * Hash of a file's contents, computed by the server without the file
+     * crossing the connection.
+     *
+     * Needs an `sftp_engine::native` connection to a server with the
+     * "check-file" extension (see `extensions`).
+     *
+     * @param algorithm  The extension's name for the hash, such as "sha256"
+     *                   or "md5".
+     */
+    std::vector<unsigned char> check_file(const path& file,
+                                          const std::string& algorithm)
+    {
+        if (!sftp_ref().native())
+        {
+            BOOST_THROW_EXCEPTION(std::logic_error(
+                "Only the native SFTP engine can ask the server for hashes"));
+        }
+
+        std::string algorithm_used;
+        std::vector<unsigned char> hash = sftp_ref().native()->check_file(
+            file.native(), algorithm, algorithm_used);
+        if (algorithm_used != algorithm)
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Server hashed with " + algorithm_used + " instead of " +
+                algorithm));
+        }
+
+        return hash;
+    }
+
     /// @cond INTERNAL
     /**
      * Defines the single permitted factory of `sftp_filesystem` instances.
@@ -751,9 +900,10 @@ public:
     private:
         friend class ssh::session;
 
-        sftp_filesystem operator()(::ssh::detail::session_state& session_state)
+        sftp_filesystem operator()(::ssh::detail::session_state& session_state,
+                                   BOOST_SCOPED_ENUM(sftp_engine) engine)
         {
-            return sftp_filesystem(session_state);
+            return sftp_filesystem(session_state, engine);
         }
     };
     /// @endcond
@@ -761,14 +911,17 @@ public:
 private:
     friend class factory_attorney;
 
-    explicit sftp_filesystem(::ssh::detail::session_state& session_state)
-        : m_sftp(new ::ssh::detail::sftp_channel_state(session_state))
+    sftp_filesystem(::ssh::detail::session_state& session_state,
+                    BOOST_SCOPED_ENUM(sftp_engine) engine)
+        : m_sftp(new ::ssh::detail::sftp_channel_state(session_state, engine))
     {
     }
 
     friend class sftp_input_device;
     friend class sftp_output_device;
     friend class sftp_io_device;
+    friend class hashing_input_device;
+    friend class hashing_output_device;
 
     friend bool create_directory(sftp_filesystem& fs,
                                  const path& new_directory);
@@ -777,6 +930,8 @@ private:
     friend file_status status(sftp_filesystem& fs, const path& target);
     friend void permissions(sftp_filesystem& fs, const path& file,
                             perms new_permissions);
+    friend void last_write_time(sftp_filesystem& fs, const path& file,
+                                std::time_t new_time);
     friend void rename(sftp_filesystem& fs, const path& source,
                        const path& destination,
                        BOOST_SCOPED_ENUM(overwrite_behaviour) overwrite_hint);
@@ -785,17 +940,26 @@ private:
 
     bool create_directory(const path& new_directory)
     {
-        std::string new_directory_string = new_directory.native();
+        const std::string& new_directory_string = new_directory.native();
+        const long mode = LIBSSH2_SFTP_S_IRWXU | LIBSSH2_SFTP_S_IRGRP |
+                          LIBSSH2_SFTP_S_IXGRP | LIBSSH2_SFTP_S_IROTH |
+                          LIBSSH2_SFTP_S_IXOTH;
         try
         {
-            ::ssh::detail::sftp_channel_state::scoped_lock lock =
-                sftp_ref().aquire_lock();
-            ::ssh::detail::libssh2::sftp::mkdir_ex(
-                sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
-                new_directory_string.data(), new_directory_string.size(),
-                LIBSSH2_SFTP_S_IRWXU | LIBSSH2_SFTP_S_IRGRP |
-                    LIBSSH2_SFTP_S_IXGRP | LIBSSH2_SFTP_S_IROTH |
-                    LIBSSH2_SFTP_S_IXOTH);
+            if (sftp_ref().native())
+            {
+                sftp_ref().native()->make_directory(new_directory_string,
+                                                    mode);
+            }
+            else
+            {
+                ::ssh::detail::sftp_channel_state::scoped_lock lock =
+                    sftp_ref().aquire_lock("sftp_mkdir");
+                ::ssh::detail::libssh2::sftp::mkdir_ex(
+                    sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
+                    new_directory_string.data(), new_directory_string.size(),
+                    mode);
+            }
 
             return true;
         }
@@ -835,11 +999,17 @@ private:
 
     void create_symlink(const path& link, const path& target)
     {
-        std::string link_string = link.native();
-        std::string target_string = target.native();
+        const std::string& link_string = link.native();
+        const std::string& target_string = target.native();
+
+        if (sftp_ref().native())
+        {
+            sftp_ref().native()->symlink(link_string, target_string);
+            return;
+        }
 
         ::ssh::detail::sftp_channel_state::scoped_lock lock =
-            sftp_ref().aquire_lock();
+            sftp_ref().aquire_lock("sftp_symlink");
 
         ::ssh::detail::libssh2::sftp::symlink(
             sftp_ref().session_ptr(), sftp_ref().sftp_ptr(), link_string.data(),
@@ -848,20 +1018,29 @@ private:
 
     file_status status(const path& target)
     {
-        std::string file_path = target.native();
+        const std::string& file_path = target.native();
         LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
 
         {
-            ::ssh::detail::sftp_channel_state::scoped_lock lock =
-                sftp_ref().aquire_lock();
-
             boost::system::error_code ec;
             std::string message;
 
-            ::ssh::detail::libssh2::sftp::stat(
-                sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
-                file_path.data(), file_path.size(), LIBSSH2_SFTP_STAT,
-                &attributes, ec, message);
+            if (sftp_ref().native())
+            {
+                attributes =
+                    sftp_ref().native()->stat(file_path, true, ec, message);
+            }
+            else
+            {
+                ::ssh::detail::sftp_channel_state::scoped_lock lock =
+                    sftp_ref().aquire_lock("sftp_stat");
+
+                ::ssh::detail::libssh2::sftp::stat(
+                    sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
+                    file_path.data(), file_path.size(), LIBSSH2_SFTP_STAT,
+                    &attributes, ec, message);
+            }
+
             if (ec)
             {
                 if (ec == boost::system::errc::no_such_file_or_directory)
@@ -901,25 +1080,71 @@ private:
                 ~(new_permissions & perms::mask) & current_permissions;
         }
 
-        std::string file_path = file.native();
+        const std::string& file_path = file.native();
         LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
         attributes.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
         attributes.permissions =
             static_cast<unsigned long>(new_permissions & perms::mask);
 
+        if (sftp_ref().native())
+        {
+            sftp_ref().native()->setstat(file_path, attributes);
+            return;
+        }
+
+        ::ssh::detail::sftp_channel_state::scoped_lock lock =
+            sftp_ref().aquire_lock("sftp_setstat");
+
+        ::ssh::detail::libssh2::sftp::stat(
+            sftp_ref().session_ptr(), sftp_ref().sftp_ptr(), file_path.data(),
+            file_path.size(), LIBSSH2_SFTP_SETSTAT, &attributes);
+    }
+
+    void last_write_time(const path& file, std::time_t new_time)
+    {
+        const std::string& file_path = file.native();
+        LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+
+        if (sftp_ref().native())
+        {
+            attributes = sftp_ref().native()->stat(file_path, true);
+            set_modification_time(attributes, new_time);
+            sftp_ref().native()->setstat(file_path, attributes);
+            return;
+        }
+
         ::ssh::detail::sftp_channel_state::scoped_lock lock =
-            sftp_ref().aquire_lock();
+            sftp_ref().aquire_lock("sftp_setstat");
+
+        // SFTP only sets both times together, so the access time is read
+        // first to leave it unchanged
+        ::ssh::detail::libssh2::sftp::stat(
+            sftp_ref().session_ptr(), sftp_ref().sftp_ptr(), file_path.data(),
+            file_path.size(), LIBSSH2_SFTP_STAT, &attributes);
+
+        set_modification_time(attributes, new_time);
 
         ::ssh::detail::libssh2::sftp::stat(
             sftp_ref().session_ptr(), sftp_ref().sftp_ptr(), file_path.data(),
             file_path.size(), LIBSSH2_SFTP_SETSTAT, &attributes);
     }
 
+    static void set_modification_time(LIBSSH2_SFTP_ATTRIBUTES& attributes,
+                                      std::time_t new_time)
+    {
+        if (!(attributes.flags & LIBSSH2_SFTP_ATTR_ACMODTIME))
+        {
+            attributes.atime = static_cast<unsigned long>(new_time);
+        }
+        attributes.flags = LIBSSH2_SFTP_ATTR_ACMODTIME;
+        attributes.mtime = static_cast<unsigned long>(new_time);
+    }
+
     void rename(const path& source, const path& destination,
                 BOOST_SCOPED_ENUM(overwrite_behaviour) overwrite_hint)
     {
-        std::string source_string = source.native();
-        std::string destination_string = destination.native();
+        const std::string& source_string = source.native();
+        const std::string& destination_string = destination.native();
 
         int flags;
         switch (overwrite_hint)
@@ -943,8 +1168,58 @@ private:
                 std::invalid_argument("Unrecognised overwrite behaviour"));
         }
 
+        // Where possible, one request that atomically replaces the
+        // destination, as version 3 of the protocol can't overwrite at all
+        bool overwrite =
+            overwrite_hint != overwrite_behaviour::prevent_overwrite;
+
+        if (sftp_ref().native())
+        {
+            if (overwrite && can_overwrite_atomically())
+            {
+                sftp_ref().native()->posix_rename(source_string,
+                                                  destination_string);
+            }
+            else
+            {
+                // Version 3 of the protocol has no rename flags, so libssh2
+                // doesn't send them either
+                sftp_ref().native()->rename(source_string, destination_string);
+            }
+            return;
+        }
+
         ::ssh::detail::sftp_channel_state::scoped_lock lock =
-            sftp_ref().aquire_lock();
+            sftp_ref().aquire_lock("sftp_rename");
+
+#ifdef SSH_DETAIL_LIBSSH2_POSIX_RENAME
+        if (overwrite && can_overwrite_atomically())
+        {
+            boost::system::error_code ec;
+            std::string message;
+            ::ssh::detail::libssh2::sftp::posix_rename(
+                sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
+                source_string.data(), source_string.size(),
+                destination_string.data(), destination_string.size(), ec,
+                message);
+
+            if (!ec)
+            {
+                return;
+            }
+            else if (ec == boost::system::errc::operation_not_supported)
+            {
+                // Fall back to an ordinary rename, now and from now on
+                sftp_ref().refuse_posix_rename();
+            }
+            else
+            {
+                SSH_DETAIL_THROW_API_ERROR_CODE_WITH_PATH(
+                    ec, message, "libssh2_sftp_posix_rename_ex",
+                    source_string.data(), source_string.size());
+            }
+        }
+#endif
 
         ::ssh::detail::libssh2::sftp::rename(
             sftp_ref().session_ptr(), sftp_ref().sftp_ptr(),
@@ -1025,12 +1300,26 @@ private:
 
     bool do_remove(const path& target, bool is_directory)
     {
-        std::string target_string = target.native();
+        const std::string& target_string = target.native();
 
         try
         {
+            if (sftp_ref().native())
+            {
+                if (is_directory)
+                {
+                    sftp_ref().native()->remove_directory(target_string);
+                }
+                else
+                {
+                    sftp_ref().native()->remove_file(target_string);
+                }
+
+                return true;
+            }
+
             ::ssh::detail::sftp_channel_state::scoped_lock lock =
-                sftp_ref().aquire_lock();
+                sftp_ref().aquire_lock("sftp_remove");
 
             if (is_directory)
             {
@@ -1075,7 +1364,7 @@ private:
         std::vector<char> target_path_buffer(1024, '\0');
 
         ::ssh::detail::sftp_channel_state::scoped_lock lock =
-            sftp_ref().aquire_lock();
+            sftp_ref().aquire_lock("sftp_readlink");
 
         int len = ::ssh::detail::libssh2::sftp::symlink_ex(
             sftp_ref().session_ptr(), sftp_ref().sftp_ptr(), path, path_len,
@@ -1171,6 +1460,13 @@ inline void create_symlink(sftp_filesystem& fs, const path& link,
  *     path to a file, this function will throw an unspecified
  *     `boost::system::system_error`.
  *
+ *     Servers with the "posix-rename@openssh.com" extension, such as
+ *     OpenSSH, obey both overwriting hints, replacing `destination`
+ *     atomically as POSIX `rename` does.  Like POSIX `rename`, they won't
+ *     replace a directory that isn't empty.  Connections using
+ *     `sftp_engine::libssh2` need libssh2 1.11.1 or later to send the
+ *     request.
+ *
  * @throws `boost::system::system_error` if `destination` is already a
  *         path to a file before this function is called and either
  *         `prevent_overwrite` is specified as `overwrite_hint` or the
@@ -1395,6 +1691,17 @@ inline std::time_t last_write_time(sftp_filesystem& filesystem,
     return status(filesystem, file).last_write_time();
 }
 
+/**
+ * Set the time of the last write to the given file.
+ *
+ * The time of the last access is unchanged.
+ */
+inline void last_write_time(sftp_filesystem& filesystem, const path& file,
+                            std::time_t new_time)
+{
+    filesystem.last_write_time(file, new_time);
+}
+
 /**
  * Determine whether the given file or directory is empty.
  */
@@ -16,14 +16,23 @@
 #ifndef SSH_FILESYSTEM_PATH_HPP
 #define SSH_FILESYSTEM_PATH_HPP
 
+#include <ssh/detail/utf.hpp> // utf8_to_wide, wide_to_utf8
+
 #include <boost/algorithm/string.hpp>
 #include <boost/iterator/iterator_facade.hpp>
 #include <boost/locale/encoding.hpp> // to_utf
 #include <boost/locale/generator.hpp>
 #include <boost/locale/util.hpp> // get_system_locale
+#include <boost/noncopyable.hpp>
 #include <boost/operators.hpp>
+#include <boost/optional/optional.hpp>
+#include <boost/thread/locks.hpp> // lock_guard
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp> // call_once
 #include <boost/throw_exception.hpp>
 
+#include <algorithm> // min, unique
+#include <cstddef>   // NULL, size_t
 #include <locale>
 #include <ostream>
 #include <stdexcept> // logic_error
@@ -45,35 +54,140 @@ namespace detail
  * specially.  A leading separator is the root dirctory and is kept as a token.
  * A trailing separator is a directory path indicator and causes a dot token (.)
  * to be emitted.
+ *
+ * Gives the same elements as `path::iterator` but without making a `path`
+ * for each, so elements can be compared without allocating.  Each element
+ * points into the tokenised string, except the dot token.
  */
-
-// Because the iterators produce paths, std::lexicograpical_compare will not
-// terminate. Therefore we have our own that works on the string form of the
-// path in each segment
-template <typename Iterator>
-inline int lexical_compare(Iterator lhs, const Iterator& lhs_end, Iterator rhs,
-                           const Iterator& rhs_end)
+class path_element_cursor
 {
-    while (lhs != lhs_end && rhs != rhs_end)
+public:
+    explicit path_element_cursor(const std::string& source)
+        : m_source(source),
+          m_data(NULL),
+          m_size(0),
+          m_resume(0),
+          m_trailing_dot(false)
+    {
+        if (m_source.empty())
+        {
+            return;
+        }
+        else if (m_source[0] == '/')
+        {
+            m_data = m_source.data();
+            m_size = 1;
+            m_resume = m_source.find_first_not_of('/');
+        }
+        else
+        {
+            load(0);
+        }
+    }
+
+    bool at_end() const
+    {
+        return m_data == NULL;
+    }
+
+    const char* data() const
     {
-        int comparison = lhs->native().compare(rhs->native());
-        if (comparison == 0)
+        return m_data;
+    }
+
+    std::size_t size() const
+    {
+        return m_size;
+    }
+
+    void next()
+    {
+        if (m_trailing_dot)
+        {
+            m_trailing_dot = false;
+            m_data = ".";
+            m_size = 1;
+            m_resume = std::string::npos;
+        }
+        else
+        {
+            load(m_resume);
+        }
+    }
+
+private:
+    /**
+     * Make the element starting at `position` current.
+     *
+     * `position` is the first character of a segment, or npos if there are
+     * no more elements.
+     */
+    void load(std::string::size_type position)
+    {
+        if (position == std::string::npos)
+        {
+            m_data = NULL;
+            m_size = 0;
+            return;
+        }
+
+        std::string::size_type slash = m_source.find('/', position);
+        m_data = m_source.data() + position;
+        if (slash == std::string::npos)
         {
-            ++lhs;
-            ++rhs;
-            continue;
+            m_size = m_source.size() - position;
+            m_resume = std::string::npos;
         }
         else
+        {
+            m_size = slash - position;
+            m_resume = m_source.find_first_not_of('/', slash);
+            m_trailing_dot = (m_resume == std::string::npos);
+        }
+    }
+
+    const std::string& m_source;
+    const char* m_data;
+    std::size_t m_size;
+    std::string::size_type m_resume;
+    bool m_trailing_dot;
+};
+
+/**
+ * Compare paths an element at a time, as `std::string::compare` would
+ * compare the elements' strings.
+ */
+inline int lexical_compare(const std::string& lhs, const std::string& rhs)
+{
+    path_element_cursor lhs_element(lhs);
+    path_element_cursor rhs_element(rhs);
+
+    while (!lhs_element.at_end() && !rhs_element.at_end())
+    {
+        int comparison =
+            std::char_traits<char>::compare(lhs_element.data(),
+                                            rhs_element.data(),
+                                            (std::min)(lhs_element.size(),
+                                                       rhs_element.size()));
+        if (comparison == 0 && lhs_element.size() != rhs_element.size())
+        {
+            comparison = (lhs_element.size() < rhs_element.size()) ? -1 : 1;
+        }
+
+        if (comparison != 0)
         {
             return comparison;
         }
+
+        lhs_element.next();
+        rhs_element.next();
     }
 
-    if (lhs != lhs_end)
+    if (!lhs_element.at_end())
     {
         return 1;
     }
-    else if (rhs != rhs_end)
+    else if (!rhs_element.at_end())
     {
         return -1;
     }
@@ -130,16 +244,95 @@ find_previous_non_slash(const StringType& string,
     return StringType::npos;
 }
 
+/**
+ * Locales for the system locale, generated once and shared by all threads.
+ *
+ * Generating a locale costs far more than the conversions it is used for.
+ * The system locale's name is still looked up on each use, which only reads
+ * the environment, so a locale is generated again if the name changes.
+ */
+class locale_cache : private boost::noncopyable
+{
+public:
+    static locale_cache& instance()
+    {
+        static boost::once_flag initialise_once = BOOST_ONCE_INIT;
+        boost::call_once(initialise_once, &locale_cache::create_instance);
+
+        return *instance_pointer();
+    }
+
+    /**
+     * The system locale with UTF-8 as its encoding.
+     */
+    std::locale utf8()
+    {
+        return cached(m_utf8, true);
+    }
+
+    /**
+     * The system locale with its own encoding.
+     */
+    std::locale system()
+    {
+        return cached(m_system, false);
+    }
+
+private:
+    struct entry
+    {
+        std::string name;
+        boost::optional<std::locale> locale;
+    };
+
+    locale_cache()
+    {
+    }
+
+    static locale_cache*& instance_pointer()
+    {
+        // Zero-initialised before any code runs, so safe to read from any
+        // thread once call_once has returned
+        static locale_cache* instance;
+        return instance;
+    }
+
+    static void create_instance()
+    {
+        // Never destroyed so that paths converted during static destruction
+        // still have their locales
+        instance_pointer() = new locale_cache();
+    }
+
+    std::locale cached(entry& cache, bool use_utf8)
+    {
+        std::string name = boost::locale::util::get_system_locale(use_utf8);
+
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        if (!cache.locale || cache.name != name)
+        {
+            cache.locale = m_generator.generate(name);
+            cache.name = name;
+        }
+
+        return *cache.locale;
+    }
+
+    boost::mutex m_mutex;
+    boost::locale::generator m_generator;
+    entry m_utf8;
+    entry m_system;
+};
+
 inline std::locale utf8_locale()
 {
-    return boost::locale::generator().generate(
-        boost::locale::util::get_system_locale(true));
+    return locale_cache::instance().utf8();
 }
 
 inline std::locale system_locale()
 {
-    return boost::locale::generator().generate(
-        boost::locale::util::get_system_locale(false));
+    return locale_cache::instance().system();
 }
 
 inline std::string from_source(const std::string& source)
@@ -149,8 +342,7 @@ inline std::string from_source(const std::string& source)
 
 inline std::string from_source(const std::wstring& source)
 {
-    return boost::locale::conv::utf_to_utf<char>(source,
-                                                 boost::locale::conv::stop);
+    return ::ssh::detail::wide_to_utf8(source, boost::locale::conv::stop);
 }
 
 template <typename InputIterator>
@@ -224,11 +416,22 @@ public:
 
     path filename() const;
 
-    string_type native() const
+    /**
+     * The path's UTF-8 string, borrowed from the path.
+     *
+     * The reference is valid until the path is changed or destroyed, so
+     * operations can pass the path on without copying it.
+     */
+    const string_type& native() const
     {
         return m_path;
     }
 
+    const value_type* c_str() const
+    {
+        return m_path.c_str();
+    }
+
     operator string_type() const
     {
         return native();
@@ -246,7 +449,7 @@ public:
     template <>
     std::wstring string() const
     {
-        return boost::locale::conv::utf_to_utf<wchar_t>(m_path);
+        return ::ssh::detail::utf8_to_wide(m_path);
     }
 
     std::string u8string() const
@@ -268,23 +471,55 @@ public:
 
     int compare(const path& rhs) const;
 
+    /**
+     * Make room for the path to grow to `size` bytes without reallocating.
+     */
+    void reserve(string_type::size_type size)
+    {
+        m_path.reserve(size);
+    }
+
     iterator begin() const;
 
     iterator end() const;
 
     path& operator/=(const path& rhs)
     {
+        return (*this) /= rhs.m_path;
+    }
+
+    /**
+     * Append a UTF-8 string, as if it were a path.
+     *
+     * The string is appended in place, without making a path of it first.
+     */
+    path& operator/=(const string_type& rhs)
+    {
+        if (&rhs == &m_path)
+        {
+            // Appending would change rhs as it went
+            string_type copy(rhs);
+            return (*this) /= copy;
+        }
+
         if (!empty())
         {
-            string_type lhs_string = boost::algorithm::trim_right_copy_if(
-                m_path, boost::algorithm::is_any_of("/"));
-            string_type rhs_string = boost::algorithm::trim_left_copy_if(
-                rhs.m_path, boost::algorithm::is_any_of("/"));
-            m_path = lhs_string + '/' + rhs_string;
+            string_type::size_type lhs_end = m_path.find_last_not_of('/');
+            m_path.erase((lhs_end == string_type::npos) ? 0 : lhs_end + 1);
+
+            string_type::size_type rhs_start = rhs.find_first_not_of('/');
+            if (rhs_start == string_type::npos)
+            {
+                rhs_start = rhs.size();
+            }
+
+            m_path.reserve(m_path.size() + 1 + rhs.size() - rhs_start);
+            m_path += '/';
+            m_path.append(rhs, rhs_start, string_type::npos);
         }
         else
         {
-            m_path = rhs.m_path;
+            m_path = rhs;
         }
         return *this;
     }
@@ -308,6 +543,27 @@ private:
         return p;
     }
 
+    static bool both_slashes(value_type lhs, value_type rhs)
+    {
+        return lhs == '/' && rhs == '/';
+    }
+
+    /**
+     * The first `size` characters of this path as a path of their own.
+     *
+     * Repeated separators are merged, as they are when a path is built from
+     * its elements.
+     */
+    path slice(string_type::size_type size) const
+    {
+        path prefix;
+        prefix.m_path.assign(m_path, 0, size);
+        prefix.m_path.erase(std::unique(prefix.m_path.begin(),
+                                        prefix.m_path.end(), &both_slashes),
+                            prefix.m_path.end());
+        return prefix;
+    }
+
     std::string from_utf(const std::locale& locale) const
     {
         return boost::locale::conv::from_utf<char>(m_path, locale,
@@ -638,14 +894,37 @@ private:
 
 inline path path::parent_path() const
 {
-    if (empty())
+    string_type::size_type last_non_slash = m_path.find_last_not_of('/');
+    if (last_non_slash == string_type::npos)
     {
+        // Empty or only the root
         return path();
     }
+
+    string_type::size_type parent_end;
+    if (last_non_slash != m_path.size() - 1)
+    {
+        // The last element is the dot of a trailing slash, so the parent ends
+        // with the segment before it
+        parent_end = last_non_slash + 1;
+    }
     else
     {
-        return path_from_range(begin(), --end());
+        string_type::size_type slash = m_path.rfind('/', last_non_slash);
+        if (slash == string_type::npos)
+        {
+            // Single relative segment
+            return path();
+        }
+
+        string_type::size_type previous_non_slash =
+            m_path.find_last_not_of('/', slash);
+        parent_end = (previous_non_slash == string_type::npos)
+                         ? 1 // Parent is the root
+                         : previous_non_slash + 1;
     }
+
+    return slice(parent_end);
 }
 
 inline path path::relative_path() const
@@ -662,19 +941,33 @@ inline path path::relative_path() const
 
 inline path path::filename() const
 {
+    string_type::size_type last_non_slash = m_path.find_last_not_of('/');
     if (empty())
     {
         return path();
     }
+    else if (last_non_slash == string_type::npos)
+    {
+        return path("/");
+    }
+    else if (last_non_slash != m_path.size() - 1)
+    {
+        return path(".");
+    }
     else
     {
-        return path_from_range(--end(), end());
+        string_type::size_type slash = m_path.rfind('/', last_non_slash);
+        path element;
+        element.m_path.assign(
+            m_path, (slash == string_type::npos) ? 0 : slash + 1,
+            string_type::npos);
+        return element;
     }
 }
 
 inline int path::compare(const path& rhs) const
 {
-    return detail::lexical_compare(begin(), end(), rhs.begin(), rhs.end());
+    return detail::lexical_compare(m_path, rhs.m_path);
 }
 
 inline path::iterator path::begin() const
@@ -713,6 +1006,23 @@ inline path operator/(const path& lhs, const Source& rhs)
     concatenation /= rhs;
     return concatenation;
 }
+
+/**
+ * Join a path and a UTF-8 string, such as a filename from a listing.
+ */
+inline path operator/(const path& lhs, const path::string_type& rhs)
+{
+    path concatenation;
+    concatenation.reserve(lhs.native().size() + 1 + rhs.size());
+    concatenation /= lhs;
+    concatenation /= rhs;
+    return concatenation;
+}
+
+inline path operator/(const path& lhs, const path& rhs)
+{
+    return lhs / rhs.native();
+}
 }
 } // namespace ssh::filesystem
 
@@ -0,0 +1,451 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Paths stored as a tree of shared prefixes, for operations over large
+ * trees.
+ *
+ * Every `path` owns its whole string, so a million paths under
+ * `/srv/data/projects` hold a million copies of that prefix.  A
+ * `path_arena` stores each path as its parent plus its last element, and
+ * stores each distinct element name once.  Paths interned in an arena are
+ * single pointers, so they copy, compare and hash without looking at their
+ * text, which makes them cheap keys for walkers, plans and caches.
+ */
+
+#ifndef SSH_FILESYSTEM_PATH_ARENA_HPP
+#define SSH_FILESYSTEM_PATH_ARENA_HPP
+
+#include <ssh/filesystem/path.hpp>
+
+#include <boost/cstdint.hpp>         // uint32_t
+#include <boost/functional/hash.hpp> // hash_combine, hash_range, hash_value
+#include <boost/noncopyable.hpp>
+#include <boost/operators.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+#include <boost/unordered_set.hpp>
+
+#include <cstddef> // NULL, size_t
+#include <cstring> // memchr, memcmp
+#include <deque>
+#include <functional> // less
+#include <stdexcept>  // invalid_argument
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+namespace filesystem
+{
+
+class path_arena;
+
+namespace detail
+{
+
+struct interned_path_node
+{
+    /// NULL for the first element of a path.
+    const interned_path_node* parent;
+
+    /// Shared by every node whose element has this name.
+    const std::string* name;
+
+    /// Number of elements, counting this one.
+    boost::uint32_t depth;
+
+    /// Length of the path's string.
+    boost::uint32_t size;
+};
+
+/**
+ * An element name that hasn't been copied into a string.
+ */
+struct element_name
+{
+    element_name(const char* data, std::size_t size) : data(data), size(size)
+    {
+    }
+
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * Hashes element names the same way whether or not they are in a string.
+ */
+struct element_name_hash
+{
+    std::size_t operator()(const std::string& name) const
+    {
+        return boost::hash_range(name.data(), name.data() + name.size());
+    }
+
+    std::size_t operator()(const element_name& name) const
+    {
+        return boost::hash_range(name.data, name.data + name.size);
+    }
+};
+
+struct element_name_equal
+{
+    bool operator()(const std::string& lhs, const std::string& rhs) const
+    {
+        return lhs == rhs;
+    }
+
+    bool operator()(const element_name& lhs, const std::string& rhs) const
+    {
+        return lhs.size == rhs.size() &&
+               std::memcmp(lhs.data, rhs.data(), lhs.size) == 0;
+    }
+
+    bool operator()(const std::string& lhs, const element_name& rhs) const
+    {
+        return (*this)(rhs, lhs);
+    }
+};
+}
+
+/**
+ * A path stored in a `path_arena`.
+ *
+ * Only a pointer, valid for as long as the arena that made it.  Paths that
+ * are equal when interned in the same arena are the same `interned_path`,
+ * so equality and hashing compare pointers.  Ordering is also by pointer:
+ * stable, which is enough for `std::map` keys, but unrelated to the paths'
+ * names.  Paths from different arenas must not be compared.
+ */
+class interned_path : boost::totally_ordered<interned_path>
+{
+public:
+    /**
+     * The empty path.
+     */
+    interned_path() : m_node(NULL)
+    {
+    }
+
+    bool empty() const
+    {
+        return m_node == NULL;
+    }
+
+    /**
+     * The path without its last element.
+     */
+    interned_path parent_path() const
+    {
+        return interned_path((m_node) ? m_node->parent : NULL);
+    }
+
+    /**
+     * The last element, as `path::filename` would give it.
+     */
+    const std::string& filename() const
+    {
+        static const std::string no_name;
+        return (m_node) ? *m_node->name : no_name;
+    }
+
+    /**
+     * Number of elements in the path, counting a root as one.
+     */
+    std::size_t depth() const
+    {
+        return (m_node) ? m_node->depth : 0;
+    }
+
+    /**
+     * The path as a `path`, built with a single allocation.
+     */
+    path to_path() const
+    {
+        std::vector<const detail::interned_path_node*> nodes(depth());
+        for (const detail::interned_path_node* node = m_node; node != NULL;
+             node = node->parent)
+        {
+            nodes[node->depth - 1] = node;
+        }
+
+        path joined;
+        if (m_node)
+        {
+            joined.reserve(m_node->size);
+        }
+
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+            joined /= *nodes[i]->name;
+        }
+
+        return joined;
+    }
+
+    friend bool operator==(const interned_path& lhs, const interned_path& rhs)
+    {
+        return lhs.m_node == rhs.m_node;
+    }
+
+    friend bool operator<(const interned_path& lhs, const interned_path& rhs)
+    {
+        return std::less<const detail::interned_path_node*>()(lhs.m_node,
+                                                              rhs.m_node);
+    }
+
+    friend std::size_t hash_value(const interned_path& p)
+    {
+        return boost::hash_value(p.m_node);
+    }
+
+private:
+    friend class path_arena;
+
+    explicit interned_path(const detail::interned_path_node* node)
+        : m_node(node)
+    {
+    }
+
+    const detail::interned_path_node* m_node;
+};
+
+/**
+ * Owns interned paths and the element names they share.
+ *
+ * Interning a path whose parent is already interned only adds its last
+ * element, so walking a tree costs one small node per entry plus one string
+ * per distinct name.  Nothing is freed until the arena is destroyed.
+ *
+ * Not thread-safe: threads sharing an arena must serialise access to it.
+ */
+class path_arena : private boost::noncopyable
+{
+public:
+    /**
+     * The interned form of `p`, interning any of its prefixes not already
+     * in the arena.
+     */
+    interned_path intern(const path& p)
+    {
+        interned_path interned;
+        for (detail::path_element_cursor element(p.native());
+             !element.at_end(); element.next())
+        {
+            interned = child(interned, element.data(), element.size());
+        }
+
+        return interned;
+    }
+
+    /**
+     * The interned form of `p` if it is in the arena, otherwise the empty
+     * path.  Never adds to the arena.
+     */
+    interned_path find(const path& p) const
+    {
+        const detail::interned_path_node* node = NULL;
+        for (detail::path_element_cursor element(p.native());
+             !element.at_end(); element.next())
+        {
+            node = find_child(node, element.data(), element.size());
+            if (node == NULL)
+            {
+                break;
+            }
+        }
+
+        return interned_path(node);
+    }
+
+    /**
+     * The path `parent / name`, where `name` is a single element such as a
+     * filename from a directory listing.
+     */
+    interned_path child(interned_path parent, const std::string& name)
+    {
+        return child(parent, name.data(), name.size());
+    }
+
+    /**
+     * Number of distinct paths, counting each prefix, in the arena.
+     */
+    std::size_t size() const
+    {
+        return m_nodes.size();
+    }
+
+    /**
+     * Number of distinct element names stored.
+     */
+    std::size_t name_count() const
+    {
+        return m_names.size();
+    }
+
+private:
+    interned_path child(interned_path parent, const char* name,
+                        std::size_t name_size)
+    {
+        if (name_size == 0 || (std::memchr(name, '/', name_size) != NULL &&
+                               !(name_size == 1 && parent.empty())))
+        {
+            BOOST_THROW_EXCEPTION(std::invalid_argument(
+                "Path element must be a single non-empty name"));
+        }
+
+        const detail::interned_path_node* existing =
+            find_child(parent.m_node, name, name_size);
+        if (existing)
+        {
+            return interned_path(existing);
+        }
+
+        const std::string* interned_name =
+            &*m_names.insert(std::string(name, name_size)).first;
+
+        detail::interned_path_node node;
+        node.parent = parent.m_node;
+        node.name = interned_name;
+        node.depth = static_cast<boost::uint32_t>(parent.depth() + 1);
+        node.size =
+            static_cast<boost::uint32_t>(joined_size(parent.m_node, name_size));
+        m_nodes.push_back(node);
+
+        const detail::interned_path_node* added = &m_nodes.back();
+        index(added);
+
+        return interned_path(added);
+    }
+
+    const detail::interned_path_node*
+    find_child(const detail::interned_path_node* parent, const char* name,
+               std::size_t name_size) const
+    {
+        if (m_index.empty())
+        {
+            return NULL;
+        }
+
+        name_set::const_iterator interned_name =
+            m_names.find(detail::element_name(name, name_size),
+                         detail::element_name_hash(),
+                         detail::element_name_equal());
+        if (interned_name == m_names.end())
+        {
+            return NULL;
+        }
+
+        const std::string* wanted = &*interned_name;
+        for (std::size_t slot = first_slot(parent, wanted);;
+             slot = (slot + 1) & (m_index.size() - 1))
+        {
+            const detail::interned_path_node* candidate = m_index[slot];
+            if (candidate == NULL)
+            {
+                return NULL;
+            }
+            else if (candidate->parent == parent && candidate->name == wanted)
+            {
+                return candidate;
+            }
+        }
+    }
+
+    /**
+     * Add a node to the index of children, growing it to keep it at most
+     * half full.
+     */
+    void index(const detail::interned_path_node* node)
+    {
+        if ((m_nodes.size()) * 2 > m_index.size())
+        {
+            std::vector<const detail::interned_path_node*> larger(
+                (m_index.empty()) ? 64 : m_index.size() * 2);
+            m_index.swap(larger);
+
+            for (std::size_t i = 0; i < larger.size(); ++i)
+            {
+                if (larger[i])
+                {
+                    insert_into_index(larger[i]);
+                }
+            }
+        }
+
+        insert_into_index(node);
+    }
+
+    void insert_into_index(const detail::interned_path_node* node)
+    {
+        std::size_t slot = first_slot(node->parent, node->name);
+        while (m_index[slot] != NULL)
+        {
+            slot = (slot + 1) & (m_index.size() - 1);
+        }
+
+        m_index[slot] = node;
+    }
+
+    std::size_t first_slot(const detail::interned_path_node* parent,
+                           const std::string* name) const
+    {
+        std::size_t seed = 0;
+        boost::hash_combine(seed, parent);
+        boost::hash_combine(seed, name);
+
+        return seed & (m_index.size() - 1);
+    }
+
+    /**
+     * Length of the string of `parent / name`, joined as `path` joins.
+     */
+    static std::size_t joined_size(const detail::interned_path_node* parent,
+                                   std::size_t name_size)
+    {
+        if (parent == NULL)
+        {
+            return name_size;
+        }
+        else if (parent->parent == NULL && *parent->name == "/")
+        {
+            // The root's separator is shared with the name
+            return parent->size + name_size;
+        }
+        else
+        {
+            return parent->size + 1 + name_size;
+        }
+    }
+
+    typedef boost::unordered_set<std::string, detail::element_name_hash,
+                                 detail::element_name_equal>
+        name_set;
+
+    /// Node-based, so interned names never move.
+    name_set m_names;
+
+    /// A deque, so nodes never move as more are added.
+    std::deque<detail::interned_path_node> m_nodes;
+
+    /// Every node, found by its parent and name with linear probing.  The
+    /// size is always a power of two.
+    std::vector<const detail::interned_path_node*> m_index;
+};
+}
+} // namespace ssh::filesystem
+
+#endif
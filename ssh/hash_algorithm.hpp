@@ -0,0 +1,43 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_HASH_ALGORITHM_HPP
+#define SSH_HASH_ALGORITHM_HPP
+
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+
+namespace ssh
+{
+
+/**
+ * Hashes of file contents that the library can compute.
+ */
+BOOST_SCOPED_ENUM_START(hash_algorithm){
+    sha256, md5,
+
+    /**
+     * XXH64: not cryptographic, but several times faster than the others.
+     * Suited to catching corruption rather than tampering.
+     */
+    xxh64,
+
+    /**
+     * XXH3 (64-bit): as for XXH64 but faster again, particularly with SSE2.
+     */
+    xxh3};
+BOOST_SCOPED_ENUM_END
+}
+
+#endif
@@ -0,0 +1,244 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * SFTP file streams that hash the bytes passing through them.
+ *
+ * Each buffer is hashed as it goes to or comes from the server, while it is
+ * still in cache, so verifying a transfer doesn't mean reading the file a
+ * second time.  The streams can't seek, as the hash only makes sense over
+ * the file read or written in order.
+ */
+
+#ifndef SSH_HASHING_STREAM_HPP
+#define SSH_HASHING_STREAM_HPP
+
+#include <ssh/detail/file_handle_state.hpp>
+#include <ssh/detail/hash.hpp>
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/hash_algorithm.hpp>
+#include <ssh/stream.hpp>
+
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM
+#include <boost/iostreams/categories.hpp> // input, output, ...
+#include <boost/iostreams/concepts.hpp>   // device
+#include <boost/iostreams/stream.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef>   // size_t
+#include <ios>       // streamsize
+#include <memory>    // auto_ptr
+#include <stdexcept> // logic_error
+#include <string>
+
+namespace ssh
+{
+namespace filesystem
+{
+
+namespace detail
+{
+
+/**
+ * Hash shared between a stream and the copies Boost.IOStreams makes of its
+ * device.
+ */
+class stream_hash : private boost::noncopyable
+{
+public:
+    explicit stream_hash(BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+        : m_hash(::ssh::detail::make_hash_function(algorithm))
+    {
+    }
+
+    void update(const char* data, std::streamsize size)
+    {
+        // Reads at the end of the file are fine after the digest is taken
+        if (size == 0)
+            return;
+
+        if (!m_hash.get())
+        {
+            BOOST_THROW_EXCEPTION(
+                std::logic_error("Stream used after its digest was taken"));
+        }
+
+        m_hash->update(data, static_cast<std::size_t>(size));
+    }
+
+    std::string digest()
+    {
+        if (m_hash.get())
+        {
+            m_digest = ::ssh::detail::hex_digest(m_hash->finish());
+            m_hash.reset();
+        }
+
+        return m_digest;
+    }
+
+private:
+    std::auto_ptr<::ssh::detail::hash_function> m_hash;
+    std::string m_digest;
+};
+
+struct hashing_input_category : boost::iostreams::input,
+                                boost::iostreams::optimally_buffered_tag
+{
+};
+
+struct hashing_output_category : boost::iostreams::output,
+                                 boost::iostreams::optimally_buffered_tag
+{
+};
+}
+
+class hashing_input_device
+    : public boost::iostreams::device<detail::hashing_input_category>
+{
+public:
+    hashing_input_device(sftp_filesystem& channel, const path& open_path,
+                         boost::shared_ptr<detail::stream_hash> hash)
+        : m_open_path(open_path),
+          m_handle(detail::open_input_file(channel.sftp_ref(), m_open_path,
+                                           openmode::in)),
+          m_hash(hash)
+    {
+    }
+
+    std::streamsize optimal_buffer_size() const
+    {
+        return detail::optimal_buffer_size(*m_handle);
+    }
+
+    std::streamsize read(char* buffer, std::streamsize buffer_size)
+    {
+        std::streamsize count =
+            detail::read(*m_handle, m_open_path, buffer, buffer_size);
+        m_hash->update(buffer, count);
+        return count;
+    }
+
+private:
+    path m_open_path;
+    boost::shared_ptr<::ssh::detail::file_handle_state> m_handle;
+    boost::shared_ptr<detail::stream_hash> m_hash;
+};
+
+class hashing_output_device
+    : public boost::iostreams::device<detail::hashing_output_category>
+{
+public:
+    hashing_output_device(sftp_filesystem& channel, const path& open_path,
+                          openmode::value opening_mode,
+                          boost::shared_ptr<detail::stream_hash> hash)
+        : m_open_path(open_path),
+          m_handle(detail::open_output_file(channel.sftp_ref(), m_open_path,
+                                            opening_mode)),
+          m_hash(hash)
+    {
+    }
+
+    std::streamsize optimal_buffer_size() const
+    {
+        return detail::optimal_buffer_size(*m_handle);
+    }
+
+    std::streamsize write(const char* data, std::streamsize data_size)
+    {
+        m_hash->update(data, data_size);
+        return detail::write(*m_handle, m_open_path, data, data_size);
+    }
+
+private:
+    path m_open_path;
+    boost::shared_ptr<::ssh::detail::file_handle_state> m_handle;
+    boost::shared_ptr<detail::stream_hash> m_hash;
+};
+
+/**
+ * Input file stream that hashes what it reads.
+ *
+ * Reads ahead of what the stream has handed out, so the digest is only
+ * meaningful once the file has been read to the end.
+ */
+class hashing_ifstream : public boost::iostreams::stream<hashing_input_device>
+{
+public:
+    hashing_ifstream(sftp_filesystem& channel, const path& open_path,
+                     BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+        : m_hash(boost::make_shared<detail::stream_hash>(algorithm))
+    {
+        // Opened here rather than in the initialiser list for the reason
+        // given in `sftp_stream`
+        open(hashing_input_device(channel, open_path, m_hash));
+    }
+
+    /**
+     * Digest of the file's contents as lowercase hexadecimal.
+     *
+     * Nothing more may be read afterwards.
+     */
+    std::string digest()
+    {
+        return m_hash->digest();
+    }
+
+private:
+    boost::shared_ptr<detail::stream_hash> m_hash;
+};
+
+/**
+ * Output file stream that hashes what it writes.
+ *
+ * By default opened as if `openmode::out` is the only flag specified.
+ */
+class hashing_ofstream
+    : public boost::iostreams::stream<hashing_output_device>
+{
+public:
+    hashing_ofstream(sftp_filesystem& channel, const path& open_path,
+                     BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                     ::ssh::filesystem::openmode::value opening_mode =
+                         ::ssh::filesystem::openmode::out)
+        : m_hash(boost::make_shared<detail::stream_hash>(algorithm))
+    {
+        open(hashing_output_device(channel, open_path, opening_mode, m_hash));
+    }
+
+    /**
+     * Digest of everything written as lowercase hexadecimal.
+     *
+     * Flushes the stream first.  Nothing more may be written afterwards.
+     */
+    std::string digest()
+    {
+        flush();
+        return m_hash->digest();
+    }
+
+private:
+    boost::shared_ptr<detail::stream_hash> m_hash;
+};
+}
+} // namespace ssh::filesystem
+
+#endif
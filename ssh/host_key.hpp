@@ -68,7 +68,7 @@ inline std::pair<std::string, int> hostkey(session_state& session)
     // change it, but they might one day.
     // Locking it for the duration makes it thread-safe either way.
 
-    detail::session_state::scoped_lock lock = session.aquire_lock();
+    detail::session_state::scoped_lock lock = session.aquire_lock("hostkey");
 
     size_t len = 0;
     int type = LIBSSH2_HOSTKEY_TYPE_UNKNOWN;
@@ -98,7 +98,8 @@ inline T hostkey_hash(session_state& session, int hash_type)
     // change it, but they might one day.
     // Locking it for the duration makes it thread-safe either way.
 
-    detail::session_state::scoped_lock lock = session.aquire_lock();
+    detail::session_state::scoped_lock lock =
+        session.aquire_lock("hostkey_hash");
 
     const T::value_type* hash_bytes = reinterpret_cast<const T::value_type*>(
         ::libssh2_hostkey_hash(session.session_ptr(), hash_type));
@@ -128,7 +129,7 @@ inline std::string method(session_state& session, int method_type)
     // change it, but they might one day.
     // Locking it for the duration makes it thread-safe either way.
 
-    detail::session_state::scoped_lock lock = session.aquire_lock();
+    detail::session_state::scoped_lock lock = session.aquire_lock("methods");
 
     const char* key_type =
         libssh2_session_methods(session.session_ptr(), method_type);
@@ -87,7 +87,8 @@ public:
      */
     void operator()(const T& entry)
     {
-        detail::session_state::scoped_lock lock = m_session->aquire_lock();
+        detail::session_state::scoped_lock lock =
+            m_session->aquire_lock("knownhost_readline");
 
         detail::libssh2::knownhost::readline(m_session->session_ptr(),
                                              m_hosts.get(), entry.data(),
@@ -178,7 +179,8 @@ inline libssh2_knownhost* next_host(boost::shared_ptr<session_state> session,
 {
     libssh2_knownhost* host = NULL;
 
-    detail::session_state::scoped_lock lock = session->aquire_lock();
+    detail::session_state::scoped_lock lock =
+        session->aquire_lock("knownhost_get");
 
     int rc = ::ssh::detail::libssh2::knownhost::get(
         session->session_ptr(), hosts.get(), &host, current_position);
@@ -210,7 +212,8 @@ inline libssh2_knownhost* add(boost::shared_ptr<session_state> session,
 
     libssh2_knownhost* host = NULL;
 
-    detail::session_state::scoped_lock lock = session->aquire_lock();
+    detail::session_state::scoped_lock lock =
+        session->aquire_lock("knownhost_add");
 
     detail::libssh2::knownhost::add(session->session_ptr(), hosts.get(),
                                     host_or_ip.c_str(),
@@ -281,7 +284,8 @@ public:
         boost::system::error_code ec;
 
         {
-            detail::session_state::scoped_lock lock = m_session->aquire_lock();
+            detail::session_state::scoped_lock lock =
+                m_session->aquire_lock("knownhost_writeline");
 
             detail::libssh2::knownhost::writeline(m_session->session_ptr(),
                                                   m_hosts.get(), m_pos, NULL, 0,
@@ -296,7 +300,8 @@ public:
         std::vector<char> buf(required_len);
 
         {
-            detail::session_state::scoped_lock lock = m_session->aquire_lock();
+            detail::session_state::scoped_lock lock =
+                m_session->aquire_lock("knownhost_writeline");
 
             ::ssh::detail::libssh2::knownhost::writeline(
                 m_session->session_ptr(), m_hosts.get(), m_pos, &buf[0],
@@ -399,7 +404,8 @@ public:
         knownhost_iterator next = it;
         next++;
 
-        detail::session_state::scoped_lock lock = it.m_session->aquire_lock();
+        detail::session_state::scoped_lock lock =
+            it.m_session->aquire_lock("knownhost_del");
 
         // this call invalidates the given iterator
         detail::libssh2::knownhost::del(it.m_session->session_ptr(),
@@ -530,7 +536,8 @@ inline int hostkey_type_to_add_type(ssh::hostkey_type::enum_t type)
 inline boost::shared_ptr<LIBSSH2_KNOWNHOSTS>
 init(boost::shared_ptr<session_state> session)
 {
-    detail::session_state::scoped_lock lock = session->aquire_lock();
+    detail::session_state::scoped_lock lock =
+        session->aquire_lock("knownhost_init");
 
     return boost::shared_ptr<LIBSSH2_KNOWNHOSTS>(
         libssh2::knownhost::init(session->session_ptr()),
@@ -578,7 +585,8 @@ public:
         int rc;
 
         {
-            detail::session_state::scoped_lock lock = m_session->aquire_lock();
+            detail::session_state::scoped_lock lock =
+                m_session->aquire_lock("knownhost_check");
 
             rc = detail::libssh2::knownhost::check(
                 m_session->session_ptr(), m_hosts.get(), host.c_str(),
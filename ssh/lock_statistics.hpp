@@ -0,0 +1,111 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_LOCK_STATISTICS_HPP
+#define SSH_LOCK_STATISTICS_HPP
+
+#include <ssh/duration_histogram.hpp>
+
+#include <boost/cstdint.hpp> // uint64_t
+
+#include <map>
+#include <string>
+
+namespace ssh
+{
+
+/**
+ * How one kind of operation has used the session lock.
+ */
+struct lock_operation_statistics
+{
+    lock_operation_statistics() : acquisitions(0), contended_acquisitions(0)
+    {
+    }
+
+    void merge(const lock_operation_statistics& other)
+    {
+        acquisitions += other.acquisitions;
+        contended_acquisitions += other.contended_acquisitions;
+        wait.merge(other.wait);
+        hold.merge(other.hold);
+    }
+
+    /// Number of times the operation took the lock.
+    boost::uint64_t acquisitions;
+
+    /// Number of those times the lock was already held by another thread.
+    boost::uint64_t contended_acquisitions;
+
+    /// Time spent waiting for the lock before the operation could start.
+    duration_histogram wait;
+
+    /// Time the operation kept the lock once it had it.
+    duration_histogram hold;
+};
+
+/**
+ * Snapshot of session-lock usage, broken down by operation.
+ *
+ * Every libssh2 call made through a session happens under that session's
+ * lock, so these statistics show which operations serialise concurrent
+ * users of the session, and for how long.
+ */
+class lock_statistics
+{
+public:
+    typedef std::map<std::string, lock_operation_statistics> operation_map;
+
+    lock_statistics()
+    {
+    }
+
+    explicit lock_statistics(const operation_map& operations)
+        : m_operations(operations)
+    {
+    }
+
+    /**
+     * Statistics for each operation that took the lock, keyed by operation
+     * name.
+     */
+    const operation_map& operations() const
+    {
+        return m_operations;
+    }
+
+    /**
+     * Statistics for all operations combined.
+     */
+    lock_operation_statistics totals() const
+    {
+        lock_operation_statistics combined;
+
+        for (operation_map::const_iterator it = m_operations.begin();
+             it != m_operations.end(); ++it)
+        {
+            combined.merge(it->second);
+        }
+
+        return combined;
+    }
+
+private:
+    operation_map m_operations;
+};
+
+} // namespace ssh
+
+#endif
@@ -0,0 +1,836 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_METRICS_HPP
+#define SSH_METRICS_HPP
+
+#include <ssh/duration_histogram.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/cstdint.hpp>              // uint64_t
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/filesystem/fstream.hpp>           // ofstream
+#include <boost/filesystem/operations.hpp>        // rename
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/locks.hpp> // lock_guard
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp> // call_once
+#include <boost/thread/thread.hpp> // this_thread::get_id
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // find, remove
+#include <cassert>   // assert
+#include <cstddef>   // size_t
+#include <ios>       // ios_base
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept> // invalid_argument, runtime_error
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+
+/**
+ * Counts and latencies of one kind of SFTP operation.
+ */
+struct operation_metrics
+{
+    operation_metrics() : calls(0), errors(0), bytes(0)
+    {
+    }
+
+    /// Number of times the operation was called.
+    boost::uint64_t calls;
+
+    /// Number of those calls that failed.
+    boost::uint64_t errors;
+
+    /// File data moved by the operation.  Only reads and writes move data.
+    boost::uint64_t bytes;
+
+    /// Time each call took, including waiting for the server to respond.
+    duration_histogram latency;
+};
+
+/**
+ * File data transferred over one live session.
+ */
+struct session_metrics
+{
+    session_metrics() : id(0), bytes_read(0), bytes_written(0)
+    {
+    }
+
+    /// Number identifying the session for the lifetime of the process.
+    boost::uint64_t id;
+
+    boost::uint64_t bytes_read;
+    boost::uint64_t bytes_written;
+};
+
+/**
+ * Snapshot of the metrics registry.
+ */
+class metrics_snapshot
+{
+public:
+    typedef std::map<std::string, operation_metrics> operation_map;
+
+    metrics_snapshot() : m_total_bytes_read(0), m_total_bytes_written(0)
+    {
+    }
+
+    metrics_snapshot(const operation_map& operations,
+                     const std::vector<session_metrics>& sessions,
+                     boost::uint64_t total_bytes_read,
+                     boost::uint64_t total_bytes_written)
+        : m_operations(operations),
+          m_sessions(sessions),
+          m_total_bytes_read(total_bytes_read),
+          m_total_bytes_written(total_bytes_written)
+    {
+    }
+
+    /**
+     * Metrics for each SFTP operation, keyed by operation name.
+     *
+     * Every operation appears, whether or not it has been called.
+     */
+    const operation_map& operations() const
+    {
+        return m_operations;
+    }
+
+    /**
+     * Traffic of each session open at the time of the snapshot.
+     */
+    const std::vector<session_metrics>& sessions() const
+    {
+        return m_sessions;
+    }
+
+    /**
+     * File data read over all sessions, including those since closed.
+     */
+    boost::uint64_t total_bytes_read() const
+    {
+        return m_total_bytes_read;
+    }
+
+    /**
+     * File data written over all sessions, including those since closed.
+     */
+    boost::uint64_t total_bytes_written() const
+    {
+        return m_total_bytes_written;
+    }
+
+private:
+    operation_map m_operations;
+    std::vector<session_metrics> m_sessions;
+    boost::uint64_t m_total_bytes_read;
+    boost::uint64_t m_total_bytes_written;
+};
+
+BOOST_SCOPED_ENUM_START(metrics_format){
+    /**
+     * A single JSON object, with durations in nanoseconds.
+     */
+    json,
+
+    /**
+     * Prometheus text exposition format, with durations in seconds.
+     */
+    prometheus};
+BOOST_SCOPED_ENUM_END
+
+namespace detail
+{
+
+/**
+ * The SFTP operations performed by the wrappers in
+ * ssh/detail/libssh2/sftp.hpp and by the native SFTP engine.
+ *
+ * `extended` counts requests for server extensions, which only the native
+ * engine can make.
+ */
+namespace sftp_operation
+{
+enum type
+{
+    init,
+    open,
+    symlink,
+    readlink,
+    realpath,
+    stat,
+    fstat,
+    unlink,
+    mkdir,
+    rmdir,
+    rename,
+    read,
+    write,
+    readdir,
+    extended
+};
+
+const std::size_t count = extended + 1;
+
+inline const char* name(type operation)
+{
+    static const char* const names[count] = {
+        "init",  "open",  "symlink", "readlink", "realpath",
+        "stat",  "fstat", "unlink",  "mkdir",    "rmdir",
+        "rename", "read", "write",   "readdir",  "extended"};
+
+    assert(operation < count);
+    return names[operation];
+}
+}
+
+/**
+ * Per-session count of file data, registered with the metrics registry for
+ * as long as it exists.
+ */
+class session_traffic : private boost::noncopyable
+{
+public:
+    session_traffic();
+    ~session_traffic();
+
+    void add_read(boost::uint64_t bytes)
+    {
+        m_bytes_read.fetch_add(bytes, boost::memory_order_relaxed);
+    }
+
+    void add_written(boost::uint64_t bytes)
+    {
+        m_bytes_written.fetch_add(bytes, boost::memory_order_relaxed);
+    }
+
+    session_metrics snapshot() const
+    {
+        session_metrics metrics;
+        metrics.id = m_id;
+        metrics.bytes_read = m_bytes_read.load(boost::memory_order_relaxed);
+        metrics.bytes_written =
+            m_bytes_written.load(boost::memory_order_relaxed);
+
+        return metrics;
+    }
+
+private:
+    boost::uint64_t m_id;
+    boost::atomic<boost::uint64_t> m_bytes_read;
+    boost::atomic<boost::uint64_t> m_bytes_written;
+};
+
+/**
+ * Lock-free counters for one operation.
+ */
+struct operation_counters
+{
+    boost::atomic<boost::uint64_t> calls;
+    boost::atomic<boost::uint64_t> errors;
+    boost::atomic<boost::uint64_t> bytes;
+    boost::atomic<boost::uint64_t> total_ns;
+    boost::atomic<boost::uint64_t> max_ns;
+    boost::atomic<boost::uint64_t> buckets[duration_histogram::bucket_count];
+
+    operation_counters()
+    {
+        reset();
+    }
+
+    void record(boost::uint64_t ns, bool failed, boost::uint64_t transferred)
+    {
+        calls.fetch_add(1, boost::memory_order_relaxed);
+        if (failed)
+        {
+            errors.fetch_add(1, boost::memory_order_relaxed);
+        }
+        if (transferred)
+        {
+            bytes.fetch_add(transferred, boost::memory_order_relaxed);
+        }
+        total_ns.fetch_add(ns, boost::memory_order_relaxed);
+
+        boost::uint64_t previous_max = max_ns.load(boost::memory_order_relaxed);
+        while (ns > previous_max &&
+               !max_ns.compare_exchange_weak(previous_max, ns,
+                                             boost::memory_order_relaxed))
+        {
+        }
+
+        std::size_t bucket =
+            duration_histogram::bucket_index(duration_histogram::duration(
+                static_cast<duration_histogram::duration::rep>(ns)));
+        buckets[bucket].fetch_add(1, boost::memory_order_relaxed);
+    }
+
+    void add_to(operation_metrics& metrics) const
+    {
+        metrics.calls += calls.load(boost::memory_order_relaxed);
+        metrics.errors += errors.load(boost::memory_order_relaxed);
+        metrics.bytes += bytes.load(boost::memory_order_relaxed);
+
+        boost::uint64_t counts[duration_histogram::bucket_count];
+        for (std::size_t i = 0; i < duration_histogram::bucket_count; ++i)
+        {
+            counts[i] = buckets[i].load(boost::memory_order_relaxed);
+        }
+
+        metrics.latency.merge(
+            counts, duration_histogram::duration(
+                        static_cast<duration_histogram::duration::rep>(
+                            total_ns.load(boost::memory_order_relaxed))),
+            duration_histogram::duration(
+                static_cast<duration_histogram::duration::rep>(
+                    max_ns.load(boost::memory_order_relaxed))));
+    }
+
+    void reset()
+    {
+        calls.store(0, boost::memory_order_relaxed);
+        errors.store(0, boost::memory_order_relaxed);
+        bytes.store(0, boost::memory_order_relaxed);
+        total_ns.store(0, boost::memory_order_relaxed);
+        max_ns.store(0, boost::memory_order_relaxed);
+        for (std::size_t i = 0; i < duration_histogram::bucket_count; ++i)
+        {
+            buckets[i].store(0, boost::memory_order_relaxed);
+        }
+    }
+};
+
+/**
+ * Counters for every operation, written by a subset of threads.
+ */
+struct counter_stripe
+{
+    operation_counters operations[sftp_operation::count];
+};
+
+class metered_sftp_call;
+}
+
+/**
+ * Process-wide registry of SFTP operation metrics.
+ *
+ * Records how many times each SFTP operation was performed, how many of
+ * those failed, how long each took and how much file data they moved.  It
+ * also tracks the file data read and written over each session.
+ *
+ * Recording operations is off by default; enable it with `enable(true)`.
+ * While off, the only cost to an operation is one relaxed atomic load.
+ * While on, recording updates relaxed atomic counters without taking any
+ * lock.  To keep threads from contending on the same cache lines, the
+ * counters are split into stripes and each thread records into the stripe
+ * picked by its thread ID.  Snapshots add the stripes together.
+ *
+ * Session traffic is always counted, as it is a single atomic add per
+ * stream read or write.
+ */
+class metrics_registry : private boost::noncopyable
+{
+public:
+    typedef boost::function<void(const std::string&)> export_callback;
+
+    static metrics_registry& instance()
+    {
+        static boost::once_flag initialise_once = BOOST_ONCE_INIT;
+        boost::call_once(initialise_once, &metrics_registry::create_instance);
+
+        return *instance_pointer();
+    }
+
+    bool enabled() const
+    {
+        return m_enabled.load(boost::memory_order_relaxed);
+    }
+
+    /**
+     * Start or stop recording SFTP operations.
+     *
+     * Stopping keeps the metrics recorded so far.
+     */
+    void enable(bool enabled)
+    {
+        m_enabled.store(enabled, boost::memory_order_relaxed);
+    }
+
+    metrics_snapshot snapshot() const
+    {
+        metrics_snapshot::operation_map operations;
+        for (std::size_t op = 0; op < detail::sftp_operation::count; ++op)
+        {
+            const char* name = detail::sftp_operation::name(
+                static_cast<detail::sftp_operation::type>(op));
+            operation_metrics& metrics = operations[name];
+
+            for (std::size_t stripe = 0; stripe < stripe_count; ++stripe)
+            {
+                m_stripes[stripe].operations[op].add_to(metrics);
+            }
+        }
+
+        boost::lock_guard<boost::mutex> guard(m_sessions_guard);
+
+        std::vector<session_metrics> sessions;
+        boost::uint64_t total_read = m_closed_sessions_read;
+        boost::uint64_t total_written = m_closed_sessions_written;
+        for (std::vector<const detail::session_traffic*>::const_iterator it =
+                 m_sessions.begin();
+             it != m_sessions.end(); ++it)
+        {
+            session_metrics session = (*it)->snapshot();
+            sessions.push_back(session);
+
+            total_read += session.bytes_read;
+            total_written += session.bytes_written;
+        }
+
+        return metrics_snapshot(operations, sessions, total_read,
+                                total_written);
+    }
+
+    /**
+     * Discard the operation metrics recorded so far.
+     *
+     * Operations that are in progress while the metrics are reset may be
+     * partially counted.  Session traffic is not affected.
+     */
+    void reset()
+    {
+        for (std::size_t stripe = 0; stripe < stripe_count; ++stripe)
+        {
+            for (std::size_t op = 0; op < detail::sftp_operation::count; ++op)
+            {
+                m_stripes[stripe].operations[op].reset();
+            }
+        }
+    }
+
+    /**
+     * Write a snapshot of the metrics to a file.
+     *
+     * The snapshot is written next to the file and then renamed over it, so
+     * readers, such as Prometheus' node exporter, never see a partial file.
+     */
+    void export_to_file(const boost::filesystem::path& file,
+                        BOOST_SCOPED_ENUM(metrics_format) format) const
+    {
+        boost::filesystem::path temporary = file;
+        temporary += ".tmp";
+
+        {
+            boost::filesystem::ofstream stream(
+                temporary, std::ios_base::out | std::ios_base::trunc);
+            if (!stream)
+            {
+                BOOST_THROW_EXCEPTION(std::runtime_error(
+                    "Unable to open metrics file: " + temporary.string()));
+            }
+
+            write(stream, format);
+
+            stream.close();
+            if (!stream)
+            {
+                BOOST_THROW_EXCEPTION(std::runtime_error(
+                    "Unable to write metrics file: " + temporary.string()));
+            }
+        }
+
+        boost::filesystem::rename(temporary, file);
+    }
+
+    /**
+     * Pass a snapshot of the metrics, as text, to a callback.
+     */
+    void export_to_callback(const export_callback& callback,
+                            BOOST_SCOPED_ENUM(metrics_format) format) const
+    {
+        std::ostringstream stream;
+        write(stream, format);
+        callback(stream.str());
+    }
+
+private:
+    friend class detail::session_traffic;
+    friend class detail::metered_sftp_call;
+
+    static const unsigned int stripe_bits = 4;
+    static const std::size_t stripe_count = std::size_t(1) << stripe_bits;
+
+    metrics_registry()
+        : m_enabled(false),
+          m_next_session_id(1),
+          m_closed_sessions_read(0),
+          m_closed_sessions_written(0)
+    {
+    }
+
+    static metrics_registry*& instance_pointer()
+    {
+        // Zero-initialised before any code runs, so safe to read from any
+        // thread once call_once has returned
+        static metrics_registry* instance;
+        return instance;
+    }
+
+    static void create_instance()
+    {
+        // Never destroyed so that sessions and operations running during
+        // static destruction still have a registry to report to
+        instance_pointer() = new metrics_registry();
+    }
+
+    void write(std::ostream& stream,
+               BOOST_SCOPED_ENUM(metrics_format) format) const;
+
+    detail::counter_stripe& current_stripe()
+    {
+        // Thread IDs are mostly pointers, whose low bits are all the same,
+        // so mix the bits before choosing a stripe
+        boost::uint64_t key = hash_value(boost::this_thread::get_id());
+        key *= 0x9E3779B97F4A7C15ULL;
+
+        return m_stripes[key >> (64 - stripe_bits)];
+    }
+
+    void record(detail::sftp_operation::type operation,
+                duration_histogram::duration elapsed, bool failed,
+                boost::uint64_t transferred)
+    {
+        boost::uint64_t ns =
+            static_cast<boost::uint64_t>((std::max)(elapsed.count(),
+                                                    duration_histogram::
+                                                        duration::rep(0)));
+        current_stripe().operations[operation].record(ns, failed, transferred);
+    }
+
+    boost::uint64_t register_session(const detail::session_traffic* session)
+    {
+        boost::lock_guard<boost::mutex> guard(m_sessions_guard);
+        m_sessions.push_back(session);
+
+        return m_next_session_id++;
+    }
+
+    void unregister_session(const detail::session_traffic* session)
+    {
+        session_metrics final_counts = session->snapshot();
+
+        boost::lock_guard<boost::mutex> guard(m_sessions_guard);
+
+        m_sessions.erase(
+            std::remove(m_sessions.begin(), m_sessions.end(), session),
+            m_sessions.end());
+
+        m_closed_sessions_read += final_counts.bytes_read;
+        m_closed_sessions_written += final_counts.bytes_written;
+    }
+
+    boost::atomic<bool> m_enabled;
+    detail::counter_stripe m_stripes[stripe_count];
+
+    mutable boost::mutex m_sessions_guard;
+    std::vector<const detail::session_traffic*> m_sessions;
+    boost::uint64_t m_next_session_id;
+    boost::uint64_t m_closed_sessions_read;
+    boost::uint64_t m_closed_sessions_written;
+};
+
+/**
+ * Write metrics as a JSON object.
+ *
+ * Latency buckets with no entries are left out.  Each bucket reports its
+ * exclusive upper bound, `lt_ns`, which is `null` for the last, unbounded
+ * bucket.
+ */
+inline void write_json(std::ostream& stream, const metrics_snapshot& metrics)
+{
+    stream << "{\"operations\":{";
+
+    for (metrics_snapshot::operation_map::const_iterator it =
+             metrics.operations().begin();
+         it != metrics.operations().end(); ++it)
+    {
+        const operation_metrics& op = it->second;
+
+        if (it != metrics.operations().begin())
+            stream << ",";
+
+        stream << "\"" << it->first << "\":{"
+               << "\"calls\":" << op.calls << ","
+               << "\"errors\":" << op.errors << ","
+               << "\"bytes\":" << op.bytes << ","
+               << "\"latency_ns\":{"
+               << "\"total\":" << op.latency.total().count() << ","
+               << "\"max\":" << op.latency.max().count() << ","
+               << "\"mean\":" << op.latency.mean().count() << ","
+               << "\"p50\":" << op.latency.percentile(0.5).count() << ","
+               << "\"p90\":" << op.latency.percentile(0.9).count() << ","
+               << "\"p99\":" << op.latency.percentile(0.99).count() << ","
+               << "\"buckets\":[";
+
+        bool first = true;
+        for (std::size_t i = 0; i < duration_histogram::bucket_count; ++i)
+        {
+            if (op.latency.bucket(i) == 0)
+                continue;
+
+            if (!first)
+                stream << ",";
+            first = false;
+
+            stream << "{\"lt_ns\":";
+            if (i + 1 < duration_histogram::bucket_count)
+                stream << duration_histogram::bucket_upper_bound(i).count();
+            else
+                stream << "null";
+            stream << ",\"count\":" << op.latency.bucket(i) << "}";
+        }
+
+        stream << "]}}";
+    }
+
+    stream << "},\"sessions\":[";
+
+    for (std::vector<session_metrics>::const_iterator it =
+             metrics.sessions().begin();
+         it != metrics.sessions().end(); ++it)
+    {
+        if (it != metrics.sessions().begin())
+            stream << ",";
+
+        stream << "{\"id\":" << it->id << ","
+               << "\"bytes_read\":" << it->bytes_read << ","
+               << "\"bytes_written\":" << it->bytes_written << "}";
+    }
+
+    stream << "],\"total_bytes_read\":" << metrics.total_bytes_read()
+           << ",\"total_bytes_written\":" << metrics.total_bytes_written()
+           << "}";
+}
+
+/**
+ * Write metrics in the Prometheus text exposition format.
+ *
+ * Latencies become a histogram per operation, in seconds.  Because
+ * Prometheus buckets are inclusive, each bucket's `le` is a nanosecond less
+ * than the exclusive upper bound the registry uses.
+ */
+inline void write_prometheus(std::ostream& stream,
+                             const metrics_snapshot& metrics)
+{
+    typedef metrics_snapshot::operation_map::const_iterator op_iterator;
+
+    std::streamsize old_precision = stream.precision(12);
+
+    stream << "# HELP ssh_sftp_operations_total SFTP operations performed.\n"
+           << "# TYPE ssh_sftp_operations_total counter\n";
+    for (op_iterator it = metrics.operations().begin();
+         it != metrics.operations().end(); ++it)
+    {
+        stream << "ssh_sftp_operations_total{operation=\"" << it->first
+               << "\"} " << it->second.calls << "\n";
+    }
+
+    stream << "# HELP ssh_sftp_operation_errors_total SFTP operations that "
+              "failed.\n"
+           << "# TYPE ssh_sftp_operation_errors_total counter\n";
+    for (op_iterator it = metrics.operations().begin();
+         it != metrics.operations().end(); ++it)
+    {
+        stream << "ssh_sftp_operation_errors_total{operation=\"" << it->first
+               << "\"} " << it->second.errors << "\n";
+    }
+
+    stream << "# HELP ssh_sftp_operation_bytes_total File data moved by SFTP "
+              "operations.\n"
+           << "# TYPE ssh_sftp_operation_bytes_total counter\n";
+    for (op_iterator it = metrics.operations().begin();
+         it != metrics.operations().end(); ++it)
+    {
+        stream << "ssh_sftp_operation_bytes_total{operation=\"" << it->first
+               << "\"} " << it->second.bytes << "\n";
+    }
+
+    stream << "# HELP ssh_sftp_operation_duration_seconds Time taken by SFTP "
+              "operations.\n"
+           << "# TYPE ssh_sftp_operation_duration_seconds histogram\n";
+    for (op_iterator it = metrics.operations().begin();
+         it != metrics.operations().end(); ++it)
+    {
+        const duration_histogram& latency = it->second.latency;
+
+        boost::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i + 1 < duration_histogram::bucket_count; ++i)
+        {
+            cumulative += latency.bucket(i);
+
+            double le =
+                (duration_histogram::bucket_upper_bound(i).count() - 1) / 1e9;
+            stream << "ssh_sftp_operation_duration_seconds_bucket{operation=\""
+                   << it->first << "\",le=\"" << le << "\"} " << cumulative
+                   << "\n";
+        }
+
+        stream << "ssh_sftp_operation_duration_seconds_bucket{operation=\""
+               << it->first << "\",le=\"+Inf\"} " << latency.count() << "\n"
+               << "ssh_sftp_operation_duration_seconds_sum{operation=\""
+               << it->first << "\"} " << latency.total().count() / 1e9 << "\n"
+               << "ssh_sftp_operation_duration_seconds_count{operation=\""
+               << it->first << "\"} " << latency.count() << "\n";
+    }
+
+    stream << "# HELP ssh_session_bytes_read_total File data read over an "
+              "open session.\n"
+           << "# TYPE ssh_session_bytes_read_total counter\n";
+    for (std::vector<session_metrics>::const_iterator it =
+             metrics.sessions().begin();
+         it != metrics.sessions().end(); ++it)
+    {
+        stream << "ssh_session_bytes_read_total{session=\"" << it->id
+               << "\"} " << it->bytes_read << "\n";
+    }
+
+    stream << "# HELP ssh_session_bytes_written_total File data written over "
+              "an open session.\n"
+           << "# TYPE ssh_session_bytes_written_total counter\n";
+    for (std::vector<session_metrics>::const_iterator it =
+             metrics.sessions().begin();
+         it != metrics.sessions().end(); ++it)
+    {
+        stream << "ssh_session_bytes_written_total{session=\"" << it->id
+               << "\"} " << it->bytes_written << "\n";
+    }
+
+    stream << "# HELP ssh_bytes_read_total File data read over all sessions.\n"
+           << "# TYPE ssh_bytes_read_total counter\n"
+           << "ssh_bytes_read_total " << metrics.total_bytes_read() << "\n"
+           << "# HELP ssh_bytes_written_total File data written over all "
+              "sessions.\n"
+           << "# TYPE ssh_bytes_written_total counter\n"
+           << "ssh_bytes_written_total " << metrics.total_bytes_written()
+           << "\n";
+
+    stream.precision(old_precision);
+}
+
+inline void
+metrics_registry::write(std::ostream& stream,
+                        BOOST_SCOPED_ENUM(metrics_format) format) const
+{
+    switch (format)
+    {
+    case metrics_format::json:
+        write_json(stream, snapshot());
+        break;
+
+    case metrics_format::prometheus:
+        write_prometheus(stream, snapshot());
+        break;
+
+    default:
+        BOOST_THROW_EXCEPTION(
+            std::invalid_argument("Unrecognised metrics format"));
+    }
+}
+
+namespace detail
+{
+
+inline session_traffic::session_traffic() : m_bytes_read(0), m_bytes_written(0)
+{
+    m_id = metrics_registry::instance().register_session(this);
+}
+
+inline session_traffic::~session_traffic()
+{
+    metrics_registry::instance().unregister_session(this);
+}
+
+/**
+ * Records one call to a libssh2 SFTP function with the metrics registry.
+ *
+ * Create one on the stack before making the call.  When it goes out of
+ * scope, it records how long it existed and whether the error code it was
+ * given is set, so the code must be clear when the call starts.
+ */
+class metered_sftp_call : private boost::noncopyable
+{
+    typedef boost::chrono::steady_clock clock;
+
+public:
+    metered_sftp_call(sftp_operation::type operation,
+                      const boost::system::error_code& ec)
+        : m_operation(operation),
+          m_ec(ec),
+          m_transferred(0),
+          m_enabled(metrics_registry::instance().enabled())
+    {
+        if (m_enabled)
+        {
+            m_start = clock::now();
+        }
+    }
+
+    ~metered_sftp_call()
+    {
+        if (m_enabled)
+        {
+            metrics_registry::instance().record(m_operation,
+                                                clock::now() - m_start,
+                                                static_cast<bool>(m_ec),
+                                                m_transferred);
+        }
+    }
+
+    /**
+     * Note the result of a call that moves file data.
+     *
+     * Negative results are errors and move nothing.
+     */
+    template <typename Count>
+    void transferred(Count count)
+    {
+        if (count > 0)
+        {
+            m_transferred += static_cast<boost::uint64_t>(count);
+        }
+    }
+
+private:
+    sftp_operation::type m_operation;
+    const boost::system::error_code& m_ec;
+    boost::uint64_t m_transferred;
+    bool m_enabled;
+    clock::time_point m_start;
+};
+}
+
+} // namespace ssh
+
+#endif
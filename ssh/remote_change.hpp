@@ -0,0 +1,54 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_REMOTE_CHANGE_HPP
+#define SSH_REMOTE_CHANGE_HPP
+
+#include <ssh/filesystem/path.hpp>
+
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(remote_change_kind){
+    created, modified, removed,
+
+    /**
+     * Changes were lost, so the directory must be listed again to catch up.
+     */
+    rescan};
+BOOST_SCOPED_ENUM_END
+
+/**
+ * A change to an entry in a watched directory, or to the directory itself.
+ */
+struct remote_change
+{
+    remote_change(BOOST_SCOPED_ENUM(remote_change_kind) kind,
+                  const ::ssh::filesystem::path& path)
+        : kind(kind), path(path)
+    {
+    }
+
+    BOOST_SCOPED_ENUM(remote_change_kind) kind;
+
+    /// The changed entry, or the watched directory for changes to the
+    /// directory itself and for `remote_change_kind::rescan`.
+    ::ssh::filesystem::path path;
+};
+}
+
+#endif
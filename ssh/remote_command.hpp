@@ -0,0 +1,136 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Helpers for features that run commands on the server when it allows
+ * them and fall back to SFTP when it doesn't.
+ */
+
+#ifndef SSH_REMOTE_COMMAND_HPP
+#define SSH_REMOTE_COMMAND_HPP
+
+#include <ssh/exec_channel.hpp> // exec_channel, streams, shell_quote
+#include <ssh/session.hpp>
+
+#include <boost/bind/bind.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <ios>      // ios_base
+#include <iterator> // istreambuf_iterator
+#include <string>
+
+namespace ssh
+{
+
+/**
+ * Whether a command is available to the user's shell on the server.
+ *
+ * Servers that only allow SFTP either refuse to run commands or run the SFTP
+ * server whatever the command, so neither is mistaken for the command
+ * being available.
+ */
+inline bool remote_command_available(session& session,
+                                     const std::string& command)
+{
+    try
+    {
+        exec_channel channel = session.exec(
+            "command -v " + shell_quote(command) + " >/dev/null && echo found");
+
+        // Servers that run the SFTP server instead wait for it to be sent
+        // something
+        channel.close_input();
+
+        exec_stdout_stream output(channel);
+        std::string reply;
+        output >> reply;
+
+        return channel.exit_status() == 0 && reply == "found";
+    }
+    catch (const boost::system::system_error&)
+    {
+        return false;
+    }
+}
+
+namespace detail
+{
+
+/**
+ * Collects a command's standard error on another thread.
+ *
+ * The command's output and error share the channel window, so error must be
+ * read while the output is being read, or the command may stop.
+ */
+class command_error_collector : private boost::noncopyable
+{
+public:
+    explicit command_error_collector(exec_channel& channel)
+        : m_stream(channel),
+          m_thread(boost::bind(&command_error_collector::collect, this))
+    {
+    }
+
+    /**
+     * Stop collecting, without waiting for the command to finish.
+     */
+    ~command_error_collector()
+    {
+        if (m_thread.joinable())
+        {
+            m_thread.interrupt();
+            m_thread.join();
+        }
+    }
+
+    /**
+     * Wait for the command to close its standard error and return everything
+     * it wrote there.
+     */
+    std::string text()
+    {
+        if (m_thread.joinable())
+            m_thread.join();
+        return m_text;
+    }
+
+private:
+    void collect()
+    {
+        try
+        {
+            m_stream.exceptions(std::ios_base::badbit);
+            m_text.assign(std::istreambuf_iterator<char>(m_stream),
+                          std::istreambuf_iterator<char>());
+        }
+        catch (...)
+        {
+            // Interrupted, or the channel failed in which case the main
+            // thread sees the failure too
+        }
+    }
+
+    exec_stderr_stream m_stream;
+    std::string m_text;
+    boost::thread m_thread;
+};
+}
+}
+
+#endif
@@ -0,0 +1,402 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Hashing the contents of files on the server.
+ *
+ * Where the server has the matching command, such as `sha256sum`, the files
+ * are hashed there, many to a command, so only the digests cross the
+ * network.  Otherwise each file is downloaded and hashed as it arrives.
+ */
+
+#ifndef SSH_REMOTE_HASH_HPP
+#define SSH_REMOTE_HASH_HPP
+
+#include <ssh/detail/hash.hpp>
+#include <ssh/detail/parallel.hpp>
+#include <ssh/exec_channel.hpp> // exec_channel, streams, shell_quote
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/hash_algorithm.hpp>
+#include <ssh/remote_command.hpp> // remote_command_available
+#include <ssh/session.hpp>
+#include <ssh/stream.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ref.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef>   // size_t
+#include <ios>       // ios_base
+#include <istream>   // getline
+#include <map>
+#include <memory>    // auto_ptr
+#include <stdexcept> // runtime_error, invalid_argument
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(remote_hash_method){
+    /**
+     * Have the SFTP server hash if it can, otherwise hash on the server if
+     * it has the hashing command, otherwise download.
+     */
+    automatic,
+
+    /**
+     * Hash on the server with `sha256sum`, `md5sum`, `xxh64sum` or
+     * `xxh3sum`.
+     */
+    command,
+
+    /**
+     * Ask the SFTP server for each hash with its "check-file" extension.
+     *
+     * Only `sftp_engine::native` connections can, and only for SHA-256 and
+     * MD5.
+     */
+    check_file,
+
+    /**
+     * Download each file and hash it locally.
+     */
+    download};
+BOOST_SCOPED_ENUM_END
+
+namespace detail
+{
+
+const std::size_t HASH_CHUNK_SIZE = 32 * 1024;
+
+/**
+ * Longest command that hashes a batch of files.
+ *
+ * Far below the argument limits of any likely server, while still hashing
+ * hundreds of files per command.
+ */
+const std::size_t MAXIMUM_HASH_COMMAND_SIZE = 32 * 1024;
+
+inline std::string hash_command(BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    switch (algorithm)
+    {
+    case hash_algorithm::sha256:
+        return "sha256sum";
+    case hash_algorithm::md5:
+        return "md5sum";
+    case hash_algorithm::xxh64:
+        return "xxh64sum";
+    case hash_algorithm::xxh3:
+        return "xxh3sum";
+    default:
+        BOOST_THROW_EXCEPTION(
+            std::invalid_argument("No command for hash algorithm"));
+    }
+}
+
+inline std::string hash_of_stream(std::istream& stream,
+                                  BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    std::auto_ptr<hash_function> hash = make_hash_function(algorithm);
+
+    std::vector<char> buffer(HASH_CHUNK_SIZE);
+    while (stream.read(&buffer[0], buffer.size()) || stream.gcount() > 0)
+    {
+        hash->update(&buffer[0], static_cast<std::size_t>(stream.gcount()));
+    }
+
+    return hex_digest(hash->finish());
+}
+
+inline void hash_by_download(::ssh::filesystem::sftp_filesystem& filesystem,
+                             const std::vector<::ssh::filesystem::path>& files,
+                             BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                             std::vector<std::string>& hashes, std::size_t i)
+{
+    ::ssh::filesystem::ifstream stream(filesystem, files[i]);
+    stream.exceptions(std::ios_base::badbit);
+    hashes[i] = hash_of_stream(stream, algorithm);
+}
+
+/**
+ * The "check-file" extension's name for the algorithm, or an empty string
+ * if it has none.
+ */
+inline std::string
+check_file_algorithm(BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    switch (algorithm)
+    {
+    case hash_algorithm::sha256:
+        return "sha256";
+    case hash_algorithm::md5:
+        return "md5";
+    default:
+        return std::string();
+    }
+}
+
+/**
+ * Whether the SFTP server announced the "check-file" extension and, if it
+ * listed the hashes it supports with it, this one among them.
+ */
+inline bool server_checks_files(::ssh::filesystem::sftp_filesystem& filesystem,
+                                BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    std::string name = check_file_algorithm(algorithm);
+    if (name.empty())
+        return false;
+
+    std::map<std::string, std::string> extensions = filesystem.extensions();
+    std::map<std::string, std::string>::const_iterator extension =
+        extensions.find("check-file");
+    if (extension == extensions.end())
+        return false;
+
+    if (extension->second.empty())
+        return true;
+
+    std::string listed = "," + extension->second + ",";
+    return listed.find("," + name + ",") != std::string::npos;
+}
+
+inline void
+hash_by_check_file(::ssh::filesystem::sftp_filesystem& filesystem,
+                   const std::vector<::ssh::filesystem::path>& files,
+                   BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                   std::vector<std::string>& hashes, std::size_t i)
+{
+    std::vector<unsigned char> digest =
+        filesystem.check_file(files[i], check_file_algorithm(algorithm));
+    if (digest.size() != make_hash_function(algorithm)->finish().size())
+    {
+        BOOST_THROW_EXCEPTION(
+            std::runtime_error("Server sent a hash of the wrong size"));
+    }
+
+    hashes[i] = hex_digest(digest);
+}
+
+/**
+ * Digest at the start of a line of `sha256sum` or `md5sum` output.
+ *
+ * Lines for names holding a backslash or newline start with a backslash.
+ * `xxh3sum` puts "XXH3_" before the digest, to tell it apart from XXH64.
+ */
+inline std::string digest_from_line(const std::string& line,
+                                    std::size_t digest_size)
+{
+    std::string::size_type start = (!line.empty() && line[0] == '\\') ? 1 : 0;
+    if (line.compare(start, 5, "XXH3_") == 0)
+        start += 5;
+    std::string digest = line.substr(start, digest_size);
+
+    if (digest.size() != digest_size ||
+        digest.find_first_not_of("0123456789abcdef") != std::string::npos)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::runtime_error("Unexpected hash command output: " + line));
+    }
+
+    return digest;
+}
+
+/**
+ * Hash a batch of files with one command on the server.
+ */
+inline void hash_batch_by_command(
+    session& session, const std::vector<::ssh::filesystem::path>& files,
+    BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+    const std::vector<std::size_t>& batch_starts,
+    std::vector<std::string>& hashes, std::size_t batch)
+{
+    std::size_t first = batch_starts[batch];
+    std::size_t last = batch_starts[batch + 1];
+
+    std::string command = hash_command(algorithm) + " --";
+    for (std::size_t i = first; i < last; ++i)
+    {
+        // Even after "--", a lone "-" means standard input
+        const std::string& name = files[i].native();
+        command += " " + shell_quote((name == "-") ? "./-" : name);
+    }
+
+    exec_channel channel = session.exec(command);
+    command_error_collector errors(channel);
+
+    exec_stdout_stream output(channel);
+    output.exceptions(std::ios_base::badbit);
+
+    std::size_t digest_size = make_hash_function(algorithm)->finish().size();
+    std::size_t i = first;
+    std::string line;
+    while (std::getline(output, line))
+    {
+        if (i < last)
+            hashes[i] = digest_from_line(line, digest_size * 2);
+        ++i;
+    }
+
+    std::string error_text = errors.text();
+    int status = channel.exit_status();
+    if (status != 0 || i != last)
+    {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "Remote " + hash_command(algorithm) + " failed with status " +
+            boost::lexical_cast<std::string>(status) + ": " + error_text));
+    }
+}
+
+/**
+ * Split files into batches whose commands fit `MAXIMUM_HASH_COMMAND_SIZE`.
+ *
+ * @returns the index of each batch's first file, followed by the number of
+ *          files.
+ */
+inline std::vector<std::size_t>
+hash_batches(const std::vector<::ssh::filesystem::path>& files)
+{
+    std::vector<std::size_t> starts(1, 0);
+
+    std::size_t command_size = 0;
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        // Allowing for the quoting
+        std::size_t argument_size = files[i].native().size() + 4;
+        if (command_size > 0 &&
+            command_size + argument_size > MAXIMUM_HASH_COMMAND_SIZE)
+        {
+            starts.push_back(i);
+            command_size = 0;
+        }
+        command_size += argument_size;
+    }
+
+    starts.push_back(files.size());
+    return starts;
+}
+}
+
+/**
+ * Hashes of the contents of several files on the server.
+ *
+ * Hashing runs over up to `parallelism` commands, requests or downloads at
+ * once.
+ *
+ * @returns each file's digest as lowercase hexadecimal, in the same order as
+ *          `files`.
+ */
+inline std::vector<std::string>
+remote_hashes(session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+              const std::vector<::ssh::filesystem::path>& files,
+              BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+              BOOST_SCOPED_ENUM(remote_hash_method) method =
+                  remote_hash_method::automatic,
+              unsigned int parallelism = 4)
+{
+    std::vector<std::string> hashes(files.size());
+    if (files.empty())
+        return hashes;
+
+    if (method == remote_hash_method::automatic)
+    {
+        if (detail::server_checks_files(filesystem, algorithm))
+        {
+            method = remote_hash_method::check_file;
+        }
+        else
+        {
+            method = remote_command_available(session,
+                                              detail::hash_command(algorithm))
+                         ? remote_hash_method::command
+                         : remote_hash_method::download;
+        }
+    }
+
+    if (method == remote_hash_method::command)
+    {
+        std::vector<std::size_t> batch_starts = detail::hash_batches(files);
+        detail::run_in_parallel(
+            batch_starts.size() - 1, parallelism,
+            boost::bind(detail::hash_batch_by_command, boost::ref(session),
+                        boost::cref(files), algorithm,
+                        boost::cref(batch_starts), boost::ref(hashes),
+                        _1));
+    }
+    else if (method == remote_hash_method::check_file)
+    {
+        detail::run_in_parallel(
+            files.size(), parallelism,
+            boost::bind(detail::hash_by_check_file, boost::ref(filesystem),
+                        boost::cref(files), algorithm, boost::ref(hashes),
+                        _1));
+    }
+    else
+    {
+        detail::run_in_parallel(
+            files.size(), parallelism,
+            boost::bind(detail::hash_by_download, boost::ref(filesystem),
+                        boost::cref(files), algorithm, boost::ref(hashes),
+                        _1));
+    }
+
+    return hashes;
+}
+
+/**
+ * Hash of the contents of a file on the server.
+ *
+ * @returns the digest as lowercase hexadecimal.
+ */
+inline std::string
+remote_hash(session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+            const ::ssh::filesystem::path& file,
+            BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+            BOOST_SCOPED_ENUM(remote_hash_method) method =
+                remote_hash_method::automatic)
+{
+    std::vector<::ssh::filesystem::path> files(1, file);
+    return remote_hashes(session, filesystem, files, algorithm, method)[0];
+}
+
+/**
+ * Hash of the contents of a local file, for comparing with `remote_hash`.
+ *
+ * @returns the digest as lowercase hexadecimal.
+ */
+inline std::string local_hash(const boost::filesystem::path& file,
+                              BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    boost::filesystem::ifstream stream(file, std::ios_base::binary);
+    if (!stream)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::runtime_error("Unable to open file: " + file.string()));
+    }
+    stream.exceptions(std::ios_base::badbit);
+
+    return detail::hash_of_stream(stream, algorithm);
+}
+}
+
+#endif
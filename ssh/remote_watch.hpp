@@ -0,0 +1,500 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Watching a directory on the server for changes.
+ *
+ * On Linux servers with `inotifywait`, the server pushes each change down
+ * an exec channel as it happens.  Elsewhere the directory's last-write time
+ * is polled over SFTP, and the directory only listed again when that moves.
+ */
+
+#ifndef SSH_REMOTE_WATCH_HPP
+#define SSH_REMOTE_WATCH_HPP
+
+#include <ssh/detail/watch_events.hpp>
+#include <ssh/exec_channel.hpp> // exec_channel, shell_quote
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/remote_change.hpp>
+#include <ssh/remote_command.hpp> // remote_command_available
+#include <ssh/session.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/chrono/duration.hpp>      // milliseconds
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/cstdint.hpp>              // uint64_t
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/exception_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef>   // size_t
+#include <ctime>     // time_t
+#include <map>
+#include <memory>    // auto_ptr
+#include <stdexcept> // runtime_error
+#include <string>
+#include <utility> // pair
+#include <vector>
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(remote_watch_method){
+    /**
+     * Use `inotifywait` if the server has it and it can watch the
+     * directory, otherwise poll.
+     */
+    automatic,
+
+    /**
+     * Have `inotifywait` on the server report each change.
+     */
+    inotify,
+
+    /**
+     * Poll the directory's last-write time over SFTP.
+     *
+     * Only sees changes that alter the directory: entries created, removed
+     * or renamed, including files saved by writing a copy and renaming it
+     * over the original.  Files written in place aren't seen.
+     */
+    poll};
+BOOST_SCOPED_ENUM_END
+
+struct remote_watch_options
+{
+    remote_watch_options()
+        : method(remote_watch_method::automatic),
+          poll_interval(boost::chrono::milliseconds(2000))
+    {
+    }
+
+    BOOST_SCOPED_ENUM(remote_watch_method) method;
+
+    /// Time between checks of the directory when polling.
+    boost::chrono::milliseconds poll_interval;
+};
+
+/**
+ * Reports changes to the entries of a directory on the server.
+ *
+ * Only the directory's own entries are watched, not those of its
+ * subdirectories.  Changes are gathered on a background thread and merged
+ * per entry until taken with `wait_for_changes`.
+ *
+ * The watch ends if the directory is removed or renamed, after reporting
+ * that as a `remote_change_kind::removed` change to the directory.
+ */
+class remote_watch : private boost::noncopyable
+{
+public:
+    /**
+     * Start watching.  Changes made after the constructor returns are
+     * reported.
+     */
+    remote_watch(session& session,
+                 ::ssh::filesystem::sftp_filesystem& filesystem,
+                 const ::ssh::filesystem::path& directory,
+                 const remote_watch_options& options = remote_watch_options())
+        : m_filesystem(filesystem),
+          m_directory(directory),
+          m_options(options),
+          m_method(options.method),
+          m_directory_time(0),
+          m_finished(false)
+    {
+        if (m_method == remote_watch_method::automatic)
+        {
+            m_method = remote_watch_method::poll;
+
+            if (remote_command_available(session, "inotifywait"))
+            {
+                try
+                {
+                    start_inotify(session);
+                    m_method = remote_watch_method::inotify;
+                }
+                catch (const std::runtime_error&)
+                {
+                    // Most often the server's limit on watches
+                }
+            }
+        }
+        else if (m_method == remote_watch_method::inotify)
+        {
+            start_inotify(session);
+        }
+
+        if (m_method == remote_watch_method::poll)
+        {
+            start_polling();
+        }
+    }
+
+    ~remote_watch()
+    {
+        m_worker.interrupt();
+        m_worker.join();
+    }
+
+    /**
+     * How changes are being found: `remote_watch_method::inotify` or
+     * `remote_watch_method::poll`.
+     */
+    BOOST_SCOPED_ENUM(remote_watch_method) method() const
+    {
+        return m_method;
+    }
+
+    /**
+     * Changes since the last call, waiting up to `timeout` for there to be
+     * some.
+     *
+     * Rethrows the error that stopped the watch, if it failed, once the
+     * changes found before it have been taken.
+     *
+     * @returns the changes, merged per entry, or nothing if none came in
+     *          time or the watch has ended.
+     */
+    std::vector<remote_change>
+    wait_for_changes(boost::chrono::milliseconds timeout)
+    {
+        boost::chrono::steady_clock::time_point deadline =
+            boost::chrono::steady_clock::now() + timeout;
+
+        boost::mutex::scoped_lock lock(m_mutex);
+        while (m_pending.empty() && !m_error && !m_finished)
+        {
+            if (m_changed.wait_until(lock, deadline) ==
+                boost::cv_status::timeout)
+            {
+                break;
+            }
+        }
+
+        if (m_pending.empty() && m_error)
+            boost::rethrow_exception(m_error);
+
+        return m_pending.take(m_directory);
+    }
+
+private:
+    /// Type, size and time of each entry, by name, as last polled.
+    typedef std::map<std::string,
+                     std::pair<bool, std::pair<boost::uint64_t, std::time_t> > >
+        poll_listing;
+
+    void start_inotify(session& session)
+    {
+        // So a directory named like an option isn't taken for one
+        std::string directory = m_directory.native();
+        if (!directory.empty() && directory[0] == '-')
+            directory = "./" + directory;
+
+        m_channel.reset(new exec_channel(session.exec(
+            std::string("inotifywait -m ") + detail::INOTIFY_EVENTS +
+            " --format " + shell_quote(detail::INOTIFY_EVENT_FORMAT) + " " +
+            shell_quote(directory))));
+
+        // Changes are only reported once inotifywait says so on its
+        // standard error, which it otherwise only uses to report failure
+        std::string error_text;
+        std::vector<char> buffer(1024);
+        while (error_text.find("Watches established.") == std::string::npos)
+        {
+            std::size_t count =
+                m_channel->read_some_error(&buffer[0], buffer.size());
+            if (count == 0)
+            {
+                int status = m_channel->exit_status();
+                m_channel.reset();
+                BOOST_THROW_EXCEPTION(std::runtime_error(
+                    "Remote inotifywait failed with status " +
+                    boost::lexical_cast<std::string>(status) + ": " +
+                    error_text));
+            }
+            error_text.append(&buffer[0], count);
+        }
+
+        m_worker = boost::thread(
+            boost::bind(&remote_watch::read_inotify_events, this));
+    }
+
+    /**
+     * How long after the directory's time last moved it is listed on every
+     * poll.  Longer than the time's resolution.
+     */
+    static boost::chrono::seconds relist_period()
+    {
+        return boost::chrono::seconds(2);
+    }
+
+    void start_polling()
+    {
+        m_directory_time = last_write_time(m_filesystem, m_directory);
+        m_relist_until = boost::chrono::steady_clock::now() + relist_period();
+        list_directory(m_listing);
+
+        m_worker =
+            boost::thread(boost::bind(&remote_watch::poll_directory, this));
+    }
+
+    void read_inotify_events()
+    {
+        try
+        {
+            std::vector<char> buffer(4096);
+            std::string unfinished_line;
+            for (;;)
+            {
+                std::size_t count =
+                    m_channel->read_some_output(&buffer[0], buffer.size());
+                if (count == 0)
+                {
+                    BOOST_THROW_EXCEPTION(std::runtime_error(
+                        "Remote inotifywait ended unexpectedly"));
+                }
+
+                unfinished_line.append(&buffer[0], count);
+
+                std::vector<std::pair<BOOST_SCOPED_ENUM(remote_change_kind),
+                                      std::string> >
+                    changes;
+                std::string::size_type start = 0;
+                for (std::string::size_type end =
+                         unfinished_line.find('\n', start);
+                     end != std::string::npos;
+                     end = unfinished_line.find('\n', start))
+                {
+                    BOOST_SCOPED_ENUM(remote_change_kind) kind;
+                    std::string name;
+                    if (detail::parse_inotify_event(
+                            unfinished_line.substr(start, end - start), kind,
+                            name))
+                    {
+                        changes.push_back(std::make_pair(kind, name));
+                    }
+                    start = end + 1;
+                }
+                unfinished_line.erase(0, start);
+
+                if (!add_changes(changes))
+                    return;
+            }
+        }
+        catch (const boost::thread_interrupted&)
+        {
+            throw;
+        }
+        catch (...)
+        {
+            fail(boost::current_exception());
+        }
+    }
+
+    void poll_directory()
+    {
+        try
+        {
+            for (;;)
+            {
+                boost::this_thread::sleep_for(m_options.poll_interval);
+
+                if (!poll_once())
+                    return;
+            }
+        }
+        catch (const boost::thread_interrupted&)
+        {
+            throw;
+        }
+        catch (...)
+        {
+            fail(boost::current_exception());
+        }
+    }
+
+    /**
+     * Look for changes to the directory.
+     *
+     * @returns false once the directory has gone.
+     */
+    bool poll_once()
+    {
+        std::vector<std::pair<BOOST_SCOPED_ENUM(remote_change_kind),
+                              std::string> >
+            changes;
+
+        std::time_t time;
+        poll_listing listing;
+        try
+        {
+            time = last_write_time(m_filesystem, m_directory);
+
+            // The time only has whole seconds, so a change in the same second
+            // as a listing leaves it alone.  Listing on every poll until the
+            // time has been still for a while catches those.
+            boost::chrono::steady_clock::time_point now =
+                boost::chrono::steady_clock::now();
+            if (time != m_directory_time)
+                m_relist_until = now + relist_period();
+            else if (now >= m_relist_until)
+                return true;
+
+            list_directory(listing);
+        }
+        catch (const boost::system::system_error& e)
+        {
+            if (e.code() != boost::system::errc::no_such_file_or_directory)
+                throw;
+
+            changes.push_back(
+                std::make_pair(remote_change_kind::removed, std::string()));
+            return add_changes(changes);
+        }
+
+        m_directory_time = time;
+
+        for (poll_listing::const_iterator it = listing.begin();
+             it != listing.end(); ++it)
+        {
+            poll_listing::const_iterator old = m_listing.find(it->first);
+            if (old == m_listing.end())
+            {
+                changes.push_back(
+                    std::make_pair(remote_change_kind::created, it->first));
+            }
+            else if (old->second != it->second)
+            {
+                changes.push_back(
+                    std::make_pair(remote_change_kind::modified, it->first));
+            }
+        }
+
+        for (poll_listing::const_iterator it = m_listing.begin();
+             it != m_listing.end(); ++it)
+        {
+            if (!listing.count(it->first))
+            {
+                changes.push_back(
+                    std::make_pair(remote_change_kind::removed, it->first));
+            }
+        }
+
+        m_listing.swap(listing);
+
+        return add_changes(changes);
+    }
+
+    void list_directory(poll_listing& listing)
+    {
+        ::ssh::filesystem::directory_iterator end;
+        for (::ssh::filesystem::directory_iterator it =
+                 m_filesystem.directory_iterator(m_directory);
+             it != end; ++it)
+        {
+            std::string name = it->path().filename().native();
+            if (name == "." || name == "..")
+                continue;
+
+            using ::ssh::filesystem::file_attributes;
+
+            const file_attributes& attributes = it->attributes();
+            bool is_directory =
+                attributes.type() == file_attributes::directory;
+            std::time_t time = static_cast<std::time_t>(
+                attributes.last_modified().get_value_or(0));
+
+            listing[name] = std::make_pair(
+                is_directory,
+                std::make_pair(attributes.size().get_value_or(0), time));
+        }
+    }
+
+    /**
+     * Hand changes to `wait_for_changes`.
+     *
+     * @returns false once the directory has gone, which ends the watch.
+     */
+    bool add_changes(const std::vector<
+                     std::pair<BOOST_SCOPED_ENUM(remote_change_kind),
+                               std::string> >& changes)
+    {
+        bool directory_removed = false;
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+
+            for (std::size_t i = 0; i < changes.size(); ++i)
+            {
+                m_pending.add(changes[i].first, changes[i].second);
+
+                if (changes[i].first == remote_change_kind::removed &&
+                    changes[i].second.empty())
+                {
+                    directory_removed = true;
+                    m_finished = true;
+                    break;
+                }
+            }
+        }
+
+        if (!changes.empty())
+            m_changed.notify_all();
+
+        return !directory_removed;
+    }
+
+    void fail(boost::exception_ptr error)
+    {
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            m_error = error;
+        }
+        m_changed.notify_all();
+    }
+
+    ::ssh::filesystem::sftp_filesystem& m_filesystem;
+    ::ssh::filesystem::path m_directory;
+    remote_watch_options m_options;
+    BOOST_SCOPED_ENUM(remote_watch_method) m_method;
+
+    // For inotify
+    std::auto_ptr<exec_channel> m_channel;
+
+    // For polling
+    std::time_t m_directory_time;
+    boost::chrono::steady_clock::time_point m_relist_until;
+    poll_listing m_listing;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_changed;
+    detail::change_coalescer m_pending;
+    boost::exception_ptr m_error;
+    bool m_finished;
+
+    boost::thread m_worker;
+};
+}
+
+#endif
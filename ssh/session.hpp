@@ -40,8 +40,12 @@
 #include <ssh/agent.hpp>
 #include <ssh/detail/libssh2/session.hpp>  // ssh::detail::libssh2::session
 #include <ssh/detail/libssh2/userauth.hpp> // ssh::detail::libssh2::userauth
+#include <ssh/exec_channel.hpp> // exec_channel
 #include <ssh/host_key.hpp>
 #include <ssh/filesystem.hpp> // sftp_filesystem
+#include <ssh/lock_statistics.hpp>
+#include <ssh/metrics.hpp> // session_metrics
+#include <ssh/trace.hpp>   // traced_call
 
 #include <boost/algorithm/string/classification.hpp> // is_any_of
 #include <boost/algorithm/string/split.hpp>
@@ -398,10 +402,13 @@ public:
         boost::system::error_code ec;
         std::string message;
 
+        detail::traced_call trace("authentication_methods", ec);
+
         // Locking until we copy out the method string owned by the session.
         // We don't want another thread inadvertently causing it to be
         // overwritten While we're reading it.
-        detail::session_state::scoped_lock lock = session_ref().aquire_lock();
+        detail::session_state::scoped_lock lock =
+            session_ref().aquire_lock("authentication_methods");
 
         const char* method_list = detail::libssh2::userauth::list(
             session_ref().session_ptr(), username.data(), username.size(), ec,
@@ -435,7 +442,8 @@ public:
 
     bool authenticated()
     {
-        detail::session_state::scoped_lock lock = session_ref().aquire_lock();
+        detail::session_state::scoped_lock lock =
+            session_ref().aquire_lock("authenticated");
 
         return ::libssh2_userauth_authenticated(session_ref().session_ptr()) !=
                0;
@@ -464,8 +472,12 @@ public:
         std::string message;
 
         {
+            // Span begins before locking so time spent waiting for other
+            // threads shows up in the trace
+            detail::traced_call trace("authenticate_by_password", ec);
+
             detail::session_state::scoped_lock lock =
-                session_ref().aquire_lock();
+                session_ref().aquire_lock("authenticate_by_password");
 
             detail::libssh2::userauth::password(
                 session_ref().session_ptr(), username.data(), username.size(),
@@ -561,16 +573,27 @@ public:
         detail::challenge_response_translator<ChallengeResponder>
             wrapped_responder(responder);
 
+        detail::traced_call trace("authenticate_interactively");
+
         // IMPORTANT: Locked from this point onwards until returning to the
         // caller so that abstract is not overwritten by another thread
         // before we pull the responder out of it later
-        detail::session_state::scoped_lock lock = session_ref().aquire_lock();
+        detail::session_state::scoped_lock lock =
+            session_ref().aquire_lock("authenticate_interactively");
 
         *::libssh2_session_abstract(session_ref().session_ptr()) =
             &wrapped_responder;
 
-        return wrapped_responder.do_challenge_response(
-            session_ref().session_ptr(), username);
+        try
+        {
+            return wrapped_responder.do_challenge_response(
+                session_ref().session_ptr(), username);
+        }
+        catch (const boost::system::system_error& e)
+        {
+            trace.fail(e.code());
+            throw;
+        }
     }
 
     /**
@@ -585,12 +608,23 @@ public:
                                    const boost::filesystem::path& private_key,
                                    const std::string& passphrase)
     {
-        detail::session_state::scoped_lock lock = session_ref().aquire_lock();
+        detail::traced_call trace("authenticate_by_key_files");
+
+        detail::session_state::scoped_lock lock =
+            session_ref().aquire_lock("authenticate_by_key_files");
 
-        detail::libssh2::userauth::public_key_from_file(
-            session_ref().session_ptr(), username.data(), username.size(),
-            public_key.string().c_str(), private_key.string().c_str(),
-            passphrase.c_str());
+        try
+        {
+            detail::libssh2::userauth::public_key_from_file(
+                session_ref().session_ptr(), username.data(), username.size(),
+                public_key.string().c_str(), private_key.string().c_str(),
+                passphrase.c_str());
+        }
+        catch (const boost::system::system_error& e)
+        {
+            trace.fail(e.code());
+            throw;
+        }
     }
 
     /**
@@ -613,7 +647,79 @@ public:
      */
     filesystem::sftp_filesystem connect_to_filesystem()
     {
-        return filesystem::sftp_filesystem::factory_attorney()(session_ref());
+        return connect_to_filesystem(filesystem::sftp_engine::libssh2);
+    }
+
+    /**
+     * Start a new SFTP connection on this session, using the given SFTP
+     * client.
+     *
+     * @see connect_to_filesystem()
+     */
+    filesystem::sftp_filesystem
+    connect_to_filesystem(BOOST_SCOPED_ENUM(filesystem::sftp_engine) engine)
+    {
+        return filesystem::sftp_filesystem::factory_attorney()(session_ref(),
+                                                               engine);
+    }
+
+    /**
+     * Run a command on the remote server over this SSH session.
+     *
+     * The command is interpreted by the user's login shell on the server.
+     * It can run while filesystems, and other commands, use the session.
+     *
+     * @warning As with `connect_to_filesystem`, it is the caller's
+     *          responsibility to ensure the session outlives the channel.
+     */
+    exec_channel exec(const std::string& command)
+    {
+        return exec_channel::factory_attorney()(session_ref(), command);
+    }
+
+    /**
+     * Start or stop recording how this session's lock is used.
+     *
+     * Every operation on the session, and on the filesystems, streams and
+     * agent identities created from it, takes the session lock.  While
+     * recording, each acquisition records how long it waited for the lock,
+     * whether another thread held it at the time and how long the operation
+     * kept it.  Recording is off by default and costs nothing measurable
+     * while off.
+     *
+     * Stopping recording keeps the statistics gathered so far.
+     */
+    void record_lock_statistics(bool enable)
+    {
+        session_ref().lock_statistics().enable(enable);
+    }
+
+    /**
+     * Lock usage recorded since the session was created or the statistics
+     * were last reset.
+     */
+    ::ssh::lock_statistics lock_statistics()
+    {
+        return session_ref().lock_statistics().snapshot();
+    }
+
+    /**
+     * Discard the lock statistics recorded so far.
+     */
+    void reset_lock_statistics()
+    {
+        session_ref().lock_statistics().reset();
+    }
+
+    /**
+     * File data read and written over this session so far.
+     *
+     * The same figures, identified by `session_metrics::id`, appear in
+     * snapshots of the metrics registry.
+     */
+    session_metrics traffic()
+    {
+        return session_ref().traffic().snapshot();
     }
 
 private:
@@ -0,0 +1,73 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_SFTP_ENGINE_HPP
+#define SSH_SFTP_ENGINE_HPP
+
+#include <boost/cstdint.hpp>                       // uint64_t
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+
+namespace ssh
+{
+namespace filesystem
+{
+
+/**
+ * Which SFTP client a filesystem connection uses to talk to the server.
+ *
+ * Both give the same results through `sftp_filesystem` and the streams.
+ */
+BOOST_SCOPED_ENUM_START(sftp_engine){
+    /**
+     * libssh2's SFTP client.
+     */
+    libssh2,
+
+    /**
+     * The library's own SFTP client.
+     *
+     * Keeps many requests in flight for large reads and writes, and for
+     * threads sharing the filesystem, rather than waiting for each to be
+     * answered.  It can also use the extensions the server supports.
+     */
+    native};
+BOOST_SCOPED_ENUM_END
+
+/**
+ * Limits the server puts on SFTP requests, as the connection applies them.
+ *
+ * Servers that support the "limits@openssh.com" extension report their own
+ * limits.  Otherwise, or where a server reports no limit, each field holds
+ * the size every SFTP server must accept.
+ */
+struct sftp_limits
+{
+    /// Longest packet, including its length field, the server accepts.
+    boost::uint64_t max_packet_length;
+
+    /// Most file data the server sends in reply to one READ request.
+    boost::uint64_t max_read_length;
+
+    /// Most file data the server accepts in one WRITE request.
+    boost::uint64_t max_write_length;
+
+    /// Most files the server lets the connection have open, or 0 if
+    /// unknown or unlimited.
+    boost::uint64_t max_open_handles;
+};
+}
+} // namespace ssh::filesystem
+
+#endif
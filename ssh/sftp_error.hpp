@@ -127,6 +127,9 @@ public:
 
         case LIBSSH2_FX_OP_UNSUPPORTED:
             return boost::system::errc::operation_not_supported;
+
+        case LIBSSH2_FX_DIR_NOT_EMPTY:
+            return boost::system::errc::directory_not_empty;
         default:
             return this->super::default_error_condition(code);
         }
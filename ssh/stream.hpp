@@ -50,6 +50,7 @@
 #include <boost/make_shared.hpp>
 #include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
 
+#include <algorithm> // max
 #include <cassert>   // assert
 #include <stdexcept> // invalid_argument, logic_error
 #include <string>
@@ -298,12 +299,10 @@ inline boost::shared_ptr<::ssh::detail::file_handle_state>
 open_file(::ssh::detail::sftp_channel_state& sftp, const path& open_path,
           openmode::value opening_mode)
 {
-    std::string path_string = open_path.native();
-
     // Open with 644 permissions - good for non-directory files
     return boost::make_shared<::ssh::detail::file_handle_state>(
         boost::ref(sftp), // http://stackoverflow.com/a/1374266/67013
-        path_string.data(), path_string.size(),
+        open_path.native(),
         openmode_to_libssh2_flags(opening_mode),
         LIBSSH2_SFTP_S_IRUSR | LIBSSH2_SFTP_S_IWUSR | LIBSSH2_SFTP_S_IRGRP |
             LIBSSH2_SFTP_S_IROTH,
@@ -346,7 +345,14 @@ seek(::ssh::detail::file_handle_state& handle, const path& open_path,
     case std::ios_base::cur:
     {
         // FIXME: possible to get integer overflow on addition?
-        new_position = libssh2_sftp_tell64(handle.file_handle()) + off;
+        if (handle.native())
+        {
+            new_position = handle.native_offset() + off;
+        }
+        else
+        {
+            new_position = libssh2_sftp_tell64(handle.file_handle()) + off;
+        }
         break;
     }
 
@@ -356,12 +362,19 @@ seek(::ssh::detail::file_handle_state& handle, const path& open_path,
 
         try
         {
-            ::ssh::detail::file_handle_state::scoped_lock lock =
-                handle.aquire_lock();
+            if (handle.native())
+            {
+                attributes = handle.native()->fstat(handle.native_handle());
+            }
+            else
+            {
+                ::ssh::detail::file_handle_state::scoped_lock lock =
+                    handle.aquire_lock("sftp_fstat");
 
-            ::ssh::detail::libssh2::sftp::fstat(
-                handle.session_ptr(), handle.sftp_ptr(), handle.file_handle(),
-                &attributes, LIBSSH2_SFTP_STAT);
+                ::ssh::detail::libssh2::sftp::fstat(
+                    handle.session_ptr(), handle.sftp_ptr(),
+                    handle.file_handle(), &attributes, LIBSSH2_SFTP_STAT);
+            }
         }
         catch (boost::exception& e)
         {
@@ -383,11 +396,56 @@ seek(::ssh::detail::file_handle_state& handle, const path& open_path,
             std::logic_error("Cannot seek before start of file"));
     }
 
-    libssh2_sftp_seek64(handle.file_handle(), new_position);
+    if (handle.native())
+    {
+        handle.set_native_offset(new_position);
+    }
+    else
+    {
+        libssh2_sftp_seek64(handle.file_handle(), new_position);
+    }
 
     return new_position;
 }
 
+/**
+ * Read through the native engine, which sends the whole read at once as
+ * many pipelined requests.
+ */
+inline std::streamsize native_read(::ssh::detail::file_handle_state& handle,
+                                   char* buffer, std::streamsize buffer_size)
+{
+    std::streamsize count = 0;
+    while (count < buffer_size)
+    {
+        std::size_t rc = handle.native()->read(
+            handle.native_handle(), handle.native_offset(), buffer + count,
+            static_cast<std::size_t>(buffer_size - count));
+        if (rc == 0)
+            break; // EOF
+
+        handle.set_native_offset(handle.native_offset() + rc);
+        count += rc;
+    }
+
+    handle.traffic().add_read(count);
+
+    return count;
+}
+
+inline std::streamsize native_write(::ssh::detail::file_handle_state& handle,
+                                    const char* data,
+                                    std::streamsize data_size)
+{
+    handle.native()->write(handle.native_handle(), handle.native_offset(),
+                           data, static_cast<std::size_t>(data_size));
+    handle.set_native_offset(handle.native_offset() + data_size);
+
+    handle.traffic().add_written(data_size);
+
+    return data_size;
+}
+
 inline std::streamsize read(::ssh::detail::file_handle_state& handle,
                             const path& open_path, char* buffer,
                             std::streamsize buffer_size)
@@ -400,11 +458,16 @@ inline std::streamsize read(::ssh::detail::file_handle_state& handle,
         // http://bit.ly/1ixEagu and http://bit.ly/1ejYm2T).  Therefore we loop
         // until all the given buffer has been filled or we reach EOF.
 
+        if (handle.native())
+        {
+            return native_read(handle, buffer, buffer_size);
+        }
+
         ssize_t count = 0;
         do
         {
             ::ssh::detail::file_handle_state::scoped_lock lock =
-                handle.aquire_lock();
+                handle.aquire_lock("sftp_read");
 
             ssize_t rc = ::ssh::detail::libssh2::sftp::read(
                 handle.session_ptr(), handle.sftp_ptr(), handle.file_handle(),
@@ -415,6 +478,8 @@ inline std::streamsize read(::ssh::detail::file_handle_state& handle,
             count += rc;
         } while (count < buffer_size);
 
+        handle.traffic().add_read(count);
+
         return count;
     }
     catch (boost::exception& e)
@@ -438,11 +503,16 @@ inline std::streamsize write(::ssh::detail::file_handle_state& handle,
         // http://bit.ly/1ixEagu and http://bit.ly/1ejYm2T).  Therefore we loop
         // until all data is written.
 
+        if (handle.native())
+        {
+            return native_write(handle, data, data_size);
+        }
+
         ssize_t count = 0;
         do
         {
             ::ssh::detail::file_handle_state::scoped_lock lock =
-                handle.aquire_lock();
+                handle.aquire_lock("sftp_write");
 
             count += ::ssh::detail::libssh2::sftp::write(
                 handle.session_ptr(), handle.sftp_ptr(), handle.file_handle(),
@@ -451,6 +521,8 @@ inline std::streamsize write(::ssh::detail::file_handle_state& handle,
 
         assert(count == data_size);
 
+        handle.traffic().add_written(count);
+
         return count;
     }
     catch (boost::exception& e)
@@ -462,6 +534,28 @@ inline std::streamsize write(::ssh::detail::file_handle_state& handle,
 
 const std::streamsize DEFAULT_BUFFER_SIZE = 1024 * 32;
 
+/**
+ * Stream buffer size that lets each buffer be read or written with as few
+ * requests as the server allows.
+ */
+inline std::streamsize
+optimal_buffer_size(::ssh::detail::file_handle_state& handle)
+{
+    if (handle.native())
+    {
+        std::size_t request_size = (std::max)(
+            handle.native()->read_chunk_size(),
+            handle.native()->write_chunk_size());
+
+        return (std::max)(DEFAULT_BUFFER_SIZE,
+                          static_cast<std::streamsize>(request_size));
+    }
+    else
+    {
+        return DEFAULT_BUFFER_SIZE;
+    }
+}
+
 struct input_device_category : boost::iostreams::input_seekable,
                                boost::iostreams::optimally_buffered_tag
 {
@@ -557,7 +651,7 @@ public:
 
     std::streamsize optimal_buffer_size() const
     {
-        return detail::DEFAULT_BUFFER_SIZE;
+        return detail::optimal_buffer_size(*m_handle);
     }
 
     std::streamsize read(char* buffer, std::streamsize buffer_size)
@@ -610,7 +704,7 @@ public:
 
     std::streamsize optimal_buffer_size() const
     {
-        return detail::DEFAULT_BUFFER_SIZE;
+        return detail::optimal_buffer_size(*m_handle);
     }
 
     std::streamsize write(const char* data, std::streamsize data_size)
@@ -662,7 +756,7 @@ public:
 
     std::streamsize optimal_buffer_size() const
     {
-        return detail::DEFAULT_BUFFER_SIZE;
+        return detail::optimal_buffer_size(*m_handle);
     }
 
     std::streamsize read(char* buffer, std::streamsize buffer_size)
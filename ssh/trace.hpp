@@ -0,0 +1,472 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SSH_TRACE_HPP
+#define SSH_TRACE_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/chrono/duration.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/cstdint.hpp>              // uint64_t
+#include <boost/filesystem/fstream.hpp>   // ofstream
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp> // shared_ptr, atomic_load, atomic_store
+#include <boost/system/error_code.hpp>
+#include <boost/thread/locks.hpp> // lock_guard
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp> // thread::id, this_thread::get_id
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef> // size_t
+#include <cstdio>  // sprintf
+#include <map>
+#include <ostream>
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+
+/**
+ * One call made through the ssh library, as seen by a tracer.
+ *
+ * A span covers either a single libssh2 call or a higher-level operation,
+ * such as authenticating a session, that makes several of them.  Spans on
+ * the same thread nest: any span that begins while another is open on that
+ * thread ends before it.
+ */
+struct trace_span
+{
+    typedef boost::chrono::steady_clock clock;
+
+    trace_span() : id(0), operation(""), bytes(0)
+    {
+    }
+
+    /// Identifies the span uniquely for the lifetime of the process.
+    boost::uint64_t id;
+
+    /// Name of the operation, usually the libssh2 function called.
+    const char* operation;
+
+    /// Remote path the operation acted on, if any, in UTF-8.
+    std::string path;
+
+    /// Data moved by the operation.  Only set when the span ends.
+    boost::uint64_t bytes;
+
+    /// How the operation failed, if it did.  Only set when the span ends.
+    boost::system::error_code error;
+
+    clock::time_point start;
+
+    /// Only set when the span ends.
+    clock::time_point end;
+
+    boost::thread::id thread;
+};
+
+/**
+ * Receives the spans of calls made through the ssh library.
+ *
+ * Install an implementation with `set_tracer`.  The ssh library calls it on
+ * whichever thread makes the call, with the session lock held for spans
+ * that cover a libssh2 call, so implementations must be thread-safe and
+ * should return quickly.  Exceptions thrown by a tracer are discarded.
+ */
+class tracer
+{
+public:
+    virtual ~tracer()
+    {
+    }
+
+    virtual void begin_span(const trace_span& span) = 0;
+    virtual void end_span(const trace_span& span) = 0;
+};
+
+namespace detail
+{
+
+inline boost::atomic<bool>& tracing_enabled()
+{
+    // Constant-initialised, so safe to use from any thread at any time
+    static boost::atomic<bool> enabled(false);
+    return enabled;
+}
+
+inline boost::shared_ptr<tracer>& installed_tracer()
+{
+    static boost::shared_ptr<tracer> instance;
+    return instance;
+}
+
+inline boost::uint64_t next_span_id()
+{
+    static boost::atomic<boost::uint64_t> next_id(1);
+    return next_id.fetch_add(1, boost::memory_order_relaxed);
+}
+}
+
+/**
+ * Send spans of subsequent calls to the given tracer.
+ *
+ * Pass a null pointer to stop tracing.  Spans already begun are ended on
+ * the tracer that began them, which is kept alive until they end.
+ */
+inline void set_tracer(boost::shared_ptr<tracer> new_tracer)
+{
+    bool enable = static_cast<bool>(new_tracer);
+
+    boost::atomic_store(&detail::installed_tracer(), new_tracer);
+    detail::tracing_enabled().store(enable, boost::memory_order_release);
+}
+
+/**
+ * The tracer currently receiving spans, or a null pointer if none.
+ */
+inline boost::shared_ptr<tracer> current_tracer()
+{
+    return boost::atomic_load(&detail::installed_tracer());
+}
+
+namespace detail
+{
+
+/**
+ * Reports a call to the installed tracer as a span lasting as long as this
+ * object.
+ *
+ * Create one on the stack before making the call.  If given an error code,
+ * the span records whatever error it holds when this object is destroyed.
+ * When no tracer is installed, construction checks a single atomic flag and
+ * nothing else happens.
+ */
+class traced_call : private boost::noncopyable
+{
+public:
+    explicit traced_call(const char* operation, const char* path = NULL,
+                         std::size_t path_len = 0)
+        : m_ec(NULL)
+    {
+        begin(operation, path, path_len);
+    }
+
+    traced_call(const char* operation, const boost::system::error_code& ec,
+                const char* path = NULL, std::size_t path_len = 0)
+        : m_ec(&ec)
+    {
+        begin(operation, path, path_len);
+    }
+
+    ~traced_call()
+    {
+        if (!m_tracer)
+        {
+            return;
+        }
+
+        m_span.end = trace_span::clock::now();
+        if (m_ec && *m_ec)
+        {
+            m_span.error = *m_ec;
+        }
+
+        try
+        {
+            m_tracer->end_span(m_span);
+        }
+        catch (...)
+        {
+            // Tracing must never change the outcome of the call
+        }
+    }
+
+    /**
+     * Note the result of a call that moves data.
+     *
+     * Negative results are errors and move nothing.
+     */
+    template <typename Count>
+    void transferred(Count count)
+    {
+        if (m_tracer && count > 0)
+        {
+            m_span.bytes += static_cast<boost::uint64_t>(count);
+        }
+    }
+
+    /**
+     * Record an error for calls that report errors by exception rather
+     * than error code.
+     */
+    void fail(const boost::system::error_code& ec)
+    {
+        if (m_tracer)
+        {
+            m_span.error = ec;
+        }
+    }
+
+private:
+    void begin(const char* operation, const char* path, std::size_t path_len)
+    {
+        if (!tracing_enabled().load(boost::memory_order_acquire))
+        {
+            return;
+        }
+
+        m_tracer = current_tracer();
+        if (!m_tracer)
+        {
+            return;
+        }
+
+        try
+        {
+            m_span.id = next_span_id();
+            m_span.operation = operation;
+            if (path)
+            {
+                m_span.path.assign(path, path_len);
+            }
+            m_span.thread = boost::this_thread::get_id();
+            m_span.start = trace_span::clock::now();
+
+            m_tracer->begin_span(m_span);
+        }
+        catch (...)
+        {
+            // Tracing must never change the outcome of the call
+            m_tracer.reset();
+        }
+    }
+
+    const boost::system::error_code* m_ec;
+    boost::shared_ptr<tracer> m_tracer;
+    trace_span m_span;
+};
+
+inline void write_json_string(std::ostream& stream, const std::string& text)
+{
+    stream << '"';
+
+    for (std::string::const_iterator it = text.begin(); it != text.end();
+         ++it)
+    {
+        unsigned char c = static_cast<unsigned char>(*it);
+        switch (c)
+        {
+        case '"':
+            stream << "\\\"";
+            break;
+        case '\\':
+            stream << "\\\\";
+            break;
+        case '\n':
+            stream << "\\n";
+            break;
+        case '\r':
+            stream << "\\r";
+            break;
+        case '\t':
+            stream << "\\t";
+            break;
+        default:
+            if (c < 0x20)
+            {
+                char escaped[8];
+                std::sprintf(escaped, "\\u%04x", static_cast<unsigned int>(c));
+                stream << escaped;
+            }
+            else
+            {
+                // UTF-8 sequences pass through unchanged
+                stream << *it;
+            }
+        }
+    }
+
+    stream << '"';
+}
+}
+
+/**
+ * Tracer that collects spans as Chrome trace events.
+ *
+ * The result loads into `chrome://tracing`, Perfetto and other viewers that
+ * read the trace event format, showing each thread's calls on a timeline.
+ * Each span becomes one complete ("X") event named after its operation,
+ * with the path, byte count and any error as arguments.
+ *
+ * Events are kept in memory until written out with `write` or `write_file`.
+ */
+class chrome_trace_exporter : public tracer
+{
+public:
+    chrome_trace_exporter() : m_origin(trace_span::clock::now())
+    {
+    }
+
+    virtual void begin_span(const trace_span&)
+    {
+        // Complete events are written in one piece when the span ends
+    }
+
+    virtual void end_span(const trace_span& span)
+    {
+        event e;
+        e.name = span.operation;
+        e.path = span.path;
+        e.bytes = span.bytes;
+        e.error = span.error;
+        e.start_us = microseconds_since_origin(span.start);
+        e.duration_us = boost::chrono::duration_cast<microseconds>(
+                            span.end - span.start)
+                            .count();
+
+        boost::lock_guard<boost::mutex> guard(m_guard);
+
+        std::map<boost::thread::id, unsigned int>::iterator thread =
+            m_thread_numbers.find(span.thread);
+        if (thread == m_thread_numbers.end())
+        {
+            unsigned int number =
+                static_cast<unsigned int>(m_thread_numbers.size() + 1);
+            thread = m_thread_numbers.insert(std::make_pair(span.thread, number))
+                         .first;
+        }
+        e.thread = thread->second;
+
+        m_events.push_back(e);
+    }
+
+    /**
+     * Number of events collected so far.
+     */
+    std::size_t size() const
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+        return m_events.size();
+    }
+
+    /**
+     * Write the events collected so far as a trace event JSON object.
+     */
+    void write(std::ostream& stream) const
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+
+        stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+        for (std::vector<event>::const_iterator it = m_events.begin();
+             it != m_events.end(); ++it)
+        {
+            if (it != m_events.begin())
+                stream << ",\n";
+
+            stream << "{\"name\":";
+            detail::write_json_string(stream, it->name);
+            stream << ",\"cat\":\"ssh\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                   << it->thread << ",\"ts\":" << it->start_us
+                   << ",\"dur\":" << it->duration_us << ",\"args\":{";
+
+            stream << "\"bytes\":" << it->bytes;
+            if (!it->path.empty())
+            {
+                stream << ",\"path\":";
+                detail::write_json_string(stream, it->path);
+            }
+            if (it->error)
+            {
+                stream << ",\"error\":";
+                detail::write_json_string(stream, it->error.message());
+                stream << ",\"error_code\":" << it->error.value()
+                       << ",\"error_category\":";
+                detail::write_json_string(stream, it->error.category().name());
+            }
+
+            stream << "}}";
+        }
+
+        stream << "]}";
+    }
+
+    /**
+     * Write the events collected so far to a file, replacing its contents.
+     */
+    void write_file(const boost::filesystem::path& file) const
+    {
+        boost::filesystem::ofstream stream(file, std::ios_base::out |
+                                                     std::ios_base::trunc);
+        if (!stream)
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Unable to open trace file: " + file.string()));
+        }
+
+        write(stream);
+
+        stream.close();
+        if (!stream)
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Unable to write trace file: " + file.string()));
+        }
+    }
+
+    /**
+     * Discard the events collected so far.
+     */
+    void clear()
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+        m_events.clear();
+    }
+
+private:
+    typedef boost::chrono::duration<boost::int64_t, boost::micro>
+        microseconds;
+
+    struct event
+    {
+        std::string name;
+        std::string path;
+        boost::uint64_t bytes;
+        boost::system::error_code error;
+        unsigned int thread;
+        boost::int64_t start_us;
+        boost::int64_t duration_us;
+    };
+
+    boost::int64_t
+    microseconds_since_origin(trace_span::clock::time_point time) const
+    {
+        return boost::chrono::duration_cast<microseconds>(time - m_origin)
+            .count();
+    }
+
+    const trace_span::clock::time_point m_origin;
+
+    mutable boost::mutex m_guard;
+    std::vector<event> m_events;
+    std::map<boost::thread::id, unsigned int> m_thread_numbers;
+};
+
+} // namespace ssh
+
+#endif
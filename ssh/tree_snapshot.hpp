@@ -0,0 +1,244 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Listing every entry of a directory tree on the server.
+ *
+ * Walking a tree with `directory_iterator` costs at least one round trip
+ * per directory, which dominates for trees of many small directories.
+ * Where the server has GNU `find`, these functions instead list the whole
+ * tree with a single `find` command and read its output as it arrives.
+ * Otherwise they fall back to walking the tree over SFTP.
+ */
+
+#ifndef SSH_TREE_SNAPSHOT_HPP
+#define SSH_TREE_SNAPSHOT_HPP
+
+#include <ssh/detail/find_listing.hpp>
+#include <ssh/exec_channel.hpp> // exec_channel, streams, shell_quote
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/remote_command.hpp> // command_error_collector
+#include <ssh/session.hpp>
+
+#include <boost/bind.hpp>
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ref.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <ios>       // ios_base
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+#include <libssh2_sftp.h>
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(tree_snapshot_method){
+    /**
+     * List with `find` if the server has GNU `find`, otherwise use SFTP.
+     */
+    automatic,
+
+    /**
+     * List the tree with a GNU `find` command on the server.
+     */
+    find,
+
+    /**
+     * Walk the tree directory by directory over SFTP.
+     */
+    sftp};
+BOOST_SCOPED_ENUM_END
+
+/**
+ * Called with each entry of a tree as it is listed.
+ */
+typedef boost::function<void(const ::ssh::filesystem::sftp_file&)>
+    tree_snapshot_visitor;
+
+namespace detail
+{
+
+/**
+ * Whether the server's `find` is GNU `find`, which alone supports `-printf`.
+ */
+inline bool remote_find_supports_printf(session& session)
+{
+    try
+    {
+        exec_channel channel =
+            session.exec("find . -maxdepth 0 -printf found 2>/dev/null");
+
+        // Servers that run the SFTP server instead wait for it to be sent
+        // something
+        channel.close_input();
+
+        exec_stdout_stream output(channel);
+        std::string reply;
+        output >> reply;
+
+        return channel.exit_status() == 0 && reply == "found";
+    }
+    catch (const boost::system::system_error&)
+    {
+        return false;
+    }
+}
+
+inline void walk_tree_by_find(session& session,
+                              const ::ssh::filesystem::path& root,
+                              const tree_snapshot_visitor& visitor)
+{
+    // A starting point that looks like an option would be taken as one
+    std::string start = root.native();
+    if (start.empty())
+        start = ".";
+    else if (start[0] == '-')
+        start = "./" + start;
+
+    exec_channel channel =
+        session.exec("find " + shell_quote(start) + " -mindepth 1 -printf " +
+                     shell_quote(FIND_LISTING_FORMAT));
+    command_error_collector errors(channel);
+
+    exec_stdout_stream output(channel);
+    output.exceptions(std::ios_base::badbit);
+
+    find_listing_reader listing(output);
+    std::string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    while (listing.next_entry(name, attributes))
+    {
+        visitor(::ssh::filesystem::sftp_file(root / name, std::string(),
+                                             attributes));
+    }
+
+    std::string error_text = errors.text();
+    int status = channel.exit_status();
+    if (status != 0)
+    {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "Remote find failed with status " +
+            boost::lexical_cast<std::string>(status) + ": " + error_text));
+    }
+}
+
+inline void walk_tree_by_sftp(::ssh::filesystem::sftp_filesystem& filesystem,
+                              const ::ssh::filesystem::path& root,
+                              const tree_snapshot_visitor& visitor)
+{
+    // Directories still to be listed.  Kept here rather than recursing so
+    // deep trees can't exhaust the stack.
+    std::vector<::ssh::filesystem::path> pending(1, root);
+
+    while (!pending.empty())
+    {
+        ::ssh::filesystem::path directory = pending.back();
+        pending.pop_back();
+
+        for (::ssh::filesystem::directory_iterator it =
+                 filesystem.directory_iterator(directory);
+             it != filesystem.directory_iterator(); ++it)
+        {
+            ::ssh::filesystem::sftp_file entry = *it;
+            visitor(entry);
+
+            // Listing attributes describe links themselves, so links to
+            // directories aren't followed, as with `find`
+            if (entry.attributes().type() ==
+                ::ssh::filesystem::file_attributes::directory)
+            {
+                pending.push_back(entry.path());
+            }
+        }
+    }
+}
+
+inline void append_entry(std::vector<::ssh::filesystem::sftp_file>& entries,
+                         const ::ssh::filesystem::sftp_file& entry)
+{
+    entries.push_back(entry);
+}
+}
+
+/**
+ * Pass every entry below a directory on the server to a visitor, as the
+ * entries are listed.
+ *
+ * The root itself isn't visited.  Entry paths are `root` joined with the
+ * path relative to it.  Entries come in no particular order, except that
+ * the `sftp` method visits a directory before its contents.
+ *
+ * Entries listed by `find` carry type, permissions, size, owner, group and
+ * times, but no long entry.  If listing fails part way, the visitor has
+ * already seen some entries when the exception is thrown.
+ *
+ * @returns the method used, which is never `automatic`.
+ */
+inline BOOST_SCOPED_ENUM(tree_snapshot_method)
+    walk_tree(session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+              const ::ssh::filesystem::path& root,
+              const tree_snapshot_visitor& visitor,
+              BOOST_SCOPED_ENUM(tree_snapshot_method) method =
+                  tree_snapshot_method::automatic)
+{
+    if (method == tree_snapshot_method::automatic)
+    {
+        method = detail::remote_find_supports_printf(session)
+                     ? tree_snapshot_method::find
+                     : tree_snapshot_method::sftp;
+    }
+
+    if (method == tree_snapshot_method::find)
+    {
+        detail::walk_tree_by_find(session, root, visitor);
+    }
+    else
+    {
+        detail::walk_tree_by_sftp(filesystem, root, visitor);
+    }
+
+    return method;
+}
+
+/**
+ * Every entry below a directory on the server.
+ *
+ * As `walk_tree`, but gathering the entries.  For very large trees, prefer
+ * `walk_tree` which needn't hold them all.
+ */
+inline std::vector<::ssh::filesystem::sftp_file>
+snapshot_tree(session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+              const ::ssh::filesystem::path& root,
+              BOOST_SCOPED_ENUM(tree_snapshot_method) method =
+                  tree_snapshot_method::automatic)
+{
+    std::vector<::ssh::filesystem::sftp_file> entries;
+    walk_tree(session, filesystem, root,
+              boost::bind(detail::append_entry, boost::ref(entries), _1),
+              method);
+    return entries;
+}
+}
+
+#endif
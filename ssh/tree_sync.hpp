@@ -0,0 +1,703 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Mirroring a local directory tree to the server, copying only what changed.
+ *
+ * Both trees are listed at the same time, the local one on the calling
+ * thread and the remote one with `walk_tree` on another.  Files are judged
+ * unchanged if their size and last-write time match.  The resulting
+ * removals and uploads are then run over several threads sharing the one
+ * SFTP channel, which keeps several requests in flight where a single
+ * thread would wait out each round trip.
+ */
+
+#ifndef SSH_TREE_SYNC_HPP
+#define SSH_TREE_SYNC_HPP
+
+#include <ssh/detail/parallel.hpp>
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/hash_algorithm.hpp>
+#include <ssh/hashing_stream.hpp> // hashing_ofstream
+#include <ssh/remote_hash.hpp> // remote_hashes, local_hash
+#include <ssh/session.hpp>
+#include <ssh/stream.hpp>
+#include <ssh/tree_snapshot.hpp> // walk_tree
+#include <ssh/tree_transfer.hpp> // utf8_name, relative_to, ...
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>                      // uint64_t
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/exception_ptr.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstddef> // size_t
+#include <ctime>   // time_t
+#include <ios>     // ios_base
+#include <istream>
+#include <map>
+#include <ostream>
+#include <set>
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(sync_action_kind){
+    /**
+     * Remove a remote entry, and anything below it, that has no local
+     * counterpart or is a different kind of entry to its counterpart.
+     */
+    remove,
+
+    create_directory,
+
+    upload,
+
+    /**
+     * Contents already match so only the last-write time is copied.
+     */
+    set_last_write_time};
+BOOST_SCOPED_ENUM_END
+
+/**
+ * One change needed to bring the remote tree in line with the local tree.
+ */
+struct sync_action
+{
+    sync_action(BOOST_SCOPED_ENUM(sync_action_kind) kind,
+                const std::string& name, boost::uint64_t size = 0,
+                std::time_t last_write_time = 0)
+        : kind(kind), name(name), size(size), last_write_time(last_write_time)
+    {
+    }
+
+    BOOST_SCOPED_ENUM(sync_action_kind) kind;
+
+    /// Path relative to both roots, `/`-separated and UTF-8 encoded.  Empty
+    /// for the roots themselves.
+    std::string name;
+
+    /// Bytes to upload, for uploads.
+    boost::uint64_t size;
+
+    /// Local last-write time given to the remote file, for uploads and
+    /// setting the time.
+    std::time_t last_write_time;
+
+    /// Hash of the bytes sent, for uploads when verifying them.
+    std::string digest;
+};
+
+struct sync_options
+{
+    sync_options()
+        : dry_run(false),
+          remove_extraneous(false),
+          compare_contents(false),
+          verify_uploads(false),
+          verification_algorithm(hash_algorithm::sha256),
+          parallelism(4),
+          listing_method(tree_snapshot_method::automatic)
+    {
+    }
+
+    /// Work out the changes without making them.
+    bool dry_run;
+
+    /// Remove remote entries that have no local counterpart.
+    bool remove_extraneous;
+
+    /// Compare the contents of files whose sizes match but whose last-write
+    /// times don't, and only copy the time if the contents match.  Saves
+    /// uploading trees whose times were reset, e.g. by a fresh checkout, at
+    /// the cost of hashing those files on the server, or reading them from
+    /// it if it can't hash them.
+    bool compare_contents;
+
+    /// Hash each file as it is uploaded and check the hash against one
+    /// taken on the server afterwards.  The server-side hash costs little
+    /// where the server has the hashing command; otherwise the files are
+    /// read back.
+    bool verify_uploads;
+
+    BOOST_SCOPED_ENUM(hash_algorithm) verification_algorithm;
+
+    /// Most removals or uploads run at once.
+    unsigned int parallelism;
+
+    /// How the remote tree is listed.
+    BOOST_SCOPED_ENUM(tree_snapshot_method) listing_method;
+};
+
+/**
+ * The changes a sync made, or would make in a dry run.
+ */
+struct sync_report
+{
+    sync_report() : unchanged_files(0), upload_bytes(0)
+    {
+    }
+
+    /// In the order they run: removals, then directory creation, then
+    /// uploads and times.
+    std::vector<sync_action> actions;
+
+    unsigned long unchanged_files;
+
+    boost::uint64_t upload_bytes;
+};
+
+/**
+ * Write one line per action, then a summary.
+ */
+inline void write_sync_report(std::ostream& stream, const sync_report& report)
+{
+    for (std::vector<sync_action>::const_iterator it = report.actions.begin();
+         it != report.actions.end(); ++it)
+    {
+        std::string name = (it->name.empty()) ? "." : it->name;
+
+        switch (it->kind)
+        {
+        case sync_action_kind::remove:
+            stream << "remove " << name << "\n";
+            break;
+        case sync_action_kind::create_directory:
+            stream << "create directory " << name << "\n";
+            break;
+        case sync_action_kind::upload:
+            stream << "upload " << name << " (" << it->size << " bytes)\n";
+            break;
+        case sync_action_kind::set_last_write_time:
+            stream << "set time " << name << "\n";
+            break;
+        }
+    }
+
+    stream << report.actions.size() << " changes, " << report.unchanged_files
+           << " files unchanged, " << report.upload_bytes
+           << " bytes to upload\n";
+}
+
+namespace detail
+{
+
+struct sync_entry
+{
+    sync_entry()
+        : is_directory(false), is_regular_file(false), size(0), mtime(0)
+    {
+    }
+
+    bool is_directory;
+    bool is_regular_file;
+    boost::uint64_t size;
+    std::time_t mtime;
+};
+
+/**
+ * Entries of a tree keyed by their path relative to the root.
+ *
+ * Sorted, so a directory always comes before its contents.
+ */
+typedef std::map<std::string, sync_entry> sync_listing;
+
+inline ::ssh::filesystem::path remote_sync_path(
+    const ::ssh::filesystem::path& remote_root, const std::string& name)
+{
+    return (name.empty()) ? remote_root : remote_root / name;
+}
+
+inline boost::filesystem::path
+local_sync_path(const boost::filesystem::path& local_root,
+                const std::string& name)
+{
+    return (name.empty()) ? local_root
+                          : local_root / local_path_from_utf8(name);
+}
+
+inline void list_local_tree(const boost::filesystem::path& local_root,
+                            sync_listing& listing)
+{
+    for (boost::filesystem::recursive_directory_iterator it(local_root), end;
+         it != end; ++it)
+    {
+        // Links are neither followed nor copied, as on the server
+        boost::filesystem::file_status status = it->symlink_status();
+
+        sync_entry entry;
+        entry.is_directory = boost::filesystem::is_directory(status);
+        entry.is_regular_file = boost::filesystem::is_regular_file(status);
+        if (!entry.is_directory && !entry.is_regular_file)
+            continue;
+
+        if (entry.is_regular_file)
+        {
+            entry.size = boost::filesystem::file_size(it->path());
+            entry.mtime = boost::filesystem::last_write_time(it->path());
+        }
+
+        listing[utf8_name(relative_to(local_root, it->path()))] = entry;
+    }
+}
+
+/**
+ * Visitor adding remote entries to a listing by their path relative to the
+ * root.
+ */
+class remote_listing_collector
+{
+public:
+    remote_listing_collector(const ::ssh::filesystem::path& root,
+                             sync_listing& listing)
+        : m_listing(listing)
+    {
+        // Whatever separator joining adds, the prefix of a joined path
+        std::string joined = (root / "x").native();
+        m_prefix_size = joined.size() - 1;
+    }
+
+    void operator()(const ::ssh::filesystem::sftp_file& file)
+    {
+        const ::ssh::filesystem::file_attributes& attributes =
+            file.attributes();
+
+        sync_entry entry;
+        entry.is_directory =
+            attributes.type() == ::ssh::filesystem::file_attributes::directory;
+        entry.is_regular_file = attributes.type() ==
+                                ::ssh::filesystem::file_attributes::normal_file;
+        entry.size = attributes.size().get_value_or(0);
+        entry.mtime = attributes.last_modified().get_value_or(0);
+
+        m_listing[file.path().native().substr(m_prefix_size)] = entry;
+    }
+
+private:
+    sync_listing& m_listing;
+    std::string::size_type m_prefix_size;
+};
+
+/**
+ * List the remote tree, if it exists, catching any failure for the calling
+ * thread to rethrow.
+ */
+inline void list_remote_tree(session& session,
+                             ::ssh::filesystem::sftp_filesystem& filesystem,
+                             const ::ssh::filesystem::path& remote_root,
+                             BOOST_SCOPED_ENUM(tree_snapshot_method) method,
+                             sync_listing& listing, bool& root_exists,
+                             boost::exception_ptr& error)
+{
+    try
+    {
+        root_exists = exists(filesystem, remote_root);
+        if (!root_exists)
+            return;
+
+        if (!is_directory(filesystem, remote_root))
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Sync destination is not a directory: " +
+                remote_root.string()));
+        }
+
+        walk_tree(session, filesystem, remote_root,
+                  remote_listing_collector(remote_root, listing), method);
+    }
+    catch (...)
+    {
+        error = boost::current_exception();
+    }
+}
+
+inline bool has_removed_ancestor(const std::set<std::string>& removed,
+                                 const std::string& name)
+{
+    for (std::string::size_type slash = name.find('/');
+         slash != std::string::npos; slash = name.find('/', slash + 1))
+    {
+        if (removed.count(name.substr(0, slash)))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Work out the actions that make the remote tree match the local one.
+ */
+inline void plan_sync(session& session,
+                      ::ssh::filesystem::sftp_filesystem& filesystem,
+                      const boost::filesystem::path& local_root,
+                      const ::ssh::filesystem::path& remote_root,
+                      const sync_listing& local, const sync_listing& remote,
+                      bool remote_root_exists, const sync_options& options,
+                      sync_report& report)
+{
+    std::vector<sync_action> removals;
+    std::vector<sync_action> directories;
+    std::vector<sync_action> transfers;
+
+    // Remote entries being removed.  Anything below them goes too.
+    std::set<std::string> removed;
+
+    // Files whose contents decide between uploading and copying the time
+    std::vector<std::string> content_candidates;
+
+    if (!remote_root_exists)
+    {
+        directories.push_back(
+            sync_action(sync_action_kind::create_directory, std::string()));
+    }
+
+    for (sync_listing::const_iterator it = local.begin(); it != local.end();
+         ++it)
+    {
+        const std::string& name = it->first;
+        const sync_entry& entry = it->second;
+        sync_listing::const_iterator counterpart = remote.find(name);
+        bool missing = counterpart == remote.end();
+
+        if (!missing &&
+            (entry.is_directory != counterpart->second.is_directory ||
+             entry.is_regular_file != counterpart->second.is_regular_file))
+        {
+            removals.push_back(sync_action(sync_action_kind::remove, name));
+            removed.insert(name);
+            missing = true;
+        }
+
+        if (entry.is_directory)
+        {
+            if (missing)
+            {
+                directories.push_back(
+                    sync_action(sync_action_kind::create_directory, name));
+            }
+        }
+        else if (missing)
+        {
+            transfers.push_back(sync_action(sync_action_kind::upload, name,
+                                            entry.size, entry.mtime));
+        }
+        else if (entry.size == counterpart->second.size &&
+                 entry.mtime == counterpart->second.mtime)
+        {
+            ++report.unchanged_files;
+        }
+        else if (options.compare_contents &&
+                 entry.size == counterpart->second.size)
+        {
+            content_candidates.push_back(name);
+        }
+        else
+        {
+            transfers.push_back(sync_action(sync_action_kind::upload, name,
+                                            entry.size, entry.mtime));
+        }
+    }
+
+    if (!content_candidates.empty())
+    {
+        std::vector<::ssh::filesystem::path> remote_files;
+        for (std::size_t i = 0; i < content_candidates.size(); ++i)
+        {
+            remote_files.push_back(
+                remote_sync_path(remote_root, content_candidates[i]));
+        }
+
+        std::vector<std::string> remote_digests = remote_hashes(
+            session, filesystem, remote_files, hash_algorithm::sha256,
+            remote_hash_method::automatic, options.parallelism);
+
+        for (std::size_t i = 0; i < content_candidates.size(); ++i)
+        {
+            const std::string& name = content_candidates[i];
+            const sync_entry& entry = local.find(name)->second;
+
+            bool equal =
+                local_hash(local_sync_path(local_root, name),
+                           hash_algorithm::sha256) == remote_digests[i];
+            transfers.push_back(
+                equal ? sync_action(sync_action_kind::set_last_write_time,
+                                    name, 0, entry.mtime)
+                      : sync_action(sync_action_kind::upload, name,
+                                    entry.size, entry.mtime));
+        }
+    }
+
+    if (options.remove_extraneous)
+    {
+        for (sync_listing::const_iterator it = remote.begin();
+             it != remote.end(); ++it)
+        {
+            if (local.count(it->first) ||
+                has_removed_ancestor(removed, it->first))
+            {
+                continue;
+            }
+
+            removals.push_back(
+                sync_action(sync_action_kind::remove, it->first));
+            removed.insert(it->first);
+        }
+    }
+
+    report.actions.insert(report.actions.end(), removals.begin(),
+                          removals.end());
+    report.actions.insert(report.actions.end(), directories.begin(),
+                          directories.end());
+    report.actions.insert(report.actions.end(), transfers.begin(),
+                          transfers.end());
+
+    for (std::vector<sync_action>::const_iterator it = transfers.begin();
+         it != transfers.end(); ++it)
+    {
+        report.upload_bytes += it->size;
+    }
+}
+
+template <typename Destination>
+inline void copy_file_contents(std::istream& source, Destination& destination,
+                               std::size_t chunk_size)
+{
+    destination.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+    std::vector<char> buffer(chunk_size);
+    while (source.read(&buffer[0], buffer.size()) || source.gcount() > 0)
+    {
+        destination.write(&buffer[0], source.gcount());
+    }
+
+    destination.flush();
+}
+
+inline void run_sync_action(::ssh::filesystem::sftp_filesystem& filesystem,
+                            const boost::filesystem::path& local_root,
+                            const ::ssh::filesystem::path& remote_root,
+                            const sync_options& options, sync_action& action)
+{
+    ::ssh::filesystem::path remote = remote_sync_path(remote_root, action.name);
+
+    switch (action.kind)
+    {
+    case sync_action_kind::remove:
+        remove_all(filesystem, remote);
+        break;
+
+    case sync_action_kind::create_directory:
+        create_directory(filesystem, remote);
+        break;
+
+    case sync_action_kind::upload:
+    {
+        boost::filesystem::ifstream source(
+            local_sync_path(local_root, action.name), std::ios_base::binary);
+        source.exceptions(std::ios_base::badbit);
+
+        if (options.verify_uploads)
+        {
+            ::ssh::filesystem::hashing_ofstream destination(
+                filesystem, remote, options.verification_algorithm);
+            copy_file_contents(source, destination,
+                               sftp_transfer_chunk_size(filesystem));
+            action.digest = destination.digest();
+        }
+        else
+        {
+            ::ssh::filesystem::ofstream destination(filesystem, remote);
+            copy_file_contents(source, destination,
+                               sftp_transfer_chunk_size(filesystem));
+        }
+
+        last_write_time(filesystem, remote, action.last_write_time);
+        break;
+    }
+
+    case sync_action_kind::set_last_write_time:
+        last_write_time(filesystem, remote, action.last_write_time);
+        break;
+    }
+}
+
+inline void run_sync_action_at(::ssh::filesystem::sftp_filesystem& filesystem,
+                               const boost::filesystem::path& local_root,
+                               const ::ssh::filesystem::path& remote_root,
+                               const sync_options& options,
+                               std::vector<sync_action>& actions,
+                               std::size_t first, std::size_t i)
+{
+    run_sync_action(filesystem, local_root, remote_root, options,
+                    actions[first + i]);
+}
+
+inline void run_sync(::ssh::filesystem::sftp_filesystem& filesystem,
+                     const boost::filesystem::path& local_root,
+                     const ::ssh::filesystem::path& remote_root,
+                     const sync_options& options,
+                     std::vector<sync_action>& actions)
+{
+    unsigned int parallelism = options.parallelism;
+
+    std::size_t directories_begin = 0;
+    while (directories_begin < actions.size() &&
+           actions[directories_begin].kind == sync_action_kind::remove)
+    {
+        ++directories_begin;
+    }
+
+    std::size_t transfers_begin = directories_begin;
+    while (transfers_begin < actions.size() &&
+           actions[transfers_begin].kind ==
+               sync_action_kind::create_directory)
+    {
+        ++transfers_begin;
+    }
+
+    run_in_parallel(directories_begin, parallelism,
+                    boost::bind(run_sync_action_at, boost::ref(filesystem),
+                                local_root, remote_root, boost::cref(options),
+                                boost::ref(actions), 0, _1));
+
+    // Parents must exist before their children, so directories are made in
+    // order on this thread.  They are few compared to files.
+    for (std::size_t i = directories_begin; i < transfers_begin; ++i)
+    {
+        run_sync_action(filesystem, local_root, remote_root, options,
+                        actions[i]);
+    }
+
+    run_in_parallel(actions.size() - transfers_begin, parallelism,
+                    boost::bind(run_sync_action_at, boost::ref(filesystem),
+                                local_root, remote_root, boost::cref(options),
+                                boost::ref(actions), transfers_begin, _1));
+}
+
+/**
+ * Check the hash of each upload against the file now on the server.
+ */
+inline void verify_uploads(session& session,
+                           ::ssh::filesystem::sftp_filesystem& filesystem,
+                           const ::ssh::filesystem::path& remote_root,
+                           const sync_options& options,
+                           const std::vector<sync_action>& actions)
+{
+    std::vector<const sync_action*> uploads;
+    std::vector<::ssh::filesystem::path> remote_files;
+    for (std::vector<sync_action>::const_iterator it = actions.begin();
+         it != actions.end(); ++it)
+    {
+        if (it->kind == sync_action_kind::upload)
+        {
+            uploads.push_back(&*it);
+            remote_files.push_back(remote_sync_path(remote_root, it->name));
+        }
+    }
+
+    std::vector<std::string> remote_digests = remote_hashes(
+        session, filesystem, remote_files, options.verification_algorithm,
+        remote_hash_method::automatic, options.parallelism);
+
+    std::string mismatches;
+    for (std::size_t i = 0; i < uploads.size(); ++i)
+    {
+        if (uploads[i]->digest != remote_digests[i])
+        {
+            mismatches += (mismatches.empty()) ? "" : ", ";
+            mismatches += uploads[i]->name;
+        }
+    }
+
+    if (!mismatches.empty())
+    {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "Uploaded files don't match the originals: " + mismatches));
+    }
+}
+}
+
+/**
+ * Make a directory on the server mirror a local directory, copying only
+ * what changed.
+ *
+ * Regular files and directories are mirrored; other kinds of local entry
+ * are ignored.  Uploaded files are given the local last-write time so that
+ * the next sync finds them unchanged.
+ *
+ * @returns the changes made, or that would be made if `options.dry_run` is
+ *          set.
+ */
+inline sync_report sync_tree(session& session,
+                             ::ssh::filesystem::sftp_filesystem& filesystem,
+                             const boost::filesystem::path& local_root,
+                             const ::ssh::filesystem::path& remote_root,
+                             const sync_options& options = sync_options())
+{
+    detail::sync_listing remote;
+    bool remote_root_exists = false;
+    boost::exception_ptr remote_error;
+
+    boost::thread remote_lister(boost::bind(
+        detail::list_remote_tree, boost::ref(session), boost::ref(filesystem),
+        remote_root, options.listing_method, boost::ref(remote),
+        boost::ref(remote_root_exists), boost::ref(remote_error)));
+
+    detail::sync_listing local;
+    try
+    {
+        detail::list_local_tree(local_root, local);
+    }
+    catch (...)
+    {
+        remote_lister.join();
+        throw;
+    }
+
+    remote_lister.join();
+    if (remote_error)
+        boost::rethrow_exception(remote_error);
+
+    sync_report report;
+    detail::plan_sync(session, filesystem, local_root, remote_root, local,
+                      remote, remote_root_exists, options, report);
+
+    if (!options.dry_run)
+    {
+        detail::run_sync(filesystem, local_root, remote_root, options,
+                         report.actions);
+
+        if (options.verify_uploads)
+        {
+            detail::verify_uploads(session, filesystem, remote_root, options,
+                                   report.actions);
+        }
+    }
+
+    return report;
+}
+}
+
+#endif
@@ -0,0 +1,557 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file
+ *
+ * Copying whole directory trees to and from the server.
+ *
+ * Copying a tree file by file over SFTP costs several round trips per file,
+ * which dominates when the tree holds many small files.  Where the server
+ * has `tar`, these functions instead stream the whole tree through a single
+ * `tar` command, packing or unpacking the archive locally as it goes so no
+ * archive is ever stored.  Otherwise they fall back to SFTP.
+ *
+ * Only regular files and directories are copied.
+ */
+
+#ifndef SSH_TREE_TRANSFER_HPP
+#define SSH_TREE_TRANSFER_HPP
+
+#include <ssh/detail/tar.hpp>
+#include <ssh/detail/utf.hpp> // utf8_to_wide, wide_to_utf8
+#include <ssh/exec_channel.hpp> // exec_channel, streams, shell_quote
+#include <ssh/filesystem.hpp>
+#include <ssh/filesystem/path.hpp>
+#include <ssh/remote_command.hpp> // remote_command_available
+#include <ssh/session.hpp>
+#include <ssh/stream.hpp>
+
+#include <boost/cstdint.hpp>                      // uint64_t
+#include <boost/detail/scoped_enum_emulation.hpp> // BOOST_SCOPED_ENUM*
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/throw_exception.hpp>      // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // max, min
+#include <cstddef>   // size_t
+#include <ios>       // streamsize
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+namespace ssh
+{
+
+BOOST_SCOPED_ENUM_START(tree_transfer_method){
+    /**
+     * Stream through `tar` if the server has it, otherwise use SFTP.
+     */
+    automatic,
+
+    /**
+     * Stream the tree through a `tar` command on the server.
+     */
+    tar,
+
+    /**
+     * Copy each file and directory over SFTP.
+     */
+    sftp};
+BOOST_SCOPED_ENUM_END
+
+/**
+ * Called as a tree transfer progresses with the total bytes of file content
+ * copied so far.
+ */
+typedef boost::function<void(boost::uint64_t)> tree_transfer_progress;
+
+namespace detail
+{
+
+const std::size_t TREE_TRANSFER_CHUNK_SIZE = 32 * 1024;
+
+/**
+ * How much file data to copy at a time over SFTP.
+ *
+ * As much as the server accepts in a request, so each chunk goes as few
+ * requests as possible, but never less than `TREE_TRANSFER_CHUNK_SIZE`.
+ */
+inline std::size_t
+sftp_transfer_chunk_size(::ssh::filesystem::sftp_filesystem& filesystem)
+{
+    ::ssh::filesystem::sftp_limits limits = filesystem.limits();
+    boost::uint64_t request_size =
+        (std::max)(limits.max_read_length, limits.max_write_length);
+
+    return static_cast<std::size_t>((std::max)(
+        request_size,
+        static_cast<boost::uint64_t>(TREE_TRANSFER_CHUNK_SIZE)));
+}
+
+/**
+ * Local path as a `/`-separated UTF-8 name, as used in tar archives and
+ * SFTP paths.
+ */
+inline std::string utf8_name(const boost::filesystem::path& local)
+{
+#ifdef BOOST_WINDOWS_API
+    return detail::wide_to_utf8(local.generic_wstring());
+#else
+    return local.generic_string();
+#endif
+}
+
+inline boost::filesystem::path local_path_from_utf8(const std::string& name)
+{
+#ifdef BOOST_WINDOWS_API
+    return boost::filesystem::path(detail::utf8_to_wide(name));
+#else
+    return boost::filesystem::path(name);
+#endif
+}
+
+/**
+ * The part of `descendant` below `root`.
+ */
+inline boost::filesystem::path
+relative_to(const boost::filesystem::path& root,
+            const boost::filesystem::path& descendant)
+{
+    boost::filesystem::path::const_iterator it = descendant.begin();
+    for (boost::filesystem::path::const_iterator r = root.begin();
+         r != root.end() && it != descendant.end(); ++r, ++it)
+    {
+    }
+
+    boost::filesystem::path relative;
+    for (; it != descendant.end(); ++it)
+    {
+        relative /= *it;
+    }
+    return relative;
+}
+
+/**
+ * Archive entry name as a path below the destination, refusing names that
+ * would escape it.
+ *
+ * The names come from the server, so nothing about them can be trusted.
+ * Elements are checked by Windows rules on every platform, because that is
+ * where the files are written: `\` is a separator there and `:` introduces
+ * a drive or an alternate data stream, so neither may appear in an element.
+ *
+ * @returns an empty string for the archive root itself.
+ */
+inline std::string safe_archive_name(const std::string& name)
+{
+    std::string safe;
+    std::string::size_type start = 0;
+    while (start <= name.size())
+    {
+        std::string::size_type end = name.find('/', start);
+        if (end == std::string::npos)
+            end = name.size();
+
+        std::string segment = name.substr(start, end - start);
+        if (segment == ".." ||
+            segment.find_first_of("\\:") != std::string::npos)
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Remote name outside destination: " + name));
+        }
+
+        if (!segment.empty() && segment != ".")
+        {
+            if (!safe.empty())
+                safe += '/';
+            safe += segment;
+        }
+
+        start = end + 1;
+    }
+
+    return safe;
+}
+
+/**
+ * Local path, relative to the destination, for a `/`-separated UTF-8 name
+ * from the server.
+ *
+ * Checks the name with `safe_archive_name` and then checks the converted
+ * path again, so a name can't escape the destination however the local
+ * platform splits it.
+ *
+ * @returns an empty path for the destination itself.
+ */
+inline boost::filesystem::path safe_local_path(const std::string& name)
+{
+    boost::filesystem::path local =
+        local_path_from_utf8(safe_archive_name(name));
+
+    bool escapes = local.has_root_path();
+    for (boost::filesystem::path::const_iterator it = local.begin();
+         it != local.end(); ++it)
+    {
+        if (*it == "..")
+            escapes = true;
+    }
+
+    if (escapes)
+    {
+        BOOST_THROW_EXCEPTION(
+            std::runtime_error("Remote name outside destination: " + name));
+    }
+
+    return local;
+}
+
+inline void check_tar_succeeded(exec_channel& channel,
+                                command_error_collector& errors)
+{
+    std::string error_text = errors.text();
+    int status = channel.exit_status();
+    if (status != 0)
+    {
+        BOOST_THROW_EXCEPTION(std::runtime_error(
+            "Remote tar failed with status " +
+            boost::lexical_cast<std::string>(status) + ": " + error_text));
+    }
+}
+
+inline void upload_tree_by_tar(session& session,
+                               const boost::filesystem::path& local_root,
+                               const ::ssh::filesystem::path& remote_root,
+                               const tree_transfer_progress& progress)
+{
+    std::string destination = shell_quote(remote_root.native());
+    exec_channel channel = session.exec("mkdir -p -- " + destination +
+                                        " && tar -x -f - -C " + destination);
+    command_error_collector errors(channel);
+
+    boost::uint64_t total = 0;
+    {
+        exec_stdin_stream input(channel);
+        input.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+        tar_writer archive(input);
+        std::vector<char> buffer(TREE_TRANSFER_CHUNK_SIZE);
+
+        for (boost::filesystem::recursive_directory_iterator it(local_root),
+             end;
+             it != end; ++it)
+        {
+            boost::filesystem::file_status status = it->status();
+
+            tar_entry entry;
+            entry.name = utf8_name(relative_to(local_root, it->path()));
+            entry.mode = status.permissions() & 07777;
+            entry.mtime = boost::filesystem::last_write_time(it->path());
+
+            if (boost::filesystem::is_directory(status))
+            {
+                entry.type = tar_directory;
+                archive.begin_entry(entry);
+                archive.end_entry();
+            }
+            else if (boost::filesystem::is_regular_file(status))
+            {
+                entry.type = tar_regular_file;
+                entry.size = boost::filesystem::file_size(it->path());
+
+                boost::filesystem::ifstream file(it->path(),
+                                                 std::ios_base::binary);
+                archive.begin_entry(entry);
+
+                boost::uint64_t remaining = entry.size;
+                while (remaining > 0)
+                {
+                    std::streamsize chunk = static_cast<std::streamsize>(
+                        std::min<boost::uint64_t>(remaining, buffer.size()));
+                    if (!file.read(&buffer[0], chunk))
+                    {
+                        BOOST_THROW_EXCEPTION(std::runtime_error(
+                            "File changed while being copied: " +
+                            it->path().string()));
+                    }
+
+                    archive.write(&buffer[0], static_cast<std::size_t>(chunk));
+                    remaining -= chunk;
+
+                    total += chunk;
+                    if (progress)
+                        progress(total);
+                }
+
+                archive.end_entry();
+            }
+        }
+
+        archive.finish();
+
+        // Closing the stream tells tar the archive is complete
+    }
+
+    check_tar_succeeded(channel, errors);
+}
+
+inline void download_tree_by_tar(session& session,
+                                 const ::ssh::filesystem::path& remote_root,
+                                 const boost::filesystem::path& local_root,
+                                 const tree_transfer_progress& progress)
+{
+    exec_channel channel = session.exec(
+        "tar -c -f - -C " + shell_quote(remote_root.native()) + " .");
+    command_error_collector errors(channel);
+
+    boost::filesystem::create_directories(local_root);
+
+    exec_stdout_stream output(channel);
+    output.exceptions(std::ios_base::badbit);
+
+    tar_reader archive(output);
+    std::vector<char> buffer(TREE_TRANSFER_CHUNK_SIZE);
+    boost::uint64_t total = 0;
+
+    tar_entry entry;
+    while (archive.next_entry(entry))
+    {
+        boost::filesystem::path relative = safe_local_path(entry.name);
+        if (relative.empty())
+            continue;
+
+        boost::filesystem::path local = local_root / relative;
+
+        if (entry.type == tar_directory)
+        {
+            boost::filesystem::create_directories(local);
+        }
+        else
+        {
+            boost::filesystem::create_directories(local.parent_path());
+
+            {
+                boost::filesystem::ofstream file(
+                    local, std::ios_base::binary | std::ios_base::trunc);
+                file.exceptions(std::ios_base::badbit |
+                                std::ios_base::failbit);
+
+                std::size_t count;
+                while ((count = archive.read(&buffer[0], buffer.size())) > 0)
+                {
+                    file.write(&buffer[0], count);
+
+                    total += count;
+                    if (progress)
+                        progress(total);
+                }
+            }
+
+            boost::filesystem::last_write_time(local, entry.mtime);
+        }
+    }
+
+    // Read to the end, past any padding tar adds after the archive, so the
+    // command can finish
+    while (output.read(&buffer[0], buffer.size()) || output.gcount() > 0)
+    {
+    }
+
+    check_tar_succeeded(channel, errors);
+}
+
+inline void upload_tree_by_sftp(::ssh::filesystem::sftp_filesystem& filesystem,
+                                const boost::filesystem::path& local_root,
+                                const ::ssh::filesystem::path& remote_root,
+                                const tree_transfer_progress& progress)
+{
+    create_directory(filesystem, remote_root);
+
+    std::vector<char> buffer(sftp_transfer_chunk_size(filesystem));
+    boost::uint64_t total = 0;
+
+    for (boost::filesystem::recursive_directory_iterator it(local_root), end;
+         it != end; ++it)
+    {
+        boost::filesystem::file_status status = it->status();
+        ::ssh::filesystem::path remote =
+            remote_root / utf8_name(relative_to(local_root, it->path()));
+
+        if (boost::filesystem::is_directory(status))
+        {
+            create_directory(filesystem, remote);
+        }
+        else if (boost::filesystem::is_regular_file(status))
+        {
+            boost::filesystem::ifstream source(it->path(),
+                                               std::ios_base::binary);
+            ::ssh::filesystem::ofstream destination(filesystem, remote);
+            destination.exceptions(std::ios_base::badbit |
+                                   std::ios_base::failbit);
+
+            while (source.read(&buffer[0], buffer.size()) ||
+                   source.gcount() > 0)
+            {
+                destination.write(&buffer[0], source.gcount());
+
+                total += source.gcount();
+                if (progress)
+                    progress(total);
+            }
+        }
+    }
+}
+
+inline void download_directory_by_sftp(
+    ::ssh::filesystem::sftp_filesystem& filesystem,
+    const ::ssh::filesystem::path& remote_directory,
+    const boost::filesystem::path& local_directory, std::vector<char>& buffer,
+    boost::uint64_t& total, const tree_transfer_progress& progress)
+{
+    boost::filesystem::create_directories(local_directory);
+
+    for (::ssh::filesystem::directory_iterator it =
+             filesystem.directory_iterator(remote_directory);
+         it != filesystem.directory_iterator(); ++it)
+    {
+        ::ssh::filesystem::path remote = it->path();
+
+        // A single element, so it must neither vanish nor split
+        boost::filesystem::path relative =
+            safe_local_path(remote.filename().native());
+        if (relative.empty() || ++relative.begin() != relative.end())
+        {
+            BOOST_THROW_EXCEPTION(std::runtime_error(
+                "Remote name outside destination: " + remote.native()));
+        }
+
+        boost::filesystem::path local = local_directory / relative;
+
+        switch (it->attributes().type())
+        {
+        case ::ssh::filesystem::file_attributes::directory:
+            download_directory_by_sftp(filesystem, remote, local, buffer,
+                                       total, progress);
+            break;
+
+        case ::ssh::filesystem::file_attributes::normal_file:
+        {
+            ::ssh::filesystem::ifstream source(filesystem, remote);
+            source.exceptions(std::ios_base::badbit);
+            boost::filesystem::ofstream destination(
+                local, std::ios_base::binary | std::ios_base::trunc);
+            destination.exceptions(std::ios_base::badbit |
+                                   std::ios_base::failbit);
+
+            while (source.read(&buffer[0], buffer.size()) ||
+                   source.gcount() > 0)
+            {
+                destination.write(&buffer[0], source.gcount());
+
+                total += source.gcount();
+                if (progress)
+                    progress(total);
+            }
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+}
+}
+
+/**
+ * Copy a local directory tree into a directory on the server.
+ *
+ * The contents of `local_root` are copied into `remote_root`, which is
+ * created if it doesn't exist.  Existing files are overwritten.
+ *
+ * @returns the method used, which is never `automatic`.
+ */
+inline BOOST_SCOPED_ENUM(tree_transfer_method) upload_tree(
+    session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+    const boost::filesystem::path& local_root,
+    const ::ssh::filesystem::path& remote_root,
+    BOOST_SCOPED_ENUM(tree_transfer_method) method =
+        tree_transfer_method::automatic,
+    const tree_transfer_progress& progress = tree_transfer_progress())
+{
+    if (method == tree_transfer_method::automatic)
+    {
+        method = remote_command_available(session, "tar")
+                     ? tree_transfer_method::tar
+                     : tree_transfer_method::sftp;
+    }
+
+    if (method == tree_transfer_method::tar)
+    {
+        detail::upload_tree_by_tar(session, local_root, remote_root, progress);
+    }
+    else
+    {
+        detail::upload_tree_by_sftp(filesystem, local_root, remote_root,
+                                    progress);
+    }
+
+    return method;
+}
+
+/**
+ * Copy a directory tree on the server into a local directory.
+ *
+ * The contents of `remote_root` are copied into `local_root`, which is
+ * created if it doesn't exist.  Existing files are overwritten.
+ *
+ * @returns the method used, which is never `automatic`.
+ */
+inline BOOST_SCOPED_ENUM(tree_transfer_method) download_tree(
+    session& session, ::ssh::filesystem::sftp_filesystem& filesystem,
+    const ::ssh::filesystem::path& remote_root,
+    const boost::filesystem::path& local_root,
+    BOOST_SCOPED_ENUM(tree_transfer_method) method =
+        tree_transfer_method::automatic,
+    const tree_transfer_progress& progress = tree_transfer_progress())
+{
+    if (method == tree_transfer_method::automatic)
+    {
+        method = remote_command_available(session, "tar")
+                     ? tree_transfer_method::tar
+                     : tree_transfer_method::sftp;
+    }
+
+    if (method == tree_transfer_method::tar)
+    {
+        detail::download_tree_by_tar(session, remote_root, local_root,
+                                     progress);
+    }
+    else
+    {
+        std::vector<char> buffer(detail::sftp_transfer_chunk_size(filesystem));
+        boost::uint64_t total = 0;
+        detail::download_directory_by_sftp(filesystem, remote_root,
+                                           local_root, buffer, total,
+                                           progress);
+    }
+
+    return method;
+}
+}
+
+#endif
@@ -260,7 +260,7 @@ void rename_non_atomic_overwrite(authenticated_session& session,
         // Rename failed, rename our temporary back to its old name
         try
         {
-            rename(session.get_sftp_filesystem(), from, to,
+            rename(session.get_sftp_filesystem(), temporary, to,
                    overwrite_behaviour::prevent_overwrite);
         }
         catch (const exception&)
@@ -284,6 +284,81 @@ void rename_non_atomic_overwrite(authenticated_session& session,
     }
 }
 
+/**
+ * Whether a failed atomic overwrite might still succeed non-atomically.
+ *
+ * That is only the case if the server turned down the request itself or
+ * the obstruction is a directory that isn't empty, which POSIX rename won't
+ * replace.  Servers speaking version 3 of the protocol, such as OpenSSH,
+ * report the latter as a generic failure, so the target is checked.
+ */
+bool non_atomic_overwrite_may_succeed(authenticated_session& session,
+                                      const system_error& error,
+                                      const string& to)
+{
+    if (error.code() == errc::operation_not_supported ||
+        error.code() == errc::directory_not_empty)
+    {
+        return true;
+    }
+
+    try
+    {
+        return is_directory(session.get_sftp_filesystem(), to) &&
+               !is_empty(session.get_sftp_filesystem(), to);
+    }
+    catch (const exception&)
+    {
+        return false;
+    }
+}
+
+/**
+ * Rename file or directory, overwriting any obstruction.
+ *
+ * Servers with the posix-rename@openssh.com extension overwrite atomically
+ * in a single request.  Servers without it, or that won't overwrite the
+ * particular obstruction, such as a directory that isn't empty, get the
+ * obstruction removed non-atomically.  Any other failure is reported as it
+ * is, as going on to move the target aside would only make things worse.
+ *
+ * @param from
+ *     Absolute path of the file or directory to be renamed.
+ * @param to
+ *     Absolute path to rename `from` to.
+ *
+ * @throws  ssh_error if the operation fails.
+ */
+void rename_overwrite(authenticated_session& session, const string& from,
+                      const string& to)
+{
+    if (!session.get_sftp_filesystem().can_overwrite_atomically())
+    {
+        rename_non_atomic_overwrite(session, from, to);
+        return;
+    }
+
+    try
+    {
+        rename(session.get_sftp_filesystem(), from, to,
+               overwrite_behaviour::atomic_overwrite);
+    }
+    catch (const system_error& e)
+    {
+        // Over libssh2, a server without the extension is only found out
+        // by the attempt
+        if (!session.get_sftp_filesystem().can_overwrite_atomically() ||
+            non_atomic_overwrite_may_succeed(session, e, to))
+        {
+            rename_non_atomic_overwrite(session, from, to);
+        }
+        else
+        {
+            throw;
+        }
+    }
+}
+
 /**
  * Retry renaming after seeking permission to overwrite the obstruction at
  * the target.
@@ -330,28 +405,8 @@ bool rename_retry_with_overwrite(authenticated_session& session,
         if (FAILED(hr))
             return false;
 
-        // Attempt rename again this time allowing it to atomically overwrite
-        // any obstruction.
-        // This will only work on a server supporting SFTP version 5 or above.
-
-        try
-        {
-            rename(session.get_sftp_filesystem(), from, to,
-                   overwrite_behaviour::atomic_overwrite);
-            return true;
-        }
-        catch (const system_error& e)
-        {
-            if (e.code() == errc::operation_not_supported)
-            {
-                rename_non_atomic_overwrite(session, from, to);
-                return true;
-            }
-            else
-            {
-                throw;
-            }
-        }
+        rename_overwrite(session, from, to);
+        return true;
     }
     else
     {
@@ -359,8 +414,9 @@ bool rename_retry_with_overwrite(authenticated_session& session,
         // SFTP servers < v5 (i.e. most of them) return this error code if the
         // file already exists as they don't explicitly support overwriting.
         // We need to stat() the file to find out if this is the case and if
-        // the user confirms the overwrite we will have to explicitly delete
-        // the target file first (via a temporary) and then repeat the rename.
+        // the user confirms the overwrite we repeat the rename, overwriting
+        // atomically if the server can, else explicitly deleting the target
+        // file first (via a temporary).
         //
         // NOTE: this is not a perfect solution due to the possibility
         // for race conditions.
@@ -377,7 +433,7 @@ bool rename_retry_with_overwrite(authenticated_session& session,
             if (FAILED(hr))
                 return false;
 
-            rename_non_atomic_overwrite(session, from, to);
+            rename_overwrite(session, from, to);
             return true;
         }
         else
@@ -411,8 +467,9 @@ bool rename_retry_with_overwrite(authenticated_session& session,
  * or not to update a directory view.
  *
  * @remarks
- * Due to the limitations of SFTP versions 4 and below, most servers will not
- * allow atomic overwrite.  We attempt to do this non-atomically by:
+ * Due to the limitations of SFTP versions 4 and below, servers only allow
+ * atomic overwrite if they have the posix-rename@openssh.com extension.
+ * Otherwise we attempt to do this non-atomically by:
  * -# appending @c ".swish_renaming_temp" to the obstructing target's filename
  * -# renaming the source file to the old target name
  * -# deleting the renamed target
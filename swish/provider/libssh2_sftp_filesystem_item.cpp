@@ -31,15 +31,12 @@
 
 #include "libssh2_sftp_filesystem_item.hpp"
 
-#include "swish/utils.hpp" // Utf8StringToWideString
-
+#include <ssh/detail/utf.hpp> // utf8_to_wide
 #include <ssh/filesystem.hpp> // file_attributes, sftp_file
 
 #include <boost/regex.hpp> // Regular expressions
 #include <boost/shared_ptr.hpp>
 
-using swish::utils::Utf8StringToWideString;
-
 using comet::datetime_t;
 
 using ssh::filesystem::file_attributes;
@@ -81,7 +78,7 @@ namespace {
         boost::smatch match;
         if (regex_match(long_entry, match, regex) && match[USER_MATCH].matched)
         {
-            return Utf8StringToWideString(match[USER_MATCH].str());
+            return ssh::detail::utf8_to_wide(match[USER_MATCH].str());
         }
         else
         {
@@ -99,7 +96,7 @@ namespace {
         boost::smatch match;
         if (regex_match(long_entry, match, regex) && match[GROUP_MATCH].matched)
         {
-            return Utf8StringToWideString(match[GROUP_MATCH].str());
+            return ssh::detail::utf8_to_wide(match[GROUP_MATCH].str());
         }
         else
         {
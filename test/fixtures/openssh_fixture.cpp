@@ -20,6 +20,7 @@
 #include <boost/assign/list_of.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
 #include <boost/io/detail/quoted_manip.hpp>
 #include <boost/optional.hpp>
 #include <boost/lexical_cast.hpp>
@@ -42,6 +43,7 @@
 
 using boost::assign::list_of;
 using boost::filesystem::path;
+using boost::format;
 using boost::io::quoted;
 using boost::lexical_cast;
 using boost::locale::conv::to_utf;
@@ -333,6 +335,20 @@ wstring openssh_fixture::wpassword() const
     return L"my test password";
 }
 
+void openssh_fixture::create_files_on_server(const string& directory,
+                                             unsigned long count)
+{
+    // Creating each file with its own process would take minutes for the
+    // largest directories, so xargs batches them
+    string script = (format("cd /home/swish && mkdir -p '%s' && cd '%s' && "
+                            "seq -f 'entry%%07.0f' 1 %d | xargs touch") %
+                     directory % directory % count)
+                        .str();
+    vector<string> exec_command = (list_of(string("exec")), "-u", user(),
+                                   m_container_id, "sh", "-c", script);
+    run_docker_command(exec_command);
+}
+
 int openssh_fixture::ask_docker_for_port() const
 {
     vector<string> inspect_host_command =
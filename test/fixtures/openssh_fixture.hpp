@@ -43,6 +43,18 @@ public:
     int port() const;
     std::string password() const;
     std::wstring wpassword() const;
+
+    /**
+     * Create `count` empty files, named `entry0000001` onwards, in a
+     * directory on the server, making the directory if necessary.
+     *
+     * Much faster than creating them over SFTP.
+     *
+     * @param directory  Path relative to the user's home directory.
+     */
+    void create_files_on_server(const std::string& directory,
+                                unsigned long count);
+
     boost::filesystem::path private_key_path() const;
     boost::filesystem::path public_key_path() const;
     boost::filesystem::path wrong_private_key_path() const;
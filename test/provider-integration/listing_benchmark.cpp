@@ -0,0 +1,182 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Speed of listing large remote directories through the provider.
+ *
+ * Complements the `ssh` listing benchmark by measuring the layers Swish
+ * adds on top of `directory_iterator`:
+ *
+ *  - `listing`: the whole of `sftp_provider::listing`, as Explorer sees it;
+ *  - `convert`: turning entries that have already been fetched into
+ *    `sftp_filesystem_item`s, which isolates the cost of the conversion from
+ *    that of the network.
+ *
+ * `listing` returns nothing until it has fetched every entry, so it has no
+ * separate time-to-first-entry.
+ *
+ * Only directories of up to 10k files are listed unless
+ * `SSH_BENCHMARK_MAX_ENTRIES` allows more, such as 1000000.  Results
+ * are saved to `provider_listing_benchmark.json` unless
+ * `SSH_BENCHMARK_RESULTS` says otherwise, and compared with
+ * `SSH_BENCHMARK_BASELINE` if that is set.
+ */
+
+#include "swish/provider/libssh2_sftp_filesystem_item.hpp"
+#include "swish/provider/sftp_provider.hpp" // sftp_provider, listing
+
+#include "test/fixtures/provider_fixture.hpp"
+#include "test/ssh/benchmark.hpp"
+
+#include <ssh/filesystem.hpp>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using swish::provider::directory_listing;
+using swish::provider::libssh2_sftp_filesystem_item;
+using swish::provider::sftp_filesystem_item;
+
+using test::fixtures::provider_fixture;
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_setting;
+using test::ssh::benchmark_timer;
+using test::ssh::median_of;
+
+using ssh::filesystem::directory_iterator;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_file;
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const unsigned long ENTRY_COUNTS[] = {1000, 10000, 100000, 1000000};
+
+const int RUNS_PER_CONFIGURATION = 3;
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+unsigned long maximum_entries()
+{
+    return boost::lexical_cast<unsigned long>(
+        benchmark_setting("SSH_BENCHMARK_MAX_ENTRIES", "10000"));
+}
+
+string benchmark_name(const string& layer, unsigned long entry_count)
+{
+    ostringstream name;
+    name << layer << "/entries=" << entry_count;
+    return name.str();
+}
+
+class listing_benchmark_fixture : public provider_fixture
+{
+public:
+    path directory_of_size(unsigned long entry_count)
+    {
+        path directory =
+            sandbox() / ("listing-" + boost::lexical_cast<string>(entry_count));
+        create_files_on_server(directory.string(), entry_count);
+        return directory;
+    }
+
+    benchmark_result list_directory(const string& name, const path& directory)
+    {
+        benchmark_timer timer;
+        directory_listing listing = Provider()->listing(directory);
+        return timer.finish(name, 0, listing.size());
+    }
+
+    benchmark_result convert_entries(const string& name,
+                                     const vector<sftp_file>& entries)
+    {
+        vector<sftp_filesystem_item> items;
+
+        benchmark_timer timer;
+        BOOST_FOREACH (const sftp_file& entry, entries)
+        {
+            items.push_back(
+                libssh2_sftp_filesystem_item::create_from_libssh2_file(entry));
+            timer.first_item();
+        }
+        return timer.finish(name, 0, items.size());
+    }
+
+    vector<sftp_file> fetch_entries(const path& directory)
+    {
+        return vector<sftp_file>(filesystem().directory_iterator(directory),
+                                 filesystem().directory_iterator());
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(provider_listing_benchmarks,
+                         listing_benchmark_fixture)
+
+BOOST_AUTO_TEST_CASE(list_and_convert)
+{
+    BOOST_FOREACH (unsigned long entry_count, ENTRY_COUNTS)
+    {
+        if (entry_count > maximum_entries())
+            continue;
+
+        path directory = directory_of_size(entry_count);
+
+        string listing_name = benchmark_name("listing", entry_count);
+        vector<benchmark_result> listing_runs;
+        for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+        {
+            listing_runs.push_back(list_directory(listing_name, directory));
+        }
+        results().add(median_of(listing_runs));
+
+        vector<sftp_file> entries = fetch_entries(directory);
+
+        string convert_name = benchmark_name("convert", entry_count);
+        vector<benchmark_result> convert_runs;
+        for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+        {
+            convert_runs.push_back(convert_entries(convert_name, entries));
+        }
+        results().add(median_of(convert_runs));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(provider_listing_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(
+        results(), "provider_listing_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,161 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Allocation budgets for the hot paths.
+ *
+ * Each test counts the heap allocations one operation makes in the steady
+ * state, after any one-off setup such as the stream buffer, and fails if
+ * the count goes over budget.  When a change reduces the allocations on a
+ * path, tighten its budget here so the gain can't be lost again unnoticed.
+ *
+ * Only allocations made through C++ `operator new` are counted, not those
+ * that libssh2 makes with `malloc`.
+ */
+
+#include "allocation_counter.hpp"
+#include "sftp_fixture.hpp"
+
+#include <ssh/filesystem.hpp> // test subject
+#include <ssh/stream.hpp>     // test subject
+
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+using ssh::filesystem::directory_iterator;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::ofstream;
+using ssh::filesystem::path;
+
+using test::ssh::allocation_guard;
+using test::ssh::sftp_fixture;
+
+using boost::uint64_t;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const std::streamsize CHUNK_SIZE = 4096;
+
+// Several times the stream buffer size, so the steady state includes
+// refilling or flushing the buffer over the network
+const std::streamsize DATA_SIZE = 8 * 32768;
+
+// Each directory entry costs the two readdir buffers and the copy of the
+// long entry
+const uint64_t ALLOCATIONS_PER_DIRECTORY_INCREMENT = 3;
+
+/**
+ * Check an operation's allocations against its budget.
+ *
+ * Checked containers in MSVC debug builds allocate a proxy object for every
+ * container, so budgets only hold in builds without them.
+ */
+void check_budget(uint64_t allocations, uint64_t budget)
+{
+#if defined(_ITERATOR_DEBUG_LEVEL) && _ITERATOR_DEBUG_LEVEL > 0
+    BOOST_TEST_MESSAGE("Allocation budget not checked in checked build; "
+                       << allocations << " allocations against " << budget);
+#else
+    BOOST_CHECK_LE(allocations, budget);
+#endif
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(allocation_budget_tests, sftp_fixture)
+
+BOOST_AUTO_TEST_CASE(input_stream_read)
+{
+    path source = new_file_in_sandbox_containing_data(string(DATA_SIZE, 'r'));
+    vector<char> buffer(CHUNK_SIZE);
+
+    ifstream stream(filesystem(), source);
+
+    // First read allocates the stream buffer
+    stream.read(&buffer[0], CHUNK_SIZE);
+
+    std::streamsize total = stream.gcount();
+
+    uint64_t allocations;
+    {
+        allocation_guard guard;
+        while (stream.read(&buffer[0], CHUNK_SIZE))
+        {
+            total += stream.gcount();
+        }
+        allocations = guard.allocations();
+    }
+
+    BOOST_REQUIRE_EQUAL(total, DATA_SIZE);
+    check_budget(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(output_stream_write)
+{
+    path target = new_file_in_sandbox();
+    string chunk(CHUNK_SIZE, 'w');
+
+    ofstream stream(filesystem(), target);
+
+    // First write allocates the stream buffer
+    stream.write(chunk.data(), chunk.size());
+
+    uint64_t allocations;
+    {
+        allocation_guard guard;
+        for (std::streamsize total = CHUNK_SIZE; total < DATA_SIZE;
+             total += CHUNK_SIZE)
+        {
+            stream.write(chunk.data(), chunk.size());
+        }
+        stream.flush();
+        allocations = guard.allocations();
+    }
+
+    BOOST_REQUIRE(stream);
+    check_budget(allocations, 0);
+}
+
+BOOST_AUTO_TEST_CASE(directory_iterator_increment)
+{
+    const unsigned long entry_count = 100;
+    path directory = sandbox() / "budget";
+    create_files_on_server(directory.string(), entry_count);
+
+    directory_iterator it = filesystem().directory_iterator(directory);
+
+    unsigned long increments = 0;
+    uint64_t allocations;
+    {
+        allocation_guard guard;
+        for (; it != filesystem().directory_iterator(); ++it)
+        {
+            ++increments;
+        }
+        allocations = guard.allocations();
+    }
+
+    BOOST_REQUIRE_EQUAL(increments, entry_count);
+    check_budget(allocations,
+                 ALLOCATIONS_PER_DIRECTORY_INCREMENT * increments);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,180 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "allocation_counter.hpp"
+
+#include <boost/atomic.hpp>
+
+#include <cstddef> // size_t
+#include <cstdlib> // malloc, free
+#include <new>     // bad_alloc, nothrow_t
+
+namespace
+{
+
+// Each allocation is prefixed with its size so that the byte count can be
+// reduced when it is freed.  Large enough to keep the memory handed out
+// suitably aligned for any type.
+const std::size_t HEADER_SIZE = 16;
+
+// Constant-initialised so they are usable by allocations made during static
+// initialisation of other translation units
+boost::atomic<boost::uint64_t> allocations(0);
+boost::atomic<boost::uint64_t> current_bytes(0);
+boost::atomic<boost::uint64_t> peak_bytes(0);
+
+void raise_peak(boost::uint64_t bytes)
+{
+    boost::uint64_t peak = peak_bytes.load(boost::memory_order_relaxed);
+    while (bytes > peak &&
+           !peak_bytes.compare_exchange_weak(peak, bytes,
+                                             boost::memory_order_relaxed))
+    {
+    }
+}
+
+// Running totals for the current thread only, for allocation_guard.  Plain
+// integers so they need no construction and can be used at any point in a
+// thread's life.
+#ifdef _MSC_VER
+__declspec(thread) boost::uint64_t thread_allocations = 0;
+__declspec(thread) boost::uint64_t thread_bytes = 0;
+#else
+__thread boost::uint64_t thread_allocations = 0;
+__thread boost::uint64_t thread_bytes = 0;
+#endif
+
+void* counted_allocation(std::size_t size)
+{
+    char* block = static_cast<char*>(std::malloc(HEADER_SIZE + size));
+    if (!block)
+    {
+        return NULL;
+    }
+
+    *reinterpret_cast<std::size_t*>(block) = size;
+
+    allocations.fetch_add(1, boost::memory_order_relaxed);
+    ++thread_allocations;
+    thread_bytes += size;
+    raise_peak(current_bytes.fetch_add(size, boost::memory_order_relaxed) +
+               size);
+
+    return block + HEADER_SIZE;
+}
+
+void counted_free(void* memory)
+{
+    if (!memory)
+    {
+        return;
+    }
+
+    char* block = static_cast<char*>(memory) - HEADER_SIZE;
+    current_bytes.fetch_sub(*reinterpret_cast<std::size_t*>(block),
+                            boost::memory_order_relaxed);
+
+    std::free(block);
+}
+}
+
+namespace test
+{
+namespace ssh
+{
+
+boost::uint64_t allocation_count()
+{
+    return allocations.load(boost::memory_order_relaxed);
+}
+
+boost::uint64_t allocated_bytes()
+{
+    return current_bytes.load(boost::memory_order_relaxed);
+}
+
+boost::uint64_t peak_allocated_bytes()
+{
+    return peak_bytes.load(boost::memory_order_relaxed);
+}
+
+void reset_peak_allocated_bytes()
+{
+    peak_bytes.store(current_bytes.load(boost::memory_order_relaxed),
+                     boost::memory_order_relaxed);
+}
+
+allocation_guard::allocation_guard()
+    : m_allocations_start(thread_allocations), m_bytes_start(thread_bytes)
+{
+}
+
+boost::uint64_t allocation_guard::allocations() const
+{
+    return thread_allocations - m_allocations_start;
+}
+
+boost::uint64_t allocation_guard::bytes() const
+{
+    return thread_bytes - m_bytes_start;
+}
+}
+} // namespace test::ssh
+
+void* operator new(std::size_t size)
+{
+    void* memory = counted_allocation(size);
+    if (!memory)
+    {
+        throw std::bad_alloc();
+    }
+
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) throw()
+{
+    return counted_allocation(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) throw()
+{
+    return counted_allocation(size);
+}
+
+void operator delete(void* memory) throw()
+{
+    counted_free(memory);
+}
+
+void operator delete[](void* memory) throw()
+{
+    counted_free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) throw()
+{
+    counted_free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) throw()
+{
+    counted_free(memory);
+}
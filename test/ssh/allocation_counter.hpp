@@ -0,0 +1,88 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TEST_SSH_ALLOCATION_COUNTER_HPP
+#define TEST_SSH_ALLOCATION_COUNTER_HPP
+
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/noncopyable.hpp>
+
+namespace test
+{
+namespace ssh
+{
+
+/**
+ * Number of times global `operator new` has been called by any thread since
+ * the program started.
+ *
+ * Only counts in executables that link `allocation_counter.cpp`, which
+ * replaces the global allocation functions.  Allocations made by C code,
+ * such as libssh2 and OpenSSL, go through `malloc` and are not counted.
+ */
+boost::uint64_t allocation_count();
+
+/**
+ * Bytes currently allocated through global `operator new`.
+ */
+boost::uint64_t allocated_bytes();
+
+/**
+ * Most bytes allocated through global `operator new` at any one time since
+ * the last call to `reset_peak_allocated_bytes`.
+ */
+boost::uint64_t peak_allocated_bytes();
+
+/**
+ * Start tracking the peak again from the bytes allocated now.
+ */
+void reset_peak_allocated_bytes();
+
+/**
+ * Counts the calls to global `operator new` made by the current thread
+ * while it exists.
+ *
+ * Put one around a hot path to check that it stays within an allocation
+ * budget:
+ *
+ *     allocation_guard guard;
+ *     stream.read(buffer, sizeof(buffer));
+ *     BOOST_CHECK_EQUAL(guard.allocations(), 0U);
+ *
+ * Allocations by other threads, such as the test's network helpers, are
+ * not counted, so the counts are exact even when those threads are busy.
+ * Guards can be nested.
+ *
+ * The same caveats apply as to `allocation_count`.
+ */
+class allocation_guard : private boost::noncopyable
+{
+public:
+    allocation_guard();
+
+    /// Calls to operator new by this thread since the guard was created.
+    boost::uint64_t allocations() const;
+
+    /// Bytes requested by those calls.
+    boost::uint64_t bytes() const;
+
+private:
+    boost::uint64_t m_allocations_start;
+    boost::uint64_t m_bytes_start;
+};
+}
+} // namespace test::ssh
+
+#endif
@@ -0,0 +1,156 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "allocation_counter.hpp" // test subject
+
+#include <boost/bind/bind.hpp>
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstddef> // size_t
+#include <new>     // nothrow
+#include <vector>
+
+using test::ssh::allocation_count;
+using test::ssh::allocation_guard;
+using test::ssh::allocated_bytes;
+using test::ssh::peak_allocated_bytes;
+using test::ssh::reset_peak_allocated_bytes;
+
+using boost::thread;
+using boost::uint64_t;
+
+using std::vector;
+
+namespace
+{
+
+void allocate_and_free(int times, std::size_t size)
+{
+    for (int i = 0; i < times; ++i)
+    {
+        // volatile stops the compiler from eliding the pair of calls
+        char* volatile block = new char[size];
+        delete[] block;
+    }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(allocation_counter_tests)
+
+BOOST_AUTO_TEST_CASE(counts_every_thread)
+{
+    uint64_t before = allocation_count();
+
+    thread(boost::bind(allocate_and_free, 10, 1)).join();
+
+    BOOST_CHECK_GE(allocation_count() - before, 10U);
+}
+
+BOOST_AUTO_TEST_CASE(freeing_reduces_allocated_bytes)
+{
+    uint64_t before = allocated_bytes();
+
+    char* volatile block = new char[1000];
+    BOOST_CHECK_EQUAL(allocated_bytes() - before, 1000U);
+
+    delete[] block;
+    BOOST_CHECK_EQUAL(allocated_bytes(), before);
+}
+
+BOOST_AUTO_TEST_CASE(peak_survives_freeing)
+{
+    reset_peak_allocated_bytes();
+    uint64_t before = peak_allocated_bytes();
+
+    allocate_and_free(1, 5000);
+
+    BOOST_CHECK_GE(peak_allocated_bytes() - before, 5000U);
+
+    reset_peak_allocated_bytes();
+    BOOST_CHECK_EQUAL(peak_allocated_bytes(), allocated_bytes());
+}
+
+BOOST_AUTO_TEST_CASE(guard_starts_at_zero)
+{
+    allocation_guard guard;
+
+    BOOST_CHECK_EQUAL(guard.allocations(), 0U);
+    BOOST_CHECK_EQUAL(guard.bytes(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(guard_counts_allocations_in_scope)
+{
+    allocation_guard guard;
+
+    allocate_and_free(3, 10);
+    allocate_and_free(1, 100);
+
+    BOOST_CHECK_EQUAL(guard.allocations(), 4U);
+    BOOST_CHECK_EQUAL(guard.bytes(), 130U);
+}
+
+BOOST_AUTO_TEST_CASE(guard_counts_nothrow_allocations)
+{
+    allocation_guard guard;
+
+    int* volatile number = new (std::nothrow) int(1);
+    delete number;
+
+    BOOST_CHECK_EQUAL(guard.allocations(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(guard_ignores_other_threads)
+{
+    // Created before the guard, as starting a thread allocates
+    thread other(boost::bind(allocate_and_free, 100, 1));
+
+    allocation_guard guard;
+    other.join();
+
+    BOOST_CHECK_EQUAL(guard.allocations(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(nested_guards)
+{
+    allocation_guard outer;
+    allocate_and_free(2, 1);
+
+    {
+        allocation_guard inner;
+        allocate_and_free(5, 1);
+
+        BOOST_CHECK_EQUAL(inner.allocations(), 5U);
+    }
+
+    BOOST_CHECK_EQUAL(outer.allocations(), 7U);
+}
+
+BOOST_AUTO_TEST_CASE(reserved_vector_fills_without_allocating)
+{
+    vector<int> numbers;
+    numbers.reserve(100);
+
+    allocation_guard guard;
+    for (int i = 0; i < 100; ++i)
+    {
+        numbers.push_back(i);
+    }
+
+    BOOST_CHECK_EQUAL(guard.allocations(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,429 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "benchmark.hpp"
+
+#include "allocation_counter.hpp"
+
+#include <boost/chrono/duration.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp> // exists
+#include <boost/filesystem/path.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/optional.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <algorithm> // nth_element
+#include <cstdlib>   // getenv
+#include <istream>
+#include <locale>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept> // invalid_argument
+
+using boost::chrono::duration;
+using boost::chrono::process_cpu_clock;
+using boost::chrono::steady_clock;
+using boost::format;
+using boost::property_tree::ptree;
+using boost::uint64_t;
+
+using std::invalid_argument;
+using std::istream;
+using std::map;
+using std::ostream;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace test
+{
+namespace ssh
+{
+
+namespace
+{
+
+const double BYTES_PER_MEGABYTE = 1024.0 * 1024.0;
+
+double seconds(duration<double> d)
+{
+    return d.count();
+}
+
+template <typename T>
+T median(vector<T> values)
+{
+    typename vector<T>::iterator middle = values.begin() + values.size() / 2;
+    std::nth_element(values.begin(), middle, values.end());
+    return *middle;
+}
+}
+
+benchmark_result::benchmark_result()
+    : bytes(0),
+      items(0),
+      runs(0),
+      wall_seconds(0),
+      first_item_seconds(0),
+      cpu_seconds(0),
+      allocations(0),
+      peak_bytes(0)
+{
+}
+
+double benchmark_result::megabytes_per_second() const
+{
+    return (wall_seconds > 0) ? (bytes / BYTES_PER_MEGABYTE) / wall_seconds
+                              : 0;
+}
+
+double benchmark_result::cpu_seconds_per_megabyte() const
+{
+    return (bytes > 0) ? cpu_seconds / (bytes / BYTES_PER_MEGABYTE) : 0;
+}
+
+double benchmark_result::allocations_per_megabyte() const
+{
+    return (bytes > 0) ? allocations / (bytes / BYTES_PER_MEGABYTE) : 0;
+}
+
+double benchmark_result::items_per_second() const
+{
+    return (wall_seconds > 0) ? items / wall_seconds : 0;
+}
+
+double benchmark_result::cpu_seconds_per_item() const
+{
+    return (items > 0) ? cpu_seconds / items : 0;
+}
+
+double benchmark_result::allocations_per_item() const
+{
+    return (items > 0) ? static_cast<double>(allocations) / items : 0;
+}
+
+double benchmark_result::peak_bytes_per_item() const
+{
+    return (items > 0) ? static_cast<double>(peak_bytes) / items : 0;
+}
+
+benchmark_timer::benchmark_timer()
+    : m_wall_start(steady_clock::now()),
+      m_cpu_start(process_cpu_clock::now()),
+      m_allocations_start(allocation_count()),
+      m_bytes_start(allocated_bytes()),
+      m_first_item_seconds(0)
+{
+    reset_peak_allocated_bytes();
+}
+
+void benchmark_timer::first_item()
+{
+    if (m_first_item_seconds == 0)
+    {
+        m_first_item_seconds = seconds(steady_clock::now() - m_wall_start);
+    }
+}
+
+benchmark_result benchmark_timer::finish(const string& name, uint64_t bytes,
+                                         uint64_t items)
+{
+    uint64_t allocations_end = allocation_count();
+    uint64_t peak = peak_allocated_bytes();
+    process_cpu_clock::times cpu_used =
+        (process_cpu_clock::now() - m_cpu_start).count();
+    steady_clock::duration wall_used = steady_clock::now() - m_wall_start;
+
+    benchmark_result result;
+    result.name = name;
+    result.bytes = bytes;
+    result.items = items;
+    result.runs = 1;
+    result.wall_seconds = seconds(wall_used);
+    result.first_item_seconds = m_first_item_seconds;
+    // process_cpu_clock counts in nanoseconds
+    result.cpu_seconds = (cpu_used.user + cpu_used.system) / 1e9;
+    result.allocations = allocations_end - m_allocations_start;
+    result.peak_bytes = (peak > m_bytes_start) ? peak - m_bytes_start : 0;
+
+    return result;
+}
+
+benchmark_result median_of(const vector<benchmark_result>& runs)
+{
+    if (runs.empty())
+    {
+        BOOST_THROW_EXCEPTION(invalid_argument("No benchmark runs"));
+    }
+
+    vector<double> wall;
+    vector<double> first_item;
+    vector<double> cpu;
+    vector<uint64_t> allocations;
+    vector<uint64_t> peak_bytes;
+    BOOST_FOREACH (const benchmark_result& run, runs)
+    {
+        wall.push_back(run.wall_seconds);
+        first_item.push_back(run.first_item_seconds);
+        cpu.push_back(run.cpu_seconds);
+        allocations.push_back(run.allocations);
+        peak_bytes.push_back(run.peak_bytes);
+    }
+
+    map<string, vector<double> > measurements;
+    BOOST_FOREACH (const benchmark_result& run, runs)
+    {
+        typedef map<string, double>::value_type measurement;
+        BOOST_FOREACH (const measurement& m, run.measurements)
+        {
+            measurements[m.first].push_back(m.second);
+        }
+    }
+
+    benchmark_result result = runs.front();
+    result.runs = static_cast<unsigned int>(runs.size());
+    result.wall_seconds = median(wall);
+    result.first_item_seconds = median(first_item);
+    result.cpu_seconds = median(cpu);
+    result.allocations = median(allocations);
+    result.peak_bytes = median(peak_bytes);
+
+    typedef map<string, vector<double> >::value_type measurement_runs;
+    BOOST_FOREACH (const measurement_runs& m, measurements)
+    {
+        result.measurements[m.first] = median(m.second);
+    }
+
+    return result;
+}
+
+void benchmark_report::add(const benchmark_result& result)
+{
+    m_results.push_back(result);
+}
+
+const vector<benchmark_result>& benchmark_report::results() const
+{
+    return m_results;
+}
+
+void benchmark_report::write_json(ostream& stream) const
+{
+    // Numbers must not pick up thousands separators from a global locale
+    std::ostringstream json;
+    json.imbue(std::locale::classic());
+
+    json << "{\"results\":[";
+
+    for (vector<benchmark_result>::const_iterator it = m_results.begin();
+         it != m_results.end(); ++it)
+    {
+        if (it != m_results.begin())
+            json << ",";
+
+        json << "\n{\"name\":\"" << it->name << "\","
+             << "\"bytes\":" << it->bytes << ","
+             << "\"items\":" << it->items << ","
+             << "\"runs\":" << it->runs << ","
+             << "\"wall_seconds\":" << it->wall_seconds << ","
+             << "\"first_item_seconds\":" << it->first_item_seconds << ","
+             << "\"cpu_seconds\":" << it->cpu_seconds << ","
+             << "\"allocations\":" << it->allocations << ","
+             << "\"peak_bytes\":" << it->peak_bytes << ","
+             << "\"megabytes_per_second\":" << it->megabytes_per_second()
+             << ","
+             << "\"cpu_seconds_per_megabyte\":"
+             << it->cpu_seconds_per_megabyte() << ","
+             << "\"allocations_per_megabyte\":"
+             << it->allocations_per_megabyte() << ","
+             << "\"items_per_second\":" << it->items_per_second() << ","
+             << "\"allocations_per_item\":" << it->allocations_per_item()
+             << ","
+             << "\"peak_bytes_per_item\":" << it->peak_bytes_per_item()
+             << ",\"measurements\":{";
+
+        for (map<string, double>::const_iterator m = it->measurements.begin();
+             m != it->measurements.end(); ++m)
+        {
+            if (m != it->measurements.begin())
+                json << ",";
+
+            json << "\"" << m->first << "\":" << m->second;
+        }
+
+        json << "}}";
+    }
+
+    json << "\n]}\n";
+
+    stream << json.str();
+}
+
+benchmark_report benchmark_report::read_json(istream& stream)
+{
+    ptree tree;
+    boost::property_tree::read_json(stream, tree);
+
+    benchmark_report report;
+    BOOST_FOREACH (const ptree::value_type& entry, tree.get_child("results"))
+    {
+        benchmark_result result;
+        result.name = entry.second.get<string>("name");
+        result.bytes = entry.second.get<uint64_t>("bytes");
+        // Absent from results saved before they were measured
+        result.items = entry.second.get<uint64_t>("items", 0);
+        result.runs = entry.second.get<unsigned int>("runs");
+        result.wall_seconds = entry.second.get<double>("wall_seconds");
+        result.first_item_seconds =
+            entry.second.get<double>("first_item_seconds", 0);
+        result.cpu_seconds = entry.second.get<double>("cpu_seconds");
+        result.allocations = entry.second.get<uint64_t>("allocations");
+        result.peak_bytes = entry.second.get<uint64_t>("peak_bytes", 0);
+
+        boost::optional<const ptree&> measurements =
+            entry.second.get_child_optional("measurements");
+        if (measurements)
+        {
+            BOOST_FOREACH (const ptree::value_type& m, *measurements)
+            {
+                result.measurements[m.first] = m.second.get_value<double>();
+            }
+        }
+
+        report.add(result);
+    }
+
+    return report;
+}
+
+vector<benchmark_comparison>
+benchmark_report::compare(const benchmark_report& baseline,
+                          double tolerance) const
+{
+    map<string, benchmark_result> baseline_by_name;
+    BOOST_FOREACH (const benchmark_result& result, baseline.results())
+    {
+        baseline_by_name[result.name] = result;
+    }
+
+    vector<benchmark_comparison> table;
+    BOOST_FOREACH (const benchmark_result& result, m_results)
+    {
+        map<string, benchmark_result>::const_iterator before =
+            baseline_by_name.find(result.name);
+        if (before == baseline_by_name.end())
+            continue;
+
+        benchmark_comparison row;
+        row.name = result.name;
+        if (result.items > 0)
+        {
+            row.unit = "item";
+            row.baseline_rate = before->second.items_per_second();
+            row.rate = result.items_per_second();
+            row.baseline_cpu_seconds_per_unit =
+                before->second.cpu_seconds_per_item();
+            row.cpu_seconds_per_unit = result.cpu_seconds_per_item();
+        }
+        else
+        {
+            row.unit = "MB";
+            row.baseline_rate = before->second.megabytes_per_second();
+            row.rate = result.megabytes_per_second();
+            row.baseline_cpu_seconds_per_unit =
+                before->second.cpu_seconds_per_megabyte();
+            row.cpu_seconds_per_unit = result.cpu_seconds_per_megabyte();
+        }
+        row.regressed =
+            row.rate < row.baseline_rate * (1 - tolerance) ||
+            row.cpu_seconds_per_unit >
+                row.baseline_cpu_seconds_per_unit * (1 + tolerance);
+
+        table.push_back(row);
+    }
+
+    return table;
+}
+
+void write_comparison_table(ostream& stream,
+                            const vector<benchmark_comparison>& table)
+{
+    stream << format("%-40s %6s %12s %12s %12s %12s\n") % "benchmark" %
+                  "unit" % "base rate" % "rate" % "base CPU" % "CPU";
+
+    BOOST_FOREACH (const benchmark_comparison& row, table)
+    {
+        stream << format("%-40s %6s %12.2f %12.2f %12.9f %12.9f%s\n") %
+                      row.name % row.unit % row.baseline_rate % row.rate %
+                      row.baseline_cpu_seconds_per_unit %
+                      row.cpu_seconds_per_unit %
+                      (row.regressed ? "  REGRESSED" : "");
+    }
+}
+
+string benchmark_setting(const char* name, const string& fallback)
+{
+    const char* value = std::getenv(name);
+    return (value && *value) ? string(value) : fallback;
+}
+
+void save_and_compare_with_baseline(const benchmark_report& results,
+                                    const string& default_results_file)
+{
+    boost::filesystem::path results_file(
+        benchmark_setting("SSH_BENCHMARK_RESULTS", default_results_file));
+    {
+        boost::filesystem::ofstream stream(results_file);
+        results.write_json(stream);
+        BOOST_REQUIRE(stream);
+    }
+    BOOST_TEST_MESSAGE("Benchmark results written to " << results_file);
+
+    boost::filesystem::path baseline_file(
+        benchmark_setting("SSH_BENCHMARK_BASELINE", ""));
+    if (baseline_file.empty())
+    {
+        return;
+    }
+
+    BOOST_REQUIRE_MESSAGE(boost::filesystem::exists(baseline_file),
+                          "No baseline at " << baseline_file);
+
+    boost::filesystem::ifstream stream(baseline_file);
+    benchmark_report baseline = benchmark_report::read_json(stream);
+
+    double tolerance = boost::lexical_cast<double>(
+        benchmark_setting("SSH_BENCHMARK_TOLERANCE", "0.1"));
+
+    vector<benchmark_comparison> table = results.compare(baseline, tolerance);
+
+    ostringstream message;
+    write_comparison_table(message, table);
+    BOOST_TEST_MESSAGE(message.str());
+
+    BOOST_FOREACH (const benchmark_comparison& row, table)
+    {
+        BOOST_CHECK_MESSAGE(!row.regressed, row.name << " regressed");
+    }
+}
+}
+} // namespace test::ssh
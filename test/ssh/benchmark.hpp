@@ -0,0 +1,198 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TEST_SSH_BENCHMARK_HPP
+#define TEST_SSH_BENCHMARK_HPP
+
+#include <boost/chrono/process_cpu_clocks.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/cstdint.hpp>              // uint64_t
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace test
+{
+namespace ssh
+{
+
+/**
+ * Cost of one benchmark configuration.
+ *
+ * Benchmarks that move data report `bytes`; those that produce discrete
+ * things, such as directory entries or completed operations, report `items`.
+ * Rates and per-unit costs are zero for whichever measure wasn't reported.
+ *
+ * Where a configuration is run several times, the fields hold the median
+ * of the runs.
+ */
+struct benchmark_result
+{
+    benchmark_result();
+
+    /// Identifies the configuration, e.g. "read/buffer=32768/file=1048576".
+    std::string name;
+
+    /// Data moved by one run.
+    boost::uint64_t bytes;
+
+    /// Things produced by one run.
+    boost::uint64_t items;
+
+    /// Number of runs summarised.
+    unsigned int runs;
+
+    double wall_seconds;
+
+    /// Wall time until the first item was produced, or zero if not
+    /// recorded.
+    double first_item_seconds;
+
+    /// User and system CPU time used by this process.
+    double cpu_seconds;
+
+    /// Calls to global operator new.
+    boost::uint64_t allocations;
+
+    /// Growth of the bytes allocated by global operator new at its highest
+    /// point during the run.
+    boost::uint64_t peak_bytes;
+
+    /// Measurements particular to one benchmark, such as latency
+    /// percentiles, keyed by name.
+    std::map<std::string, double> measurements;
+
+    double megabytes_per_second() const;
+    double cpu_seconds_per_megabyte() const;
+    double allocations_per_megabyte() const;
+
+    double items_per_second() const;
+    double cpu_seconds_per_item() const;
+    double allocations_per_item() const;
+    double peak_bytes_per_item() const;
+};
+
+/**
+ * Measures the cost of the code run between construction and `finish`.
+ */
+class benchmark_timer
+{
+public:
+    benchmark_timer();
+
+    /**
+     * Record that the first item has been produced.
+     *
+     * Only the first call has any effect.
+     */
+    void first_item();
+
+    benchmark_result finish(const std::string& name, boost::uint64_t bytes,
+                            boost::uint64_t items = 0);
+
+private:
+    boost::chrono::steady_clock::time_point m_wall_start;
+    boost::chrono::process_cpu_clock::time_point m_cpu_start;
+    boost::uint64_t m_allocations_start;
+    boost::uint64_t m_bytes_start;
+    double m_first_item_seconds;
+};
+
+/**
+ * Combine several runs of the same configuration into one result holding
+ * the median of each measurement.
+ */
+benchmark_result median_of(const std::vector<benchmark_result>& runs);
+
+/**
+ * How a result compares to the same configuration in a baseline.
+ *
+ * Rates are per item for results that report items and otherwise per
+ * megabyte.
+ */
+struct benchmark_comparison
+{
+    std::string name;
+
+    /// "MB" or "item".
+    std::string unit;
+
+    double baseline_rate;
+    double rate;
+    double baseline_cpu_seconds_per_unit;
+    double cpu_seconds_per_unit;
+
+    /// Throughput fell, or CPU cost rose, by more than the tolerance.
+    bool regressed;
+};
+
+/**
+ * Results of a benchmark run, stored and reloaded as JSON.
+ */
+class benchmark_report
+{
+public:
+    void add(const benchmark_result& result);
+
+    const std::vector<benchmark_result>& results() const;
+
+    void write_json(std::ostream& stream) const;
+
+    static benchmark_report read_json(std::istream& stream);
+
+    /**
+     * Compare each result with the result of the same name in a baseline.
+     *
+     * Results missing from the baseline are left out.
+     *
+     * @param tolerance  Fractional change allowed before a result counts as
+     *                   a regression, e.g. 0.1 for 10%.
+     */
+    std::vector<benchmark_comparison> compare(const benchmark_report& baseline,
+                                              double tolerance) const;
+
+private:
+    std::vector<benchmark_result> m_results;
+};
+
+void write_comparison_table(std::ostream& stream,
+                            const std::vector<benchmark_comparison>& table);
+
+/**
+ * Value of a benchmark setting in the environment, or `fallback` if it is
+ * not set.
+ */
+std::string benchmark_setting(const char* name, const std::string& fallback);
+
+/**
+ * Save the results of a benchmark run and check them against a baseline.
+ *
+ * The results are written as JSON to the file named by the
+ * `SSH_BENCHMARK_RESULTS` environment variable, or `default_results_file`
+ * if it is not set.  If `SSH_BENCHMARK_BASELINE` names the results of an
+ * earlier run, each result is compared with it and the current test case
+ * fails for any whose throughput fell, or CPU cost rose, by more than
+ * `SSH_BENCHMARK_TOLERANCE` (default 0.1).
+ *
+ * Must be called from a Boost.Test test case.
+ */
+void save_and_compare_with_baseline(const benchmark_report& results,
+                                    const std::string& default_results_file);
+}
+} // namespace test::ssh
+
+#endif
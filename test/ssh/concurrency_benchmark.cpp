@@ -0,0 +1,368 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Behaviour of one `sftp_filesystem` shared by many threads.
+ *
+ * For each thread count from 1 to 64, every thread runs the same mix of
+ * directory listings, stats, small reads and large reads on the shared
+ * filesystem for a fixed time.  Each result records:
+ *
+ *  - the operations (`items`) and bytes completed by all threads, so the
+ *    comparison with a baseline is on aggregate operations per second;
+ *  - the 50th and 99th percentile latency of each class of operation, as
+ *    `<class>_p50_seconds` and `<class>_p99_seconds` measurements;
+ *  - Jain's fairness index of the operations completed by each thread, as
+ *    the `fairness` measurement.  1 means every thread got the same share of
+ *    the session; 1/N means one thread got all of it.
+ *
+ * Threads start at different points in the mix so they don't all make the
+ * same kind of request at once.
+ *
+ * `SSH_BENCHMARK_MAX_THREADS` limits the thread counts tried and
+ * `SSH_BENCHMARK_SECONDS` (default 5) sets how long each runs.  The results
+ * are saved and compared with a baseline as in the stream benchmarks, with
+ * the file defaulting to `concurrency_benchmark.json`.
+ */
+
+#include "benchmark.hpp"
+#include "sftp_fixture.hpp"
+
+#include <ssh/filesystem.hpp> // test subject
+#include <ssh/stream.hpp>
+
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/duration.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/cstdint.hpp>              // uint64_t
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/thread.hpp> // thread_group
+
+#include <algorithm> // sort
+#include <cmath>     // ceil
+#include <exception>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::directory_iterator;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::path;
+
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_setting;
+using test::ssh::benchmark_timer;
+using test::ssh::sftp_fixture;
+
+using boost::barrier;
+using boost::chrono::duration;
+using boost::chrono::milliseconds;
+using boost::chrono::steady_clock;
+using boost::thread_group;
+using boost::uint64_t;
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const unsigned int THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+enum operation_class
+{
+    list_operation,
+    stat_operation,
+    small_read_operation,
+    large_read_operation,
+    operation_class_count
+};
+
+const char* const OPERATION_NAMES[] = {"list", "stat", "small_read",
+                                       "large_read"};
+
+// Weighted towards the cheap operations, as in a typical browsing session
+const operation_class OPERATION_MIX[] = {
+    stat_operation,       list_operation,       small_read_operation,
+    stat_operation,       large_read_operation, stat_operation,
+    small_read_operation, list_operation};
+
+const unsigned int OPERATION_MIX_SIZE =
+    sizeof(OPERATION_MIX) / sizeof(OPERATION_MIX[0]);
+
+const unsigned long LISTING_ENTRIES = 100;
+const std::size_t SMALL_FILE_SIZE = 4 * 1024;
+const std::size_t LARGE_FILE_SIZE = 1024 * 1024;
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+unsigned int maximum_threads()
+{
+    return boost::lexical_cast<unsigned int>(
+        benchmark_setting("SSH_BENCHMARK_MAX_THREADS", "64"));
+}
+
+milliseconds run_time()
+{
+    return milliseconds(static_cast<milliseconds::rep>(
+        boost::lexical_cast<double>(
+            benchmark_setting("SSH_BENCHMARK_SECONDS", "5")) *
+        1000));
+}
+
+string benchmark_name(unsigned int thread_count)
+{
+    ostringstream name;
+    name << "mixed/threads=" << thread_count;
+    return name.str();
+}
+
+double seconds(duration<double> d)
+{
+    return d.count();
+}
+
+/**
+ * Nearest-rank percentile of a sorted sequence.
+ */
+double percentile(const vector<double>& sorted_values, double fraction)
+{
+    if (sorted_values.empty())
+        return 0;
+
+    std::size_t rank =
+        static_cast<std::size_t>(std::ceil(fraction * sorted_values.size()));
+    return sorted_values[(rank > 0) ? rank - 1 : 0];
+}
+
+/**
+ * Jain's fairness index: (sum x)^2 / (n * sum x^2).
+ */
+double fairness_index(const vector<double>& shares)
+{
+    double sum = 0;
+    double sum_of_squares = 0;
+    BOOST_FOREACH (double share, shares)
+    {
+        sum += share;
+        sum_of_squares += share * share;
+    }
+
+    return (sum_of_squares > 0) ? (sum * sum) / (shares.size() * sum_of_squares)
+                                : 0;
+}
+
+/**
+ * What one thread did during a run.
+ */
+struct worker_record
+{
+    worker_record() : operations(0), bytes(0)
+    {
+    }
+
+    unsigned long operations;
+    uint64_t bytes;
+    vector<double> latencies[operation_class_count];
+
+    /// Why the thread stopped early, if it did.
+    string error;
+};
+
+class concurrency_benchmark_fixture : public sftp_fixture
+{
+public:
+    concurrency_benchmark_fixture()
+        : m_listing_directory(sandbox() / "listing"),
+          m_stat_target(new_file_in_sandbox()),
+          m_small_file(
+              new_file_in_sandbox_containing_data(string(SMALL_FILE_SIZE, 's'))),
+          m_large_file(
+              new_file_in_sandbox_containing_data(string(LARGE_FILE_SIZE, 'l')))
+    {
+        create_files_on_server(m_listing_directory.string(), LISTING_ENTRIES);
+    }
+
+    benchmark_result run_threads(unsigned int thread_count)
+    {
+        vector<worker_record> records(thread_count);
+        barrier start(thread_count + 1);
+        milliseconds length = run_time();
+
+        thread_group threads;
+        for (unsigned int i = 0; i < thread_count; ++i)
+        {
+            threads.create_thread(boost::bind(
+                &concurrency_benchmark_fixture::work, this, i,
+                boost::ref(start), length, boost::ref(records[i])));
+        }
+
+        start.wait();
+        benchmark_timer timer;
+        threads.join_all();
+
+        unsigned long operations = 0;
+        uint64_t bytes = 0;
+        vector<double> shares;
+        vector<double> latencies[operation_class_count];
+        BOOST_FOREACH (const worker_record& record, records)
+        {
+            BOOST_REQUIRE_MESSAGE(record.error.empty(),
+                                  "Worker failed: " << record.error);
+
+            operations += record.operations;
+            bytes += record.bytes;
+            shares.push_back(static_cast<double>(record.operations));
+            for (int c = 0; c < operation_class_count; ++c)
+            {
+                latencies[c].insert(latencies[c].end(),
+                                    record.latencies[c].begin(),
+                                    record.latencies[c].end());
+            }
+        }
+
+        benchmark_result result =
+            timer.finish(benchmark_name(thread_count), bytes, operations);
+
+        result.measurements["fairness"] = fairness_index(shares);
+        for (int c = 0; c < operation_class_count; ++c)
+        {
+            std::sort(latencies[c].begin(), latencies[c].end());
+
+            string name = OPERATION_NAMES[c];
+            result.measurements[name + "_p50_seconds"] =
+                percentile(latencies[c], 0.5);
+            result.measurements[name + "_p99_seconds"] =
+                percentile(latencies[c], 0.99);
+        }
+
+        return result;
+    }
+
+private:
+    void work(unsigned int index, barrier& start, milliseconds length,
+              worker_record& record)
+    {
+        try
+        {
+            start.wait();
+            steady_clock::time_point deadline = steady_clock::now() + length;
+
+            for (unsigned int i = index; steady_clock::now() < deadline; ++i)
+            {
+                operation_class operation =
+                    OPERATION_MIX[i % OPERATION_MIX_SIZE];
+
+                steady_clock::time_point before = steady_clock::now();
+                record.bytes += perform(operation);
+                record.latencies[operation].push_back(
+                    seconds(steady_clock::now() - before));
+                ++record.operations;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            record.error = e.what();
+        }
+    }
+
+    /**
+     * Run one operation and return the number of bytes it transferred.
+     */
+    uint64_t perform(operation_class operation)
+    {
+        switch (operation)
+        {
+        case list_operation:
+        {
+            directory_iterator it =
+                filesystem().directory_iterator(m_listing_directory);
+            for (; it != filesystem().directory_iterator(); ++it)
+            {
+            }
+            return 0;
+        }
+
+        case stat_operation:
+            status(filesystem(), m_stat_target);
+            return 0;
+
+        case small_read_operation:
+            return read_whole_file(m_small_file, SMALL_FILE_SIZE);
+
+        case large_read_operation:
+            return read_whole_file(m_large_file, LARGE_FILE_SIZE);
+
+        default:
+            return 0;
+        }
+    }
+
+    uint64_t read_whole_file(const path& file, std::size_t size)
+    {
+        vector<char> buffer(size);
+
+        ifstream stream(filesystem(), file);
+        stream.read(&buffer[0], buffer.size());
+        return static_cast<uint64_t>(stream.gcount());
+    }
+
+    path m_listing_directory;
+    path m_stat_target;
+    path m_small_file;
+    path m_large_file;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(concurrency_benchmarks, concurrency_benchmark_fixture)
+
+BOOST_AUTO_TEST_CASE(mixed_operations_on_shared_filesystem)
+{
+    BOOST_FOREACH (unsigned int thread_count, THREAD_COUNTS)
+    {
+        if (thread_count > maximum_threads())
+            continue;
+
+        benchmark_result result = run_threads(thread_count);
+        BOOST_TEST_MESSAGE(result.name
+                           << ": " << result.items_per_second() << " ops/s, "
+                           << result.megabytes_per_second() << " MB/s, "
+                           << "fairness " << result.measurements["fairness"]);
+        results().add(result);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(concurrency_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(results(),
+                                              "concurrency_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
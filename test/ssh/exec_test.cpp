@@ -0,0 +1,221 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/exec_channel.hpp> // test subject
+#include <ssh/stream.hpp>
+
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/duration.hpp> // milliseconds
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/move/move.hpp>
+#include <boost/optional/optional.hpp>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iterator> // istreambuf_iterator
+#include <string>
+
+using ssh::exec_channel;
+using ssh::exec_stderr_stream;
+using ssh::exec_stdin_stream;
+using ssh::exec_stdout_stream;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::path;
+
+using test::ssh::sftp_fixture;
+
+using boost::thread;
+
+using std::istreambuf_iterator;
+using std::string;
+
+namespace
+{
+
+template <typename Stream>
+string read_all(Stream& stream)
+{
+    return string(istreambuf_iterator<char>(stream),
+                  istreambuf_iterator<char>());
+}
+
+void read_all_into(exec_stdout_stream& stream, string& output)
+{
+    output = read_all(stream);
+}
+
+void write_all(exec_channel& channel, const string& data)
+{
+    exec_stdin_stream input(channel);
+    input << data << std::flush;
+    channel.close_input();
+}
+
+void stat_repeatedly(ssh::filesystem::sftp_filesystem& filesystem,
+                     const path& file, int count, int& successes)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        boost::optional<boost::uint64_t> size =
+            filesystem.attributes(file, false).size();
+        if (size && *size == 13U)
+        {
+            ++successes;
+        }
+    }
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(exec_tests, sftp_fixture)
+
+BOOST_AUTO_TEST_CASE(output)
+{
+    exec_channel channel = test_session().exec("echo humpty dumpty");
+
+    exec_stdout_stream output(channel);
+    BOOST_CHECK_EQUAL(read_all(output), "humpty dumpty\n");
+    BOOST_CHECK_EQUAL(channel.exit_status(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(error_output)
+{
+    exec_channel channel = test_session().exec("echo sat on a wall >&2");
+
+    exec_stderr_stream error(channel);
+    BOOST_CHECK_EQUAL(read_all(error), "sat on a wall\n");
+}
+
+BOOST_AUTO_TEST_CASE(no_output)
+{
+    exec_channel channel = test_session().exec("true");
+
+    exec_stdout_stream output(channel);
+    BOOST_CHECK_EQUAL(read_all(output), "");
+}
+
+BOOST_AUTO_TEST_CASE(exit_status)
+{
+    exec_channel channel = test_session().exec("exit 3");
+
+    BOOST_CHECK_EQUAL(channel.exit_status(), 3);
+    BOOST_CHECK_EQUAL(channel.exit_status(), 3);
+}
+
+BOOST_AUTO_TEST_CASE(exit_status_discards_unread_output)
+{
+    // More output than fits in the channel window, so the command can only
+    // finish if the output is drained
+    exec_channel channel = test_session().exec("head -c 10000000 /dev/zero");
+
+    BOOST_CHECK_EQUAL(channel.exit_status(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(input)
+{
+    exec_channel channel = test_session().exec("cat");
+
+    // Larger than the stream buffer
+    string data(100000, 'x');
+    {
+        exec_stdin_stream input(channel);
+        input << data;
+    }
+
+    exec_stdout_stream output(channel);
+    BOOST_CHECK_EQUAL(read_all(output), data);
+    BOOST_CHECK_EQUAL(channel.exit_status(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(close_input)
+{
+    exec_channel channel = test_session().exec("wc -c");
+
+    exec_stdin_stream input(channel);
+    input << "12345" << std::flush;
+    channel.close_input();
+
+    exec_stdout_stream output(channel);
+    string count;
+    output >> count;
+    BOOST_CHECK_EQUAL(count, "5");
+}
+
+BOOST_AUTO_TEST_CASE(move)
+{
+    exec_channel channel = test_session().exec("echo moved");
+    exec_channel moved(boost::move(channel));
+
+    exec_stdout_stream output(moved);
+    BOOST_CHECK_EQUAL(read_all(output), "moved\n");
+}
+
+/**
+ * A command waiting for output must not stop the filesystem being used.
+ */
+BOOST_AUTO_TEST_CASE(filesystem_use_while_command_runs)
+{
+    path file = new_file_in_sandbox_containing_data("humpty dumpty");
+
+    exec_channel channel = test_session().exec("sleep 2; echo done");
+    exec_stdout_stream output(channel);
+
+    string command_output;
+    thread reader(
+        boost::bind(read_all_into, boost::ref(output),
+                    boost::ref(command_output)));
+
+    // Give the reader time to start waiting
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(200));
+
+    ifstream stream(filesystem(), file);
+    BOOST_CHECK_EQUAL(read_all(stream), "humpty dumpty");
+    BOOST_CHECK(!reader.try_join_for(boost::chrono::milliseconds(0)));
+
+    reader.join();
+    BOOST_CHECK_EQUAL(command_output, "done\n");
+}
+
+/**
+ * A large upload that keeps filling the socket must not leave a packet half
+ * sent when another thread uses the session.
+ */
+BOOST_AUTO_TEST_CASE(filesystem_use_during_large_upload)
+{
+    path file = new_file_in_sandbox_containing_data("humpty dumpty");
+
+    exec_channel channel = test_session().exec("wc -c");
+
+    string data(32 * 1024 * 1024, 'x');
+    thread writer(
+        boost::bind(write_all, boost::ref(channel), boost::cref(data)));
+
+    int successes = 0;
+    stat_repeatedly(filesystem(), file, 500, successes);
+
+    writer.join();
+
+    exec_stdout_stream output(channel);
+    string count;
+    output >> count;
+
+    BOOST_CHECK_EQUAL(successes, 500);
+    BOOST_CHECK_EQUAL(count, "33554432");
+    BOOST_CHECK_EQUAL(channel.exit_status(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
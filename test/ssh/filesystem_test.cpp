@@ -20,6 +20,7 @@
 #include <ssh/stream.hpp>
 
 #include <boost/bind.hpp>    // bind
+#include <boost/chrono/duration.hpp>
 #include <boost/cstdint.hpp> // uintmax_t
 #include <boost/foreach.hpp> // BOOST_FOREACH
 #include <boost/move/move.hpp>
@@ -57,6 +58,8 @@ using boost::thread;
 using boost::uintmax_t;
 using boost::uuids::random_generator;
 
+using test::ssh::link_conditions;
+using test::ssh::openssh_fixture;
 using test::ssh::session_fixture;
 using test::ssh::sftp_fixture;
 
@@ -134,6 +137,19 @@ public:
         return make_pair(link.filename(), target.filename());
     }
 };
+
+/**
+ * Filesystem reached over a link with a 100ms round trip.
+ */
+class slow_link_fixture : public sftp_fixture
+{
+public:
+    slow_link_fixture()
+        : openssh_fixture(link_conditions::with_round_trip_time(
+              boost::chrono::milliseconds(100)))
+    {
+    }
+};
 }
 
 // Tests assume an authenticated session and established SFTP filesystem
@@ -422,7 +438,7 @@ BOOST_AUTO_TEST_CASE(attributes_broken_link)
 BOOST_AUTO_TEST_CASE(default_directory)
 {
     path resolved_target = filesystem().canonical_path("");
-    BOOST_CHECK_EQUAL(resolved_target, "/home/swish");
+    BOOST_CHECK_EQUAL(resolved_target, remote_home());
 }
 
 BOOST_AUTO_TEST_CASE(remove_nothing)
@@ -565,32 +581,52 @@ BOOST_AUTO_TEST_CASE(rename_file_obstacle_no_overwrite)
 
 BOOST_AUTO_TEST_CASE(rename_file_obstacle_allow_overwrite)
 {
-    path test_file = new_file_in_sandbox();
+    path test_file = new_file_in_sandbox_containing_data("source");
 
-    path target = new_file_in_sandbox("target");
+    path target = new_file_in_sandbox_containing_data("target", "obstacle");
 
-    // Using OpenSSH server which only supports SFTP 3 (no overwrite) so
-    // failure expected
-    BOOST_CHECK_THROW(rename(filesystem(), test_file, target,
-                             overwrite_behaviour::allow_overwrite),
-                      system_error);
-    BOOST_CHECK(exists(filesystem(), test_file));
-    BOOST_CHECK(exists(filesystem(), target));
+    // OpenSSH server only supports SFTP 3 (no overwrite) but overwrites
+    // using its posix-rename@openssh.com extension
+    rename(filesystem(), test_file, target,
+           overwrite_behaviour::allow_overwrite);
+    BOOST_CHECK(!exists(filesystem(), test_file));
+    BOOST_CHECK_EQUAL(file_size(filesystem(), target), 6U);
+}
+
+BOOST_AUTO_TEST_CASE(can_overwrite_atomically)
+{
+    // OpenSSH server has the posix-rename@openssh.com extension
+    BOOST_CHECK(filesystem().can_overwrite_atomically());
 }
 
 BOOST_AUTO_TEST_CASE(rename_file_obstacle_atomic_overwrite)
+{
+    path test_file = new_file_in_sandbox_containing_data("source");
+
+    path target = new_file_in_sandbox_containing_data("target", "obstacle");
+
+    // OpenSSH server only supports SFTP 3 (no overwrite) but overwrites
+    // using its posix-rename@openssh.com extension
+    rename(filesystem(), test_file, target,
+           overwrite_behaviour::atomic_overwrite);
+    BOOST_CHECK(!exists(filesystem(), test_file));
+    BOOST_CHECK_EQUAL(file_size(filesystem(), target), 6U);
+}
+
+BOOST_AUTO_TEST_CASE(rename_directory_obstacle_not_empty)
 {
     path test_file = new_file_in_sandbox();
 
-    path target = new_file_in_sandbox("target");
+    path target = new_directory_in_sandbox();
+    new_file_in_sandbox(target.filename() / "contents");
 
-    // Using OpenSSH server which only supports SFTP 3 (no overwrite) so
-    // failure expected
+    // Like POSIX rename, posix-rename@openssh.com won't replace a directory
+    // with contents
     BOOST_CHECK_THROW(rename(filesystem(), test_file, target,
                              overwrite_behaviour::atomic_overwrite),
                       system_error);
     BOOST_CHECK(exists(filesystem(), test_file));
-    BOOST_CHECK(exists(filesystem(), target));
+    BOOST_CHECK(is_directory(filesystem(), target));
 }
 
 BOOST_AUTO_TEST_CASE(exists_true)
@@ -774,6 +810,20 @@ BOOST_AUTO_TEST_CASE(last_write_time_of_non_file_throws_error)
                       system_error);
 }
 
+BOOST_AUTO_TEST_CASE(can_set_last_write_time)
+{
+    path target = new_file_in_sandbox();
+    last_write_time(filesystem(), target, 1234567890);
+    BOOST_CHECK_EQUAL(last_write_time(filesystem(), target), 1234567890);
+}
+
+BOOST_AUTO_TEST_CASE(setting_last_write_time_of_missing_file_throws_error)
+{
+    BOOST_CHECK_THROW(
+        last_write_time(filesystem(), sandbox() / "missing", 1234567890),
+        system_error);
+}
+
 BOOST_AUTO_TEST_CASE(empty_file_is_empty)
 {
     path target = new_file_in_sandbox();
@@ -800,3 +850,19 @@ BOOST_AUTO_TEST_CASE(non_empty_directory_is_not_empty)
 }
 
 BOOST_AUTO_TEST_SUITE_END();
+
+BOOST_FIXTURE_TEST_SUITE(slow_link_tests, slow_link_fixture)
+
+BOOST_AUTO_TEST_CASE(dir_with_multiple_files_over_slow_link)
+{
+    new_file_in_sandbox();
+    new_file_in_sandbox();
+    new_file_in_sandbox();
+
+    vector<sftp_file> files(filesystem().directory_iterator(sandbox()),
+                            filesystem().directory_iterator());
+
+    BOOST_CHECK_EQUAL(files.size(), 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,182 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/find_listing.hpp> // test subject
+
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <libssh2_sftp.h>
+
+using ssh::detail::find_listing_reader;
+
+using std::istringstream;
+using std::string;
+
+namespace
+{
+
+/**
+ * One entry as `find -printf FIND_LISTING_FORMAT` prints it.
+ */
+string record(const string& name, const string& type, const string& mode,
+              const string& size, const string& atime = "1400000000.5",
+              const string& mtime = "1234567890.0000000000")
+{
+    string fields[] = {name, type, mode, size, "1000", "100", atime, mtime};
+
+    string text;
+    for (std::size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+    {
+        text += fields[i];
+        text += '\0';
+    }
+    return text;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(find_listing_tests)
+
+BOOST_AUTO_TEST_CASE(empty_listing)
+{
+    istringstream stream("");
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_CHECK(!reader.next_entry(name, attributes));
+}
+
+BOOST_AUTO_TEST_CASE(entries)
+{
+    istringstream stream(record("a", "d", "755", "4096") +
+                         record("a/humpty.txt", "f", "640", "13"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(name, "a");
+    BOOST_CHECK_EQUAL(attributes.permissions, LIBSSH2_SFTP_S_IFDIR | 0755U);
+
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(name, "a/humpty.txt");
+    BOOST_CHECK_EQUAL(attributes.permissions, LIBSSH2_SFTP_S_IFREG | 0640U);
+    BOOST_CHECK_EQUAL(attributes.filesize, 13U);
+    BOOST_CHECK_EQUAL(attributes.uid, 1000U);
+    BOOST_CHECK_EQUAL(attributes.gid, 100U);
+    BOOST_CHECK_EQUAL(attributes.atime, 1400000000U);
+    BOOST_CHECK_EQUAL(attributes.mtime, 1234567890U);
+    BOOST_CHECK(attributes.flags & LIBSSH2_SFTP_ATTR_PERMISSIONS);
+    BOOST_CHECK(attributes.flags & LIBSSH2_SFTP_ATTR_SIZE);
+    BOOST_CHECK(attributes.flags & LIBSSH2_SFTP_ATTR_UIDGID);
+    BOOST_CHECK(attributes.flags & LIBSSH2_SFTP_ATTR_ACMODTIME);
+
+    BOOST_CHECK(!reader.next_entry(name, attributes));
+}
+
+BOOST_AUTO_TEST_CASE(name_with_newline)
+{
+    istringstream stream(record("humpty\ndumpty", "f", "644", "0"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(name, "humpty\ndumpty");
+}
+
+BOOST_AUTO_TEST_CASE(link)
+{
+    istringstream stream(record("link", "l", "777", "6"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(attributes.permissions, LIBSSH2_SFTP_S_IFLNK | 0777U);
+}
+
+BOOST_AUTO_TEST_CASE(size_beyond_32_bits)
+{
+    istringstream stream(record("big", "f", "644", "5000000000"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(attributes.filesize, 5000000000ULL);
+}
+
+BOOST_AUTO_TEST_CASE(time_before_epoch)
+{
+    istringstream stream(
+        record("old", "f", "644", "0", "-100.5", "-86400.0000000000"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_EQUAL(attributes.atime, 0U);
+    BOOST_CHECK_EQUAL(attributes.mtime, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_entry)
+{
+    string text = record("file", "f", "644", "3");
+    istringstream stream(text.substr(0, text.size() - 5));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_CHECK_THROW(reader.next_entry(name, attributes), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_name)
+{
+    istringstream stream(record("file", "f", "644", "3") + "fi");
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_REQUIRE(reader.next_entry(name, attributes));
+    BOOST_CHECK_THROW(reader.next_entry(name, attributes), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_field)
+{
+    istringstream stream(record("file", "f", "644", "3x"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_CHECK_THROW(reader.next_entry(name, attributes), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(malformed_mode)
+{
+    istringstream stream(record("file", "f", "648", "3"));
+    find_listing_reader reader(stream);
+
+    string name;
+    LIBSSH2_SFTP_ATTRIBUTES attributes;
+    BOOST_CHECK_THROW(reader.next_entry(name, attributes), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
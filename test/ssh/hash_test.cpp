@@ -0,0 +1,180 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/hash.hpp> // test subject
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory> // auto_ptr
+#include <string>
+
+using ssh::detail::hash_function;
+using ssh::detail::hex_digest;
+using ssh::detail::make_hash_function;
+using ssh::hash_algorithm;
+
+using std::auto_ptr;
+using std::string;
+
+namespace
+{
+
+const string QUICK_FOX = "The quick brown fox jumps over the lazy dog";
+
+// Exactly one block after padding is added to the end of a second
+const string TWO_BLOCKS =
+    "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+string hash_of(BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+               const string& data)
+{
+    auto_ptr<hash_function> hash = make_hash_function(algorithm);
+    hash->update(data.data(), data.size());
+    return hex_digest(hash->finish());
+}
+
+/**
+ * Hash of data passed in pieces of the given size, to exercise the
+ * buffering of partial blocks.
+ */
+string hash_in_pieces(BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                      const string& data, string::size_type piece_size)
+{
+    auto_ptr<hash_function> hash = make_hash_function(algorithm);
+    for (string::size_type i = 0; i < data.size(); i += piece_size)
+    {
+        string piece = data.substr(i, piece_size);
+        hash->update(piece.data(), piece.size());
+    }
+    return hex_digest(hash->finish());
+}
+}
+
+BOOST_AUTO_TEST_SUITE(hash_tests)
+
+BOOST_AUTO_TEST_CASE(sha256_known_values)
+{
+    BOOST_CHECK_EQUAL(
+        hash_of(hash_algorithm::sha256, ""),
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+    BOOST_CHECK_EQUAL(
+        hash_of(hash_algorithm::sha256, "abc"),
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+    BOOST_CHECK_EQUAL(
+        hash_of(hash_algorithm::sha256, TWO_BLOCKS),
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+    BOOST_CHECK_EQUAL(
+        hash_of(hash_algorithm::sha256, QUICK_FOX),
+        "d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592");
+}
+
+BOOST_AUTO_TEST_CASE(sha256_million_bytes_in_pieces)
+{
+    BOOST_CHECK_EQUAL(
+        hash_in_pieces(hash_algorithm::sha256, string(1000000, 'a'), 1000),
+        "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+}
+
+BOOST_AUTO_TEST_CASE(md5_known_values)
+{
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::md5, ""),
+                      "d41d8cd98f00b204e9800998ecf8427e");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::md5, "abc"),
+                      "900150983cd24fb0d6963f7d28e17f72");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::md5, TWO_BLOCKS),
+                      "8215ef0796a20bcaaae116d3876c664a");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::md5, QUICK_FOX),
+                      "9e107d9d372bb6826bd81d3542a419d6");
+}
+
+BOOST_AUTO_TEST_CASE(md5_million_bytes_in_pieces)
+{
+    BOOST_CHECK_EQUAL(
+        hash_in_pieces(hash_algorithm::md5, string(1000000, 'a'), 1000),
+        "7707d6ae4e027c70eea2a935c2296f21");
+}
+
+BOOST_AUTO_TEST_CASE(xxh64_known_values)
+{
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh64, ""), "ef46db3751d8e999");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh64, "abc"),
+                      "44bc2cf5ad770999");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh64, TWO_BLOCKS),
+                      "f06103773e8585df");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh64, QUICK_FOX),
+                      "0b242d361fda71bc");
+}
+
+BOOST_AUTO_TEST_CASE(xxh64_million_bytes_in_pieces)
+{
+    BOOST_CHECK_EQUAL(
+        hash_in_pieces(hash_algorithm::xxh64, string(1000000, 'a'), 1000),
+        "dc483aaa9b4fdc40");
+}
+
+BOOST_AUTO_TEST_CASE(xxh3_known_values)
+{
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, ""), "2d06800538d394c2");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, "abc"), "78af5f94892f3950");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, TWO_BLOCKS),
+                      "5bbcbbabcdcc3d3f");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, QUICK_FOX),
+                      "ce7d19a5418fb365");
+}
+
+// Each length takes a different path through XXH3
+BOOST_AUTO_TEST_CASE(xxh3_lengths)
+{
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(8, 'a')),
+                      "c9dbc05573cd5d9a");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(16, 'a')),
+                      "13ba5039476cd10a");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(128, 'a')),
+                      "7a22200aadc3d36c");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(240, 'a')),
+                      "993c46d96a01b5c6");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(241, 'a')),
+                      "f6cfef5c5aca1930");
+    BOOST_CHECK_EQUAL(hash_of(hash_algorithm::xxh3, string(1024, 'a')),
+                      "4a5d6b09a9587a1c");
+}
+
+BOOST_AUTO_TEST_CASE(xxh3_million_bytes_in_pieces)
+{
+    BOOST_CHECK_EQUAL(
+        hash_in_pieces(hash_algorithm::xxh3, string(1000000, 'a'), 1000),
+        "b1fd6fae5285c4eb");
+}
+
+BOOST_AUTO_TEST_CASE(piece_size_does_not_change_hash)
+{
+    string data(1000, 'x');
+    string whole = hash_of(hash_algorithm::sha256, data);
+    string whole_xxh64 = hash_of(hash_algorithm::xxh64, data);
+    string whole_xxh3 = hash_of(hash_algorithm::xxh3, data);
+    for (string::size_type piece_size = 1; piece_size < 130; ++piece_size)
+    {
+        BOOST_CHECK_EQUAL(
+            hash_in_pieces(hash_algorithm::sha256, data, piece_size), whole);
+        BOOST_CHECK_EQUAL(
+            hash_in_pieces(hash_algorithm::xxh64, data, piece_size),
+            whole_xxh64);
+        BOOST_CHECK_EQUAL(
+            hash_in_pieces(hash_algorithm::xxh3, data, piece_size),
+            whole_xxh3);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,159 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/detail/hash.hpp>
+#include <ssh/hashing_stream.hpp> // test subject
+#include <ssh/stream.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+#include <iterator> // istreambuf_iterator
+#include <memory>   // auto_ptr
+#include <string>
+
+using ssh::detail::hash_function;
+using ssh::detail::hex_digest;
+using ssh::detail::make_hash_function;
+using ssh::filesystem::hashing_ifstream;
+using ssh::filesystem::hashing_ofstream;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::path;
+using ssh::hash_algorithm;
+
+using test::ssh::sftp_fixture;
+
+using std::string;
+
+namespace
+{
+
+const string ABC_SHA256 =
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+/**
+ * Data spanning several stream buffers, not all the same byte.
+ */
+string large_data()
+{
+    string data;
+    for (int i = 0; i < 200000; ++i)
+    {
+        data.push_back(static_cast<char>((i * 7) % 251));
+    }
+    return data;
+}
+
+string hash_of(BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+               const string& data)
+{
+    std::auto_ptr<hash_function> hash = make_hash_function(algorithm);
+    hash->update(data.data(), data.size());
+    return hex_digest(hash->finish());
+}
+
+string read_all(std::istream& stream)
+{
+    return string(std::istreambuf_iterator<char>(stream),
+                  std::istreambuf_iterator<char>());
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(hashing_stream_tests, sftp_fixture)
+
+BOOST_AUTO_TEST_CASE(write_hashes_data)
+{
+    path target = new_file_in_sandbox();
+
+    hashing_ofstream stream(filesystem(), target, hash_algorithm::sha256);
+    stream << "abc";
+
+    BOOST_CHECK_EQUAL(stream.digest(), ABC_SHA256);
+
+    ifstream written(filesystem(), target);
+    BOOST_CHECK_EQUAL(read_all(written), "abc");
+}
+
+BOOST_AUTO_TEST_CASE(read_hashes_data)
+{
+    path source = new_file_in_sandbox_containing_data("abc");
+
+    hashing_ifstream stream(filesystem(), source, hash_algorithm::sha256);
+
+    BOOST_CHECK_EQUAL(read_all(stream), "abc");
+    BOOST_CHECK_EQUAL(stream.digest(), ABC_SHA256);
+}
+
+BOOST_AUTO_TEST_CASE(empty_file)
+{
+    path source = new_file_in_sandbox();
+
+    hashing_ifstream stream(filesystem(), source, hash_algorithm::md5);
+
+    BOOST_CHECK_EQUAL(read_all(stream), "");
+    BOOST_CHECK_EQUAL(stream.digest(), "d41d8cd98f00b204e9800998ecf8427e");
+}
+
+BOOST_AUTO_TEST_CASE(large_write_and_read_agree)
+{
+    path target = new_file_in_sandbox();
+    string data = large_data();
+    string expected = hash_of(hash_algorithm::xxh64, data);
+
+    {
+        hashing_ofstream output(filesystem(), target, hash_algorithm::xxh64);
+        output.write(data.data(), data.size());
+        BOOST_CHECK_EQUAL(output.digest(), expected);
+    }
+
+    hashing_ifstream input(filesystem(), target, hash_algorithm::xxh64);
+    BOOST_CHECK(read_all(input) == data);
+    BOOST_CHECK_EQUAL(input.digest(), expected);
+}
+
+BOOST_AUTO_TEST_CASE(digest_repeats)
+{
+    path target = new_file_in_sandbox();
+
+    hashing_ofstream stream(filesystem(), target, hash_algorithm::sha256);
+    stream << "abc";
+
+    BOOST_CHECK_EQUAL(stream.digest(), ABC_SHA256);
+    BOOST_CHECK_EQUAL(stream.digest(), ABC_SHA256);
+}
+
+BOOST_AUTO_TEST_CASE(write_after_digest_fails)
+{
+    path target = new_file_in_sandbox();
+
+    hashing_ofstream stream(filesystem(), target, hash_algorithm::sha256);
+    stream << "abc";
+    stream.digest();
+
+    stream << "def";
+    BOOST_CHECK(!stream.flush());
+}
+
+BOOST_AUTO_TEST_CASE(missing_file_fails)
+{
+    path missing = sandbox() / "missing";
+
+    BOOST_CHECK_THROW(
+        hashing_ifstream(filesystem(), missing, hash_algorithm::sha256),
+        std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -15,21 +15,31 @@
 
 #include "sftp_fixture.hpp"
 
+#include <ssh/metrics.hpp>
 #include <ssh/stream.hpp> // test subject
+#include <ssh/trace.hpp>
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/uuid/uuid_generators.hpp> // random_generator
 #include <boost/uuid/uuid_io.hpp>         // to_string
 
+#include <sstream>
 #include <string>
 #include <vector>
 
+using ssh::chrome_trace_exporter;
 using ssh::filesystem::ifstream;
 using ssh::filesystem::openmode;
 using ssh::filesystem::path;
 using ssh::filesystem::perms;
 using ssh::filesystem::sftp_filesystem;
+using ssh::metrics_registry;
+using ssh::operation_metrics;
+using ssh::set_tracer;
+using ssh::tracer;
 
 using boost::uuids::random_generator;
 using boost::system::system_error;
@@ -38,6 +48,7 @@ using test::ssh::sftp_fixture;
 
 using std::runtime_error;
 using std::string;
+using std::stringstream;
 using std::vector;
 
 namespace
@@ -159,6 +170,70 @@ BOOST_AUTO_TEST_CASE(input_stream_readable_multiple_buffers)
                                   expected_data.begin(), expected_data.end());
 }
 
+BOOST_AUTO_TEST_CASE(input_stream_read_is_metered)
+{
+    string expected_data(large_data());
+    path target = new_file_in_sandbox_containing_data(expected_data);
+
+    metrics_registry& registry = metrics_registry::instance();
+    registry.reset();
+    registry.enable(true);
+
+    boost::uint64_t traffic_before = test_session().traffic().bytes_read;
+
+    {
+        ifstream input_stream(filesystem(), target);
+
+        vector<char> buffer(expected_data.size());
+        BOOST_CHECK(input_stream.read(&buffer[0], buffer.size()));
+    }
+
+    registry.enable(false);
+
+    BOOST_CHECK_EQUAL(test_session().traffic().bytes_read - traffic_before,
+                      expected_data.size());
+
+    operation_metrics reads =
+        registry.snapshot().operations().find("read")->second;
+    BOOST_CHECK_GE(reads.calls, 2U);
+    BOOST_CHECK_EQUAL(reads.errors, 0U);
+    BOOST_CHECK_EQUAL(reads.bytes, expected_data.size());
+    BOOST_CHECK_EQUAL(reads.latency.count(), reads.calls);
+
+    BOOST_CHECK_EQUAL(
+        registry.snapshot().operations().find("open")->second.calls, 1U);
+
+    registry.reset();
+}
+
+BOOST_AUTO_TEST_CASE(input_stream_read_is_traced)
+{
+    string expected_data(large_data());
+    path target = new_file_in_sandbox_containing_data(expected_data);
+
+    boost::shared_ptr<chrome_trace_exporter> exporter =
+        boost::make_shared<chrome_trace_exporter>();
+    set_tracer(exporter);
+
+    {
+        ifstream input_stream(filesystem(), target);
+
+        vector<char> buffer(expected_data.size());
+        BOOST_CHECK(input_stream.read(&buffer[0], buffer.size()));
+    }
+
+    set_tracer(boost::shared_ptr<tracer>());
+
+    stringstream trace;
+    exporter->write(trace);
+
+    BOOST_CHECK(trace.str().find("\"name\":\"libssh2_sftp_open_ex\"") !=
+                string::npos);
+    BOOST_CHECK(trace.str().find("\"name\":\"libssh2_sftp_read\"") !=
+                string::npos);
+    BOOST_CHECK(trace.str().find(target.string()) != string::npos);
+}
+
 // Test with Boost.IOStreams buffer disabled.
 // Should call directly to libssh2
 BOOST_AUTO_TEST_CASE(input_stream_readable_no_buffer)
@@ -0,0 +1,160 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Speed of listing large remote directories.
+ *
+ * Directories of 1k, 10k, 100k and 1M empty files are made on the fixture
+ * server and each listed several times with `directory_iterator`, keeping
+ * the median.  Each result records the time until the first entry arrived,
+ * the total time, entries per second and the peak memory and allocations
+ * per entry.
+ *
+ * Only directories of up to 10k files are listed unless
+ * `SSH_BENCHMARK_MAX_ENTRIES` allows more; set it to 1000000 for the full
+ * run, which takes a long time to make its files.  The results are saved
+ * and compared with a baseline as in the stream benchmarks, with the file
+ * defaulting to `listing_benchmark.json`.
+ */
+
+#include "benchmark.hpp"
+#include "sftp_fixture.hpp"
+
+#include <ssh/filesystem.hpp> // test subject
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::directory_iterator;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_file;
+
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_setting;
+using test::ssh::benchmark_timer;
+using test::ssh::median_of;
+using test::ssh::sftp_fixture;
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const unsigned long ENTRY_COUNTS[] = {1000, 10000, 100000, 1000000};
+
+const int RUNS_PER_CONFIGURATION = 3;
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+unsigned long maximum_entries()
+{
+    return boost::lexical_cast<unsigned long>(
+        benchmark_setting("SSH_BENCHMARK_MAX_ENTRIES", "10000"));
+}
+
+string benchmark_name(unsigned long entry_count)
+{
+    ostringstream name;
+    name << "list/entries=" << entry_count;
+    return name.str();
+}
+
+class listing_benchmark_fixture : public sftp_fixture
+{
+public:
+    path directory_of_size(unsigned long entry_count)
+    {
+        path directory =
+            sandbox() / ("listing-" + boost::lexical_cast<string>(entry_count));
+        create_files_on_server(directory.string(), entry_count);
+        return directory;
+    }
+
+    benchmark_result list_directory(const string& name, const path& directory,
+                                    unsigned long entry_count)
+    {
+        vector<sftp_file> entries;
+
+        benchmark_timer timer;
+        {
+            directory_iterator it = filesystem().directory_iterator(directory);
+            for (; it != filesystem().directory_iterator(); ++it)
+            {
+                entries.push_back(*it);
+                timer.first_item();
+            }
+        }
+        benchmark_result result = timer.finish(name, 0, entries.size());
+
+        BOOST_REQUIRE_EQUAL(entries.size(), entry_count);
+
+        return result;
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(listing_benchmarks, listing_benchmark_fixture)
+
+BOOST_AUTO_TEST_CASE(list_directory_iterator)
+{
+    BOOST_FOREACH (unsigned long entry_count, ENTRY_COUNTS)
+    {
+        if (entry_count > maximum_entries())
+            continue;
+
+        path directory = directory_of_size(entry_count);
+        string name = benchmark_name(entry_count);
+
+        vector<benchmark_result> runs;
+        for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+        {
+            runs.push_back(list_directory(name, directory, entry_count));
+        }
+
+        benchmark_result result = median_of(runs);
+        BOOST_TEST_MESSAGE(name << ": first entry after "
+                                << result.first_item_seconds << "s, "
+                                << result.items_per_second()
+                                << " entries/s, "
+                                << result.peak_bytes_per_item()
+                                << " peak bytes/entry");
+        results().add(result);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(listing_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(results(),
+                                              "listing_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,339 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "local_sshd.hpp"
+
+#include <boost/algorithm/string/classification.hpp> // is_any_of
+#include <boost/algorithm/string/split.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/assign/list_of.hpp>
+#include <boost/chrono/duration.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/process/child.hpp>
+#include <boost/process/context.hpp>
+#include <boost/process/operations.hpp> // create_child
+#include <boost/process/self.hpp>
+#include <boost/process/stream_behavior.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/thread/thread.hpp> // this_thread
+#include <boost/throw_exception.hpp> // BOOST_THROW_EXCEPTION
+
+#include <cstdlib> // getenv
+#include <iterator> // istreambuf_iterator
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+using boost::asio::io_service;
+using boost::asio::ip::tcp;
+using boost::assign::list_of;
+using boost::chrono::milliseconds;
+using boost::chrono::seconds;
+using boost::chrono::steady_clock;
+using boost::filesystem::path;
+using boost::process::child;
+using boost::process::context;
+using boost::process::self;
+using boost::process::stderr_id;
+using boost::process::stdin_id;
+using boost::process::stdout_id;
+using boost::system::error_code;
+
+using std::runtime_error;
+using std::string;
+using std::vector;
+
+namespace test
+{
+namespace ssh
+{
+
+namespace
+{
+
+string environment_variable(const char* name)
+{
+    const char* value = std::getenv(name);
+    return value ? string(value) : string();
+}
+
+path find_sshd()
+{
+    string configured = environment_variable("SSHD");
+    if (!configured.empty())
+    {
+        return configured;
+    }
+
+#ifdef _WIN32
+    const char* separator = ";";
+    const char* executable = "sshd.exe";
+#else
+    const char* separator = ":";
+    const char* executable = "sshd";
+#endif
+
+    // sshd usually lives in an sbin directory, which may not be on the PATH
+    // of an unprivileged user
+    vector<string> directories;
+    boost::split(directories, environment_variable("PATH"),
+                 boost::is_any_of(separator));
+    directories.push_back("/usr/sbin");
+    directories.push_back("/usr/local/sbin");
+    directories.push_back("/sbin");
+
+    BOOST_FOREACH (const string& directory, directories)
+    {
+        path candidate = path(directory) / executable;
+        if (!directory.empty() && boost::filesystem::exists(candidate))
+        {
+            // sshd re-executes itself so insists on an absolute path
+            return boost::filesystem::absolute(candidate);
+        }
+    }
+
+    BOOST_THROW_EXCEPTION(
+        runtime_error("Can't find sshd; set SSHD to its location"));
+}
+
+string current_user()
+{
+    string user = environment_variable("USER");
+    if (user.empty())
+        user = environment_variable("LOGNAME");
+    if (user.empty())
+        user = environment_variable("USERNAME");
+    if (user.empty())
+        BOOST_THROW_EXCEPTION(runtime_error("Can't tell who the user is"));
+
+    return user;
+}
+
+/**
+ * A port nobody is listening on right now.
+ *
+ * Another process could take it before the server does, but collisions in
+ * the ephemeral range are rare enough for tests.
+ */
+int unused_loopback_port(io_service& io)
+{
+    tcp::acceptor probe(
+        io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    return probe.local_endpoint().port();
+}
+
+bool accepts_connections(io_service& io, int port)
+{
+    tcp::socket socket(io);
+    error_code ec;
+    socket.connect(
+        tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), ec);
+    return !ec;
+}
+
+string file_contents(const path& file)
+{
+    boost::filesystem::ifstream stream(file);
+    return string(std::istreambuf_iterator<char>(stream),
+                  std::istreambuf_iterator<char>());
+}
+
+void write_file(const path& file, const string& contents)
+{
+    boost::filesystem::ofstream stream(file);
+    stream << contents;
+    if (!stream)
+    {
+        BOOST_THROW_EXCEPTION(
+            runtime_error("Unable to write " + file.string()));
+    }
+}
+}
+
+class local_sshd::implementation : private boost::noncopyable
+{
+public:
+    implementation(const path& host_key, const path& authorized_keys)
+        : m_user(current_user()),
+          m_root(boost::filesystem::temp_directory_path() /
+                 boost::filesystem::unique_path("ssh-test-server-%%%%-%%%%")),
+          m_port(0)
+    {
+        boost::filesystem::create_directories(m_root);
+        try
+        {
+            // Symlinks in the temp path (e.g. /tmp on OS X) would make paths
+            // reported by the server differ from the ones we expect
+            m_root = boost::filesystem::canonical(m_root);
+            boost::filesystem::create_directory(m_root / "sandbox");
+
+            start(host_key, authorized_keys);
+        }
+        catch (...)
+        {
+            // The server may have started without ever listening
+            stop_server();
+
+            error_code ignored;
+            boost::filesystem::remove_all(m_root, ignored);
+            throw;
+        }
+    }
+
+    ~implementation()
+    {
+        stop_server();
+
+        error_code ignored;
+        boost::filesystem::remove_all(m_root, ignored);
+    }
+
+    string user() const
+    {
+        return m_user;
+    }
+
+    int port() const
+    {
+        return m_port;
+    }
+
+    path home() const
+    {
+        return m_root;
+    }
+
+private:
+    void stop_server()
+    {
+        if (m_server)
+        {
+            try
+            {
+                m_server->terminate();
+                m_server->wait();
+            }
+            catch (...)
+            {
+            }
+        }
+    }
+
+    void start(const path& host_key, const path& authorized_keys)
+    {
+        // sshd refuses host keys that others can read
+        path private_host_key = m_root / "host_key";
+        boost::filesystem::copy_file(host_key, private_host_key);
+        boost::filesystem::permissions(private_host_key,
+                                       boost::filesystem::owner_read |
+                                           boost::filesystem::owner_write);
+
+        boost::filesystem::copy_file(authorized_keys,
+                                     m_root / "authorized_keys");
+
+        io_service io;
+        m_port = unused_loopback_port(io);
+
+        path config = m_root / "sshd_config";
+        write_file(config, configuration(private_host_key));
+
+        path log = m_root / "sshd.log";
+
+        context ctx;
+        ctx.env = self::get_environment();
+        ctx.streams[stdin_id] = boost::process::behavior::null();
+        ctx.streams[stdout_id] = boost::process::behavior::null();
+        ctx.streams[stderr_id] = boost::process::behavior::null();
+
+        vector<string> arguments =
+            list_of(string("-D"))("-f")(config.string())("-E")(log.string());
+        m_server = boost::make_shared<child>(boost::process::create_child(
+            find_sshd().string(), arguments, ctx));
+
+        steady_clock::time_point deadline = steady_clock::now() + seconds(10);
+        while (!accepts_connections(io, m_port))
+        {
+            if (steady_clock::now() > deadline)
+            {
+                BOOST_THROW_EXCEPTION(runtime_error(
+                    "sshd did not start listening: " + file_contents(log)));
+            }
+
+            boost::this_thread::sleep_for(milliseconds(50));
+        }
+    }
+
+    string configuration(const path& host_key) const
+    {
+        string port = boost::lexical_cast<string>(m_port);
+
+        // Everything the server needs is in our directory, so it doesn't
+        // matter what the system's own sshd configuration says.
+        //
+        // internal-sftp's -d starts each session in our directory instead
+        // of the user's real home.
+        return "ListenAddress 127.0.0.1:" + port + "\n"
+               "HostKey " + host_key.string() + "\n"
+               "PidFile " + (m_root / "sshd.pid").string() + "\n"
+               "AuthorizedKeysFile " + (m_root / "authorized_keys").string() +
+               "\n"
+               "AllowUsers " + m_user + "\n"
+               "StrictModes no\n"
+               "PubkeyAuthentication yes\n"
+               "PubkeyAcceptedKeyTypes +ssh-dss\n"
+               "PasswordAuthentication no\n"
+               "ChallengeResponseAuthentication no\n"
+               "UsePAM no\n"
+               "Subsystem sftp internal-sftp -d " + m_root.string() + "\n"
+               "LogLevel ERROR\n";
+    }
+
+    const string m_user;
+    path m_root;
+    int m_port;
+    boost::shared_ptr<child> m_server;
+};
+
+local_sshd::local_sshd(const path& host_key, const path& authorized_keys)
+    : m_impl(boost::make_shared<implementation>(host_key, authorized_keys))
+{
+}
+
+local_sshd::~local_sshd()
+{
+}
+
+string local_sshd::user() const
+{
+    return m_impl->user();
+}
+
+int local_sshd::port() const
+{
+    return m_impl->port();
+}
+
+path local_sshd::home() const
+{
+    return m_impl->home();
+}
+}
+} // namespace test::ssh
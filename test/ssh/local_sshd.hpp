@@ -0,0 +1,73 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TEST_SSH_LOCAL_SSHD_HPP
+#define TEST_SSH_LOCAL_SSHD_HPP
+
+#include <boost/filesystem/path.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace test
+{
+namespace ssh
+{
+
+/**
+ * OpenSSH server run by the current user, serving a private temporary
+ * directory on a loopback port.
+ *
+ * Needs nothing but an `sshd` binary, so tests can run without Docker or
+ * network access.  The binary is found on the `PATH` or in the usual
+ * `sbin` directories, unless the `SSHD` environment variable gives its
+ * path.
+ *
+ * The server accepts the keys in `authorized_keys` for the current user and
+ * SFTP sessions start in the temporary directory rather than the user's
+ * real home, so relative paths stay inside it.  Password and
+ * keyboard-interactive authentication are not available as the server
+ * cannot know the user's password.
+ */
+class local_sshd : private boost::noncopyable
+{
+public:
+    local_sshd(const boost::filesystem::path& host_key,
+               const boost::filesystem::path& authorized_keys);
+
+    /**
+     * Stops the server and deletes its directory.
+     */
+    ~local_sshd();
+
+    std::string user() const;
+
+    int port() const;
+
+    /**
+     * Directory that relative paths on the server resolve against.
+     */
+    boost::filesystem::path home() const;
+
+private:
+    class implementation;
+
+    boost::shared_ptr<implementation> m_impl;
+};
+}
+} // namespace test::ssh
+
+#endif
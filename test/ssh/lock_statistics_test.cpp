@@ -0,0 +1,330 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/session_lock.hpp> // test subject
+#include <ssh/duration_histogram.hpp>  // test subject
+#include <ssh/lock_statistics.hpp>     // test subject
+
+#include <boost/chrono/duration.hpp>
+#include <boost/move/move.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/barrier.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+using ssh::detail::lock_statistics_recorder;
+using ssh::detail::session_lock;
+using ssh::duration_histogram;
+using ssh::lock_operation_statistics;
+using ssh::lock_statistics;
+
+using boost::barrier;
+using boost::chrono::milliseconds;
+using boost::chrono::nanoseconds;
+using boost::mutex;
+using boost::thread;
+
+namespace
+{
+
+void hold_lock(mutex& session_mutex, lock_statistics_recorder& recorder,
+               barrier& locked)
+{
+    session_lock lock(session_mutex, recorder, "holder");
+    locked.wait();
+    boost::this_thread::sleep_for(milliseconds(50));
+}
+}
+
+BOOST_AUTO_TEST_SUITE(duration_histogram_tests)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    duration_histogram histogram;
+
+    BOOST_CHECK_EQUAL(histogram.count(), 0U);
+    BOOST_CHECK(histogram.total() == nanoseconds(0));
+    BOOST_CHECK(histogram.max() == nanoseconds(0));
+    BOOST_CHECK(histogram.mean() == nanoseconds(0));
+    BOOST_CHECK(histogram.percentile(0.5) == nanoseconds(0));
+}
+
+BOOST_AUTO_TEST_CASE(bucket_boundaries)
+{
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(0)), 0U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(1)), 1U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(2)), 2U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(3)), 2U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(4)), 3U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(1023)),
+                      10U);
+    BOOST_CHECK_EQUAL(duration_histogram::bucket_index(nanoseconds(1024)),
+                      11U);
+
+    BOOST_CHECK(duration_histogram::bucket_upper_bound(0) == nanoseconds(1));
+    BOOST_CHECK(duration_histogram::bucket_upper_bound(11) ==
+                nanoseconds(2048));
+}
+
+BOOST_AUTO_TEST_CASE(huge_durations_land_in_last_bucket)
+{
+    duration_histogram histogram;
+    histogram.record(boost::chrono::hours(24 * 365));
+
+    BOOST_CHECK_EQUAL(
+        histogram.bucket(duration_histogram::bucket_count - 1), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(negative_durations_count_as_zero)
+{
+    duration_histogram histogram;
+    histogram.record(nanoseconds(-5));
+
+    BOOST_CHECK_EQUAL(histogram.bucket(0), 1U);
+    BOOST_CHECK(histogram.total() == nanoseconds(0));
+}
+
+BOOST_AUTO_TEST_CASE(summary)
+{
+    duration_histogram histogram;
+    histogram.record(nanoseconds(10));
+    histogram.record(nanoseconds(20));
+    histogram.record(nanoseconds(30));
+
+    BOOST_CHECK_EQUAL(histogram.count(), 3U);
+    BOOST_CHECK(histogram.total() == nanoseconds(60));
+    BOOST_CHECK(histogram.max() == nanoseconds(30));
+    BOOST_CHECK(histogram.mean() == nanoseconds(20));
+}
+
+BOOST_AUTO_TEST_CASE(percentile_never_underestimates)
+{
+    duration_histogram histogram;
+    for (int i = 1; i <= 100; ++i)
+    {
+        histogram.record(nanoseconds(i * 1000));
+    }
+
+    BOOST_CHECK(histogram.percentile(0.5) >= nanoseconds(50000));
+    BOOST_CHECK(histogram.percentile(0.5) < nanoseconds(100000));
+    BOOST_CHECK(histogram.percentile(0.99) >= nanoseconds(99000));
+    BOOST_CHECK(histogram.percentile(1.0) == nanoseconds(100000));
+}
+
+BOOST_AUTO_TEST_CASE(merge)
+{
+    duration_histogram a;
+    a.record(nanoseconds(5));
+
+    duration_histogram b;
+    b.record(nanoseconds(7));
+    b.record(nanoseconds(100));
+
+    a.merge(b);
+
+    BOOST_CHECK_EQUAL(a.count(), 3U);
+    BOOST_CHECK(a.total() == nanoseconds(112));
+    BOOST_CHECK(a.max() == nanoseconds(100));
+    BOOST_CHECK_EQUAL(a.bucket(3), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(no_such_bucket)
+{
+    duration_histogram histogram;
+    BOOST_CHECK_THROW(histogram.bucket(duration_histogram::bucket_count),
+                      std::out_of_range);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+BOOST_AUTO_TEST_SUITE(session_lock_tests)
+
+BOOST_AUTO_TEST_CASE(disabled_by_default)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+        BOOST_CHECK(lock.owns_lock());
+    }
+
+    BOOST_CHECK(recorder.snapshot().operations().empty());
+}
+
+BOOST_AUTO_TEST_CASE(releases_mutex)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+        BOOST_CHECK(!session_mutex.try_lock());
+    }
+
+    BOOST_CHECK(session_mutex.try_lock());
+    session_mutex.unlock();
+}
+
+BOOST_AUTO_TEST_CASE(records_by_operation)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        session_lock lock(session_mutex, recorder, "read");
+    }
+
+    {
+        session_lock lock(session_mutex, recorder, "write");
+        boost::this_thread::sleep_for(milliseconds(10));
+    }
+
+    lock_statistics statistics = recorder.snapshot();
+    BOOST_REQUIRE_EQUAL(statistics.operations().size(), 2U);
+
+    const lock_operation_statistics& reads =
+        statistics.operations().find("read")->second;
+    BOOST_CHECK_EQUAL(reads.acquisitions, 3U);
+    BOOST_CHECK_EQUAL(reads.contended_acquisitions, 0U);
+    BOOST_CHECK_EQUAL(reads.wait.count(), 3U);
+    BOOST_CHECK_EQUAL(reads.hold.count(), 3U);
+
+    const lock_operation_statistics& writes =
+        statistics.operations().find("write")->second;
+    BOOST_CHECK_EQUAL(writes.acquisitions, 1U);
+    BOOST_CHECK(writes.hold.max() >= milliseconds(10));
+
+    lock_operation_statistics totals = statistics.totals();
+    BOOST_CHECK_EQUAL(totals.acquisitions, 4U);
+    BOOST_CHECK_EQUAL(totals.hold.count(), 4U);
+}
+
+// Names are usually literals but the same name can come from different
+// literals in different translation units
+BOOST_AUTO_TEST_CASE(operations_matched_by_name)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    char first[] = "stat";
+    char second[] = "stat";
+
+    {
+        session_lock lock(session_mutex, recorder, first);
+    }
+    {
+        session_lock lock(session_mutex, recorder, second);
+    }
+
+    lock_statistics statistics = recorder.snapshot();
+    BOOST_REQUIRE_EQUAL(statistics.operations().size(), 1U);
+    BOOST_CHECK_EQUAL(statistics.operations().begin()->second.acquisitions,
+                      2U);
+}
+
+BOOST_AUTO_TEST_CASE(moved_lock_records_once)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+        session_lock moved_to(boost::move(lock));
+
+        BOOST_CHECK(!lock.owns_lock());
+        BOOST_CHECK(moved_to.owns_lock());
+    }
+
+    BOOST_CHECK(session_mutex.try_lock());
+    session_mutex.unlock();
+
+    BOOST_CHECK_EQUAL(
+        recorder.snapshot().operations().find("operation")->second.acquisitions,
+        1U);
+}
+
+BOOST_AUTO_TEST_CASE(contention)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    barrier locked(2);
+    thread holder(hold_lock, boost::ref(session_mutex), boost::ref(recorder),
+                  boost::ref(locked));
+
+    locked.wait();
+    {
+        session_lock lock(session_mutex, recorder, "waiter");
+    }
+
+    holder.join();
+
+    lock_statistics statistics = recorder.snapshot();
+
+    const lock_operation_statistics& waiter =
+        statistics.operations().find("waiter")->second;
+    BOOST_CHECK_EQUAL(waiter.acquisitions, 1U);
+    BOOST_CHECK_EQUAL(waiter.contended_acquisitions, 1U);
+    BOOST_CHECK(waiter.wait.max() >= milliseconds(25));
+
+    const lock_operation_statistics& holder_statistics =
+        statistics.operations().find("holder")->second;
+    BOOST_CHECK_EQUAL(holder_statistics.contended_acquisitions, 0U);
+    BOOST_CHECK(holder_statistics.hold.max() >= milliseconds(50));
+}
+
+BOOST_AUTO_TEST_CASE(disabling_keeps_statistics)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+    }
+
+    recorder.enable(false);
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+    }
+
+    BOOST_CHECK_EQUAL(
+        recorder.snapshot().operations().find("operation")->second.acquisitions,
+        1U);
+}
+
+BOOST_AUTO_TEST_CASE(reset)
+{
+    mutex session_mutex;
+    lock_statistics_recorder recorder;
+    recorder.enable(true);
+
+    {
+        session_lock lock(session_mutex, recorder, "operation");
+    }
+
+    recorder.reset();
+
+    BOOST_CHECK(recorder.snapshot().operations().empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,342 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/metrics.hpp> // test subject
+
+#include <boost/bind/bind.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <iterator> // istreambuf_iterator
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::detail::metered_sftp_call;
+using ssh::detail::session_traffic;
+using ssh::metrics_format;
+using ssh::metrics_registry;
+using ssh::metrics_snapshot;
+using ssh::operation_metrics;
+using ssh::session_metrics;
+
+namespace sftp_operation = ssh::detail::sftp_operation;
+
+using boost::property_tree::ptree;
+using boost::system::error_code;
+using boost::thread;
+
+using std::string;
+using std::stringstream;
+using std::vector;
+
+namespace
+{
+
+/**
+ * Starts each test with an empty, enabled registry and leaves it disabled.
+ */
+struct registry_fixture
+{
+    registry_fixture()
+    {
+        registry().reset();
+        registry().enable(true);
+    }
+
+    ~registry_fixture()
+    {
+        registry().enable(false);
+        registry().reset();
+    }
+
+    metrics_registry& registry()
+    {
+        return metrics_registry::instance();
+    }
+
+    operation_metrics metrics_of(const string& operation)
+    {
+        return registry().snapshot().operations().find(operation)->second;
+    }
+};
+
+void perform_reads(int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::read, ec);
+        call.transferred(10);
+    }
+}
+
+session_metrics find_session(const metrics_snapshot& snapshot,
+                             boost::uint64_t id)
+{
+    for (vector<session_metrics>::const_iterator it =
+             snapshot.sessions().begin();
+         it != snapshot.sessions().end(); ++it)
+    {
+        if (it->id == id)
+            return *it;
+    }
+
+    BOOST_FAIL("Session not in snapshot");
+    return session_metrics();
+}
+
+class appender
+{
+public:
+    explicit appender(string& destination) : m_destination(&destination)
+    {
+    }
+
+    void operator()(const string& text) const
+    {
+        *m_destination += text;
+    }
+
+private:
+    string* m_destination;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(metrics_tests, registry_fixture)
+
+BOOST_AUTO_TEST_CASE(every_operation_listed)
+{
+    metrics_snapshot snapshot = registry().snapshot();
+
+    BOOST_CHECK_EQUAL(snapshot.operations().size(), sftp_operation::count);
+    BOOST_CHECK(snapshot.operations().count("open"));
+    BOOST_CHECK(snapshot.operations().count("readdir"));
+    BOOST_CHECK_EQUAL(metrics_of("open").calls, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(records_calls)
+{
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::stat, ec);
+    }
+
+    operation_metrics stat = metrics_of("stat");
+    BOOST_CHECK_EQUAL(stat.calls, 1U);
+    BOOST_CHECK_EQUAL(stat.errors, 0U);
+    BOOST_CHECK_EQUAL(stat.latency.count(), 1U);
+    BOOST_CHECK_EQUAL(metrics_of("fstat").calls, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(records_errors)
+{
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::open, ec);
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::no_such_file_or_directory);
+    }
+
+    BOOST_CHECK_EQUAL(metrics_of("open").calls, 1U);
+    BOOST_CHECK_EQUAL(metrics_of("open").errors, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(records_bytes)
+{
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::write, ec);
+        call.transferred(100);
+        call.transferred(-1);
+        call.transferred(23);
+    }
+
+    BOOST_CHECK_EQUAL(metrics_of("write").bytes, 123U);
+}
+
+BOOST_AUTO_TEST_CASE(records_latency)
+{
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::readdir, ec);
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    }
+
+    BOOST_CHECK(metrics_of("readdir").latency.max() >=
+                boost::chrono::milliseconds(5));
+}
+
+BOOST_AUTO_TEST_CASE(disabled_records_nothing)
+{
+    registry().enable(false);
+
+    {
+        error_code ec;
+        metered_sftp_call call(sftp_operation::stat, ec);
+    }
+
+    BOOST_CHECK_EQUAL(metrics_of("stat").calls, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(threads_combined_in_snapshot)
+{
+    vector<boost::shared_ptr<thread> > threads;
+    for (int i = 0; i < 8; ++i)
+    {
+        threads.push_back(
+            boost::make_shared<thread>(boost::bind(perform_reads, 1000)));
+    }
+
+    for (size_t i = 0; i < threads.size(); ++i)
+    {
+        threads[i]->join();
+    }
+
+    operation_metrics reads = metrics_of("read");
+    BOOST_CHECK_EQUAL(reads.calls, 8000U);
+    BOOST_CHECK_EQUAL(reads.bytes, 80000U);
+    BOOST_CHECK_EQUAL(reads.latency.count(), 8000U);
+}
+
+BOOST_AUTO_TEST_CASE(reset)
+{
+    perform_reads(3);
+    registry().reset();
+
+    BOOST_CHECK_EQUAL(metrics_of("read").calls, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(session_traffic_while_open)
+{
+    session_traffic traffic;
+    traffic.add_read(5);
+    traffic.add_written(7);
+
+    metrics_snapshot snapshot = registry().snapshot();
+    session_metrics session = find_session(snapshot, traffic.snapshot().id);
+    BOOST_CHECK_EQUAL(session.bytes_read, 5U);
+    BOOST_CHECK_EQUAL(session.bytes_written, 7U);
+}
+
+BOOST_AUTO_TEST_CASE(closed_sessions_stay_in_totals)
+{
+    metrics_snapshot before = registry().snapshot();
+
+    boost::uint64_t id;
+    {
+        session_traffic traffic;
+        traffic.add_read(11);
+        traffic.add_written(13);
+        id = traffic.snapshot().id;
+    }
+
+    metrics_snapshot after = registry().snapshot();
+
+    for (vector<session_metrics>::const_iterator it =
+             after.sessions().begin();
+         it != after.sessions().end(); ++it)
+    {
+        BOOST_CHECK_NE(it->id, id);
+    }
+
+    BOOST_CHECK_EQUAL(after.total_bytes_read() - before.total_bytes_read(),
+                      11U);
+    BOOST_CHECK_EQUAL(
+        after.total_bytes_written() - before.total_bytes_written(), 13U);
+}
+
+BOOST_AUTO_TEST_CASE(sessions_numbered_uniquely)
+{
+    session_traffic first;
+    session_traffic second;
+
+    BOOST_CHECK_NE(first.snapshot().id, second.snapshot().id);
+}
+
+BOOST_AUTO_TEST_CASE(json_export)
+{
+    perform_reads(2);
+    session_traffic traffic;
+    traffic.add_written(42);
+
+    string json;
+    registry().export_to_callback(appender(json), metrics_format::json);
+
+    stringstream stream(json);
+    ptree tree;
+    boost::property_tree::read_json(stream, tree);
+
+    BOOST_CHECK_EQUAL(tree.get<int>("operations.read.calls"), 2);
+    BOOST_CHECK_EQUAL(tree.get<int>("operations.read.bytes"), 20);
+    BOOST_CHECK_EQUAL(tree.get<int>("operations.open.calls"), 0);
+    BOOST_CHECK(tree.get_child("operations.read.latency_ns.buckets").size() >
+                0);
+    BOOST_CHECK(tree.get_child("sessions").size() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(prometheus_export)
+{
+    perform_reads(2);
+
+    string text;
+    registry().export_to_callback(appender(text), metrics_format::prometheus);
+
+    BOOST_CHECK(text.find("# TYPE ssh_sftp_operation_duration_seconds "
+                          "histogram\n") != string::npos);
+    BOOST_CHECK(
+        text.find("ssh_sftp_operations_total{operation=\"read\"} 2\n") !=
+        string::npos);
+    BOOST_CHECK(text.find("ssh_sftp_operation_duration_seconds_bucket{"
+                          "operation=\"read\",le=\"+Inf\"} 2\n") !=
+                string::npos);
+    BOOST_CHECK(text.find("ssh_sftp_operation_duration_seconds_count{"
+                          "operation=\"read\"} 2\n") != string::npos);
+    BOOST_CHECK(text.find("ssh_sftp_operation_bytes_total{operation=\"read\"} "
+                          "20\n") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(file_export)
+{
+    perform_reads(1);
+
+    boost::filesystem::path file =
+        boost::filesystem::temp_directory_path() /
+        boost::filesystem::unique_path("ssh-metrics-%%%%-%%%%.prom");
+
+    registry().export_to_file(file, metrics_format::prometheus);
+
+    BOOST_REQUIRE(boost::filesystem::exists(file));
+    BOOST_CHECK(!boost::filesystem::exists(file.string() + ".tmp"));
+
+    boost::filesystem::ifstream stream(file);
+    string contents((std::istreambuf_iterator<char>(stream)),
+                    std::istreambuf_iterator<char>());
+    stream.close();
+
+    boost::filesystem::remove(file);
+
+    BOOST_CHECK(contents.find("ssh_sftp_operations_total{operation=\"read\"} "
+                              "1\n") != string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
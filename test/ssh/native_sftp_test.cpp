@@ -0,0 +1,444 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * The filesystem and streams over the native SFTP engine.
+ *
+ * Results are checked against the default libssh2 engine, which the fixture's
+ * own filesystem uses.
+ */
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/filesystem.hpp>
+#include <ssh/sftp_engine.hpp> // test subject
+#include <ssh/stream.hpp>
+
+#include <boost/bind/bind.hpp>
+#include <boost/chrono/duration.hpp> // milliseconds
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/future.hpp> // packaged_task
+#include <boost/thread/thread.hpp>
+
+#include <algorithm> // sort
+#include <ctime>     // time_t
+#include <iterator>  // istreambuf_iterator
+#include <map>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::directory_iterator;
+using ssh::filesystem::file_type;
+using ssh::filesystem::fstream;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::ofstream;
+using ssh::filesystem::openmode;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_engine;
+using ssh::filesystem::sftp_file;
+using ssh::filesystem::sftp_filesystem;
+using ssh::filesystem::sftp_limits;
+
+using test::ssh::sftp_fixture;
+
+using boost::packaged_task;
+using boost::thread;
+
+using std::map;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+/**
+ * Data needing many pipelined requests, not all the same byte.
+ */
+string large_data()
+{
+    string data;
+    for (int i = 0; i < 3 * 1024 * 1024 + 123; ++i)
+    {
+        data.push_back(static_cast<char>((i * 7) % 251));
+    }
+    return data;
+}
+
+string read_all(std::istream& stream)
+{
+    return string(std::istreambuf_iterator<char>(stream),
+                  std::istreambuf_iterator<char>());
+}
+
+vector<string> names_in(sftp_filesystem& fs, const path& directory)
+{
+    vector<string> names;
+    for (directory_iterator it = fs.directory_iterator(directory);
+         it != fs.directory_iterator(); ++it)
+    {
+        names.push_back(it->path().filename().string());
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+class native_sftp_fixture : public sftp_fixture
+{
+public:
+    native_sftp_fixture()
+        : m_native(test_session().connect_to_filesystem(sftp_engine::native))
+    {
+    }
+
+    sftp_filesystem& native()
+    {
+        return m_native;
+    }
+
+private:
+    sftp_filesystem m_native;
+};
+
+string write_and_read_back(sftp_filesystem& fs, const path& target,
+                           const string& data)
+{
+    {
+        ofstream stream(fs, target);
+        stream.write(data.data(), data.size());
+    }
+
+    ifstream stream(fs, target);
+    return read_all(stream);
+}
+
+void read_until_interrupted(sftp_filesystem& fs, const path& target)
+{
+    try
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            ifstream stream(fs, target);
+            read_all(stream);
+        }
+    }
+    catch (...)
+    {
+    }
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(native_sftp_tests, native_sftp_fixture)
+
+BOOST_AUTO_TEST_CASE(engines)
+{
+    BOOST_CHECK(native().engine() == sftp_engine::native);
+    BOOST_CHECK(filesystem().engine() == sftp_engine::libssh2);
+    BOOST_CHECK(filesystem().extensions().empty());
+}
+
+BOOST_AUTO_TEST_CASE(discovers_extensions)
+{
+    // The OpenSSH test server has had these since version 5
+    map<string, string> extensions = native().extensions();
+    BOOST_CHECK(extensions.count("posix-rename@openssh.com"));
+    BOOST_CHECK(extensions.count("statvfs@openssh.com"));
+}
+
+BOOST_AUTO_TEST_CASE(libssh2_limits_are_defaults)
+{
+    sftp_limits limits = filesystem().limits();
+    BOOST_CHECK_EQUAL(limits.max_packet_length, 34000U);
+    BOOST_CHECK_EQUAL(limits.max_read_length, 32U * 1024);
+    BOOST_CHECK_EQUAL(limits.max_write_length, 32U * 1024);
+    BOOST_CHECK_EQUAL(limits.max_open_handles, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(discovers_limits)
+{
+    sftp_limits limits = native().limits();
+
+    if (native().extensions().count("limits@openssh.com"))
+    {
+        // OpenSSH allows much larger requests than the defaults
+        BOOST_CHECK_GT(limits.max_read_length, 32U * 1024);
+        BOOST_CHECK_GT(limits.max_write_length, 32U * 1024);
+        BOOST_CHECK_LE(limits.max_write_length, limits.max_packet_length);
+    }
+    else
+    {
+        // Older servers don't say, so only the defaults are safe
+        BOOST_CHECK_EQUAL(limits.max_read_length, 32U * 1024);
+        BOOST_CHECK_EQUAL(limits.max_write_length, 32U * 1024);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(large_file_round_trip)
+{
+    path target = sandbox() / "large";
+    string data = large_data();
+
+    {
+        // Large buffers let each write send many requests at once
+        ofstream stream(native(), target, openmode::out, 1024 * 1024);
+        stream.write(data.data(), data.size());
+    }
+
+    ifstream libssh2_stream(filesystem(), target);
+    BOOST_CHECK(read_all(libssh2_stream) == data);
+
+    ifstream native_stream(native(), target, openmode::in, 1024 * 1024);
+    BOOST_CHECK(read_all(native_stream) == data);
+}
+
+BOOST_AUTO_TEST_CASE(default_buffers_round_trip)
+{
+    // Default stream buffers are sized from the server's limits
+    path target = sandbox() / "large";
+    string data = large_data();
+
+    BOOST_CHECK(write_and_read_back(native(), target, data) == data);
+
+    ifstream stream(filesystem(), target);
+    BOOST_CHECK(read_all(stream) == data);
+}
+
+BOOST_AUTO_TEST_CASE(read_written_by_libssh2)
+{
+    string data = large_data();
+    path target = new_file_in_sandbox_containing_data(data);
+
+    ifstream stream(native(), target);
+    BOOST_CHECK(read_all(stream) == data);
+}
+
+BOOST_AUTO_TEST_CASE(read_past_end)
+{
+    path target = new_file_in_sandbox_containing_data("short");
+
+    ifstream stream(native(), target);
+    char buffer[100];
+    stream.read(buffer, sizeof(buffer));
+
+    BOOST_CHECK_EQUAL(stream.gcount(), 5);
+    BOOST_CHECK(stream.eof());
+}
+
+BOOST_AUTO_TEST_CASE(seek)
+{
+    path target = new_file_in_sandbox_containing_data("0123456789");
+
+    fstream stream(native(), target);
+    stream.seekg(-3, std::ios_base::end);
+    BOOST_CHECK_EQUAL(read_all(stream), "789");
+
+    stream.clear();
+    stream.seekp(2, std::ios_base::beg);
+    stream << "ab";
+    stream.flush();
+
+    ifstream result(filesystem(), target);
+    BOOST_CHECK_EQUAL(read_all(result), "01ab456789");
+}
+
+BOOST_AUTO_TEST_CASE(append)
+{
+    path target = new_file_in_sandbox_containing_data("start");
+
+    {
+        ofstream stream(native(), target, openmode::app);
+        stream << "end";
+    }
+
+    ifstream result(filesystem(), target);
+    BOOST_CHECK_EQUAL(read_all(result), "startend");
+}
+
+BOOST_AUTO_TEST_CASE(open_missing_file)
+{
+    BOOST_CHECK_THROW(ifstream(native(), sandbox() / "missing"),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(listing_matches_libssh2)
+{
+    // Enough entries that the server sends them in several batches
+    for (int i = 0; i < 250; ++i)
+    {
+        new_file_in_sandbox();
+    }
+    new_directory_in_sandbox();
+
+    vector<string> names = names_in(native(), sandbox());
+    BOOST_CHECK_EQUAL(names.size(), 251U);
+    BOOST_CHECK(names == names_in(filesystem(), sandbox()));
+}
+
+BOOST_AUTO_TEST_CASE(listing_attributes)
+{
+    path target = new_file_in_sandbox_containing_data("12345");
+
+    directory_iterator it = native().directory_iterator(sandbox());
+    BOOST_REQUIRE(it != native().directory_iterator());
+
+    sftp_file file = *it;
+    BOOST_CHECK_EQUAL(file.path(), target);
+    BOOST_CHECK_EQUAL(*file.attributes().size(), 5U);
+    BOOST_CHECK(!file.long_entry().empty());
+}
+
+BOOST_AUTO_TEST_CASE(status)
+{
+    path file = new_file_in_sandbox();
+
+    BOOST_CHECK(ssh::filesystem::status(native(), file).type() ==
+                file_type::regular);
+    BOOST_CHECK(ssh::filesystem::status(native(), sandbox()).type() ==
+                file_type::directory);
+    BOOST_CHECK(ssh::filesystem::status(native(), sandbox() / "missing")
+                    .type() == file_type::not_found);
+}
+
+BOOST_AUTO_TEST_CASE(directories)
+{
+    path directory = sandbox() / "new";
+
+    BOOST_CHECK(create_directory(native(), directory));
+    BOOST_CHECK(!create_directory(native(), directory));
+    BOOST_CHECK(is_directory(filesystem(), directory));
+
+    BOOST_CHECK(remove(native(), directory));
+    BOOST_CHECK(!exists(filesystem(), directory));
+}
+
+BOOST_AUTO_TEST_CASE(remove_files)
+{
+    path directory = new_directory_in_sandbox();
+    new_file_in_sandbox_containing_data(directory.filename() / "file", "data");
+
+    BOOST_CHECK_EQUAL(remove_all(native(), directory), 2U);
+    BOOST_CHECK(!exists(filesystem(), directory));
+    BOOST_CHECK(!remove(native(), directory));
+}
+
+BOOST_AUTO_TEST_CASE(rename_file)
+{
+    path source = new_file_in_sandbox();
+    path destination = sandbox() / "renamed";
+
+    rename(native(), source, destination);
+
+    BOOST_CHECK(!exists(filesystem(), source));
+    BOOST_CHECK(exists(filesystem(), destination));
+}
+
+BOOST_AUTO_TEST_CASE(rename_overwrites)
+{
+    path source = new_file_in_sandbox_containing_data("source");
+    path destination = new_file_in_sandbox_containing_data("renamed", "old");
+
+    rename(native(), source, destination);
+
+    BOOST_CHECK(!exists(filesystem(), source));
+    ifstream result(filesystem(), destination);
+    BOOST_CHECK_EQUAL(read_all(result), "source");
+}
+
+BOOST_AUTO_TEST_CASE(rename_prevents_overwrite)
+{
+    path source = new_file_in_sandbox();
+    path destination = new_file_in_sandbox("renamed");
+
+    BOOST_CHECK_THROW(rename(native(), source, destination,
+                             ssh::filesystem::overwrite_behaviour::
+                                 prevent_overwrite),
+                      std::exception);
+
+    BOOST_CHECK(exists(filesystem(), source));
+}
+
+BOOST_AUTO_TEST_CASE(symlinks)
+{
+    path target = new_file_in_sandbox();
+    path link = sandbox() / "link";
+
+    // Arguments reversed, as the fixture does, because OpenSSH reverses
+    // them too
+    ssh::filesystem::create_symlink(native(), target, link);
+
+    BOOST_CHECK_EQUAL(native().resolve_link_target(link),
+                      filesystem().resolve_link_target(link));
+    BOOST_CHECK_EQUAL(native().canonical_path(sandbox()),
+                      filesystem().canonical_path(sandbox()));
+}
+
+BOOST_AUTO_TEST_CASE(modification_time)
+{
+    path target = new_file_in_sandbox();
+    std::time_t time = 1400000000;
+
+    last_write_time(native(), target, time);
+
+    BOOST_CHECK_EQUAL(last_write_time(filesystem(), target), time);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_streams)
+{
+    // Threads share the engine, so replies to one thread's requests arrive
+    // while another waits for its own
+    string data = large_data();
+
+    packaged_task<string> first(boost::bind(
+        &write_and_read_back, boost::ref(native()), sandbox() / "first", data));
+    packaged_task<string> second(
+        boost::bind(&write_and_read_back, boost::ref(native()),
+                    sandbox() / "second", data));
+
+    thread(boost::ref(first)).detach();
+    thread(boost::ref(second)).detach();
+
+    BOOST_CHECK(first.get_future().get() == data);
+    BOOST_CHECK(second.get_future().get() == data);
+}
+
+BOOST_AUTO_TEST_CASE(interrupted_read)
+{
+    // Interrupting a pipelined read leaves replies in flight and may cut a
+    // packet short.  Later calls must then either find their own replies or
+    // fail, never get someone else's.
+    path large = sandbox() / "large";
+    write_and_read_back(native(), large, large_data());
+    path small = new_file_in_sandbox_containing_data("humpty dumpty");
+
+    thread reader(boost::bind(&read_until_interrupted, boost::ref(native()),
+                              large));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+    reader.interrupt();
+    reader.join();
+
+    try
+    {
+        for (int i = 0; i < 10; ++i)
+        {
+            ifstream stream(native(), small);
+            BOOST_CHECK_EQUAL(read_all(stream), "humpty dumpty");
+        }
+    }
+    catch (const std::exception&)
+    {
+        // The interruption left the channel part way through a packet
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
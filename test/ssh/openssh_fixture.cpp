@@ -16,9 +16,14 @@
 #include "openssh_fixture.hpp"
 
 #include <boost/assign/list_of.hpp>
+#include <boost/chrono/duration.hpp> // milliseconds
+#include <boost/cstdint.hpp>         // uint64_t
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
+#include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
+#include <boost/format.hpp>
 #include <boost/io/detail/quoted_manip.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/optional.hpp>
 #include <boost/process/context.hpp>
 #include <boost/process/environment.hpp>
@@ -36,7 +41,10 @@
 #include <string>
 #include <vector>
 
+using test::ssh::link_conditions;
+
 using boost::assign::list_of;
+using boost::format;
 using boost::io::quoted;
 using boost::filesystem::path;
 using boost::optional;
@@ -139,6 +147,42 @@ void run_docker_command(const ArgSequence& arguments)
     single_value_from_docker_command<string>(arguments);
 }
 
+bool use_local_server()
+{
+    boost::process::environment environment = self::get_environment();
+    return environment.count("SSH_TEST_SERVER") == 1 &&
+           environment["SSH_TEST_SERVER"] == "local";
+}
+
+/**
+ * Network conditions requested by the `SSH_TEST_LATENCY_MS` (one-way delay
+ * of each request and response) and `SSH_TEST_BANDWIDTH` (bytes per second)
+ * environment variables, if either is set.
+ */
+optional<link_conditions> link_conditions_from_environment()
+{
+    boost::process::environment environment = self::get_environment();
+
+    optional<link_conditions> conditions;
+    if (environment.count("SSH_TEST_LATENCY_MS") == 1)
+    {
+        conditions = link_conditions();
+        conditions->latency = boost::chrono::milliseconds(
+            boost::lexical_cast<int>(environment["SSH_TEST_LATENCY_MS"]));
+    }
+
+    if (environment.count("SSH_TEST_BANDWIDTH") == 1)
+    {
+        if (!conditions)
+            conditions = link_conditions();
+
+        conditions->bandwidth = boost::lexical_cast<boost::uint64_t>(
+            environment["SSH_TEST_BANDWIDTH"]);
+    }
+
+    return conditions;
+}
+
 optional<string> docker_machine_name()
 {
     const string docker_machine_name_variable = "DOCKER_MACHINE_NAME";
@@ -173,6 +217,11 @@ struct global_fixture
 {
     global_fixture()
     {
+        if (use_local_server())
+        {
+            return;
+        }
+
         // Ensure the docker image has been built
         vector<string> build_command = (list_of(string("build")), "-t",
                                         "ssh2pp/openssh_server", "ssh_server");
@@ -205,6 +254,32 @@ namespace ssh
 
 openssh_fixture::openssh_fixture()
 {
+    start_server();
+
+    optional<link_conditions> conditions = link_conditions_from_environment();
+    if (conditions)
+    {
+        start_proxy(*conditions);
+    }
+}
+
+openssh_fixture::openssh_fixture(const link_conditions& conditions)
+{
+    start_server();
+    start_proxy(conditions);
+}
+
+void openssh_fixture::start_server()
+{
+    if (use_local_server())
+    {
+        m_local_server.reset(
+            new local_sshd("fixture_hostkey", "ssh_server/authorized_keys"));
+        m_host = "127.0.0.1";
+        m_port = m_local_server->port();
+        return;
+    }
+
     vector<string> docker_command =
         (list_of(string("run")), "--detach", "-P", "ssh2pp/openssh_server");
     m_container_id = single_value_from_docker_command<string>(docker_command);
@@ -212,8 +287,25 @@ openssh_fixture::openssh_fixture()
     m_port = ask_docker_for_port();
 }
 
+void openssh_fixture::start_proxy(const link_conditions& conditions)
+{
+    m_proxy.reset(new shaping_proxy(m_host, m_port, conditions));
+
+    m_host = m_proxy->host();
+    m_port = m_proxy->port();
+}
+
 openssh_fixture::~openssh_fixture()
 {
+    // Cut connections through the proxy before the server goes
+    m_proxy.reset();
+
+    if (m_local_server)
+    {
+        m_local_server.reset();
+        return;
+    }
+
     try
     {
         vector<string> stop_command = (list_of(string("stop")), m_container_id);
@@ -274,7 +366,7 @@ string openssh_fixture::ask_docker_for_host() const
 
 string openssh_fixture::user() const
 {
-    return "swish";
+    return (m_local_server) ? m_local_server->user() : "swish";
 }
 
 int openssh_fixture::port() const
@@ -282,6 +374,37 @@ int openssh_fixture::port() const
     return m_port;
 }
 
+string openssh_fixture::remote_home() const
+{
+    return (m_local_server) ? m_local_server->home().string() : "/home/swish";
+}
+
+void openssh_fixture::create_files_on_server(const string& directory,
+                                             unsigned long count)
+{
+    if (m_local_server)
+    {
+        path target = m_local_server->home() / directory;
+        boost::filesystem::create_directories(target);
+        for (unsigned long i = 1; i <= count; ++i)
+        {
+            boost::filesystem::ofstream(target /
+                                        (format("entry%07d") % i).str());
+        }
+        return;
+    }
+
+    // Creating each file with its own process would take minutes for the
+    // largest directories, so xargs batches them
+    string script = (format("cd %s && mkdir -p '%s' && cd '%s' && "
+                            "seq -f 'entry%%07.0f' 1 %d | xargs touch") %
+                     remote_home() % directory % directory % count)
+                        .str();
+    vector<string> exec_command = (list_of(string("exec")), "-u", user(),
+                                   m_container_id, "sh", "-c", script);
+    run_docker_command(exec_command);
+}
+
 int openssh_fixture::ask_docker_for_port() const
 {
     vector<string> inspect_host_command =
@@ -16,7 +16,11 @@
 #ifndef SSH_OPENSSH_FIXTURE_HPP
 #define SSH_OPENSSH_FIXTURE_HPP
 
+#include "local_sshd.hpp"
+#include "shaping_proxy.hpp"
+
 #include <boost/filesystem.hpp> // path
+#include <boost/shared_ptr.hpp>
 
 #include <string>
 
@@ -27,25 +31,62 @@ namespace ssh
 
 /**
  * Fixture that starts and stops an OpenSSH server.
+ *
+ * The server runs in a Docker container unless the `SSH_TEST_SERVER`
+ * environment variable is `local`, in which case it is a `local_sshd` run
+ * by the current user.  The local server needs no Docker or network, but
+ * only accepts key authentication.
+ *
+ * Because the fixture is a virtual base of the other fixtures, a test
+ * fixture can slow the network down by passing `link_conditions` to this
+ * constructor from its own.  The server is then reached through a
+ * `shaping_proxy` and `host` and `port` give the proxy's address instead.
+ * Tests using the default constructor can be slowed the same way by setting
+ * `SSH_TEST_LATENCY_MS` and `SSH_TEST_BANDWIDTH` in the environment.
  */
 class openssh_fixture
 {
 public:
     openssh_fixture();
+    explicit openssh_fixture(const link_conditions& conditions);
     virtual ~openssh_fixture();
 
     std::string host() const;
     std::string user() const;
     int port() const;
+
+    /**
+     * Directory that relative paths on the server resolve against.
+     */
+    std::string remote_home() const;
+
+    /**
+     * Create `count` empty files in a directory on the server, making the
+     * directory if necessary.
+     *
+     * Runs on the server rather than over SFTP so that directories with
+     * hundreds of thousands of entries can be made in seconds.  The files
+     * are named `entry0000001` onwards.
+     *
+     * @param directory  Path relative to `remote_home()`.
+     */
+    void create_files_on_server(const std::string& directory,
+                                unsigned long count);
+
     boost::filesystem::path private_key_path() const;
     boost::filesystem::path public_key_path() const;
     boost::filesystem::path wrong_private_key_path() const;
     boost::filesystem::path wrong_public_key_path() const;
 
 private:
+    void start_server();
+    void start_proxy(const link_conditions& conditions);
+
     std::string m_container_id;
+    boost::shared_ptr<local_sshd> m_local_server;
     std::string m_host;
     int m_port;
+    boost::shared_ptr<shaping_proxy> m_proxy;
 
     std::string ask_docker_for_host() const;
     int ask_docker_for_port() const;
@@ -0,0 +1,165 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/filesystem/path_arena.hpp> // test subject
+
+#include <boost/functional/hash.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <map>
+#include <stdexcept> // invalid_argument
+#include <string>
+
+using ssh::filesystem::interned_path;
+using ssh::filesystem::path;
+using ssh::filesystem::path_arena;
+
+using std::string;
+
+BOOST_AUTO_TEST_SUITE(path_arena_tests)
+
+BOOST_AUTO_TEST_CASE(empty_path)
+{
+    path_arena arena;
+    interned_path interned = arena.intern(path());
+
+    BOOST_CHECK(interned.empty());
+    BOOST_CHECK(interned == interned_path());
+    BOOST_CHECK_EQUAL(interned.to_path(), path());
+    BOOST_CHECK_EQUAL(arena.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    const char* paths[] = {"/",   "/srv",    "/srv/data/file.txt",
+                           "a",   "a/b/c",   "/srv//data///file.txt",
+                           "a/b/", "/srv/data/"};
+
+    path_arena arena;
+    for (std::size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); ++i)
+    {
+        path original(paths[i]);
+        BOOST_CHECK_EQUAL(arena.intern(original).to_path(), original);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(round_trip_has_joined_form)
+{
+    path_arena arena;
+    BOOST_CHECK_EQUAL(
+        arena.intern(path("/srv//data///file.txt")).to_path().native(),
+        "/srv/data/file.txt");
+}
+
+BOOST_AUTO_TEST_CASE(equal_paths_are_the_same)
+{
+    path_arena arena;
+    interned_path first = arena.intern(path("/srv/data/file.txt"));
+    interned_path second = arena.intern(path("/srv/data//file.txt"));
+
+    BOOST_CHECK(first == second);
+    BOOST_CHECK_EQUAL(hash_value(first), hash_value(second));
+    BOOST_CHECK(first != arena.intern(path("/srv/data/other.txt")));
+}
+
+BOOST_AUTO_TEST_CASE(prefixes_are_shared)
+{
+    path_arena arena;
+    arena.intern(path("/srv/data/projects/one"));
+    arena.intern(path("/srv/data/projects/two"));
+
+    // "/", "srv", "data", "projects", "one" and "two"
+    BOOST_CHECK_EQUAL(arena.size(), 6U);
+    BOOST_CHECK_EQUAL(arena.name_count(), 6U);
+}
+
+BOOST_AUTO_TEST_CASE(names_are_shared)
+{
+    path_arena arena;
+    arena.intern(path("/a/same"));
+    arena.intern(path("/b/same"));
+
+    BOOST_CHECK_EQUAL(arena.size(), 5U);
+    BOOST_CHECK_EQUAL(arena.name_count(), 4U);
+}
+
+BOOST_AUTO_TEST_CASE(parent_and_filename)
+{
+    path_arena arena;
+    interned_path interned = arena.intern(path("/srv/data/file.txt"));
+
+    BOOST_CHECK_EQUAL(interned.filename(), "file.txt");
+    BOOST_CHECK_EQUAL(interned.depth(), 4U);
+    BOOST_CHECK(interned.parent_path() == arena.intern(path("/srv/data")));
+    BOOST_CHECK_EQUAL(interned.parent_path().to_path(),
+                      path("/srv/data/file.txt").parent_path());
+    BOOST_CHECK_EQUAL(arena.intern(path("/")).filename(), "/");
+}
+
+BOOST_AUTO_TEST_CASE(child)
+{
+    path_arena arena;
+    interned_path directory = arena.intern(path("/srv/data"));
+
+    interned_path file = arena.child(directory, "file.txt");
+
+    BOOST_CHECK(file == arena.intern(path("/srv/data/file.txt")));
+    BOOST_CHECK_EQUAL(file.to_path(), path("/srv/data") / "file.txt");
+}
+
+BOOST_AUTO_TEST_CASE(child_must_be_one_element)
+{
+    path_arena arena;
+    interned_path directory = arena.intern(path("/srv"));
+
+    BOOST_CHECK_THROW(arena.child(directory, "data/file.txt"),
+                      std::invalid_argument);
+    BOOST_CHECK_THROW(arena.child(directory, ""), std::invalid_argument);
+    BOOST_CHECK_THROW(arena.child(directory, "/"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(find_does_not_add)
+{
+    path_arena arena;
+    interned_path interned = arena.intern(path("/srv/data"));
+
+    BOOST_CHECK(arena.find(path("/srv/data")) == interned);
+    BOOST_CHECK(arena.find(path("/srv/other")).empty());
+    BOOST_CHECK(arena.find(path("/srv/data/deeper")).empty());
+    BOOST_CHECK_EQUAL(arena.size(), 3U);
+}
+
+BOOST_AUTO_TEST_CASE(usable_as_keys)
+{
+    path_arena arena;
+    interned_path one = arena.intern(path("/one"));
+    interned_path two = arena.intern(path("/two"));
+
+    boost::unordered_map<interned_path, int> hashed;
+    hashed[one] = 1;
+    hashed[two] = 2;
+
+    std::map<interned_path, int> ordered;
+    ordered[one] = 1;
+    ordered[two] = 2;
+
+    BOOST_CHECK_EQUAL(hashed[arena.intern(path("/one"))], 1);
+    BOOST_CHECK_EQUAL(ordered[arena.intern(path("/two"))], 2);
+    BOOST_CHECK_EQUAL(hashed.size(), 2U);
+    BOOST_CHECK_EQUAL(ordered.size(), 2U);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
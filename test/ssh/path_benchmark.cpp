@@ -0,0 +1,299 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Cost of the `ssh::filesystem::path` operations on the hot paths.
+ *
+ * Each operation is timed over many iterations on absolute paths of
+ * depth 1, 4 and 16, made of either ASCII or non-ASCII (Devanagari and CJK)
+ * segments.  Results are named `<operation>/<charset>/depth=<n>` and
+ * record nanoseconds per operation (as the `nanoseconds_per_operation`
+ * measurement) and allocations per operation.
+ *
+ * Needs no server.  `SSH_BENCHMARK_ITERATIONS` (default 100000) sets the
+ * iterations per run, though slow operations run fewer.  The results are
+ * saved and compared with a baseline as in the stream benchmarks, with the
+ * file defaulting to `path_benchmark.json`.
+ *
+ * `system_locale` times getting the locale that `string` converts with on
+ * its own, so the saved results show what each call pays for it.
+ */
+
+#include "benchmark.hpp"
+
+#include <ssh/filesystem/path.hpp> // test subject
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/locale/encoding_utf.hpp> // utf_to_utf
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef> // size_t
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::path;
+
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_setting;
+using test::ssh::benchmark_timer;
+using test::ssh::median_of;
+
+using std::ostringstream;
+using std::size_t;
+using std::string;
+using std::vector;
+using std::wstring;
+
+namespace
+{
+
+const int DEPTHS[] = {1, 4, 16};
+
+const int RUNS_PER_CONFIGURATION = 3;
+
+const char ASCII_SEGMENT[] = "directory";
+
+// Devanagari followed by CJK, so conversions see both 3-byte sequences and
+// more than one script
+const char NON_ASCII_SEGMENT[] =
+    "\xe0\xa4\xae\xe0\xa4\xb9\xe0\xa4\xb8\xe0\xa5\x81\xe0\xa4\xb8"
+    "\xe4\xb8\xad\xe5\x9c\x8b";
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+unsigned long iterations()
+{
+    return boost::lexical_cast<unsigned long>(
+        benchmark_setting("SSH_BENCHMARK_ITERATIONS", "100000"));
+}
+
+/**
+ * The paths an operation works on, made before timing starts.
+ */
+struct path_operands
+{
+    path subject;
+
+    /// Same as subject except for the last segment.
+    path sibling;
+
+    path leaf;
+
+    wstring wide_subject;
+};
+
+path_operands operands(const string& segment, int depth)
+{
+    string subject;
+    for (int i = 0; i < depth; ++i)
+    {
+        subject += "/" + segment + boost::lexical_cast<string>(i);
+    }
+
+    path_operands o;
+    o.subject = subject;
+    o.sibling = o.subject.parent_path() / (segment + "-sibling");
+    o.leaf = segment + ".txt";
+    o.wide_subject = boost::locale::conv::utf_to_utf<wchar_t>(subject);
+    return o;
+}
+
+// Each operation returns something derived from its result, so that the
+// compiler can't discard the work
+
+size_t join(const path_operands& o)
+{
+    return (o.subject / o.leaf).native().size();
+}
+
+size_t append_in_place(const path_operands& o)
+{
+    path p(o.subject);
+    p /= o.leaf;
+    return p.native().size();
+}
+
+size_t filename(const path_operands& o)
+{
+    return o.subject.filename().native().size();
+}
+
+size_t parent_path(const path_operands& o)
+{
+    return o.subject.parent_path().native().size();
+}
+
+size_t iterate(const path_operands& o)
+{
+    size_t segments = 0;
+    for (path::iterator it = o.subject.begin(); it != o.subject.end(); ++it)
+    {
+        ++segments;
+    }
+    return segments;
+}
+
+size_t compare(const path_operands& o)
+{
+    return static_cast<size_t>(o.subject.compare(o.sibling) + 1);
+}
+
+size_t native(const path_operands& o)
+{
+    return o.subject.native().size();
+}
+
+size_t to_string(const path_operands& o)
+{
+    return o.subject.string().size();
+}
+
+size_t system_locale(const path_operands& o)
+{
+    return ssh::filesystem::detail::system_locale().name().size() +
+           o.subject.native().size();
+}
+
+size_t to_wstring(const path_operands& o)
+{
+    return o.subject.wstring().size();
+}
+
+size_t from_wstring(const path_operands& o)
+{
+    return path(o.wide_subject).native().size();
+}
+
+typedef size_t (*path_operation)(const path_operands&);
+
+struct named_operation
+{
+    const char* name;
+    path_operation operation;
+};
+
+const named_operation OPERATIONS[] = {
+    {"join", &join},
+    {"append_in_place", &append_in_place},
+    {"filename", &filename},
+    {"parent_path", &parent_path},
+    {"iterate", &iterate},
+    {"compare", &compare},
+    {"native", &native},
+    {"string", &to_string},
+    {"system_locale", &system_locale},
+    {"wstring", &to_wstring},
+    {"from_wstring", &from_wstring}};
+
+volatile size_t sink;
+
+// Some operations take milliseconds, so each run stops short of the
+// requested iterations if they would take much longer than this
+const double SECONDS_PER_RUN = 0.5;
+
+benchmark_result time_operation(const string& name, path_operation operation,
+                                const path_operands& o, unsigned long count)
+{
+    // Let any lazily-created state, such as cached locales, be made before
+    // timing starts
+    sink = operation(o);
+
+    benchmark_timer calibration;
+    sink = operation(o);
+    double seconds_per_operation =
+        calibration.finish(name, 0, 1).wall_seconds;
+    if (seconds_per_operation * count > SECONDS_PER_RUN)
+    {
+        count = static_cast<unsigned long>(
+                    SECONDS_PER_RUN / seconds_per_operation) +
+                1;
+    }
+
+    benchmark_timer timer;
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        sink = operation(o);
+    }
+    benchmark_result result = timer.finish(name, 0, count);
+
+    result.measurements["nanoseconds_per_operation"] =
+        result.wall_seconds * 1e9 / count;
+
+    return result;
+}
+
+void benchmark_charset(const string& charset, const string& segment)
+{
+    unsigned long count = iterations();
+
+    BOOST_FOREACH (int depth, DEPTHS)
+    {
+        path_operands o = operands(segment, depth);
+
+        BOOST_FOREACH (const named_operation& operation, OPERATIONS)
+        {
+            ostringstream name;
+            name << operation.name << "/" << charset << "/depth=" << depth;
+
+            vector<benchmark_result> runs;
+            for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+            {
+                runs.push_back(time_operation(name.str(), operation.operation,
+                                              o, count));
+            }
+
+            benchmark_result result = median_of(runs);
+            BOOST_TEST_MESSAGE(
+                result.name
+                << ": " << result.measurements["nanoseconds_per_operation"]
+                << " ns/op, " << result.allocations_per_item()
+                << " allocations/op");
+            results().add(result);
+        }
+    }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(path_benchmarks)
+
+BOOST_AUTO_TEST_CASE(ascii_paths)
+{
+    benchmark_charset("ascii", ASCII_SEGMENT);
+}
+
+BOOST_AUTO_TEST_CASE(non_ascii_paths)
+{
+    benchmark_charset("non_ascii", NON_ASCII_SEGMENT);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(path_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(results(),
+                                              "path_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -1184,6 +1184,20 @@ BOOST_AUTO_TEST_CASE(
     BOOST_CHECK_EQUAL(q.native(), "/baz/woz");
 }
 
+BOOST_AUTO_TEST_CASE( appending_path_to_itself_repeats_it )
+{
+    path p("foo/bar");
+    p /= p;
+    BOOST_CHECK_EQUAL(p.native(), "foo/bar/foo/bar");
+}
+
+BOOST_AUTO_TEST_CASE( appending_own_native_string_repeats_it )
+{
+    path p("/foo/bar/");
+    p /= p.native();
+    BOOST_CHECK_EQUAL(p.native(), "/foo/bar/foo/bar/");
+}
+
 BOOST_AUTO_TEST_CASE(
     concatenating_relative_directory_and_absolute_returns_concatenation )
 {
@@ -1533,4 +1547,17 @@ BOOST_AUTO_TEST_CASE( concatenating_wide_string_and_path_returns_concatenation )
     BOOST_CHECK_EQUAL(p / WIDE_STRING2, q);
 }
 
+BOOST_AUTO_TEST_CASE( system_locale_is_generated_once )
+{
+    // Freshly generated locales never compare equal, copies of one do
+    using ssh::filesystem::detail::system_locale;
+    BOOST_CHECK(system_locale() == system_locale());
+}
+
+BOOST_AUTO_TEST_CASE( utf8_locale_is_generated_once )
+{
+    using ssh::filesystem::detail::utf8_locale;
+    BOOST_CHECK(utf8_locale() == utf8_locale());
+}
+
 BOOST_AUTO_TEST_SUITE_END();
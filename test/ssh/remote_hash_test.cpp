@@ -0,0 +1,173 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/remote_hash.hpp> // test subject
+
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+using ssh::filesystem::path;
+using ssh::hash_algorithm;
+using ssh::remote_hash;
+using ssh::remote_hash_method;
+using ssh::remote_hashes;
+
+using test::ssh::sftp_fixture;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const string ABC_SHA256 =
+    "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+const string ABC_MD5 = "900150983cd24fb0d6963f7d28e17f72";
+}
+
+BOOST_FIXTURE_TEST_SUITE(remote_hash_tests, sftp_fixture)
+
+BOOST_AUTO_TEST_CASE(hash_by_command)
+{
+    path file = new_file_in_sandbox_containing_data("abc");
+
+    BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                  hash_algorithm::sha256,
+                                  remote_hash_method::command),
+                      ABC_SHA256);
+    BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                  hash_algorithm::md5,
+                                  remote_hash_method::command),
+                      ABC_MD5);
+}
+
+BOOST_AUTO_TEST_CASE(hash_by_download)
+{
+    path file = new_file_in_sandbox_containing_data("abc");
+
+    BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                  hash_algorithm::sha256,
+                                  remote_hash_method::download),
+                      ABC_SHA256);
+    BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                  hash_algorithm::md5,
+                                  remote_hash_method::download),
+                      ABC_MD5);
+}
+
+BOOST_AUTO_TEST_CASE(hash_by_check_file_if_offered)
+{
+    path file = new_file_in_sandbox_containing_data("abc");
+
+    if (filesystem().extensions().count("check-file"))
+    {
+        BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                      hash_algorithm::sha256,
+                                      remote_hash_method::check_file),
+                          ABC_SHA256);
+    }
+    else
+    {
+        BOOST_CHECK_THROW(remote_hash(test_session(), filesystem(), file,
+                                      hash_algorithm::sha256,
+                                      remote_hash_method::check_file),
+                          std::exception);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hash_automatically)
+{
+    path file = new_file_in_sandbox_containing_data("abc");
+
+    BOOST_CHECK_EQUAL(remote_hash(test_session(), filesystem(), file,
+                                  hash_algorithm::sha256),
+                      ABC_SHA256);
+}
+
+BOOST_AUTO_TEST_CASE(methods_agree_on_awkward_names)
+{
+    vector<path> files;
+    files.push_back(new_file_in_sandbox_containing_data("-", "abc"));
+    files.push_back(new_file_in_sandbox_containing_data("back\\slash", "abc"));
+    files.push_back(new_file_in_sandbox_containing_data("new\nline", "abc"));
+    files.push_back(new_file_in_sandbox_containing_data("it's", "abc"));
+    files.push_back(new_file_in_sandbox_containing_data("empty", ""));
+
+    vector<string> by_command =
+        remote_hashes(test_session(), filesystem(), files,
+                      hash_algorithm::sha256, remote_hash_method::command);
+    vector<string> by_download =
+        remote_hashes(test_session(), filesystem(), files,
+                      hash_algorithm::sha256, remote_hash_method::download);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(by_command.begin(), by_command.end(),
+                                  by_download.begin(), by_download.end());
+    BOOST_CHECK_EQUAL(by_command[0], ABC_SHA256);
+}
+
+BOOST_AUTO_TEST_CASE(many_files_span_several_commands)
+{
+    vector<path> files;
+    for (int i = 0; i < 1000; ++i)
+    {
+        string name = string(100, 'x') + boost::lexical_cast<string>(i);
+        files.push_back(new_file_in_sandbox_containing_data(
+            name, boost::lexical_cast<string>(i)));
+    }
+
+    vector<string> by_command =
+        remote_hashes(test_session(), filesystem(), files,
+                      hash_algorithm::md5, remote_hash_method::command, 3);
+    vector<string> by_download =
+        remote_hashes(test_session(), filesystem(), files,
+                      hash_algorithm::md5, remote_hash_method::download, 3);
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(by_command.begin(), by_command.end(),
+                                  by_download.begin(), by_download.end());
+}
+
+BOOST_AUTO_TEST_CASE(no_files)
+{
+    BOOST_CHECK(remote_hashes(test_session(), filesystem(), vector<path>(),
+                              hash_algorithm::sha256)
+                    .empty());
+}
+
+BOOST_AUTO_TEST_CASE(missing_file_fails_by_command)
+{
+    path missing = sandbox() / "missing";
+
+    BOOST_CHECK_THROW(remote_hash(test_session(), filesystem(), missing,
+                                  hash_algorithm::sha256,
+                                  remote_hash_method::command),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(missing_file_fails_by_download)
+{
+    path missing = sandbox() / "missing";
+
+    BOOST_CHECK_THROW(remote_hash(test_session(), filesystem(), missing,
+                                  hash_algorithm::sha256,
+                                  remote_hash_method::download),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
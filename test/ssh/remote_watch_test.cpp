@@ -0,0 +1,267 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/remote_command.hpp>
+#include <ssh/remote_watch.hpp> // test subject
+#include <ssh/stream.hpp>
+
+#include <boost/chrono/duration.hpp>
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+using ssh::filesystem::ofstream;
+using ssh::filesystem::path;
+using ssh::remote_change;
+using ssh::remote_change_kind;
+using ssh::remote_command_available;
+using ssh::remote_watch;
+using ssh::remote_watch_method;
+using ssh::remote_watch_options;
+
+using test::ssh::sftp_fixture;
+
+using boost::chrono::milliseconds;
+using boost::chrono::steady_clock;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+class remote_watch_fixture : public sftp_fixture
+{
+public:
+    remote_watch_fixture() : m_directory(new_directory_in_sandbox())
+    {
+    }
+
+    remote_watch_options options(BOOST_SCOPED_ENUM(remote_watch_method)
+                                     method)
+    {
+        remote_watch_options options;
+        options.method = method;
+        options.poll_interval = milliseconds(200);
+        return options;
+    }
+
+    bool inotify_available()
+    {
+        if (remote_command_available(test_session(), "inotifywait"))
+        {
+            return true;
+        }
+        else
+        {
+            BOOST_TEST_MESSAGE("inotifywait not on server; test skipped");
+            return false;
+        }
+    }
+
+    void write(const string& name, const string& data)
+    {
+        ofstream stream(filesystem(), m_directory / name);
+        stream << data;
+    }
+
+    path directory() const
+    {
+        return m_directory;
+    }
+
+private:
+    path m_directory;
+};
+
+/**
+ * Collect changes until one matches, or a generous timeout passes.
+ *
+ * @returns every change collected.
+ */
+vector<remote_change> changes_until(remote_watch& watch,
+                                    BOOST_SCOPED_ENUM(remote_change_kind) kind,
+                                    const path& changed)
+{
+    steady_clock::time_point deadline =
+        steady_clock::now() + milliseconds(10000);
+
+    vector<remote_change> all;
+    while (steady_clock::now() < deadline)
+    {
+        vector<remote_change> changes =
+            watch.wait_for_changes(milliseconds(500));
+        all.insert(all.end(), changes.begin(), changes.end());
+
+        for (vector<remote_change>::const_iterator it = changes.begin();
+             it != changes.end(); ++it)
+        {
+            if (it->kind == kind && it->path == changed)
+                return all;
+        }
+    }
+
+    BOOST_FAIL("Expected change not seen: " + changed.native());
+    return all;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(remote_watch_tests, remote_watch_fixture)
+
+BOOST_AUTO_TEST_CASE(automatic_reports_new_file)
+{
+    remote_watch watch(test_session(), filesystem(), directory());
+
+    write("new.txt", "data");
+
+    changes_until(watch, remote_change_kind::created, directory() / "new.txt");
+}
+
+BOOST_AUTO_TEST_CASE(no_changes)
+{
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::poll));
+
+    BOOST_CHECK(watch.wait_for_changes(milliseconds(500)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(poll_reports_created_and_removed)
+{
+    write("existing.txt", "data");
+
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::poll));
+    BOOST_CHECK(watch.method() == remote_watch_method::poll);
+
+    write("new.txt", "data");
+    changes_until(watch, remote_change_kind::created, directory() / "new.txt");
+
+    remove(filesystem(), directory() / "existing.txt");
+    changes_until(watch, remote_change_kind::removed,
+                  directory() / "existing.txt");
+}
+
+BOOST_AUTO_TEST_CASE(poll_reports_replaced_file)
+{
+    write("file.txt", "old");
+
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::poll));
+
+    // Written beside and renamed over, as editors save
+    write("file.txt.new", "new contents");
+    rename(filesystem(), directory() / "file.txt.new",
+           directory() / "file.txt");
+
+    changes_until(watch, remote_change_kind::modified,
+                  directory() / "file.txt");
+}
+
+BOOST_AUTO_TEST_CASE(poll_ends_when_directory_removed)
+{
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::poll));
+
+    remove_all(filesystem(), directory());
+
+    changes_until(watch, remote_change_kind::removed, directory());
+    BOOST_CHECK(watch.wait_for_changes(milliseconds(500)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(poll_of_missing_directory_fails)
+{
+    BOOST_CHECK_THROW(remote_watch(test_session(), filesystem(),
+                                   sandbox() / "missing",
+                                   options(remote_watch_method::poll)),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE(inotify_reports_modification)
+{
+    if (!inotify_available())
+        return;
+
+    write("file.txt", "old");
+
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::inotify));
+    BOOST_CHECK(watch.method() == remote_watch_method::inotify);
+
+    write("file.txt", "new");
+
+    changes_until(watch, remote_change_kind::modified,
+                  directory() / "file.txt");
+}
+
+BOOST_AUTO_TEST_CASE(inotify_merges_changes_to_new_file)
+{
+    if (!inotify_available())
+        return;
+
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::inotify));
+
+    {
+        ofstream stream(filesystem(), directory() / "log.txt");
+        for (int i = 0; i < 100; ++i)
+        {
+            stream << string(1000, 'x');
+            stream.flush();
+        }
+    }
+
+    vector<remote_change> changes = changes_until(
+        watch, remote_change_kind::created, directory() / "log.txt");
+
+    // Writes after the creation was taken may still follow as a
+    // modification, but never as another creation
+    for (vector<remote_change>::const_iterator it = changes.begin();
+         it != changes.end(); ++it)
+    {
+        BOOST_CHECK(it->kind == remote_change_kind::created ||
+                    it->kind == remote_change_kind::modified);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(inotify_ends_when_directory_removed)
+{
+    if (!inotify_available())
+        return;
+
+    remote_watch watch(test_session(), filesystem(), directory(),
+                       options(remote_watch_method::inotify));
+
+    remove_all(filesystem(), directory());
+
+    changes_until(watch, remote_change_kind::removed, directory());
+    BOOST_CHECK(watch.wait_for_changes(milliseconds(500)).empty());
+}
+
+BOOST_AUTO_TEST_CASE(inotify_of_missing_directory_fails)
+{
+    if (!inotify_available())
+        return;
+
+    BOOST_CHECK_THROW(remote_watch(test_session(), filesystem(),
+                                   sandbox() / "missing",
+                                   options(remote_watch_method::inotify)),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
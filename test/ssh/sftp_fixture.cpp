@@ -69,7 +69,7 @@ path sftp_fixture::sandbox() const
 
 path sftp_fixture::absolute_sandbox() const
 {
-    return "/home/swish/sandbox";
+    return path(remote_home()) / sandbox();
 }
 
 sftp_file sftp_fixture::find_file_in_sandbox(const string& filename)
@@ -0,0 +1,197 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/sftp_packet.hpp> // test subject
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+
+using ssh::detail::sftp_packet_reader;
+using ssh::detail::sftp_packet_writer;
+using ssh::detail::sftp_protocol_error;
+using ssh::detail::sftp_slice;
+
+using std::string;
+
+namespace sftp_packet_type = ssh::detail::sftp_packet_type;
+
+namespace
+{
+
+/**
+ * The packet as sent, without its length prefix.
+ */
+string packet_body(sftp_packet_writer& packet)
+{
+    return string(packet.data() + sftp_packet_writer::LENGTH_SIZE,
+                  packet.size() - sftp_packet_writer::LENGTH_SIZE);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(sftp_packet_tests)
+
+BOOST_AUTO_TEST_CASE(length_prefix)
+{
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::init);
+    packet.uint32(3);
+
+    string wire(packet.data(), packet.size());
+    BOOST_CHECK_EQUAL(wire, string("\0\0\0\x05\x01\0\0\0\x03", 9));
+}
+
+BOOST_AUTO_TEST_CASE(big_endian_fields)
+{
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::read);
+    packet.uint32(0x01020304);
+    packet.uint64(0x05060708090A0B0CULL);
+    packet.string("ab");
+
+    BOOST_CHECK_EQUAL(packet_body(packet),
+                      string("\x05"
+                             "\x01\x02\x03\x04"
+                             "\x05\x06\x07\x08\x09\x0A\x0B\x0C"
+                             "\0\0\0\x02"
+                             "ab",
+                             19));
+}
+
+BOOST_AUTO_TEST_CASE(start_discards_earlier_packet)
+{
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::open);
+    packet.string("a long path that is thrown away");
+    packet.start(sftp_packet_type::close);
+    packet.uint32(7);
+
+    BOOST_CHECK_EQUAL(packet_body(packet), string("\x04\0\0\0\x07", 5));
+}
+
+BOOST_AUTO_TEST_CASE(fields_read_back)
+{
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::data);
+    packet.uint32(42);
+    packet.uint64(0xFFFFFFFF00000001ULL);
+    packet.string(string("with\0nul", 8));
+
+    string body = packet_body(packet);
+    sftp_packet_reader reader(body.data(), body.size());
+
+    BOOST_CHECK_EQUAL(reader.byte(), sftp_packet_type::data);
+    BOOST_CHECK_EQUAL(reader.uint32(), 42U);
+    BOOST_CHECK_EQUAL(reader.uint64(), 0xFFFFFFFF00000001ULL);
+
+    sftp_slice data = reader.string();
+    BOOST_CHECK_EQUAL(data.str(), string("with\0nul", 8));
+    BOOST_CHECK(reader.at_end());
+}
+
+BOOST_AUTO_TEST_CASE(strings_point_into_packet)
+{
+    string body("\0\0\0\x03xyz", 7);
+    sftp_packet_reader reader(body.data(), body.size());
+
+    sftp_slice slice = reader.string();
+
+    BOOST_CHECK(slice.data == body.data() + 4);
+    BOOST_CHECK_EQUAL(slice.size, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(attributes_round_trip)
+{
+    LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+    attributes.flags = LIBSSH2_SFTP_ATTR_SIZE | LIBSSH2_SFTP_ATTR_UIDGID |
+                       LIBSSH2_SFTP_ATTR_PERMISSIONS |
+                       LIBSSH2_SFTP_ATTR_ACMODTIME;
+    attributes.filesize = 0x100000000ULL;
+    attributes.uid = 1000;
+    attributes.gid = 100;
+    attributes.permissions = 0100644;
+    attributes.atime = 1400000000;
+    attributes.mtime = 1400000001;
+
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::attrs);
+    packet.attributes(attributes);
+
+    string body = packet_body(packet);
+    sftp_packet_reader reader(body.data(), body.size());
+    reader.byte();
+    LIBSSH2_SFTP_ATTRIBUTES parsed = reader.attributes();
+
+    BOOST_CHECK_EQUAL(parsed.flags, attributes.flags);
+    BOOST_CHECK_EQUAL(parsed.filesize, attributes.filesize);
+    BOOST_CHECK_EQUAL(parsed.uid, attributes.uid);
+    BOOST_CHECK_EQUAL(parsed.gid, attributes.gid);
+    BOOST_CHECK_EQUAL(parsed.permissions, attributes.permissions);
+    BOOST_CHECK_EQUAL(parsed.atime, attributes.atime);
+    BOOST_CHECK_EQUAL(parsed.mtime, attributes.mtime);
+    BOOST_CHECK(reader.at_end());
+}
+
+BOOST_AUTO_TEST_CASE(only_flagged_attributes_written)
+{
+    LIBSSH2_SFTP_ATTRIBUTES attributes = LIBSSH2_SFTP_ATTRIBUTES();
+    attributes.flags = LIBSSH2_SFTP_ATTR_PERMISSIONS;
+    attributes.permissions = 0755;
+    attributes.filesize = 99;
+
+    sftp_packet_writer packet;
+    packet.start(sftp_packet_type::mkdir);
+    packet.attributes(attributes);
+
+    BOOST_CHECK_EQUAL(packet_body(packet),
+                      string("\x0E\0\0\0\x04\0\0\x01\xED", 9));
+}
+
+BOOST_AUTO_TEST_CASE(extended_attributes_skipped)
+{
+    string body("\x80\0\0\x04" // flags: extended and permissions
+                "\0\0\x01\xA4" // permissions
+                "\0\0\0\x01"   // one extended attribute
+                "\0\0\0\x01t"  // type
+                "\0\0\0\x02"   // data
+                "dd"
+                "\0\0\0\x09",  // next field
+                27);
+    sftp_packet_reader reader(body.data(), body.size());
+
+    LIBSSH2_SFTP_ATTRIBUTES parsed = reader.attributes();
+
+    BOOST_CHECK_EQUAL(parsed.permissions, 0644U);
+    BOOST_CHECK_EQUAL(reader.uint32(), 9U);
+    BOOST_CHECK(reader.at_end());
+}
+
+BOOST_AUTO_TEST_CASE(truncated_field)
+{
+    string body("\0\0\0", 3);
+    sftp_packet_reader reader(body.data(), body.size());
+
+    BOOST_CHECK_THROW(reader.uint32(), sftp_protocol_error);
+}
+
+BOOST_AUTO_TEST_CASE(string_longer_than_packet)
+{
+    string body("\0\0\0\x10short", 9);
+    sftp_packet_reader reader(body.data(), body.size());
+
+    BOOST_CHECK_THROW(reader.string(), sftp_protocol_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,443 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "shaping_proxy.hpp"
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_01.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/system/system_error.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm> // max
+#include <cstddef>   // size_t
+#include <deque>
+#include <string>
+#include <vector>
+
+using boost::asio::io_service;
+using boost::asio::ip::tcp;
+using boost::chrono::milliseconds;
+using boost::chrono::nanoseconds;
+using boost::chrono::steady_clock;
+using boost::condition_variable;
+using boost::mutex;
+using boost::shared_ptr;
+using boost::system::error_code;
+using boost::system::system_error;
+using boost::thread;
+using boost::unique_lock;
+
+using std::deque;
+using std::size_t;
+using std::string;
+using std::vector;
+
+namespace test
+{
+namespace ssh
+{
+
+namespace
+{
+
+const size_t SEGMENT_SIZE = 16 * 1024;
+
+// Limits how far a sender can run ahead of the shaped link before TCP flow
+// control pushes back on it
+const size_t MAX_QUEUED_BYTES = 1024 * 1024;
+
+struct segment
+{
+    vector<char> data;
+    steady_clock::time_point deliver_at;
+};
+
+/**
+ * One direction of a proxied connection.
+ *
+ * The reader thread reads from the source as fast as it can, stamps each
+ * segment with the time the shaped link would deliver it, and queues it.
+ * The writer thread waits for each segment's time and writes it to the
+ * destination.
+ */
+class shaped_pipe : private boost::noncopyable
+{
+public:
+    shaped_pipe(tcp::socket& source, tcp::socket& destination,
+                const link_conditions& conditions, unsigned int seed)
+        : m_source(source),
+          m_destination(destination),
+          m_conditions(conditions),
+          m_random(seed),
+          m_link_free_at(steady_clock::now()),
+          m_last_delivery(m_link_free_at),
+          m_queued_bytes(0),
+          m_source_finished(false),
+          m_broken(false)
+    {
+    }
+
+    void read_from_source()
+    {
+        for (;;)
+        {
+            segment s;
+            s.data.resize(SEGMENT_SIZE);
+
+            error_code ec;
+            size_t count =
+                m_source.read_some(boost::asio::buffer(s.data), ec);
+            if (ec)
+            {
+                finish_source();
+                return;
+            }
+
+            s.data.resize(count);
+            s.deliver_at = schedule(count);
+
+            unique_lock<mutex> lock(m_guard);
+            while (m_queued_bytes >= MAX_QUEUED_BYTES && !m_broken)
+            {
+                m_queue_changed.wait(lock);
+            }
+
+            if (m_broken)
+            {
+                return;
+            }
+
+            m_queued_bytes += count;
+            m_queue.push_back(s);
+            m_queue_changed.notify_all();
+        }
+    }
+
+    void write_to_destination()
+    {
+        for (;;)
+        {
+            segment s;
+            {
+                unique_lock<mutex> lock(m_guard);
+                while (m_queue.empty() && !m_source_finished && !m_broken)
+                {
+                    m_queue_changed.wait(lock);
+                }
+
+                if (m_broken || m_queue.empty())
+                {
+                    break;
+                }
+
+                s = m_queue.front();
+                m_queue.pop_front();
+                m_queued_bytes -= s.data.size();
+                m_queue_changed.notify_all();
+            }
+
+            boost::this_thread::sleep_until(s.deliver_at);
+
+            error_code ec;
+            boost::asio::write(m_destination, boost::asio::buffer(s.data),
+                               ec);
+            if (ec)
+            {
+                stop();
+                return;
+            }
+        }
+
+        // Pass on the end of the stream once everything before it arrived
+        error_code ignored;
+        m_destination.shutdown(tcp::socket::shutdown_send, ignored);
+    }
+
+    void stop()
+    {
+        boost::lock_guard<mutex> lock(m_guard);
+        m_broken = true;
+        m_queue_changed.notify_all();
+    }
+
+private:
+    steady_clock::time_point schedule(size_t count)
+    {
+        steady_clock::time_point now = steady_clock::now();
+
+        // Segments queue for the link, which carries them one at a time at
+        // the link's bandwidth
+        steady_clock::time_point transmitted = (std::max)(now, m_link_free_at);
+        if (m_conditions.bandwidth > 0)
+        {
+            transmitted += nanoseconds(static_cast<nanoseconds::rep>(
+                count * 1000000000.0 / m_conditions.bandwidth));
+        }
+        m_link_free_at = transmitted;
+
+        steady_clock::duration delay = m_conditions.latency;
+        if (m_conditions.jitter > milliseconds(0))
+        {
+            boost::random::uniform_int_distribution<milliseconds::rep> jitter(
+                0, m_conditions.jitter.count());
+            delay += milliseconds(jitter(m_random));
+        }
+
+        if (m_conditions.stall_probability > 0 &&
+            boost::random::uniform_01<double>()(m_random) <
+                m_conditions.stall_probability)
+        {
+            // A stall holds up everything behind it too
+            m_link_free_at += m_conditions.stall_duration;
+            delay += m_conditions.stall_duration;
+        }
+
+        m_last_delivery = (std::max)(transmitted + delay, m_last_delivery);
+        return m_last_delivery;
+    }
+
+    void finish_source()
+    {
+        boost::lock_guard<mutex> lock(m_guard);
+        m_source_finished = true;
+        m_queue_changed.notify_all();
+    }
+
+    tcp::socket& m_source;
+    tcp::socket& m_destination;
+    const link_conditions m_conditions;
+
+    // Only used by the reader thread
+    boost::random::mt19937 m_random;
+    steady_clock::time_point m_link_free_at;
+    steady_clock::time_point m_last_delivery;
+
+    mutex m_guard;
+    condition_variable m_queue_changed;
+    deque<segment> m_queue;
+    size_t m_queued_bytes;
+    bool m_source_finished;
+    bool m_broken;
+};
+
+class proxied_connection : private boost::noncopyable
+{
+public:
+    proxied_connection(io_service& io, const link_conditions& conditions,
+                       unsigned int seed)
+        : m_client(io),
+          m_server(io),
+          m_upstream(m_client, m_server, conditions, seed),
+          m_downstream(m_server, m_client, conditions, seed + 1)
+    {
+    }
+
+    ~proxied_connection()
+    {
+        stop();
+        m_threads.join_all();
+    }
+
+    tcp::socket& client_socket()
+    {
+        return m_client;
+    }
+
+    /**
+     * Connect to the target and start forwarding the accepted client's
+     * traffic.
+     */
+    void start(const tcp::endpoint& target)
+    {
+        m_server.connect(target);
+
+        m_threads.create_thread(
+            boost::bind(&shaped_pipe::read_from_source, &m_upstream));
+        m_threads.create_thread(
+            boost::bind(&shaped_pipe::write_to_destination, &m_upstream));
+        m_threads.create_thread(
+            boost::bind(&shaped_pipe::read_from_source, &m_downstream));
+        m_threads.create_thread(
+            boost::bind(&shaped_pipe::write_to_destination, &m_downstream));
+    }
+
+private:
+    void stop()
+    {
+        m_upstream.stop();
+        m_downstream.stop();
+
+        // Unblocks any reads in progress
+        error_code ignored;
+        m_client.shutdown(tcp::socket::shutdown_both, ignored);
+        m_server.shutdown(tcp::socket::shutdown_both, ignored);
+    }
+
+    tcp::socket m_client;
+    tcp::socket m_server;
+    shaped_pipe m_upstream;
+    shaped_pipe m_downstream;
+    boost::thread_group m_threads;
+};
+
+tcp::endpoint resolve(io_service& io, const string& host, int port)
+{
+    tcp::resolver resolver(io);
+    tcp::resolver::query query(host, boost::lexical_cast<string>(port));
+    return *resolver.resolve(query);
+}
+}
+
+link_conditions::link_conditions()
+    : latency(0),
+      jitter(0),
+      bandwidth(0),
+      stall_probability(0),
+      stall_duration(0),
+      seed(5489)
+{
+}
+
+link_conditions link_conditions::with_round_trip_time(milliseconds round_trip)
+{
+    link_conditions conditions;
+    conditions.latency = round_trip / 2;
+    return conditions;
+}
+
+class shaping_proxy::implementation : private boost::noncopyable
+{
+public:
+    implementation(const string& target_host, int target_port,
+                   const link_conditions& conditions)
+        : m_conditions(conditions),
+          m_acceptor(m_io, tcp::endpoint(
+                               boost::asio::ip::address_v4::loopback(), 0)),
+          m_stopping(false)
+    {
+        m_target = resolve(m_io, target_host, target_port);
+
+        m_accept_thread =
+            thread(boost::bind(&implementation::accept_connections, this));
+    }
+
+    ~implementation()
+    {
+        m_stopping = true;
+
+        // A blocking accept can't safely be cancelled from another thread
+        // so wake it with a connection of our own
+        try
+        {
+            tcp::socket waker(m_io);
+            waker.connect(m_acceptor.local_endpoint());
+        }
+        catch (const system_error&)
+        {
+        }
+
+        m_accept_thread.join();
+
+        // Destroying the connections cuts them and joins their threads
+        boost::lock_guard<mutex> lock(m_guard);
+        m_connections.clear();
+    }
+
+    int port() const
+    {
+        return m_acceptor.local_endpoint().port();
+    }
+
+private:
+    void accept_connections()
+    {
+        unsigned int seed = m_conditions.seed;
+
+        while (!m_stopping)
+        {
+            shared_ptr<proxied_connection> connection =
+                boost::make_shared<proxied_connection>(boost::ref(m_io),
+                                                m_conditions, seed);
+            seed += 2;
+
+            try
+            {
+                m_acceptor.accept(connection->client_socket());
+
+                if (m_stopping)
+                {
+                    break;
+                }
+
+                connection->start(m_target);
+            }
+            catch (const system_error&)
+            {
+                // The accept failed or the target refused us.  Either way
+                // the client sees its connection dropped, as it would if
+                // the server were unreachable.
+                continue;
+            }
+
+            boost::lock_guard<mutex> lock(m_guard);
+            m_connections.push_back(connection);
+        }
+    }
+
+    const link_conditions m_conditions;
+    io_service m_io;
+    tcp::endpoint m_target;
+    tcp::acceptor m_acceptor;
+    boost::atomic<bool> m_stopping;
+    thread m_accept_thread;
+
+    mutex m_guard;
+    vector<shared_ptr<proxied_connection> > m_connections;
+};
+
+shaping_proxy::shaping_proxy(const string& target_host, int target_port,
+                             const link_conditions& conditions)
+    : m_impl(boost::make_shared<implementation>(target_host, target_port,
+                                         conditions))
+{
+}
+
+shaping_proxy::~shaping_proxy()
+{
+}
+
+string shaping_proxy::host() const
+{
+    return "127.0.0.1";
+}
+
+int shaping_proxy::port() const
+{
+    return m_impl->port();
+}
+}
+} // namespace test::ssh
@@ -0,0 +1,104 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef TEST_SSH_SHAPING_PROXY_HPP
+#define TEST_SSH_SHAPING_PROXY_HPP
+
+#include <boost/chrono/duration.hpp> // milliseconds
+#include <boost/cstdint.hpp>         // uint64_t
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+
+namespace test
+{
+namespace ssh
+{
+
+/**
+ * Network conditions imposed by a `shaping_proxy`.
+ *
+ * Each direction of a connection is shaped separately, so a round trip
+ * takes at least twice the `latency`.  The default is a perfect link.
+ */
+struct link_conditions
+{
+    link_conditions();
+
+    /**
+     * Conditions of a link whose round trip takes the given time.
+     */
+    static link_conditions
+    with_round_trip_time(boost::chrono::milliseconds round_trip);
+
+    /// Delay added to all data in each direction.
+    boost::chrono::milliseconds latency;
+
+    /// Upper bound of a random delay added on top of `latency`.
+    boost::chrono::milliseconds jitter;
+
+    /// Bytes per second in each direction.  Zero means unlimited.
+    boost::uint64_t bandwidth;
+
+    /// Chance, between 0 and 1, that a segment of data stalls the link.
+    double stall_probability;
+
+    /// How long a stall holds up the link.
+    boost::chrono::milliseconds stall_duration;
+
+    /// Seeds the random jitter and stalls, so runs can be repeated.
+    unsigned int seed;
+};
+
+/**
+ * TCP proxy that delays and throttles traffic passing through it.
+ *
+ * Listens on a loopback port and forwards each connection it accepts to
+ * the target, delivering data in each direction no earlier than the
+ * `link_conditions` allow.  Runs entirely in userspace so needs no special
+ * privileges.
+ *
+ * Data is forwarded in the order it arrived; jitter never reorders it, as
+ * TCP would not.  Only a bounded amount of data is queued in each
+ * direction, so senders feel the throttling through TCP flow control much
+ * as they would on a real link.
+ */
+class shaping_proxy : private boost::noncopyable
+{
+public:
+    shaping_proxy(const std::string& target_host, int target_port,
+                  const link_conditions& conditions);
+
+    /**
+     * Stops listening and cuts all connections through the proxy.
+     */
+    ~shaping_proxy();
+
+    /// Host clients connect to instead of the target.
+    std::string host() const;
+
+    /// Port clients connect to instead of the target.
+    int port() const;
+
+private:
+    class implementation;
+
+    boost::shared_ptr<implementation> m_impl;
+};
+}
+} // namespace test::ssh
+
+#endif
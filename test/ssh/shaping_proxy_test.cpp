@@ -0,0 +1,254 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "shaping_proxy.hpp" // test subject
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/bind.hpp>
+#include <boost/chrono/system_clocks.hpp> // steady_clock
+#include <boost/lexical_cast.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <cstddef> // size_t
+#include <memory>  // auto_ptr
+#include <string>
+#include <vector>
+
+using test::ssh::link_conditions;
+using test::ssh::shaping_proxy;
+
+using boost::asio::io_service;
+using boost::asio::ip::tcp;
+using boost::chrono::milliseconds;
+using boost::chrono::steady_clock;
+using boost::system::error_code;
+using boost::thread;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+/**
+ * Server that echoes everything sent on a single connection back to the
+ * sender.
+ */
+class echo_server
+{
+public:
+    echo_server()
+        : m_acceptor(m_io, tcp::endpoint(
+                               boost::asio::ip::address_v4::loopback(), 0)),
+          m_thread(boost::bind(&echo_server::serve, this))
+    {
+    }
+
+    ~echo_server()
+    {
+        m_thread.join();
+    }
+
+    int port() const
+    {
+        return m_acceptor.local_endpoint().port();
+    }
+
+private:
+    void serve()
+    {
+        tcp::socket connection(m_io);
+        m_acceptor.accept(connection);
+
+        vector<char> buffer(4096);
+        error_code ec;
+        for (;;)
+        {
+            size_t count =
+                connection.read_some(boost::asio::buffer(buffer), ec);
+            if (ec)
+                break;
+
+            boost::asio::write(connection,
+                               boost::asio::buffer(&buffer[0], count), ec);
+            if (ec)
+                break;
+        }
+
+        connection.shutdown(tcp::socket::shutdown_send, ec);
+    }
+
+    io_service m_io;
+    tcp::acceptor m_acceptor;
+    thread m_thread;
+};
+
+class proxy_fixture
+{
+public:
+    tcp::socket& connect_through(const shaping_proxy& proxy)
+    {
+        m_socket.reset(new tcp::socket(m_io));
+
+        tcp::resolver resolver(m_io);
+        tcp::resolver::query query(
+            proxy.host(), boost::lexical_cast<string>(proxy.port()));
+        m_socket->connect(*resolver.resolve(query));
+
+        return *m_socket;
+    }
+
+    string round_trip(tcp::socket& socket, const string& message)
+    {
+        boost::asio::write(socket, boost::asio::buffer(message));
+
+        string reply(message.size(), '\0');
+        boost::asio::read(socket,
+                          boost::asio::buffer(&reply[0], reply.size()));
+        return reply;
+    }
+
+    void close(tcp::socket& socket)
+    {
+        socket.shutdown(tcp::socket::shutdown_send);
+
+        // Wait for the echo server to finish
+        char remainder;
+        error_code ec;
+        socket.read_some(boost::asio::buffer(&remainder, 1), ec);
+        BOOST_CHECK(ec == boost::asio::error::eof);
+    }
+
+private:
+    io_service m_io;
+    std::auto_ptr<tcp::socket> m_socket;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(shaping_proxy_tests, proxy_fixture)
+
+BOOST_AUTO_TEST_CASE(forwards_both_ways)
+{
+    echo_server server;
+    shaping_proxy proxy("127.0.0.1", server.port(), link_conditions());
+
+    tcp::socket& socket = connect_through(proxy);
+
+    BOOST_CHECK_EQUAL(round_trip(socket, "hello"), "hello");
+    BOOST_CHECK_EQUAL(round_trip(socket, "again"), "again");
+
+    close(socket);
+}
+
+BOOST_AUTO_TEST_CASE(delays_round_trip)
+{
+    echo_server server;
+    shaping_proxy proxy(
+        "127.0.0.1", server.port(),
+        link_conditions::with_round_trip_time(milliseconds(100)));
+
+    tcp::socket& socket = connect_through(proxy);
+
+    steady_clock::time_point start = steady_clock::now();
+    BOOST_CHECK_EQUAL(round_trip(socket, "ping"), "ping");
+    BOOST_CHECK(steady_clock::now() - start >= milliseconds(100));
+
+    close(socket);
+}
+
+BOOST_AUTO_TEST_CASE(jitter_keeps_order)
+{
+    echo_server server;
+    link_conditions conditions;
+    conditions.latency = milliseconds(5);
+    conditions.jitter = milliseconds(20);
+    shaping_proxy proxy("127.0.0.1", server.port(), conditions);
+
+    tcp::socket& socket = connect_through(proxy);
+
+    string message;
+    for (int i = 0; i < 50; ++i)
+    {
+        string part = boost::lexical_cast<string>(i) + ",";
+        boost::asio::write(socket, boost::asio::buffer(part));
+        message += part;
+    }
+
+    string reply(message.size(), '\0');
+    boost::asio::read(socket, boost::asio::buffer(&reply[0], reply.size()));
+    BOOST_CHECK_EQUAL(reply, message);
+
+    close(socket);
+}
+
+BOOST_AUTO_TEST_CASE(limits_bandwidth)
+{
+    echo_server server;
+    link_conditions conditions;
+    conditions.bandwidth = 1024 * 1024;
+    shaping_proxy proxy("127.0.0.1", server.port(), conditions);
+
+    tcp::socket& socket = connect_through(proxy);
+
+    // The echo starts before the upload ends, so the round trip takes as
+    // long as one crossing: a quarter of a second at 1 MB/s
+    string data(256 * 1024, 'x');
+
+    steady_clock::time_point start = steady_clock::now();
+    BOOST_CHECK(round_trip(socket, data) == data);
+    BOOST_CHECK(steady_clock::now() - start >= milliseconds(240));
+
+    close(socket);
+}
+
+BOOST_AUTO_TEST_CASE(stalls)
+{
+    echo_server server;
+    link_conditions conditions;
+    conditions.stall_probability = 1.0;
+    conditions.stall_duration = milliseconds(50);
+    shaping_proxy proxy("127.0.0.1", server.port(), conditions);
+
+    tcp::socket& socket = connect_through(proxy);
+
+    steady_clock::time_point start = steady_clock::now();
+    BOOST_CHECK_EQUAL(round_trip(socket, "ping"), "ping");
+    BOOST_CHECK(steady_clock::now() - start >= milliseconds(100));
+
+    close(socket);
+}
+
+BOOST_AUTO_TEST_CASE(destruction_cuts_connections)
+{
+    echo_server server;
+    tcp::socket* socket;
+    {
+        shaping_proxy proxy("127.0.0.1", server.port(), link_conditions());
+        socket = &connect_through(proxy);
+        BOOST_CHECK_EQUAL(round_trip(*socket, "hello"), "hello");
+    }
+
+    char c;
+    error_code ec;
+    socket->read_some(boost::asio::buffer(&c, 1), ec);
+    BOOST_CHECK(ec);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,365 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Throughput of the SFTP streams.
+ *
+ * Each configuration of direction, stream buffer size and file size is run
+ * several times against the fixture server and the median kept.  After all
+ * benchmarks have run, the results are written as JSON to the file named by
+ * the `SSH_BENCHMARK_RESULTS` environment variable (default
+ * `stream_benchmark.json`).  If `SSH_BENCHMARK_BASELINE` names the results
+ * of an earlier run, each configuration is compared with it and fails if its
+ * throughput fell, or its CPU cost per MB rose, by more than
+ * `SSH_BENCHMARK_TOLERANCE` (default 0.1).
+ *
+ * Baselines are only meaningful on the machine that produced them, so none
+ * is checked in.  Save the results of a run of the old code and pass them as
+ * the baseline to a run of the new.
+ *
+ * Set `SSH_TEST_SERVER=local` to benchmark against a private sshd instead of
+ * the Docker container, which starts faster and varies less between runs.
+ * `SSH_TEST_LATENCY_MS` and `SSH_TEST_BANDWIDTH` benchmark a slower link.
+ *
+ * The hashing streams run at the default buffer size; compare them with the
+ * plain streams' 32K results to see what hashing costs.
+ *
+ * The `native_` benchmarks repeat the plain ones over the native SFTP engine,
+ * which pipelines the requests for buffers larger than one request.
+ */
+
+#include "benchmark.hpp"
+#include "sftp_fixture.hpp"
+
+#include <ssh/filesystem.hpp>
+#include <ssh/hash_algorithm.hpp>
+#include <ssh/hashing_stream.hpp> // test subject
+#include <ssh/sftp_engine.hpp>
+#include <ssh/stream.hpp> // test subject
+
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::hashing_ifstream;
+using ssh::filesystem::hashing_ofstream;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::ofstream;
+using ssh::filesystem::openmode;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_engine;
+using ssh::filesystem::sftp_filesystem;
+using ssh::hash_algorithm;
+
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_timer;
+using test::ssh::median_of;
+using test::ssh::sftp_fixture;
+
+using boost::uint64_t;
+
+using std::ostringstream;
+using std::string;
+using std::streamsize;
+using std::vector;
+
+namespace
+{
+
+const streamsize BUFFER_SIZES[] = {4 * 1024, 32 * 1024, 256 * 1024};
+
+const uint64_t FILE_SIZES[] = {64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+
+const BOOST_SCOPED_ENUM(hash_algorithm) HASH_ALGORITHMS[] = {
+    hash_algorithm::sha256, hash_algorithm::xxh64, hash_algorithm::xxh3};
+
+const int RUNS_PER_CONFIGURATION = 3;
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+string benchmark_name(const string& direction, streamsize buffer_size,
+                      uint64_t file_size)
+{
+    ostringstream name;
+    name << direction << "/buffer=" << buffer_size << "/file=" << file_size;
+    return name.str();
+}
+
+string algorithm_name(BOOST_SCOPED_ENUM(hash_algorithm) algorithm)
+{
+    switch (algorithm)
+    {
+    case hash_algorithm::sha256:
+        return "sha256";
+    case hash_algorithm::xxh64:
+        return "xxh64";
+    case hash_algorithm::xxh3:
+        return "xxh3";
+    default:
+        return "other";
+    }
+}
+
+string hashed_benchmark_name(const string& direction,
+                             BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                             uint64_t file_size)
+{
+    ostringstream name;
+    name << direction << "/" << algorithm_name(algorithm)
+         << "/file=" << file_size;
+    return name.str();
+}
+
+string data_of_size(uint64_t size)
+{
+    string data;
+    data.reserve(static_cast<string::size_type>(size));
+    for (uint64_t i = 0; i < size; ++i)
+    {
+        // Not all the same byte, in case anything along the way compresses
+        data.push_back(static_cast<char>((i * 7) % 251));
+    }
+    return data;
+}
+
+class stream_benchmark_fixture : public sftp_fixture
+{
+public:
+    stream_benchmark_fixture()
+        : m_native_filesystem(
+              test_session().connect_to_filesystem(sftp_engine::native))
+    {
+    }
+
+    sftp_filesystem& native_filesystem()
+    {
+        return m_native_filesystem;
+    }
+
+    benchmark_result write_file(sftp_filesystem& fs, const string& name,
+                                const string& data, streamsize buffer_size)
+    {
+        path target = new_file_in_sandbox();
+
+        benchmark_timer timer;
+        {
+            ofstream stream(fs, target, openmode::out, buffer_size);
+            stream.write(data.data(), data.size());
+            BOOST_REQUIRE(stream);
+        }
+        benchmark_result result = timer.finish(name, data.size());
+
+        remove(filesystem(), target);
+
+        return result;
+    }
+
+    benchmark_result read_file(sftp_filesystem& fs, const string& name,
+                               const path& source, uint64_t size,
+                               streamsize buffer_size)
+    {
+        vector<char> buffer(static_cast<vector<char>::size_type>(size));
+
+        benchmark_timer timer;
+        {
+            ifstream stream(fs, source, openmode::in, buffer_size);
+            stream.read(&buffer[0], buffer.size());
+            BOOST_REQUIRE_EQUAL(stream.gcount(),
+                                static_cast<streamsize>(buffer.size()));
+        }
+        return timer.finish(name, size);
+    }
+
+    benchmark_result write_hashed_file(const string& name, const string& data,
+                                       BOOST_SCOPED_ENUM(hash_algorithm)
+                                           algorithm)
+    {
+        path target = new_file_in_sandbox();
+
+        benchmark_timer timer;
+        {
+            hashing_ofstream stream(filesystem(), target, algorithm);
+            stream.write(data.data(), data.size());
+            BOOST_REQUIRE(!stream.digest().empty());
+        }
+        benchmark_result result = timer.finish(name, data.size());
+
+        remove(filesystem(), target);
+
+        return result;
+    }
+
+    benchmark_result read_hashed_file(const string& name, const path& source,
+                                      uint64_t size,
+                                      BOOST_SCOPED_ENUM(hash_algorithm)
+                                          algorithm)
+    {
+        vector<char> buffer(static_cast<vector<char>::size_type>(size));
+
+        benchmark_timer timer;
+        {
+            hashing_ifstream stream(filesystem(), source, algorithm);
+            stream.read(&buffer[0], buffer.size());
+            BOOST_REQUIRE_EQUAL(stream.gcount(),
+                                static_cast<streamsize>(buffer.size()));
+            BOOST_REQUIRE(!stream.digest().empty());
+        }
+        return timer.finish(name, size);
+    }
+
+    void benchmark_writes(sftp_filesystem& fs, const string& direction)
+    {
+        BOOST_FOREACH (uint64_t file_size, FILE_SIZES)
+        {
+            string data = data_of_size(file_size);
+
+            BOOST_FOREACH (streamsize buffer_size, BUFFER_SIZES)
+            {
+                string name = benchmark_name(direction, buffer_size, file_size);
+
+                vector<benchmark_result> runs;
+                for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+                {
+                    runs.push_back(write_file(fs, name, data, buffer_size));
+                }
+
+                results().add(median_of(runs));
+            }
+        }
+    }
+
+    void benchmark_reads(sftp_filesystem& fs, const string& direction)
+    {
+        BOOST_FOREACH (uint64_t file_size, FILE_SIZES)
+        {
+            path source =
+                new_file_in_sandbox_containing_data(data_of_size(file_size));
+
+            BOOST_FOREACH (streamsize buffer_size, BUFFER_SIZES)
+            {
+                string name = benchmark_name(direction, buffer_size, file_size);
+
+                vector<benchmark_result> runs;
+                for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+                {
+                    runs.push_back(
+                        read_file(fs, name, source, file_size, buffer_size));
+                }
+
+                results().add(median_of(runs));
+            }
+
+            remove(filesystem(), source);
+        }
+    }
+
+private:
+    sftp_filesystem m_native_filesystem;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(stream_benchmarks, stream_benchmark_fixture)
+
+BOOST_AUTO_TEST_CASE(sequential_write)
+{
+    benchmark_writes(filesystem(), "write");
+}
+
+BOOST_AUTO_TEST_CASE(sequential_read)
+{
+    benchmark_reads(filesystem(), "read");
+}
+
+BOOST_AUTO_TEST_CASE(native_sequential_write)
+{
+    benchmark_writes(native_filesystem(), "native_write");
+}
+
+BOOST_AUTO_TEST_CASE(native_sequential_read)
+{
+    benchmark_reads(native_filesystem(), "native_read");
+}
+
+BOOST_AUTO_TEST_CASE(hashed_write)
+{
+    BOOST_FOREACH (uint64_t file_size, FILE_SIZES)
+    {
+        string data = data_of_size(file_size);
+
+        BOOST_FOREACH (BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                       HASH_ALGORITHMS)
+        {
+            string name =
+                hashed_benchmark_name("hashed_write", algorithm, file_size);
+
+            vector<benchmark_result> runs;
+            for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+            {
+                runs.push_back(write_hashed_file(name, data, algorithm));
+            }
+
+            results().add(median_of(runs));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(hashed_read)
+{
+    BOOST_FOREACH (uint64_t file_size, FILE_SIZES)
+    {
+        path source =
+            new_file_in_sandbox_containing_data(data_of_size(file_size));
+
+        BOOST_FOREACH (BOOST_SCOPED_ENUM(hash_algorithm) algorithm,
+                       HASH_ALGORITHMS)
+        {
+            string name =
+                hashed_benchmark_name("hashed_read", algorithm, file_size);
+
+            vector<benchmark_result> runs;
+            for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+            {
+                runs.push_back(
+                    read_hashed_file(name, source, file_size, algorithm));
+            }
+
+            results().add(median_of(runs));
+        }
+
+        remove(filesystem(), source);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(stream_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(results(),
+                                              "stream_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
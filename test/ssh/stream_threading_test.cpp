@@ -15,6 +15,7 @@
 
 #include "sftp_fixture.hpp"
 
+#include <ssh/lock_statistics.hpp>
 #include <ssh/stream.hpp> // test subject
 
 #include <boost/bind/bind.hpp>
@@ -28,6 +29,8 @@ using ssh::filesystem::ifstream;
 using ssh::filesystem::fstream;
 using ssh::filesystem::path;
 using ssh::filesystem::sftp_filesystem;
+using ssh::lock_operation_statistics;
+using ssh::lock_statistics;
 
 using boost::bind;
 using boost::packaged_task;
@@ -117,4 +120,47 @@ BOOST_AUTO_TEST_CASE(parallel_file_closing)
     BOOST_CHECK_EQUAL(ps.get_future().get(), data);
 }
 
+BOOST_AUTO_TEST_CASE(lock_statistics_of_parallel_reads)
+{
+    path target1 = new_file_in_sandbox_containing_data(large_data());
+    path target2 = new_file_in_sandbox_containing_data(large_data());
+
+    test_session().record_lock_statistics(true);
+
+    {
+        ifstream s1(filesystem(), target1);
+        ifstream s2(filesystem(), target2);
+
+        packaged_task<string> p1(boost::bind(get_first_token, boost::ref(s1)));
+        packaged_task<string> p2(boost::bind(get_first_token, boost::ref(s2)));
+
+        thread(boost::ref(p1)).detach();
+        thread(boost::ref(p2)).detach();
+
+        p1.get_future().get();
+        p2.get_future().get();
+    }
+
+    test_session().record_lock_statistics(false);
+
+    lock_statistics statistics = test_session().lock_statistics();
+
+    BOOST_REQUIRE(statistics.operations().count("sftp_open"));
+    BOOST_CHECK_EQUAL(
+        statistics.operations().find("sftp_open")->second.acquisitions, 2U);
+
+    BOOST_REQUIRE(statistics.operations().count("sftp_read"));
+    const lock_operation_statistics& reads =
+        statistics.operations().find("sftp_read")->second;
+    BOOST_CHECK_GT(reads.acquisitions, 2U);
+    BOOST_CHECK_EQUAL(reads.hold.count(), reads.acquisitions);
+    BOOST_CHECK(reads.hold.total() > boost::chrono::nanoseconds(0));
+
+    BOOST_CHECK_EQUAL(statistics.totals().acquisitions,
+                      statistics.totals().hold.count());
+
+    test_session().reset_lock_statistics();
+    BOOST_CHECK(test_session().lock_statistics().operations().empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,282 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/tar.hpp> // test subject
+
+#include <boost/test/unit_test.hpp>
+
+#include <cstdio>  // sprintf
+#include <cstring> // memcpy, memset
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using ssh::detail::TAR_BLOCK_SIZE;
+using ssh::detail::tar_directory;
+using ssh::detail::tar_entry;
+using ssh::detail::tar_reader;
+using ssh::detail::tar_regular_file;
+using ssh::detail::tar_writer;
+
+using std::istringstream;
+using std::ostringstream;
+using std::string;
+
+namespace
+{
+
+tar_entry file_entry(const string& name, const string& content)
+{
+    tar_entry entry;
+    entry.name = name;
+    entry.type = tar_regular_file;
+    entry.size = content.size();
+    entry.mode = 0640;
+    entry.mtime = 1234567890;
+    return entry;
+}
+
+tar_entry directory_entry(const string& name)
+{
+    tar_entry entry;
+    entry.name = name;
+    entry.type = tar_directory;
+    entry.mode = 0755;
+    return entry;
+}
+
+void add_file(tar_writer& writer, const string& name, const string& content)
+{
+    writer.begin_entry(file_entry(name, content));
+    writer.write(content.data(), content.size());
+    writer.end_entry();
+}
+
+string read_content(tar_reader& reader)
+{
+    string content;
+    char buffer[100];
+    std::size_t count;
+    while ((count = reader.read(buffer, sizeof(buffer))) > 0)
+    {
+        content.append(buffer, count);
+    }
+    return content;
+}
+
+/**
+ * Header block as GNU tar writes it, with its checksum filled in.
+ */
+string gnu_header(const string& name, char type, const string& octal_size)
+{
+    char header[TAR_BLOCK_SIZE] = {};
+    std::memcpy(header, name.data(), name.size());
+    std::memcpy(header + 100, "0000644", 7);
+    std::memcpy(header + 124, octal_size.data(), octal_size.size());
+    std::memcpy(header + 136, "00000000000", 11);
+    header[156] = type;
+    std::memcpy(header + 257, "ustar  ", 8);
+
+    unsigned int sum = 0;
+    std::memset(header + 148, ' ', 8);
+    for (std::size_t i = 0; i < TAR_BLOCK_SIZE; ++i)
+    {
+        sum += static_cast<unsigned char>(header[i]);
+    }
+    std::sprintf(header + 148, "%06o", sum);
+
+    return string(header, TAR_BLOCK_SIZE);
+}
+
+string padded(const string& content)
+{
+    string block = content;
+    block.resize((content.size() + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE *
+                 TAR_BLOCK_SIZE);
+    return block;
+}
+}
+
+BOOST_AUTO_TEST_SUITE(tar_tests)
+
+BOOST_AUTO_TEST_CASE(empty_archive)
+{
+    ostringstream archive;
+    tar_writer writer(archive);
+    writer.finish();
+
+    BOOST_CHECK_EQUAL(archive.str(), string(2 * TAR_BLOCK_SIZE, '\0'));
+
+    istringstream input(archive.str());
+    tar_reader reader(input);
+    tar_entry entry;
+    BOOST_CHECK(!reader.next_entry(entry));
+}
+
+BOOST_AUTO_TEST_CASE(round_trip)
+{
+    ostringstream archive;
+    {
+        tar_writer writer(archive);
+        writer.begin_entry(directory_entry("dir"));
+        writer.end_entry();
+        add_file(writer, "dir/humpty.txt", "humpty dumpty");
+        add_file(writer, "empty", "");
+        add_file(writer, "big", string(3 * TAR_BLOCK_SIZE + 1, 'b'));
+        writer.finish();
+    }
+
+    BOOST_CHECK_EQUAL(archive.str().size() % TAR_BLOCK_SIZE, 0U);
+
+    istringstream input(archive.str());
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "dir/");
+    BOOST_CHECK_EQUAL(entry.type, tar_directory);
+    BOOST_CHECK_EQUAL(entry.mode, 0755U);
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "dir/humpty.txt");
+    BOOST_CHECK_EQUAL(entry.type, tar_regular_file);
+    BOOST_CHECK_EQUAL(entry.mode, 0640U);
+    BOOST_CHECK_EQUAL(entry.mtime, 1234567890);
+    BOOST_CHECK_EQUAL(read_content(reader), "humpty dumpty");
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "empty");
+    BOOST_CHECK_EQUAL(read_content(reader), "");
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "big");
+    BOOST_CHECK_EQUAL(read_content(reader),
+                      string(3 * TAR_BLOCK_SIZE + 1, 'b'));
+
+    BOOST_CHECK(!reader.next_entry(entry));
+}
+
+BOOST_AUTO_TEST_CASE(unread_content_is_skipped)
+{
+    ostringstream archive;
+    {
+        tar_writer writer(archive);
+        add_file(writer, "first", string(1000, 'x'));
+        add_file(writer, "second", "sat on a wall");
+        writer.finish();
+    }
+
+    istringstream input(archive.str());
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    char partial[10];
+    reader.read(partial, sizeof(partial));
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "second");
+    BOOST_CHECK_EQUAL(read_content(reader), "sat on a wall");
+}
+
+BOOST_AUTO_TEST_CASE(long_name)
+{
+    string name = string(150, 'd') + "/" + string(120, 'f');
+
+    ostringstream archive;
+    {
+        tar_writer writer(archive);
+        add_file(writer, name, "long");
+        writer.finish();
+    }
+
+    istringstream input(archive.str());
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, name);
+    BOOST_CHECK_EQUAL(read_content(reader), "long");
+    BOOST_CHECK(!reader.next_entry(entry));
+}
+
+BOOST_AUTO_TEST_CASE(gnu_long_name)
+{
+    string name = string(200, 'g');
+
+    string archive = gnu_header("././@LongLink", 'L', "00000000311") +
+                     padded(name + '\0') +
+                     gnu_header(name.substr(0, 100), '0', "00000000003") +
+                     padded("abc") + string(2 * TAR_BLOCK_SIZE, '\0');
+
+    istringstream input(archive);
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, name);
+    BOOST_CHECK_EQUAL(read_content(reader), "abc");
+}
+
+BOOST_AUTO_TEST_CASE(other_entry_types_are_skipped)
+{
+    string archive = gnu_header("link", '2', "00000000000") +
+                     gnu_header("file", '0', "00000000003") + padded("abc") +
+                     string(2 * TAR_BLOCK_SIZE, '\0');
+
+    istringstream input(archive);
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_EQUAL(entry.name, "file");
+}
+
+BOOST_AUTO_TEST_CASE(bad_checksum)
+{
+    string header = gnu_header("file", '0', "00000000003");
+    header[0] = 'F';
+
+    istringstream input(header + padded("abc"));
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_CHECK_THROW(reader.next_entry(entry), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(truncated_content)
+{
+    string archive = gnu_header("file", '0', "00000001000") + "abc";
+
+    istringstream input(archive);
+    tar_reader reader(input);
+    tar_entry entry;
+
+    BOOST_REQUIRE(reader.next_entry(entry));
+    BOOST_CHECK_THROW(read_content(reader), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(content_must_match_size)
+{
+    ostringstream archive;
+    tar_writer writer(archive);
+
+    writer.begin_entry(file_entry("file", "abc"));
+    BOOST_CHECK_THROW(writer.write("abcd", 4), std::logic_error);
+    writer.write("ab", 2);
+    BOOST_CHECK_THROW(writer.end_entry(), std::logic_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,294 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/trace.hpp> // test subject
+
+#include <boost/foreach.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/system/error_code.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <cstring> // strlen
+#include <sstream>
+#include <stdexcept> // runtime_error
+#include <string>
+#include <vector>
+
+using ssh::chrome_trace_exporter;
+using ssh::current_tracer;
+using ssh::detail::traced_call;
+using ssh::set_tracer;
+using ssh::trace_span;
+using ssh::tracer;
+
+using boost::make_shared;
+using boost::property_tree::ptree;
+using boost::shared_ptr;
+using boost::system::error_code;
+
+using std::string;
+using std::stringstream;
+using std::vector;
+
+namespace
+{
+
+class recording_tracer : public tracer
+{
+public:
+    virtual void begin_span(const trace_span& span)
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+        begun.push_back(span);
+    }
+
+    virtual void end_span(const trace_span& span)
+    {
+        boost::lock_guard<boost::mutex> guard(m_guard);
+        ended.push_back(span);
+    }
+
+    vector<trace_span> begun;
+    vector<trace_span> ended;
+
+private:
+    boost::mutex m_guard;
+};
+
+class throwing_tracer : public tracer
+{
+public:
+    virtual void begin_span(const trace_span&)
+    {
+        throw std::runtime_error("begin");
+    }
+
+    virtual void end_span(const trace_span&)
+    {
+        throw std::runtime_error("end");
+    }
+};
+
+/**
+ * Removes any tracer a test installs.
+ */
+struct tracer_fixture
+{
+    ~tracer_fixture()
+    {
+        set_tracer(shared_ptr<tracer>());
+    }
+};
+
+ptree parse_json(const chrome_trace_exporter& exporter)
+{
+    stringstream stream;
+    exporter.write(stream);
+
+    ptree tree;
+    boost::property_tree::read_json(stream, tree);
+    return tree;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(trace_tests, tracer_fixture)
+
+BOOST_AUTO_TEST_CASE(no_tracer_by_default)
+{
+    BOOST_CHECK(!current_tracer());
+
+    // Nothing to observe except that this does not crash
+    traced_call trace("operation");
+    trace.transferred(10);
+}
+
+BOOST_AUTO_TEST_CASE(span_reported)
+{
+    shared_ptr<recording_tracer> recorder = make_shared<recording_tracer>();
+    set_tracer(recorder);
+
+    const char* path = "/tmp/some file";
+    {
+        error_code ec;
+        traced_call trace("libssh2_sftp_open_ex", ec, path,
+                          std::strlen(path));
+
+        BOOST_REQUIRE_EQUAL(recorder->begun.size(), 1U);
+        BOOST_CHECK(recorder->ended.empty());
+
+        trace.transferred(7);
+        trace.transferred(-1);
+        trace.transferred(8);
+    }
+
+    BOOST_REQUIRE_EQUAL(recorder->ended.size(), 1U);
+
+    const trace_span& span = recorder->ended[0];
+    BOOST_CHECK_EQUAL(span.operation, string("libssh2_sftp_open_ex"));
+    BOOST_CHECK_EQUAL(span.path, path);
+    BOOST_CHECK_EQUAL(span.bytes, 15U);
+    BOOST_CHECK(!span.error);
+    BOOST_CHECK(span.end >= span.start);
+    BOOST_CHECK_EQUAL(span.id, recorder->begun[0].id);
+}
+
+BOOST_AUTO_TEST_CASE(error_reported)
+{
+    shared_ptr<recording_tracer> recorder = make_shared<recording_tracer>();
+    set_tracer(recorder);
+
+    {
+        error_code ec;
+        traced_call trace("libssh2_sftp_stat_ex", ec);
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::no_such_file_or_directory);
+    }
+
+    {
+        traced_call trace("authenticate_by_key_files");
+        trace.fail(boost::system::errc::make_error_code(
+            boost::system::errc::permission_denied));
+    }
+
+    BOOST_REQUIRE_EQUAL(recorder->ended.size(), 2U);
+    BOOST_CHECK(recorder->ended[0].error ==
+                boost::system::errc::no_such_file_or_directory);
+    BOOST_CHECK(recorder->ended[1].error ==
+                boost::system::errc::permission_denied);
+}
+
+BOOST_AUTO_TEST_CASE(spans_nest)
+{
+    shared_ptr<recording_tracer> recorder = make_shared<recording_tracer>();
+    set_tracer(recorder);
+
+    {
+        traced_call outer("outer");
+        {
+            traced_call inner("inner");
+        }
+    }
+
+    BOOST_REQUIRE_EQUAL(recorder->begun.size(), 2U);
+    BOOST_REQUIRE_EQUAL(recorder->ended.size(), 2U);
+    BOOST_CHECK_EQUAL(recorder->begun[0].operation, string("outer"));
+    BOOST_CHECK_EQUAL(recorder->ended[0].operation, string("inner"));
+    BOOST_CHECK_NE(recorder->ended[0].id, recorder->ended[1].id);
+    BOOST_CHECK(recorder->ended[1].start <= recorder->ended[0].start);
+    BOOST_CHECK(recorder->ended[1].end >= recorder->ended[0].end);
+}
+
+BOOST_AUTO_TEST_CASE(tracer_exceptions_discarded)
+{
+    set_tracer(make_shared<throwing_tracer>());
+
+    BOOST_CHECK_NO_THROW(traced_call trace("operation"));
+}
+
+BOOST_AUTO_TEST_CASE(removing_tracer_stops_spans)
+{
+    shared_ptr<recording_tracer> recorder = make_shared<recording_tracer>();
+    set_tracer(recorder);
+    set_tracer(shared_ptr<tracer>());
+
+    {
+        traced_call trace("operation");
+    }
+
+    BOOST_CHECK(recorder->begun.empty());
+    BOOST_CHECK(recorder->ended.empty());
+}
+
+BOOST_AUTO_TEST_CASE(span_ends_on_tracer_that_began_it)
+{
+    shared_ptr<recording_tracer> first = make_shared<recording_tracer>();
+    shared_ptr<recording_tracer> second = make_shared<recording_tracer>();
+    set_tracer(first);
+
+    {
+        traced_call trace("operation");
+        set_tracer(second);
+    }
+
+    BOOST_CHECK_EQUAL(first->ended.size(), 1U);
+    BOOST_CHECK(second->ended.empty());
+}
+
+BOOST_AUTO_TEST_CASE(chrome_trace_events)
+{
+    shared_ptr<chrome_trace_exporter> exporter =
+        make_shared<chrome_trace_exporter>();
+    set_tracer(exporter);
+
+    const char* path = "/odd \"name\"\\\n";
+    {
+        error_code ec;
+        traced_call trace("libssh2_sftp_read", ec, path, std::strlen(path));
+        trace.transferred(42);
+        ec = boost::system::errc::make_error_code(
+            boost::system::errc::io_error);
+    }
+    {
+        traced_call trace("libssh2_sftp_write");
+    }
+
+    BOOST_CHECK_EQUAL(exporter->size(), 2U);
+
+    ptree tree = parse_json(*exporter);
+    vector<ptree> events;
+    BOOST_FOREACH (const ptree::value_type& event,
+                   tree.get_child("traceEvents"))
+    {
+        events.push_back(event.second);
+    }
+
+    BOOST_REQUIRE_EQUAL(events.size(), 2U);
+
+    BOOST_CHECK_EQUAL(events[0].get<string>("name"), "libssh2_sftp_read");
+    BOOST_CHECK_EQUAL(events[0].get<string>("ph"), "X");
+    BOOST_CHECK_EQUAL(events[0].get<int>("tid"), 1);
+    BOOST_CHECK(events[0].get<long>("ts") >= 0);
+    BOOST_CHECK(events[0].get<long>("dur") >= 0);
+    BOOST_CHECK_EQUAL(events[0].get<int>("args.bytes"), 42);
+    BOOST_CHECK_EQUAL(events[0].get<string>("args.path"), path);
+    BOOST_CHECK_EQUAL(events[0].get<int>("args.error_code"),
+                      static_cast<int>(boost::system::errc::io_error));
+
+    BOOST_CHECK_EQUAL(events[1].get<string>("name"), "libssh2_sftp_write");
+    BOOST_CHECK(!events[1].get_optional<string>("args.path"));
+    BOOST_CHECK(!events[1].get_optional<string>("args.error"));
+}
+
+BOOST_AUTO_TEST_CASE(chrome_trace_clear)
+{
+    shared_ptr<chrome_trace_exporter> exporter =
+        make_shared<chrome_trace_exporter>();
+    set_tracer(exporter);
+
+    {
+        traced_call trace("operation");
+    }
+    exporter->clear();
+
+    BOOST_CHECK_EQUAL(exporter->size(), 0U);
+    BOOST_CHECK(parse_json(*exporter).get_child("traceEvents").empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END();
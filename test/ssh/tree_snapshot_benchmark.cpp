@@ -0,0 +1,209 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * Speed of listing large remote trees with `find` compared to walking them
+ * over SFTP.
+ *
+ * Trees of 1k, 10k, 100k and 1M empty files, in directories of 100 files
+ * each, are made on the fixture server and each listed several times by both
+ * methods, keeping the median.  Each result records the time until the
+ * first entry arrived, the total time, entries per second and the peak
+ * memory and allocations per entry.
+ *
+ * Only trees of up to 10k files are listed unless
+ * `SSH_BENCHMARK_MAX_ENTRIES` allows more; set it to 1000000 for the full
+ * run, which takes a long time to make its files.  The results are saved
+ * and compared with a baseline as in the other benchmarks, with the file
+ * defaulting to `tree_snapshot_benchmark.json`.
+ */
+
+#include "benchmark.hpp"
+#include "sftp_fixture.hpp"
+
+#include <ssh/exec_channel.hpp>
+#include <ssh/tree_snapshot.hpp> // test subject
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using ssh::exec_channel;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_file;
+using ssh::shell_quote;
+using ssh::tree_snapshot_method;
+using ssh::walk_tree;
+
+using test::ssh::benchmark_report;
+using test::ssh::benchmark_result;
+using test::ssh::benchmark_setting;
+using test::ssh::benchmark_timer;
+using test::ssh::median_of;
+using test::ssh::sftp_fixture;
+
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace
+{
+
+const unsigned long ENTRY_COUNTS[] = {1000, 10000, 100000, 1000000};
+
+const unsigned long FILES_PER_DIRECTORY = 100;
+
+const int RUNS_PER_CONFIGURATION = 3;
+
+benchmark_report& results()
+{
+    static benchmark_report report;
+    return report;
+}
+
+unsigned long maximum_entries()
+{
+    return boost::lexical_cast<unsigned long>(
+        benchmark_setting("SSH_BENCHMARK_MAX_ENTRIES", "10000"));
+}
+
+string benchmark_name(const string& method, unsigned long file_count)
+{
+    ostringstream name;
+    name << "snapshot/method=" << method << "/files=" << file_count;
+    return name.str();
+}
+
+struct entry_counter
+{
+    entry_counter(benchmark_timer& timer) : timer(timer), count(0)
+    {
+    }
+
+    benchmark_timer& timer;
+    unsigned long count;
+};
+
+void count_entry(entry_counter& counter, const sftp_file&)
+{
+    ++counter.count;
+    counter.timer.first_item();
+}
+
+class tree_snapshot_benchmark_fixture : public sftp_fixture
+{
+public:
+    /**
+     * Make a tree of `file_count` files on the server.
+     *
+     * Runs as a single command so that trees of a million files can be made
+     * in reasonable time.
+     */
+    path tree_of_size(unsigned long file_count)
+    {
+        path root =
+            sandbox() / ("tree-" + boost::lexical_cast<string>(file_count));
+        unsigned long directory_count = file_count / FILES_PER_DIRECTORY;
+
+        ostringstream script;
+        script << "mkdir -p " << shell_quote(root.string()) << " && cd "
+               << shell_quote(root.string()) << " && seq -f 'd%06.0f' 1 "
+               << directory_count << " | xargs mkdir && for d in d*; do "
+               << "(cd $d && seq -f 'entry%07.0f' 1 " << FILES_PER_DIRECTORY
+               << " | xargs touch) || exit 1; done";
+
+        exec_channel channel = test_session().exec(script.str());
+        BOOST_REQUIRE_EQUAL(channel.exit_status(), 0);
+
+        return root;
+    }
+
+    benchmark_result list_tree(const string& name, const path& root,
+                               BOOST_SCOPED_ENUM(tree_snapshot_method) method,
+                               unsigned long entry_count)
+    {
+        benchmark_timer timer;
+        entry_counter counter(timer);
+        walk_tree(test_session(), filesystem(), root,
+                  boost::bind(count_entry, boost::ref(counter), _1), method);
+        benchmark_result result = timer.finish(name, 0, counter.count);
+
+        BOOST_REQUIRE_EQUAL(counter.count, entry_count);
+
+        return result;
+    }
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(tree_snapshot_benchmarks,
+                         tree_snapshot_benchmark_fixture)
+
+BOOST_AUTO_TEST_CASE(find_and_sftp)
+{
+    BOOST_FOREACH (unsigned long file_count, ENTRY_COUNTS)
+    {
+        if (file_count > maximum_entries())
+            continue;
+
+        path root = tree_of_size(file_count);
+
+        // Both the directories and the files are listed
+        unsigned long entry_count =
+            file_count + file_count / FILES_PER_DIRECTORY;
+
+        const BOOST_SCOPED_ENUM(tree_snapshot_method) methods[] = {
+            tree_snapshot_method::find, tree_snapshot_method::sftp};
+        const char* method_names[] = {"find", "sftp"};
+
+        for (int m = 0; m < 2; ++m)
+        {
+            string name = benchmark_name(method_names[m], file_count);
+
+            vector<benchmark_result> runs;
+            for (int i = 0; i < RUNS_PER_CONFIGURATION; ++i)
+            {
+                runs.push_back(list_tree(name, root, methods[m], entry_count));
+            }
+
+            benchmark_result result = median_of(runs);
+            BOOST_TEST_MESSAGE(name << ": first entry after "
+                                    << result.first_item_seconds << "s, "
+                                    << result.items_per_second()
+                                    << " entries/s, "
+                                    << result.peak_bytes_per_item()
+                                    << " peak bytes/entry");
+            results().add(result);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+// Must come after the benchmarks, which run in the order they are declared
+BOOST_AUTO_TEST_SUITE(tree_snapshot_benchmark_report)
+
+BOOST_AUTO_TEST_CASE(save_and_compare_with_baseline)
+{
+    test::ssh::save_and_compare_with_baseline(results(),
+                                              "tree_snapshot_benchmark.json");
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,182 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/tree_snapshot.hpp> // test subject
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm> // sort
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using ssh::filesystem::file_attributes;
+using ssh::filesystem::path;
+using ssh::filesystem::sftp_file;
+using ssh::snapshot_tree;
+using ssh::tree_snapshot_method;
+
+using test::ssh::sftp_fixture;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+class tree_snapshot_fixture : public sftp_fixture
+{
+public:
+    /**
+     * Tree of nested and empty directories, files and a link to a
+     * directory.
+     */
+    path make_tree()
+    {
+        path root = sandbox() / "tree";
+        create_directory(filesystem(), root);
+        create_directory(filesystem(), root / "a");
+        create_directory(filesystem(), root / "a" / "b");
+        create_directory(filesystem(), root / "empty-directory");
+        new_file_in_sandbox_containing_data("tree/top.txt", "humpty dumpty");
+        new_file_in_sandbox_containing_data("tree/a/b/deep.txt",
+                                            "sat on a wall");
+        create_symlink(root / "link", root / "a");
+        return root;
+    }
+
+    vector<sftp_file> sorted_snapshot(const path& root,
+                                      BOOST_SCOPED_ENUM(tree_snapshot_method)
+                                          method)
+    {
+        vector<sftp_file> entries =
+            snapshot_tree(test_session(), filesystem(), root, method);
+        std::sort(entries.begin(), entries.end());
+        return entries;
+    }
+};
+
+vector<string> paths_of(const vector<sftp_file>& entries)
+{
+    vector<string> paths;
+    BOOST_FOREACH (const sftp_file& entry, entries)
+    {
+        paths.push_back(entry.path().string());
+    }
+    return paths;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(tree_snapshot_tests, tree_snapshot_fixture)
+
+BOOST_AUTO_TEST_CASE(snapshot_by_find)
+{
+    path root = make_tree();
+
+    vector<sftp_file> entries =
+        sorted_snapshot(root, tree_snapshot_method::find);
+
+    vector<string> expected;
+    expected.push_back((root / "a").string());
+    expected.push_back((root / "a" / "b").string());
+    expected.push_back((root / "a" / "b" / "deep.txt").string());
+    expected.push_back((root / "empty-directory").string());
+    expected.push_back((root / "link").string());
+    expected.push_back((root / "top.txt").string());
+
+    vector<string> paths = paths_of(entries);
+    BOOST_CHECK_EQUAL_COLLECTIONS(paths.begin(), paths.end(), expected.begin(),
+                                  expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(find_matches_sftp)
+{
+    path root = make_tree();
+
+    vector<sftp_file> by_find =
+        sorted_snapshot(root, tree_snapshot_method::find);
+    vector<sftp_file> by_sftp =
+        sorted_snapshot(root, tree_snapshot_method::sftp);
+
+    BOOST_REQUIRE_EQUAL(by_find.size(), by_sftp.size());
+    for (vector<sftp_file>::size_type i = 0; i < by_find.size(); ++i)
+    {
+        const file_attributes& found = by_find[i].attributes();
+        const file_attributes& listed = by_sftp[i].attributes();
+
+        BOOST_CHECK_EQUAL(by_find[i].path(), by_sftp[i].path());
+        BOOST_CHECK_EQUAL(found.type(), listed.type());
+        BOOST_CHECK_EQUAL(*found.permissions(), *listed.permissions());
+        BOOST_CHECK_EQUAL(*found.uid(), *listed.uid());
+        BOOST_CHECK_EQUAL(*found.gid(), *listed.gid());
+        BOOST_CHECK_EQUAL(*found.last_modified(), *listed.last_modified());
+
+        if (found.type() == file_attributes::normal_file)
+        {
+            BOOST_CHECK_EQUAL(*found.size(), *listed.size());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(links_are_not_followed)
+{
+    path root = make_tree();
+
+    vector<sftp_file> entries =
+        sorted_snapshot(root, tree_snapshot_method::find);
+    BOOST_FOREACH (const sftp_file& entry, entries)
+    {
+        if (entry.path() == root / "link")
+        {
+            BOOST_CHECK_EQUAL(entry.attributes().type(),
+                              file_attributes::symbolic_link);
+        }
+    }
+    BOOST_CHECK_EQUAL(sorted_snapshot(root, tree_snapshot_method::sftp).size(),
+                      entries.size());
+}
+
+BOOST_AUTO_TEST_CASE(empty_tree)
+{
+    path root = new_directory_in_sandbox();
+
+    BOOST_CHECK(snapshot_tree(test_session(), filesystem(), root,
+                              tree_snapshot_method::find)
+                    .empty());
+    BOOST_CHECK(snapshot_tree(test_session(), filesystem(), root,
+                              tree_snapshot_method::sftp)
+                    .empty());
+}
+
+BOOST_AUTO_TEST_CASE(automatic_lists_whole_tree)
+{
+    path root = make_tree();
+
+    BOOST_CHECK_EQUAL(snapshot_tree(test_session(), filesystem(), root).size(),
+                      6U);
+}
+
+BOOST_AUTO_TEST_CASE(missing_root_by_find_fails)
+{
+    BOOST_CHECK_THROW(snapshot_tree(test_session(), filesystem(),
+                                    sandbox() / "missing",
+                                    tree_snapshot_method::find),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
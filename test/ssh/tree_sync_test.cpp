@@ -0,0 +1,329 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/detail/hash.hpp>
+#include <ssh/stream.hpp>
+#include <ssh/tree_sync.hpp> // test subject
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <ctime>    // time_t
+#include <iterator> // istreambuf_iterator
+#include <memory>   // auto_ptr
+#include <sstream>
+#include <string>
+
+using ssh::filesystem::ifstream;
+using ssh::filesystem::path;
+using ssh::sync_action;
+using ssh::sync_action_kind;
+using ssh::sync_options;
+using ssh::sync_report;
+using ssh::sync_tree;
+using ssh::tree_snapshot_method;
+
+using test::ssh::sftp_fixture;
+
+using std::string;
+
+namespace
+{
+
+class tree_sync_fixture : public sftp_fixture
+{
+public:
+    tree_sync_fixture()
+        : m_local_root(boost::filesystem::temp_directory_path() /
+                       boost::filesystem::unique_path()),
+          m_remote_root(sandbox() / "mirror")
+    {
+        boost::filesystem::create_directories(m_local_root / "a" / "b");
+        boost::filesystem::create_directories(m_local_root / "empty");
+        write_local("top.txt", "humpty dumpty");
+        write_local("a/b/deep.txt", "sat on a wall");
+        write_local("a/large.bin", string(100000, 'L'));
+    }
+
+    ~tree_sync_fixture()
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove_all(m_local_root, ignored);
+    }
+
+    sync_report sync(const sync_options& options = sync_options())
+    {
+        return sync_tree(test_session(), filesystem(), m_local_root,
+                         m_remote_root, options);
+    }
+
+    void write_local(const string& name, const string& data)
+    {
+        boost::filesystem::ofstream stream(m_local_root / name,
+                                           std::ios_base::binary);
+        stream << data;
+    }
+
+    /**
+     * Rewrite a local file with the same size but a different time, as a
+     * fresh checkout would.
+     */
+    void rewrite_local_with_new_time(const string& name, const string& data)
+    {
+        write_local(name, data);
+        boost::filesystem::last_write_time(
+            m_local_root / name,
+            boost::filesystem::last_write_time(m_local_root / name) + 60);
+    }
+
+    string read_remote(const string& name)
+    {
+        ifstream stream(filesystem(), m_remote_root / name);
+        return string(std::istreambuf_iterator<char>(stream),
+                      std::istreambuf_iterator<char>());
+    }
+
+    boost::filesystem::path local_root() const
+    {
+        return m_local_root;
+    }
+
+    path remote_root() const
+    {
+        return m_remote_root;
+    }
+
+private:
+    boost::filesystem::path m_local_root;
+    path m_remote_root;
+};
+
+std::vector<unsigned char> sha256_of(const string& data)
+{
+    std::auto_ptr<ssh::detail::hash_function> hash =
+        ssh::detail::make_hash_function(ssh::hash_algorithm::sha256);
+    hash->update(data.data(), data.size());
+    return hash->finish();
+}
+
+unsigned long count_of(const sync_report& report,
+                       BOOST_SCOPED_ENUM(sync_action_kind) kind)
+{
+    unsigned long count = 0;
+    for (std::vector<sync_action>::const_iterator it = report.actions.begin();
+         it != report.actions.end(); ++it)
+    {
+        if (it->kind == kind)
+            ++count;
+    }
+    return count;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(tree_sync_tests, tree_sync_fixture)
+
+BOOST_AUTO_TEST_CASE(first_sync_copies_everything)
+{
+    sync_report report = sync();
+
+    // The root and the three directories below it
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::create_directory),
+                      4U);
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::upload), 3U);
+    BOOST_CHECK_EQUAL(report.upload_bytes, 100026U);
+
+    BOOST_CHECK_EQUAL(read_remote("top.txt"), "humpty dumpty");
+    BOOST_CHECK_EQUAL(read_remote("a/b/deep.txt"), "sat on a wall");
+    BOOST_CHECK(read_remote("a/large.bin") == string(100000, 'L'));
+    BOOST_CHECK(is_directory(filesystem(), remote_root() / "empty"));
+}
+
+BOOST_AUTO_TEST_CASE(uploads_keep_local_time)
+{
+    sync();
+
+    std::time_t local_time =
+        boost::filesystem::last_write_time(local_root() / "top.txt");
+    BOOST_CHECK_EQUAL(last_write_time(filesystem(), remote_root() / "top.txt"),
+                      local_time);
+}
+
+BOOST_AUTO_TEST_CASE(second_sync_changes_nothing)
+{
+    sync();
+
+    sync_report report = sync();
+
+    BOOST_CHECK(report.actions.empty());
+    BOOST_CHECK_EQUAL(report.unchanged_files, 3U);
+}
+
+BOOST_AUTO_TEST_CASE(only_changed_file_is_uploaded)
+{
+    sync();
+
+    rewrite_local_with_new_time("a/b/deep.txt", "had a great fall");
+    write_local("a/new.txt", "new");
+
+    sync_report report = sync();
+
+    BOOST_CHECK_EQUAL(report.actions.size(), 2U);
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::upload), 2U);
+    BOOST_CHECK_EQUAL(report.unchanged_files, 2U);
+    BOOST_CHECK_EQUAL(read_remote("a/b/deep.txt"), "had a great fall");
+    BOOST_CHECK_EQUAL(read_remote("a/new.txt"), "new");
+}
+
+BOOST_AUTO_TEST_CASE(dry_run_changes_nothing)
+{
+    sync_options options;
+    options.dry_run = true;
+
+    sync_report report = sync(options);
+
+    BOOST_CHECK_EQUAL(report.actions.size(), 7U);
+    BOOST_CHECK(!exists(filesystem(), remote_root()));
+
+    std::ostringstream text;
+    write_sync_report(text, report);
+    BOOST_CHECK(text.str().find("upload top.txt (13 bytes)") !=
+                string::npos);
+    BOOST_CHECK(text.str().find("create directory a/b") != string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(extraneous_entries_kept_by_default)
+{
+    sync();
+    boost::filesystem::remove_all(local_root() / "a");
+
+    sync_report report = sync();
+
+    BOOST_CHECK(report.actions.empty());
+    BOOST_CHECK(exists(filesystem(), remote_root() / "a" / "b" / "deep.txt"));
+}
+
+BOOST_AUTO_TEST_CASE(extraneous_entries_removed)
+{
+    sync();
+    boost::filesystem::remove_all(local_root() / "a");
+    boost::filesystem::remove(local_root() / "top.txt");
+
+    sync_options options;
+    options.remove_extraneous = true;
+    sync_report report = sync(options);
+
+    // Only the top of a removed directory is listed
+    BOOST_CHECK_EQUAL(report.actions.size(), 2U);
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::remove), 2U);
+    BOOST_CHECK(!exists(filesystem(), remote_root() / "a"));
+    BOOST_CHECK(!exists(filesystem(), remote_root() / "top.txt"));
+    BOOST_CHECK(exists(filesystem(), remote_root() / "empty"));
+}
+
+BOOST_AUTO_TEST_CASE(file_replaces_directory)
+{
+    sync();
+    boost::filesystem::remove_all(local_root() / "a");
+    write_local("a", "now a file");
+
+    sync_report report = sync();
+
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::remove), 1U);
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::upload), 1U);
+    BOOST_CHECK_EQUAL(read_remote("a"), "now a file");
+}
+
+BOOST_AUTO_TEST_CASE(directory_replaces_file)
+{
+    sync();
+    boost::filesystem::remove(local_root() / "top.txt");
+    boost::filesystem::create_directory(local_root() / "top.txt");
+    write_local("top.txt/inner.txt", "inner");
+
+    sync();
+
+    BOOST_CHECK(is_directory(filesystem(), remote_root() / "top.txt"));
+    BOOST_CHECK_EQUAL(read_remote("top.txt/inner.txt"), "inner");
+}
+
+BOOST_AUTO_TEST_CASE(matching_contents_only_copy_time)
+{
+    sync();
+    rewrite_local_with_new_time("top.txt", "humpty dumpty");
+
+    sync_options options;
+    options.compare_contents = true;
+    sync_report report = sync(options);
+
+    BOOST_CHECK_EQUAL(report.actions.size(), 1U);
+    BOOST_CHECK_EQUAL(
+        count_of(report, sync_action_kind::set_last_write_time), 1U);
+    BOOST_CHECK(sync().actions.empty());
+}
+
+BOOST_AUTO_TEST_CASE(different_contents_of_same_size_uploaded)
+{
+    sync();
+    rewrite_local_with_new_time("top.txt", "HUMPTY DUMPTY");
+
+    sync_options options;
+    options.compare_contents = true;
+    sync_report report = sync(options);
+
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::upload), 1U);
+    BOOST_CHECK_EQUAL(read_remote("top.txt"), "HUMPTY DUMPTY");
+}
+
+BOOST_AUTO_TEST_CASE(verified_uploads_record_digests)
+{
+    sync_options options;
+    options.verify_uploads = true;
+
+    sync_report report = sync(options);
+
+    BOOST_CHECK_EQUAL(count_of(report, sync_action_kind::upload), 3U);
+    for (std::vector<sync_action>::const_iterator it = report.actions.begin();
+         it != report.actions.end(); ++it)
+    {
+        if (it->name == "top.txt")
+        {
+            BOOST_CHECK_EQUAL(it->digest, ssh::detail::hex_digest(
+                                              sha256_of("humpty dumpty")));
+        }
+        else if (it->kind == sync_action_kind::upload)
+        {
+            BOOST_CHECK(!it->digest.empty());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(single_thread_and_sftp_listing)
+{
+    sync_options options;
+    options.parallelism = 1;
+    options.listing_method = tree_snapshot_method::sftp;
+
+    sync(options);
+    sync_report report = sync(options);
+
+    BOOST_CHECK(report.actions.empty());
+    BOOST_CHECK_EQUAL(report.unchanged_files, 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
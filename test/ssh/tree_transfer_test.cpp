@@ -0,0 +1,329 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "sftp_fixture.hpp"
+
+#include <ssh/stream.hpp>
+#include <ssh/tree_transfer.hpp> // test subject
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp> // uint64_t
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/ref.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef>   // size_t
+#include <iterator>  // istreambuf_iterator
+#include <stdexcept> // runtime_error
+#include <string>
+
+using ssh::download_tree;
+using ssh::filesystem::ifstream;
+using ssh::filesystem::ofstream;
+using ssh::filesystem::path;
+using ssh::tree_transfer_method;
+using ssh::upload_tree;
+
+using test::ssh::sftp_fixture;
+
+using boost::uint64_t;
+
+using std::size_t;
+using std::string;
+
+namespace
+{
+
+// Larger than a transfer chunk
+const string LARGE_CONTENT(100000, 'L');
+
+class tree_transfer_fixture : public sftp_fixture
+{
+public:
+    tree_transfer_fixture()
+        : m_local_sandbox(boost::filesystem::temp_directory_path() /
+                          boost::filesystem::unique_path())
+    {
+        boost::filesystem::create_directories(m_local_sandbox);
+    }
+
+    ~tree_transfer_fixture()
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove_all(m_local_sandbox, ignored);
+    }
+
+    boost::filesystem::path local_sandbox() const
+    {
+        return m_local_sandbox;
+    }
+
+    /**
+     * Make a local tree with nested and empty directories, an empty file and
+     * a file bigger than a transfer chunk.
+     */
+    boost::filesystem::path make_local_tree()
+    {
+        boost::filesystem::path root = local_sandbox() / "tree";
+        boost::filesystem::create_directories(root / "a" / "b");
+        boost::filesystem::create_directories(root / "empty-directory");
+
+        write_local(root / "top.txt", "humpty dumpty");
+        write_local(root / "a" / "b" / "deep.txt", "sat on a wall");
+        write_local(root / "a" / "empty.txt", "");
+        write_local(root / "a" / "large.bin", LARGE_CONTENT);
+
+        return root;
+    }
+
+    /**
+     * Make the same tree as `make_local_tree` on the server.
+     */
+    path make_remote_tree()
+    {
+        path root = sandbox() / "tree";
+        create_directory(filesystem(), root);
+        create_directory(filesystem(), root / "a");
+        create_directory(filesystem(), root / "a" / "b");
+        create_directory(filesystem(), root / "empty-directory");
+
+        write_remote(root / "top.txt", "humpty dumpty");
+        write_remote(root / "a" / "b" / "deep.txt", "sat on a wall");
+        write_remote(root / "a" / "empty.txt", "");
+        write_remote(root / "a" / "large.bin", LARGE_CONTENT);
+
+        return root;
+    }
+
+    /**
+     * Make a remote directory holding one file with the given name, which
+     * the server accepts but which must not be trusted locally.
+     */
+    path make_remote_tree_with_name(const string& name)
+    {
+        path root = sandbox() / "hostile";
+        create_directory(filesystem(), root);
+        write_remote(root / name, "escaped");
+        return root;
+    }
+
+    void check_remote_tree(const path& root)
+    {
+        BOOST_CHECK_EQUAL(read_remote(root / "top.txt"), "humpty dumpty");
+        BOOST_CHECK_EQUAL(read_remote(root / "a" / "b" / "deep.txt"),
+                          "sat on a wall");
+        BOOST_CHECK_EQUAL(read_remote(root / "a" / "empty.txt"), "");
+        BOOST_CHECK(read_remote(root / "a" / "large.bin") == LARGE_CONTENT);
+        BOOST_CHECK(is_directory(filesystem(), root / "empty-directory"));
+    }
+
+    void check_local_tree(const boost::filesystem::path& root)
+    {
+        BOOST_CHECK_EQUAL(read_local(root / "top.txt"), "humpty dumpty");
+        BOOST_CHECK_EQUAL(read_local(root / "a" / "b" / "deep.txt"),
+                          "sat on a wall");
+        BOOST_CHECK_EQUAL(read_local(root / "a" / "empty.txt"), "");
+        BOOST_CHECK(read_local(root / "a" / "large.bin") == LARGE_CONTENT);
+        BOOST_CHECK(boost::filesystem::is_directory(root / "empty-directory"));
+    }
+
+private:
+    void write_local(const boost::filesystem::path& file, const string& data)
+    {
+        boost::filesystem::ofstream stream(file, std::ios_base::binary);
+        stream << data;
+    }
+
+    string read_local(const boost::filesystem::path& file)
+    {
+        boost::filesystem::ifstream stream(file, std::ios_base::binary);
+        return string(std::istreambuf_iterator<char>(stream),
+                      std::istreambuf_iterator<char>());
+    }
+
+    void write_remote(const path& file, const string& data)
+    {
+        ofstream stream(filesystem(), file);
+        stream << data;
+    }
+
+    string read_remote(const path& file)
+    {
+        ifstream stream(filesystem(), file);
+        return string(std::istreambuf_iterator<char>(stream),
+                      std::istreambuf_iterator<char>());
+    }
+
+    boost::filesystem::path m_local_sandbox;
+};
+
+const uint64_t TREE_CONTENT_BYTES =
+    string("humpty dumpty").size() + string("sat on a wall").size() +
+    LARGE_CONTENT.size();
+
+void record_progress(uint64_t& latest, uint64_t total)
+{
+    BOOST_CHECK_GE(total, latest);
+    latest = total;
+}
+}
+
+BOOST_FIXTURE_TEST_SUITE(tree_transfer_tests, tree_transfer_fixture)
+
+BOOST_AUTO_TEST_CASE(upload_by_tar)
+{
+    boost::filesystem::path local = make_local_tree();
+    path remote = sandbox() / "uploaded";
+
+    BOOST_CHECK(upload_tree(test_session(), filesystem(), local, remote,
+                            tree_transfer_method::tar) ==
+                tree_transfer_method::tar);
+
+    check_remote_tree(remote);
+}
+
+BOOST_AUTO_TEST_CASE(upload_by_sftp)
+{
+    boost::filesystem::path local = make_local_tree();
+    path remote = sandbox() / "uploaded";
+
+    BOOST_CHECK(upload_tree(test_session(), filesystem(), local, remote,
+                            tree_transfer_method::sftp) ==
+                tree_transfer_method::sftp);
+
+    check_remote_tree(remote);
+}
+
+BOOST_AUTO_TEST_CASE(upload_automatic)
+{
+    boost::filesystem::path local = make_local_tree();
+    path remote = sandbox() / "uploaded";
+
+    BOOST_CHECK(upload_tree(test_session(), filesystem(), local, remote) !=
+                tree_transfer_method::automatic);
+
+    check_remote_tree(remote);
+}
+
+BOOST_AUTO_TEST_CASE(upload_reports_progress)
+{
+    boost::filesystem::path local = make_local_tree();
+    path remote = sandbox() / "uploaded";
+
+    uint64_t latest = 0;
+    upload_tree(test_session(), filesystem(), local, remote,
+                tree_transfer_method::tar,
+                boost::bind(record_progress, boost::ref(latest), _1));
+
+    BOOST_CHECK_EQUAL(latest, TREE_CONTENT_BYTES);
+}
+
+BOOST_AUTO_TEST_CASE(download_by_tar)
+{
+    path remote = make_remote_tree();
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    BOOST_CHECK(download_tree(test_session(), filesystem(), remote, local,
+                              tree_transfer_method::tar) ==
+                tree_transfer_method::tar);
+
+    check_local_tree(local);
+}
+
+BOOST_AUTO_TEST_CASE(download_by_sftp)
+{
+    path remote = make_remote_tree();
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    BOOST_CHECK(download_tree(test_session(), filesystem(), remote, local,
+                              tree_transfer_method::sftp) ==
+                tree_transfer_method::sftp);
+
+    check_local_tree(local);
+}
+
+BOOST_AUTO_TEST_CASE(download_reports_progress)
+{
+    path remote = make_remote_tree();
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    uint64_t latest = 0;
+    download_tree(test_session(), filesystem(), remote, local,
+                  tree_transfer_method::tar,
+                  boost::bind(record_progress, boost::ref(latest), _1));
+
+    BOOST_CHECK_EQUAL(latest, TREE_CONTENT_BYTES);
+}
+
+BOOST_AUTO_TEST_CASE(download_missing_directory_by_tar_fails)
+{
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    BOOST_CHECK_THROW(download_tree(test_session(), filesystem(),
+                                    sandbox() / "missing", local,
+                                    tree_transfer_method::tar),
+                      std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(safe_local_path_keeps_names_below_destination)
+{
+    BOOST_CHECK_EQUAL(ssh::detail::safe_local_path("./a//b/./c.txt"),
+                      boost::filesystem::path("a") / "b" / "c.txt");
+    BOOST_CHECK(ssh::detail::safe_local_path("./").empty());
+}
+
+BOOST_AUTO_TEST_CASE(safe_local_path_refuses_escaping_names)
+{
+    const char* names[] = {"..",
+                           "../evil",
+                           "a/../../evil",
+                           "a\\..\\..\\evil",
+                           "C:\\evil",
+                           "C:evil",
+                           "\\evil",
+                           "file:stream"};
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+    {
+        BOOST_CHECK_THROW(ssh::detail::safe_local_path(names[i]),
+                          std::runtime_error);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(download_by_tar_refuses_escaping_name)
+{
+    path remote = make_remote_tree_with_name("a\\..\\..\\evil");
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    BOOST_CHECK_THROW(download_tree(test_session(), filesystem(), remote,
+                                    local, tree_transfer_method::tar),
+                      std::runtime_error);
+    BOOST_CHECK(!boost::filesystem::exists(local_sandbox() / "evil"));
+}
+
+BOOST_AUTO_TEST_CASE(download_by_sftp_refuses_escaping_name)
+{
+    path remote = make_remote_tree_with_name("C:evil");
+    boost::filesystem::path local = local_sandbox() / "downloaded";
+
+    BOOST_CHECK_THROW(download_tree(test_session(), filesystem(), remote,
+                                    local, tree_transfer_method::sftp),
+                      std::runtime_error);
+    BOOST_CHECK(boost::filesystem::is_empty(local));
+}
+
+BOOST_AUTO_TEST_SUITE_END();
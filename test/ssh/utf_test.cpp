@@ -0,0 +1,162 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/utf.hpp> // test subject
+
+#include <boost/locale/encoding_utf.hpp> // utf_to_utf
+#include <boost/test/unit_test.hpp>
+
+#include <cstddef> // size_t
+#include <string>
+
+using ssh::detail::utf8_to_wide;
+using ssh::detail::wide_to_utf8;
+
+using boost::locale::conv::conversion_error;
+using boost::locale::conv::skip;
+using boost::locale::conv::stop;
+using boost::locale::conv::utf_to_utf;
+
+using std::size_t;
+using std::string;
+using std::wstring;
+
+namespace
+{
+
+// Long enough that every test string has ASCII runs both longer and shorter
+// than the 16-character blocks, and non-ASCII at many offsets into a block
+const string ASCII_RUN = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+const char* VALID_CHARACTERS[] = {
+    "\xc3\xa9",         // U+00E9, two bytes
+    "\xe4\xbd\xa0",     // U+4F60, three bytes
+    "\xf0\x9f\x98\x80", // U+1F600, four bytes, a surrogate pair in UTF-16
+    "\x7f"};
+
+const char* INVALID_SEQUENCES[] = {
+    "\x80",             // Trail byte on its own
+    "\xc0\xaf",         // Overlong
+    "\xed\xa0\x80",     // Surrogate
+    "\xf4\x90\x80\x80", // Beyond U+10FFFF
+    "\xff",             // Never valid
+    "\xe4\xbd",         // Truncated
+    "\xe4\x41"};        // Truncated by another character
+
+template <typename T, size_t N>
+size_t count_of(const T (&)[N])
+{
+    return N;
+}
+
+/**
+ * The strings made by putting `inserted` after every length of ASCII prefix.
+ */
+template <typename Check>
+void at_every_offset(const string& inserted, Check check)
+{
+    for (size_t prefix = 0; prefix <= ASCII_RUN.size(); ++prefix)
+    {
+        string text = ASCII_RUN.substr(0, prefix) + inserted +
+                      ASCII_RUN.substr(prefix) + ASCII_RUN;
+        check(text);
+    }
+}
+
+void matches_boost(const string& utf8)
+{
+    wstring expected = utf_to_utf<wchar_t>(utf8, stop);
+    BOOST_CHECK(utf8_to_wide(utf8, stop) == expected);
+    BOOST_CHECK(wide_to_utf8(expected, stop) == utf8);
+}
+
+void matches_boost_when_skipping(const string& utf8)
+{
+    BOOST_CHECK(utf8_to_wide(utf8, skip) == utf_to_utf<wchar_t>(utf8, skip));
+    BOOST_CHECK_THROW(utf8_to_wide(utf8, stop), conversion_error);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(utf_tests)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    BOOST_CHECK(utf8_to_wide(string()).empty());
+    BOOST_CHECK(wide_to_utf8(wstring()).empty());
+}
+
+BOOST_AUTO_TEST_CASE(ascii)
+{
+    for (size_t length = 0; length <= ASCII_RUN.size(); ++length)
+    {
+        matches_boost(ASCII_RUN.substr(0, length));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ascii_includes_nul)
+{
+    string with_nul = ASCII_RUN + string(1, '\0') + ASCII_RUN;
+
+    BOOST_CHECK_EQUAL(utf8_to_wide(with_nul).size(), with_nul.size());
+    matches_boost(with_nul);
+}
+
+BOOST_AUTO_TEST_CASE(non_ascii)
+{
+    for (size_t i = 0; i < count_of(VALID_CHARACTERS); ++i)
+    {
+        at_every_offset(VALID_CHARACTERS[i], &matches_boost);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(all_non_ascii)
+{
+    string text;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        text += VALID_CHARACTERS[i % count_of(VALID_CHARACTERS)];
+    }
+
+    matches_boost(text);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_utf8)
+{
+    for (size_t i = 0; i < count_of(INVALID_SEQUENCES); ++i)
+    {
+        at_every_offset(INVALID_SEQUENCES[i], &matches_boost_when_skipping);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(truncated_at_end)
+{
+    string truncated = ASCII_RUN + "\xf0\x9f\x98";
+
+    BOOST_CHECK_THROW(utf8_to_wide(truncated, stop), conversion_error);
+    BOOST_CHECK(utf8_to_wide(truncated, skip) == utf8_to_wide(ASCII_RUN));
+}
+
+BOOST_AUTO_TEST_CASE(invalid_wide)
+{
+    // A lone surrogate is invalid as UTF-16 and as UTF-32
+    wstring wide = utf8_to_wide(ASCII_RUN);
+    wide.insert(wide.begin() + 20, static_cast<wchar_t>(0xD800));
+
+    BOOST_CHECK_THROW(wide_to_utf8(wide, stop), conversion_error);
+    BOOST_CHECK(wide_to_utf8(wide, skip) == utf_to_utf<char>(wide, skip));
+    BOOST_CHECK(wide_to_utf8(wide, skip) == ASCII_RUN);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,196 @@
+// Copyright 2016 Alexander Lamaison
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <ssh/detail/watch_events.hpp> // test subject
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+using ssh::detail::change_coalescer;
+using ssh::detail::parse_inotify_event;
+using ssh::filesystem::path;
+using ssh::remote_change;
+using ssh::remote_change_kind;
+
+using std::string;
+using std::vector;
+
+namespace
+{
+
+/**
+ * Kind of change parsed from a line, checking the name is as expected.
+ */
+BOOST_SCOPED_ENUM(remote_change_kind)
+parsed_kind(const string& line, const string& expected_name)
+{
+    BOOST_SCOPED_ENUM(remote_change_kind) kind;
+    string name;
+    BOOST_REQUIRE(parse_inotify_event(line, kind, name));
+    BOOST_CHECK_EQUAL(name, expected_name);
+    return kind;
+}
+
+bool is_ignored(const string& line)
+{
+    BOOST_SCOPED_ENUM(remote_change_kind) kind;
+    string name;
+    return !parse_inotify_event(line, kind, name);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(watch_events_tests)
+
+BOOST_AUTO_TEST_CASE(entry_events)
+{
+    BOOST_CHECK(parsed_kind("CREATE new.txt", "new.txt") ==
+                remote_change_kind::created);
+    BOOST_CHECK(parsed_kind("CREATE,ISDIR subdir", "subdir") ==
+                remote_change_kind::created);
+    BOOST_CHECK(parsed_kind("MOVED_TO renamed", "renamed") ==
+                remote_change_kind::created);
+    BOOST_CHECK(parsed_kind("DELETE old.txt", "old.txt") ==
+                remote_change_kind::removed);
+    BOOST_CHECK(parsed_kind("MOVED_FROM original", "original") ==
+                remote_change_kind::removed);
+    BOOST_CHECK(parsed_kind("MODIFY data.bin", "data.bin") ==
+                remote_change_kind::modified);
+    BOOST_CHECK(parsed_kind("ATTRIB,ISDIR subdir", "subdir") ==
+                remote_change_kind::modified);
+}
+
+BOOST_AUTO_TEST_CASE(name_with_spaces)
+{
+    BOOST_CHECK(parsed_kind("CREATE name with  spaces ",
+                            "name with  spaces ") ==
+                remote_change_kind::created);
+}
+
+BOOST_AUTO_TEST_CASE(directory_events)
+{
+    BOOST_CHECK(parsed_kind("DELETE_SELF ", "") ==
+                remote_change_kind::removed);
+    BOOST_CHECK(parsed_kind("MOVE_SELF ", "") == remote_change_kind::removed);
+    BOOST_CHECK(parsed_kind("Q_OVERFLOW ", "") == remote_change_kind::rescan);
+}
+
+BOOST_AUTO_TEST_CASE(ignored_events)
+{
+    BOOST_CHECK(is_ignored("IGNORED "));
+    BOOST_CHECK(is_ignored("ATTRIB,ISDIR "));
+    BOOST_CHECK(is_ignored("OPEN file"));
+    BOOST_CHECK(is_ignored("no-space"));
+    BOOST_CHECK(is_ignored(""));
+}
+
+BOOST_AUTO_TEST_CASE(event_names_must_match_whole)
+{
+    // DELETE_SELF must not be read as DELETE of the directory's entry
+    BOOST_CHECK(is_ignored("DELETED name"));
+    BOOST_CHECK(parsed_kind("DELETE_SELF ", "") ==
+                remote_change_kind::removed);
+}
+
+BOOST_AUTO_TEST_CASE(repeated_changes_merge)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::modified, "a");
+    pending.add(remote_change_kind::modified, "b");
+    pending.add(remote_change_kind::modified, "a");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 2U);
+    BOOST_CHECK_EQUAL(changes[0].path, path("dir/a"));
+    BOOST_CHECK_EQUAL(changes[1].path, path("dir/b"));
+    BOOST_CHECK(pending.empty());
+    BOOST_CHECK(pending.take(path("dir")).empty());
+}
+
+BOOST_AUTO_TEST_CASE(created_then_modified_is_created)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::created, "a");
+    pending.add(remote_change_kind::modified, "a");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+    BOOST_CHECK(changes[0].kind == remote_change_kind::created);
+}
+
+BOOST_AUTO_TEST_CASE(created_then_removed_cancel)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::created, "a");
+    pending.add(remote_change_kind::removed, "a");
+
+    BOOST_CHECK(pending.empty());
+    BOOST_CHECK(pending.take(path("dir")).empty());
+}
+
+BOOST_AUTO_TEST_CASE(cancelled_entry_can_change_again)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::created, "a");
+    pending.add(remote_change_kind::removed, "a");
+    pending.add(remote_change_kind::created, "a");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+    BOOST_CHECK(changes[0].kind == remote_change_kind::created);
+}
+
+BOOST_AUTO_TEST_CASE(removed_then_created_is_modified)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::removed, "a");
+    pending.add(remote_change_kind::created, "a");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+    BOOST_CHECK(changes[0].kind == remote_change_kind::modified);
+}
+
+BOOST_AUTO_TEST_CASE(modified_then_removed_is_removed)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::modified, "a");
+    pending.add(remote_change_kind::removed, "a");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 1U);
+    BOOST_CHECK(changes[0].kind == remote_change_kind::removed);
+}
+
+BOOST_AUTO_TEST_CASE(directory_changes_use_directory_path)
+{
+    change_coalescer pending;
+    pending.add(remote_change_kind::modified, "a");
+    pending.add(remote_change_kind::rescan, "");
+
+    vector<remote_change> changes = pending.take(path("dir"));
+
+    BOOST_REQUIRE_EQUAL(changes.size(), 2U);
+    BOOST_CHECK(changes[1].kind == remote_change_kind::rescan);
+    BOOST_CHECK_EQUAL(changes[1].path, path("dir"));
+}
+
+BOOST_AUTO_TEST_SUITE_END();